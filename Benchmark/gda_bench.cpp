@@ -0,0 +1,918 @@
+/**
+ * GeoDa TM, Copyright (C) 2011-2015 by Luc Anselin - all rights reserved
+ *
+ * This file is part of GeoDa.
+ * 
+ * GeoDa is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+ *
+ * GeoDa is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program.  If not, see <http://www.gnu.org/licenses/>.
+ */
+
+/**
+ gda_bench runs the spatial statistics kernels of GeoDa without the GUI and
+ reports, for every kernel and layer, the best wall clock time of a few
+ repeats, the peak resident set size and a checksum of the results.  The
+ layers are the polygon layers under SampleData plus synthetic square grids
+ with jittered vertices, so that every kernel can be run at several sizes.
+
+ Output is one CSV line per kernel and layer:
+
+   kernel,layer,num_obs,threads,seconds,peak_rss_kb,checksum
+
+ A previous output file can be given with --baseline.  Checksums must then
+ match the baseline for the same kernel and layer whatever the number of
+ threads, and times may not exceed the baseline time for the same number of
+ threads by more than --tolerance.  Any difference is reported on stderr and
+ makes gda_bench exit with status 1.
+
+ The size of the thread pool is fixed for the life of the process, so
+ several thread counts take several runs; see "make run" in the GNUmakefile.
+ */
+
+#include <algorithm>
+#include <fstream>
+#include <map>
+#include <sstream>
+#include <string>
+#include <vector>
+#include <math.h>
+#include <stdint.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <sys/resource.h>
+#include <boost/multi_array.hpp>
+#include <boost/uuid/uuid.hpp>
+#include <wx/app.h>
+#include <wx/filefn.h>
+#include <wx/filename.h>
+#include <wx/init.h>
+#include <wx/stopwatch.h>
+#include <wx/string.h>
+#include "../GdaThreadPool.h"
+#include "../GenUtils.h"
+#include "../ShpFile.h"
+#include "../SpatialIndAlgs.h"
+#include "../VarTools.h"
+#include "../Explore/CatClassification.h"
+#include "../Explore/CorrelogramAlgs.h"
+#include "../Explore/GStatCoordinator.h"
+#include "../Explore/LisaCoordinator.h"
+#include "../Regression/DiagnosticReport.h"
+#include "../Regression/LogJacobian.h"
+#include "../Regression/ML_im.h"
+#include "../DataViewer/OGRTable.h"
+#include "../ShapeOperations/CsvImporter.h"
+#include "../ShapeOperations/DBF.h"
+#include "../ShapeOperations/GalWeight.h"
+#include "../ShapeOperations/GwtWeight.h"
+#include "../ShapeOperations/PolysToContigWeights.h"
+#include "../ShapeOperations/ShpMappedMain.h"
+#include "../ShapeOperations/WeightsManager.h"
+#include "../ShapeOperations/WeightsManState.h"
+#include "../VarCalc/WeightsMetaInfo.h"
+
+class wxGauge;
+
+bool classicalRegression(GalElement *g,
+						 int num_obs,
+						 double * Y,
+						 int dim,
+						 double ** X,
+						 int expl,
+						 DiagnosticReport *dr,
+						 bool InclConstant,
+						 bool m_moranz,
+						 wxGauge* gauge,
+						 bool do_white_test,
+						 double w_trace = -1);
+
+bool spatialLagRegression(GalElement *g,
+						  int num_obs,
+						  double * Y,
+						  int dim,
+						  double ** X,
+						  int deps,
+						  DiagnosticReport *dr,
+						  bool InclConstant,
+						  wxGauge* p_bar = 0,
+						  LogJacobian::Method lj_method = LogJacobian::char_poly,
+						  bool lj_grid = false,
+						  const GdaCancelToken* token = 0,
+						  MLError* error = 0);
+
+bool spatialErrorRegression(GalElement *g,
+							int num_obs,
+							double * Y,
+							int dim,
+							double ** XX,
+							int deps,
+							DiagnosticReport *rr,
+							bool InclConstant,
+							wxGauge* p_bar = 0,
+							LogJacobian::Method lj_method = LogJacobian::char_poly,
+							bool lj_grid = false,
+							const GdaCancelToken* token = 0,
+							MLError* error = 0);
+
+namespace {
+
+struct BenchOptions {
+	BenchOptions() : data_dir("../SampleData"), use_samples(true),
+	repeat(3), threads(0), seed(123456789), tolerance(0.25),
+	lj_method(LogJacobian::char_poly), header(true) {
+		sizes.push_back(30); sizes.push_back(60); sizes.push_back(120);
+	}
+	wxString data_dir;
+	bool use_samples;
+	std::vector<int> sizes; // side lengths of the synthetic grids
+	std::vector<std::string> kernels; // empty for all kernels
+	int repeat;
+	int threads;
+	uint64_t seed;
+	std::string baseline;
+	double tolerance;
+	LogJacobian::Method lj_method;
+	bool header;
+};
+
+/** A polygon layer with box centers, a dependent variable and a few
+ explanatory variables, and queen contiguity weights registered with a
+ WeightsNewManager of its own. */
+struct BenchLayer {
+	BenchLayer() : num_obs(0), thresh(0), w_man_state(0), w_man_int(0),
+	gal(0) {}
+	~BenchLayer() {
+		if (w_man_int) delete w_man_int; // owns the GalWeight
+		if (w_man_state) delete w_man_state;
+		if (!csv_path.IsEmpty()) wxRemoveFile(csv_path);
+	}
+	std::string name;
+	int num_obs;
+	Shapefile::Main main;
+	Shapefile::MappedMain shp; // open for sample layers only
+	std::vector<double> x;
+	std::vector<double> y;
+	std::vector<double> dep;
+	std::vector<std::vector<double> > indep;
+	rtree_pt_2d_t rtree;
+	double thresh; // smallest distance band without isolates
+	WeightsManState* w_man_state;
+	WeightsNewManager* w_man_int;
+	boost::uuids::uuid w_id;
+	GalElement* gal;
+	wxString csv_path; // written by the csv_import kernel on first use
+private:
+	BenchLayer(const BenchLayer&);
+	BenchLayer& operator=(const BenchLayer&);
+};
+
+typedef std::string (*KernelFunc)(BenchLayer& l, const BenchOptions& opt);
+
+struct Kernel {
+	const char* name;
+	KernelFunc func;
+};
+
+uint64_t Fnv1a(uint64_t h, uint64_t v)
+{
+	for (int b=0; b<8; b++) {
+		h ^= (v >> (8*b)) & 0xff;
+		h *= 1099511628211ULL;
+	}
+	return h;
+}
+
+const uint64_t fnv_offset = 14695981039346656037ULL;
+
+std::string Hex(uint64_t h)
+{
+	char buf[32];
+	sprintf(buf, "%016llx", (unsigned long long) h);
+	return buf;
+}
+
+/** Ten significant digits, so that checksums survive the last-bit
+ differences between compilers and optimization levels. */
+std::string Num(double v)
+{
+	char buf[64];
+	sprintf(buf, "%.10g", v);
+	return buf;
+}
+
+std::string Sum(const double* v, int n)
+{
+	double s = 0;
+	for (int i=0; i<n; i++) s += v[i];
+	return Num(s);
+}
+
+std::string GalChecksum(const GalElement* gal, int num_obs)
+{
+	uint64_t h = fnv_offset;
+	long nnz = 0;
+	for (int i=0; i<num_obs; i++) {
+		std::vector<long> nbrs(gal[i].GetNbrs());
+		std::sort(nbrs.begin(), nbrs.end());
+		h = Fnv1a(h, nbrs.size());
+		for (size_t j=0; j<nbrs.size(); j++) h = Fnv1a(h, nbrs[j]);
+		nnz += nbrs.size();
+	}
+	std::ostringstream ss;
+	ss << nnz << "/" << Hex(h);
+	return ss.str();
+}
+
+/** Neighbors are hashed in their stored order, which is also the order
+ they are written to a .gwt file. */
+std::string GwtChecksum(const GwtWeight* w, int num_obs)
+{
+	uint64_t h = fnv_offset;
+	long nnz = 0;
+	double w_sum = 0;
+	for (int i=0; i<num_obs; i++) {
+		const GwtElement& e = w->gwt[i];
+		h = Fnv1a(h, e.Size());
+		for (long j=0; j<e.Size(); j++) {
+			h = Fnv1a(h, e.elt(j).nbx);
+			w_sum += e.elt(j).weight;
+		}
+		nnz += e.Size();
+	}
+	std::ostringstream ss;
+	ss << nnz << "/" << Hex(h) << "/" << Num(w_sum);
+	return ss.str();
+}
+
+void ResetPeakRss()
+{
+#ifdef __linux__
+	// since Linux 4.0 writing 5 resets VmHWM to the current RSS; on older
+	// kernels the peak is that of the whole process so far
+	std::ofstream f("/proc/self/clear_refs");
+	if (f) f << "5";
+#endif
+}
+
+long PeakRssKb()
+{
+#ifdef __linux__
+	std::ifstream f("/proc/self/status");
+	std::string line;
+	while (std::getline(f, line)) {
+		if (line.compare(0, 6, "VmHWM:") == 0) return atol(line.c_str()+6);
+	}
+#endif
+	struct rusage ru;
+	if (getrusage(RUSAGE_SELF, &ru) != 0) return 0;
+#ifdef __APPLE__
+	return ru.ru_maxrss / 1024; // bytes on Mac OS X
+#else
+	return ru.ru_maxrss;
+#endif
+}
+
+/** Fills x, y with box centers, the rtree and the threshold distance, and
+ registers queen contiguity weights. */
+bool InitLayer(BenchLayer& l)
+{
+	l.num_obs = l.main.records.size();
+	l.x.resize(l.num_obs);
+	l.y.resize(l.num_obs);
+	std::vector<pt_2d> pts(l.num_obs);
+	for (int i=0; i<l.num_obs; i++) {
+		Shapefile::PolygonContents* p =
+			dynamic_cast<Shapefile::PolygonContents*>(l.main.records[i].contents_p);
+		if (!p) return false;
+		l.x[i] = (p->box[0] + p->box[2])/2.0;
+		l.y[i] = (p->box[1] + p->box[3])/2.0;
+		pts[i] = pt_2d(l.x[i], l.y[i]);
+	}
+	SpatialIndAlgs::fill_pt_rtree(l.rtree, pts);
+	l.thresh = SpatialIndAlgs::find_max_1nn_dist(l.x, l.y, false, false);
+
+	l.gal = PolysToContigWeights(l.main, true);
+	if (!l.gal) return false;
+	GalWeight* gw = new GalWeight();
+	gw->num_obs = l.num_obs;
+	gw->gal = l.gal;
+	l.w_man_state = new WeightsManState;
+	l.w_man_int = new WeightsNewManager(l.w_man_state, 0);
+	WeightsMetaInfo wmi;
+	wmi.SetToQueen("");
+	l.w_id = l.w_man_int->RequestWeights(wmi);
+	if (!l.w_man_int->AssociateGal(l.w_id, gw)) {
+		delete gw;
+		l.gal = 0;
+		return false;
+	}
+	return true;
+}
+
+bool ReadDbfColumn(const wxString& fname, const wxString& field,
+				   int num_obs, std::vector<double>& v)
+{
+	// iDBF reads a column in one sequential pass, so every column gets a
+	// fresh reader
+	iDBF dbf(fname);
+	if (!dbf.IsConnectedToFile() || dbf.GetNumOfRecord() != num_obs) {
+		return false;
+	}
+	v.resize(num_obs);
+	return dbf.GetDblDataArray(field, &v[0]);
+}
+
+bool LoadSampleLayer(const wxString& data_dir, const wxString& rel_path,
+					 const wxString& dep, const std::vector<wxString>& indep,
+					 BenchLayer& l)
+{
+	wxFileName fn(data_dir + wxFileName::GetPathSeparator() + rel_path);
+	wxString shp = fn.GetFullPath();
+	fn.SetExt("shx");
+	wxString shx = fn.GetFullPath();
+	fn.SetExt("dbf");
+	wxString dbf = fn.GetFullPath();
+
+	if (!l.shp.Open(shp, shx) || !l.shp.ToMain(l.main)) return false;
+	if (l.main.header.shape_type != Shapefile::POLYGON) return false;
+	int n = l.main.records.size();
+	if (!ReadDbfColumn(dbf, dep, n, l.dep)) return false;
+	l.indep.resize(indep.size());
+	for (size_t i=0; i<indep.size(); i++) {
+		if (!ReadDbfColumn(dbf, indep[i], n, l.indep[i])) return false;
+	}
+	l.name = std::string(fn.GetName().mb_str());
+	return InitLayer(l);
+}
+
+/** Vertex (i, j) of the grid, moved by up to 0.3 in each direction.
+ Neighboring cells compute their shared vertices with the same function,
+ so contiguity is exact. */
+Shapefile::Point GridVertex(int i, int j, int side, uint64_t seed)
+{
+	uint64_t key = seed + 2*((uint64_t) j*(side+1) + i);
+	double dx = 0, dy = 0;
+	if (i > 0 && i < side && j > 0 && j < side) {
+		dx = 0.6*(Gda::SplitMix64Double(key) - 0.5);
+		dy = 0.6*(Gda::SplitMix64Double(key+1) - 0.5);
+	}
+	return Shapefile::Point(i + dx, j + dy);
+}
+
+/** side x side grid of quadrilaterals.  The dependent variable is a linear
+ function of two uniform variables plus a smooth spatial trend and noise,
+ so the lag and error models and the local statistics have structure to
+ find. */
+bool MakeGridLayer(int side, uint64_t seed, BenchLayer& l)
+{
+	using namespace Shapefile;
+	int n = side*side;
+	l.main.header.shape_type = POLYGON;
+	l.main.header.bbox_x_min = -1;
+	l.main.header.bbox_y_min = -1;
+	l.main.header.bbox_x_max = side+1;
+	l.main.header.bbox_y_max = side+1;
+	l.main.records.resize(n);
+	for (int r=0; r<side; r++) {
+		for (int c=0; c<side; c++) {
+			PolygonContents* p = new PolygonContents;
+			p->num_parts = 1;
+			p->num_points = 5;
+			p->parts.resize(1, 0);
+			// outer rings are clockwise in shapefiles
+			p->points.push_back(GridVertex(c, r, side, seed));
+			p->points.push_back(GridVertex(c, r+1, side, seed));
+			p->points.push_back(GridVertex(c+1, r+1, side, seed));
+			p->points.push_back(GridVertex(c+1, r, side, seed));
+			p->points.push_back(p->points[0]);
+			p->box[0] = p->box[2] = p->points[0].x;
+			p->box[1] = p->box[3] = p->points[0].y;
+			for (int k=1; k<4; k++) {
+				p->box[0] = std::min(p->box[0], p->points[k].x);
+				p->box[1] = std::min(p->box[1], p->points[k].y);
+				p->box[2] = std::max(p->box[2], p->points[k].x);
+				p->box[3] = std::max(p->box[3], p->points[k].y);
+			}
+			int i = r*side + c;
+			l.main.records[i].header.record_number = i+1;
+			l.main.records[i].contents_p = p;
+		}
+	}
+	l.dep.resize(n);
+	l.indep.resize(2, std::vector<double>(n));
+	uint64_t s = seed + 2*(uint64_t) (side+1)*(side+1);
+	for (int r=0; r<side; r++) {
+		for (int c=0; c<side; c++) {
+			int i = r*side + c;
+			double x1 = Gda::SplitMix64Double(s + 3*i);
+			double x2 = Gda::SplitMix64Double(s + 3*i + 1);
+			double e = Gda::SplitMix64Double(s + 3*i + 2) - 0.5;
+			double trend = sin(0.3*c) + cos(0.2*r);
+			l.indep[0][i] = x1;
+			l.indep[1][i] = x2;
+			l.dep[i] = 1 + 2*x1 - x2 + trend + 0.5*e;
+		}
+	}
+	std::ostringstream ss;
+	ss << "grid" << side;
+	l.name = ss.str();
+	return InitLayer(l);
+}
+
+/** Sample layers read the polygons in place from the mapped .shp. */
+std::string RunContiguity(BenchLayer& l, const BenchOptions& opt)
+{
+	GalElement* gal = (l.shp.IsOpen() ? PolysToContigWeights(l.shp, true) :
+					   PolysToContigWeights(l.main, true));
+	if (!gal) return "failed";
+	std::string cs = GalChecksum(gal, l.num_obs);
+	delete [] gal;
+	return cs;
+}
+
+std::string RunKnn(BenchLayer& l, const BenchOptions& opt)
+{
+	GwtWeight* w = SpatialIndAlgs::knn_build(l.x, l.y, 6, false, false);
+	if (!w) return "failed";
+	std::string cs = GwtChecksum(w, l.num_obs);
+	delete w;
+	return cs;
+}
+
+std::string RunThresh(BenchLayer& l, const BenchOptions& opt)
+{
+	GwtWeight* w = SpatialIndAlgs::thresh_build(l.x, l.y, 1.5*l.thresh,
+												false, false);
+	if (!w) return "failed";
+	std::string cs = GwtChecksum(w, l.num_obs);
+	delete w;
+	return cs;
+}
+
+std::string RunNaturalBreaks(BenchLayer& l, const BenchOptions& opt)
+{
+	Gda::dbl_int_pair_vec_type var(l.num_obs);
+	for (int i=0; i<l.num_obs; i++) {
+		var[i].first = l.dep[i];
+		var[i].second = i;
+	}
+	std::sort(var.begin(), var.end(), Gda::dbl_int_pair_cmp_less);
+	std::vector<bool> undef(l.num_obs, false);
+	std::vector<double> breaks;
+	// time the computation, not the memoized result of the last repetition
+	CatClassification::ClearNaturalBreaksCache();
+	CatClassification::FindNaturalBreaks(5, var, undef, breaks);
+	if (breaks.empty()) return "failed";
+	return Sum(&breaks[0], breaks.size());
+}
+
+std::string CorreloSum(const std::vector<CorrelogramAlgs::CorreloBin>& bins)
+{
+	uint64_t h = fnv_offset;
+	double corr = 0;
+	for (size_t i=0; i<bins.size(); i++) {
+		h = Fnv1a(h, bins[i].num_pairs);
+		if (bins[i].corr_avg_valid) corr += bins[i].corr_avg;
+	}
+	return Hex(h) + "/" + Num(corr);
+}
+
+std::string RunCorrelogram(BenchLayer& l, const BenchOptions& opt)
+{
+	std::vector<bool> undef(l.num_obs, false);
+	std::vector<CorrelogramAlgs::CorreloBin> bins;
+	if (!CorrelogramAlgs::MakeCorrThresh(l.rtree, l.dep, undef, 3*l.thresh,
+										 10, bins)) {
+		return "failed";
+	}
+	return CorreloSum(bins);
+}
+
+std::string RunCorrelogramAllPairs(BenchLayer& l, const BenchOptions& opt)
+{
+	std::vector<wxRealPoint> pts(l.num_obs);
+	for (int i=0; i<l.num_obs; i++) pts[i] = wxRealPoint(l.x[i], l.y[i]);
+	std::vector<bool> undef(l.num_obs, false);
+	std::vector<CorrelogramAlgs::CorreloBin> bins;
+	if (!CorrelogramAlgs::MakeCorrAllPairs(pts, l.dep, undef, false, 10,
+										   bins)) {
+		return "failed";
+	}
+	return CorreloSum(bins);
+}
+
+std::string RunCorrelogramSample(BenchLayer& l, const BenchOptions& opt)
+{
+	std::vector<wxRealPoint> pts(l.num_obs);
+	for (int i=0; i<l.num_obs; i++) pts[i] = wxRealPoint(l.x[i], l.y[i]);
+	std::vector<bool> undef(l.num_obs, false);
+	std::vector<CorrelogramAlgs::CorreloBin> bins;
+	if (!CorrelogramAlgs::MakeCorrRandSamp(pts, l.dep, undef, false, -1, 10,
+										   1000000, bins, opt.seed)) {
+		return "failed";
+	}
+	return CorreloSum(bins);
+}
+
+void FillData(const std::vector<double>& v, std::vector<d_array_type>& data,
+			  std::vector<b_array_type>& undef)
+{
+	int n = v.size();
+	data.resize(1);
+	undef.resize(1);
+	data[0].resize(boost::extents[1][n]);
+	undef[0].resize(boost::extents[1][n]);
+	for (int i=0; i<n; i++) {
+		data[0][0][i] = v[i];
+		undef[0][0][i] = false;
+	}
+}
+
+std::string RunLisa(BenchLayer& l, const BenchOptions& opt)
+{
+	std::vector<GdaVarTools::VarInfo> var_info(1);
+	var_info[0].name = "dep";
+	std::vector<d_array_type> data;
+	std::vector<b_array_type> undef;
+	FillData(l.dep, data, undef);
+	LisaCoordinator lc(l.w_id, l.w_man_int, l.w_man_state, var_info, data,
+					   undef, LisaCoordinator::univariate, opt.seed);
+	uint64_t h = fnv_offset;
+	for (int i=0; i<l.num_obs; i++) h = Fnv1a(h, lc.cluster_vecs[0][i]);
+	return (Sum(lc.local_moran_vecs[0], l.num_obs) + "/" +
+			Sum(lc.sig_local_moran_vecs[0], l.num_obs) + "/" + Hex(h));
+}
+
+std::string RunGStat(BenchLayer& l, const BenchOptions& opt)
+{
+	std::vector<GdaVarTools::VarInfo> var_info(1);
+	var_info[0].name = "dep";
+	std::vector<d_array_type> data;
+	std::vector<b_array_type> undef;
+	FillData(l.dep, data, undef);
+	GStatCoordinator gc(l.w_id, l.w_man_int, l.w_man_state, var_info, data,
+						undef, true, opt.seed);
+	double g = 0;
+	for (int i=0; i<l.num_obs; i++) {
+		if (gc.G_defined_vecs[0][i]) g += gc.G_vecs[0][i];
+	}
+	return (Num(g) + "/" + Sum(gc.G_star_vecs[0], l.num_obs) + "/" +
+			Sum(gc.pseudo_p_vecs[0], l.num_obs) + "/" +
+			Sum(gc.pseudo_p_star_vecs[0], l.num_obs));
+}
+
+/** model is 1 for OLS, 2 for the spatial lag and 3 for the spatial error
+ model, as in RegressionDlg.  Y and X are copied for every run as the
+ regressions may work on them in place. */
+std::string RunRegression(BenchLayer& l, const BenchOptions& opt, int model)
+{
+	int n = l.num_obs;
+	int nX = l.indep.size() + 1;
+	std::vector<double> y(l.dep);
+	std::vector<std::vector<double> > cols(nX, std::vector<double>(n, 1.0));
+	for (int i=1; i<nX; i++) cols[i] = l.indep[i-1];
+	std::vector<double*> x(nX);
+	for (int i=0; i<nX; i++) x[i] = &cols[i][0];
+
+	int nvar = model == 1 ? nX : nX+1;
+	DiagnosticReport dr(n, nvar, true, true, model);
+	bool ok = false;
+	if (model == 1) {
+		ok = classicalRegression(l.gal, n, &y[0], n, &x[0], nX, &dr, true,
+								 true, 0, false);
+	} else if (model == 2) {
+		ok = spatialLagRegression(l.gal, n, &y[0], n, &x[0], nX, &dr, true,
+								  0, opt.lj_method);
+	} else {
+		ok = spatialErrorRegression(l.gal, n, &y[0], n, &x[0], nX, &dr,
+									true, 0, opt.lj_method);
+	}
+	std::string cs = "failed";
+	if (ok) {
+		double c = 0;
+		for (int i=0; i<nvar; i++) c += (i+1)*dr.GetCoefficient(i);
+		cs = Num(c) + "/" + Num(dr.GetLIK());
+	}
+	dr.release_Var();
+	return cs;
+}
+
+std::string RunOls(BenchLayer& l, const BenchOptions& opt)
+{
+	return RunRegression(l, opt, 1);
+}
+
+std::string RunLag(BenchLayer& l, const BenchOptions& opt)
+{
+	return RunRegression(l, opt, 2);
+}
+
+std::string RunError(BenchLayer& l, const BenchOptions& opt)
+{
+	return RunRegression(l, opt, 3);
+}
+
+/** The layer is written to a temporary CSV file once, so only the first
+ repetition also pays for writing it. */
+std::string RunCsvImport(BenchLayer& l, const BenchOptions& opt)
+{
+	if (l.csv_path.IsEmpty()) {
+		l.csv_path = wxFileName::CreateTempFileName("gda_bench");
+		std::ofstream f(l.csv_path.mb_str());
+		f << "POLY_ID,X,Y,DEP,LABEL\n";
+		f.precision(17);
+		for (int i=0; i<l.num_obs; i++) {
+			f << i+1 << "," << l.x[i] << "," << l.y[i] << "," << l.dep[i];
+			f << ",\"obs " << i%100 << "\"\n";
+		}
+		if (!f) return "failed";
+	}
+	CsvImporter csv(l.csv_path);
+	if (!csv.ReadHeader() || !csv.Read()) return "failed";
+	OGRTable* table = csv.CreateTable();
+	std::vector<double> dep;
+	table->GetColData(3, 0, dep);
+	std::ostringstream ss;
+	ss << table->GetNumberRows() << "/" << Sum(&dep[0], dep.size());
+	delete table;
+	return ss.str();
+}
+
+const Kernel kernels[] = {
+	{ "contiguity", RunContiguity },
+	{ "knn", RunKnn },
+	{ "thresh", RunThresh },
+	{ "natural_breaks", RunNaturalBreaks },
+	{ "correlogram", RunCorrelogram },
+	{ "correlogram_all_pairs", RunCorrelogramAllPairs },
+	{ "correlogram_sample", RunCorrelogramSample },
+	{ "lisa", RunLisa },
+	{ "gstat", RunGStat },
+	{ "ols", RunOls },
+	{ "lag", RunLag },
+	{ "error", RunError },
+	{ "csv_import", RunCsvImport }
+};
+const int num_kernels = sizeof(kernels)/sizeof(kernels[0]);
+
+struct BaselineEntry {
+	BaselineEntry() : seconds(-1) {}
+	std::string checksum;
+	double seconds;
+};
+
+/** Results keyed by kernel,layer,num_obs,threads. */
+typedef std::map<std::string, BaselineEntry> Baseline;
+
+std::vector<std::string> SplitCsv(const std::string& line)
+{
+	std::vector<std::string> f;
+	std::istringstream ss(line);
+	std::string s;
+	while (std::getline(ss, s, ',')) f.push_back(s);
+	return f;
+}
+
+bool ReadBaseline(const std::string& fname, Baseline& b)
+{
+	std::ifstream f(fname.c_str());
+	if (!f) return false;
+	std::string line;
+	while (std::getline(f, line)) {
+		std::vector<std::string> v = SplitCsv(line);
+		if (v.size() != 7 || v[0] == "kernel") continue;
+		BaselineEntry& e = b[v[0] + "," + v[1] + "," + v[2] + "," + v[3]];
+		e.seconds = atof(v[4].c_str());
+		e.checksum = v[6];
+	}
+	return true;
+}
+
+/** Returns the number of differences from the baseline. */
+int CompareToBaseline(const Baseline& b, const std::string& key_no_threads,
+					  int threads, double seconds,
+					  const std::string& checksum, double tolerance)
+{
+	int failures = 0;
+	std::ostringstream key;
+	key << key_no_threads << "," << threads;
+	Baseline::const_iterator it = b.find(key.str());
+	if (it != b.end() && seconds > it->second.seconds*(1+tolerance)) {
+		fprintf(stderr, "slower: %s took %.4f s, baseline %.4f s\n",
+				key.str().c_str(), seconds, it->second.seconds);
+		failures++;
+	}
+	// results must not depend on the number of threads
+	std::string prefix = key_no_threads + ",";
+	for (it = b.lower_bound(prefix);
+		 it != b.end() && it->first.compare(0, prefix.size(), prefix) == 0;
+		 ++it) {
+		if (it->second.checksum != checksum) {
+			fprintf(stderr, "checksum: %s gave %s, baseline %s gave %s\n",
+					key.str().c_str(), checksum.c_str(), it->first.c_str(),
+					it->second.checksum.c_str());
+			failures++;
+			break;
+		}
+	}
+	return failures;
+}
+
+bool IsSelected(const BenchOptions& opt, const char* kernel)
+{
+	if (opt.kernels.empty()) return true;
+	return (std::find(opt.kernels.begin(), opt.kernels.end(), kernel) !=
+			opt.kernels.end());
+}
+
+int RunLayer(BenchLayer& l, const BenchOptions& opt, int threads,
+			 const Baseline& baseline)
+{
+	int failures = 0;
+	for (int k=0; k<num_kernels; k++) {
+		if (!IsSelected(opt, kernels[k].name)) continue;
+		double best = -1;
+		long peak_rss = 0;
+		std::string checksum;
+		for (int r=0; r<opt.repeat; r++) {
+			ResetPeakRss();
+			wxStopWatch sw;
+			std::string cs = kernels[k].func(l, opt);
+			double t = sw.TimeInMicro().ToDouble()/1.0e6;
+			if (best < 0 || t < best) best = t;
+			peak_rss = std::max(peak_rss, PeakRssKb());
+			if (r == 0) {
+				checksum = cs;
+			} else if (cs != checksum) {
+				fprintf(stderr, "%s on %s: repeat %d gave %s instead of %s\n",
+						kernels[k].name, l.name.c_str(), r, cs.c_str(),
+						checksum.c_str());
+				failures++;
+			}
+		}
+		std::ostringstream key;
+		key << kernels[k].name << "," << l.name << "," << l.num_obs;
+		printf("%s,%d,%.6f,%ld,%s\n", key.str().c_str(), threads, best,
+			   peak_rss, checksum.c_str());
+		fflush(stdout);
+		failures += CompareToBaseline(baseline, key.str(), threads, best,
+									  checksum, opt.tolerance);
+	}
+	return failures;
+}
+
+std::vector<int> ParseSizes(const char* s)
+{
+	std::vector<int> v;
+	std::istringstream ss(s);
+	std::string t;
+	while (std::getline(ss, t, ',')) {
+		int n = atoi(t.c_str());
+		if (n > 1) v.push_back(n);
+	}
+	return v;
+}
+
+void PrintUsage()
+{
+	fprintf(stderr,
+			"usage: gda_bench [options]\n"
+			"  --data DIR          SampleData directory (../SampleData)\n"
+			"  --no-samples        only run the synthetic grids\n"
+			"  --sizes A,B,...     side lengths of the grids (30,60,120)\n"
+			"  --kernels K1,K2,... subset of the kernels below\n"
+			"  --threads N         size of the thread pool (all cores)\n"
+			"  --repeat N          runs per kernel, the best is kept (3)\n"
+			"  --seed N            seed for the permutation tests\n"
+			"  --log-jacobian M    charpoly, lu, chebyshev or montecarlo\n"
+			"  --baseline FILE     compare with an earlier output\n"
+			"  --tolerance X       allowed slowdown over baseline (0.25)\n"
+			"  --no-header         do not print the CSV header\n"
+			"kernels:");
+	for (int k=0; k<num_kernels; k++) fprintf(stderr, " %s", kernels[k].name);
+	fprintf(stderr, "\n");
+}
+
+bool ParseArgs(int argc, char** argv, BenchOptions& opt)
+{
+	for (int i=1; i<argc; i++) {
+		std::string a(argv[i]);
+		bool has_val = i+1 < argc;
+		if (a == "--no-samples") {
+			opt.use_samples = false;
+		} else if (a == "--no-header") {
+			opt.header = false;
+		} else if (a == "--data" && has_val) {
+			opt.data_dir = wxString(argv[++i]);
+		} else if (a == "--sizes" && has_val) {
+			opt.sizes = ParseSizes(argv[++i]);
+		} else if (a == "--kernels" && has_val) {
+			opt.kernels.clear();
+			std::istringstream ss(argv[++i]);
+			std::string k;
+			while (std::getline(ss, k, ',')) opt.kernels.push_back(k);
+		} else if (a == "--threads" && has_val) {
+			opt.threads = atoi(argv[++i]);
+		} else if (a == "--repeat" && has_val) {
+			opt.repeat = std::max(1, atoi(argv[++i]));
+		} else if (a == "--seed" && has_val) {
+			opt.seed = strtoull(argv[++i], 0, 10);
+		} else if (a == "--baseline" && has_val) {
+			opt.baseline = argv[++i];
+		} else if (a == "--tolerance" && has_val) {
+			opt.tolerance = atof(argv[++i]);
+		} else if (a == "--log-jacobian" && has_val) {
+			std::string m(argv[++i]);
+			if (m == "charpoly") opt.lj_method = LogJacobian::char_poly;
+			else if (m == "lu") opt.lj_method = LogJacobian::sparse_lu;
+			else if (m == "chebyshev") opt.lj_method = LogJacobian::chebyshev;
+			else if (m == "montecarlo") opt.lj_method = LogJacobian::monte_carlo;
+			else return false;
+		} else {
+			return false;
+		}
+	}
+	return true;
+}
+
+} // namespace
+
+int main(int argc, char** argv)
+{
+	BenchOptions opt;
+	if (!ParseArgs(argc, argv, opt)) {
+		PrintUsage();
+		return 2;
+	}
+
+	// GeoDa.cpp is linked in for the symbols other modules refer to, but no
+	// GdaApp is created: a console app keeps wxWidgets away from the display
+	wxAppConsole::SetInstance(new wxAppConsole);
+	wxInitializer initializer(argc, argv);
+	if (!initializer.IsOk()) {
+		fprintf(stderr, "gda_bench: could not initialize wxWidgets\n");
+		return 2;
+	}
+
+	GdaThreadPool::SetNumWorkers(opt.threads);
+	int threads = GdaThreadPool::GetInstance()->GetNumWorkers();
+
+	Baseline baseline;
+	if (!opt.baseline.empty() && !ReadBaseline(opt.baseline, baseline)) {
+		fprintf(stderr, "gda_bench: could not read %s\n", opt.baseline.c_str());
+		return 2;
+	}
+
+	if (opt.header) {
+		printf("kernel,layer,num_obs,threads,seconds,peak_rss_kb,checksum\n");
+	}
+	int failures = 0;
+
+	if (opt.use_samples) {
+		struct SampleSpec {
+			const char* path;
+			const char* dep;
+			const char* indep[3];
+		};
+		const SampleSpec samples[] = {
+			{ "Examples/columbus/shapefile/columbus.shp", "CRIME",
+				{ "INC", "HOVAL", 0 } },
+			{ "nat.shp", "HR90", { "RD90", "PS90", "UE90" } }
+		};
+		for (size_t s=0; s<sizeof(samples)/sizeof(samples[0]); s++) {
+			std::vector<wxString> indep;
+			for (int i=0; i<3 && samples[s].indep[i]; i++) {
+				indep.push_back(samples[s].indep[i]);
+			}
+			BenchLayer l;
+			if (!LoadSampleLayer(opt.data_dir, samples[s].path, samples[s].dep,
+								 indep, l)) {
+				fprintf(stderr, "gda_bench: skipping %s\n", samples[s].path);
+				continue;
+			}
+			failures += RunLayer(l, opt, threads, baseline);
+		}
+	}
+
+	for (size_t s=0; s<opt.sizes.size(); s++) {
+		BenchLayer l;
+		if (!MakeGridLayer(opt.sizes[s], opt.seed, l)) {
+			fprintf(stderr, "gda_bench: could not build grid%d\n",
+					opt.sizes[s]);
+			failures++;
+			continue;
+		}
+		failures += RunLayer(l, opt, threads, baseline);
+	}
+
+	return failures > 0 ? 1 : 0;
+}
@@ -26,12 +26,15 @@
 #include <wx/button.h>
 #include <wx/filedlg.h>
 #include <wx/textdlg.h>
+#include <boost/bind.hpp>
 #include "MergeTableDlg.h"
 #include "DataSource.h"
 #include "DbfColContainer.h"
+#include "OGRTable.h"
 #include "TableBase.h"
 #include "TableInterface.h"
 #include "../DbfFile.h"
+#include "../ShapeOperations/CsvImporter.h"
 #include "../ShapeOperations/OGRLayerProxy.h"
 #include "../ShapeOperations/OGRDataAdapter.h"
 #include "../DialogTools/ConnectDatasourceDlg.h"
@@ -60,7 +63,8 @@ END_EVENT_TABLE()
 using namespace std;
 
 MergeTableDlg::MergeTableDlg(TableInterface* _table_int, const wxPoint& pos)
-: table_int(_table_int)
+: table_int(_table_int), merge_layer_proxy(NULL),
+merge_csv_table(NULL), csv_importer(NULL), csv_read_ok(false)
 {
     wxLogMessage("Open MergeTableDlg.");
 	SetParent(NULL);
@@ -77,6 +81,9 @@ MergeTableDlg::~MergeTableDlg()
 {
     //delete merge_datasource_proxy;
     //merge_datasource_proxy = NULL;
+    csv_task.Stop();
+    delete csv_importer;
+    delete merge_csv_table;
 }
 
 void MergeTableDlg::CreateControls()
@@ -152,33 +159,25 @@ void MergeTableDlg::OnOpenClick( wxCommandEvent& ev )
        
         wxLogMessage(_("ds:") + datasource_name + _(" layer") + layer_name);
         
-        merge_datasource_proxy = new OGRDatasourceProxy(datasource_name, ds_type, true);
-        merge_layer_proxy = merge_datasource_proxy->GetLayerProxy(layer_name.ToStdString());
-        merge_layer_proxy->ReadData();
-        m_input_file_name->SetValue(layer_name);
-        
-        // get the unique field names, and fill to m_import_key (wxChoice)
-        map<wxString, int> dbf_fn_freq;
-        dups.clear();
-        dedup_to_id.clear();
-        for (int i=0, iend=merge_layer_proxy->GetNumFields(); i<iend; i++) {
-            GdaConst::FieldType field_type = merge_layer_proxy->GetFieldType(i);
-            wxString name = merge_layer_proxy->GetFieldName(i);
-            wxString dedup_name = name;
-            if (dbf_fn_freq.find(name) != dbf_fn_freq.end()) {
-                dedup_name << " (" << dbf_fn_freq[name]++ << ")";
-            } else {
-                dbf_fn_freq[name] = 1;
-            }
-            dups.insert(dedup_name);
-            dedup_to_id[dedup_name] = i; // map to DBF col id
-            if ( field_type == GdaConst::long64_type ||
-                 field_type == GdaConst::string_type )
-            {
-                m_import_key->Append(dedup_name);
+        // CSV files are parsed on all cores, in the background
+        if (ds_type == GdaConst::ds_csv) {
+            delete csv_importer;
+            csv_importer = new CsvImporter(datasource_name);
+            if (csv_importer->ReadHeader()) {
+                csv_layer_name = layer_name;
+                csv_read_ok = false;
+                csv_task.Start(boost::bind(&MergeTableDlg::ReadCsv, this, _1),
+                               boost::bind(&MergeTableDlg::ReadCsvDone,
+                                           this, _1));
+                csv_task.ShowProgress(this, _("Merge"),
+                                      _("Reading ") + layer_name + "...");
+                return;
             }
-            m_exclude_list->Append(dedup_name);
+            wxLogMessage(csv_importer->GetErrorMessage());
+            delete csv_importer;
+            csv_importer = NULL;
         }
+        OpenOGRLayer(datasource_name, ds_type, layer_name);
         
     }catch(GdaException& e) {
         wxMessageDialog dlg (this, e.what(), _("Error"), wxOK | wxICON_ERROR);
@@ -187,6 +186,168 @@ void MergeTableDlg::OnOpenClick( wxCommandEvent& ev )
     }
 }
 
+void MergeTableDlg::OpenOGRLayer(const wxString& ds_name,
+                                 GdaConst::DataSourceType ds_type,
+                                 const wxString& layer_name)
+{
+    delete merge_csv_table;
+    merge_csv_table = NULL;
+    merge_datasource_proxy = new OGRDatasourceProxy(ds_name, ds_type, true);
+    merge_layer_proxy = merge_datasource_proxy->GetLayerProxy(layer_name.ToStdString());
+    merge_layer_proxy->ReadData();
+    m_input_file_name->SetValue(layer_name);
+    FillImportFields();
+}
+
+/** Parses the CSV file opened by OnOpenClick on the csv_task thread.  Only
+ touches csv_importer and csv_read_ok until ReadCsvDone. */
+bool MergeTableDlg::ReadCsv(const GdaCancelToken& token)
+{
+    try {
+        csv_read_ok = csv_importer->Read(token);
+    } catch (...) {
+        csv_read_ok = false;
+    }
+    return !token.IsCancelled();
+}
+
+/** Takes the parsed CSV table, or falls back to OGR if the file could not
+ be parsed, e.g. as a quoted field spans several lines. */
+void MergeTableDlg::ReadCsvDone(bool ok)
+{
+    if (!ok) {
+        delete csv_importer;
+        csv_importer = NULL;
+        return;
+    }
+    if (csv_read_ok) {
+        delete merge_csv_table;
+        merge_csv_table = csv_importer->CreateTable();
+        delete csv_importer;
+        csv_importer = NULL;
+        m_input_file_name->SetValue(csv_layer_name);
+        FillImportFields();
+        return;
+    }
+    wxLogMessage(csv_importer->GetErrorMessage());
+    wxString ds_name = csv_importer->GetCsvPath();
+    delete csv_importer;
+    csv_importer = NULL;
+    try {
+        OpenOGRLayer(ds_name, GdaConst::ds_csv, csv_layer_name);
+    } catch(GdaException& e) {
+        wxMessageDialog dlg (this, e.what(), _("Error"), wxOK | wxICON_ERROR);
+        dlg.ShowModal();
+    }
+}
+
+void MergeTableDlg::FillImportFields()
+{
+    // get the unique field names, and fill to m_import_key (wxChoice)
+    map<wxString, int> dbf_fn_freq;
+    dups.clear();
+    dedup_to_id.clear();
+    for (int i=0, iend=GetImportNumFields(); i<iend; i++) {
+        GdaConst::FieldType field_type = GetImportFieldType(i);
+        wxString name = GetImportFieldName(i);
+        wxString dedup_name = name;
+        if (dbf_fn_freq.find(name) != dbf_fn_freq.end()) {
+            dedup_name << " (" << dbf_fn_freq[name]++ << ")";
+        } else {
+            dbf_fn_freq[name] = 1;
+        }
+        dups.insert(dedup_name);
+        dedup_to_id[dedup_name] = i; // map to DBF col id
+        if ( field_type == GdaConst::long64_type ||
+             field_type == GdaConst::string_type )
+        {
+            m_import_key->Append(dedup_name);
+        }
+        m_exclude_list->Append(dedup_name);
+    }
+}
+
+int MergeTableDlg::GetImportNumFields()
+{
+    if (merge_csv_table) return merge_csv_table->GetNumberCols();
+    return merge_layer_proxy->GetNumFields();
+}
+
+int MergeTableDlg::GetImportNumRecords()
+{
+    if (merge_csv_table) return merge_csv_table->GetNumberRows();
+    return merge_layer_proxy->GetNumRecords();
+}
+
+int MergeTableDlg::GetImportFieldPos(const wxString& name)
+{
+    if (merge_csv_table) return merge_csv_table->FindColId(name);
+    return merge_layer_proxy->GetFieldPos(name);
+}
+
+wxString MergeTableDlg::GetImportFieldName(int fid)
+{
+    if (merge_csv_table) return merge_csv_table->GetColName(fid);
+    return merge_layer_proxy->GetFieldName(fid);
+}
+
+GdaConst::FieldType MergeTableDlg::GetImportFieldType(int fid)
+{
+    if (merge_csv_table) return merge_csv_table->GetColType(fid);
+    return merge_layer_proxy->GetFieldType(fid);
+}
+
+void MergeTableDlg::GetImportColData(int fid, vector<wxString>& data,
+                                     vector<bool>& undefs)
+{
+    if (merge_csv_table) {
+        merge_csv_table->GetColData(fid, 0, data, undefs);
+        // undefined numbers read as 0, keys must not match them
+        for (size_t i=0; i<data.size(); i++) {
+            if (undefs[i]) data[i] = wxEmptyString;
+        }
+        return;
+    }
+    int n = merge_layer_proxy->GetNumRecords();
+    data.resize(n);
+    undefs.assign(n, false);
+    for (int i=0; i<n; i++) {
+        data[i] = wxString(merge_layer_proxy->GetValueAt(i, fid));
+    }
+}
+
+void MergeTableDlg::GetImportColData(int fid, vector<wxInt64>& data,
+                                     vector<bool>& undefs)
+{
+    if (merge_csv_table) {
+        merge_csv_table->GetColData(fid, 0, data, undefs);
+        return;
+    }
+    int n = merge_layer_proxy->GetNumRecords();
+    data.resize(n);
+    undefs.assign(n, false);
+    for (int i=0; i<n; i++) {
+        OGRFeature* feat = merge_layer_proxy->GetFeatureAt(i);
+        data[i] = feat->GetFieldAsInteger64(fid);
+    }
+}
+
+void MergeTableDlg::GetImportColData(int fid, vector<double>& data,
+                                     vector<bool>& undefs)
+{
+    if (merge_csv_table) {
+        merge_csv_table->GetColData(fid, 0, data, undefs);
+        return;
+    }
+    int n = merge_layer_proxy->GetNumRecords();
+    data.resize(n);
+    undefs.assign(n, false);
+    for (int i=0; i<n; i++) {
+        OGRFeature* feat = merge_layer_proxy->GetFeatureAt(i);
+        data[i] = feat->GetFieldAsDouble(fid);
+    }
+}
+
 void MergeTableDlg::OnIncAllClick( wxCommandEvent& ev)
 {
     wxLogMessage("Entering MergeTableDlg::OnIncAllClick()");
@@ -372,13 +533,11 @@ void MergeTableDlg::OnMergeClick( wxCommandEvent& ev )
             // get and check keys from import table
             int key2_id = m_import_key->GetSelection();
             wxString key2_name = m_import_key->GetString(key2_id);
-            int col2_id = merge_layer_proxy->GetFieldPos(key2_name);
-            int n_merge_rows = merge_layer_proxy->GetNumRecords();
+            int col2_id = GetImportFieldPos(key2_name);
             vector<wxString> key2_vec;
+            vector<bool> key2_undefs;
             map<wxString,int> key2_map;
-            for (int i=0; i < n_merge_rows; i++) {
-                key2_vec.push_back(merge_layer_proxy->GetValueAt(i, col2_id));
-            }
+            GetImportColData(col2_id, key2_vec, key2_undefs);
             CheckKeys(key2_name, key2_vec, key2_map);
             
             // make sure key1 <= key2, and store their mappings
@@ -400,7 +559,7 @@ void MergeTableDlg::OnMergeClick( wxCommandEvent& ev )
         }
         // merge by order sequence
         else if (m_rec_order_rb->GetValue() == 1) {
-            if (table_int->GetNumberRows() > merge_layer_proxy->GetNumRecords()) {
+            if (table_int->GetNumberRows() > GetImportNumRecords()) {
                 error_msg = wxString::Format(_("The number of records in current table is larger than the number of records in import table. Please choose import table >= %d records"), table_int->GetNumberRows());
                 throw GdaException(error_msg.mb_str());
             }
@@ -437,24 +596,30 @@ void MergeTableDlg::AppendNewField(wxString field_name,
                                    int n_rows,
                                    map<int,int>& rowid_map)
 {
-    int fid = merge_layer_proxy->GetFieldPos(real_field_name);
-    GdaConst::FieldType ftype = merge_layer_proxy->GetFieldType(fid);
+    int fid = GetImportFieldPos(real_field_name);
+    GdaConst::FieldType ftype = GetImportFieldType(fid);
+    
+    // import_rid[i] is the import row of row i, or -1
+    vector<int> import_rid(n_rows);
+    for (int i=0; i<n_rows; i++) {
+        import_rid[i] = i; // default merge by row
+        if (!rowid_map.empty()) {
+            // merge by key
+            import_rid[i] = rowid_map.find(i) == rowid_map.end() ? -1 : rowid_map[i];
+        }
+    }
     
     if ( ftype == GdaConst::string_type ) {
         int add_pos = table_int->InsertCol(ftype, field_name);
+        vector<wxString> import_data;
+        vector<bool> import_undefs;
+        GetImportColData(fid, import_data, import_undefs);
         vector<wxString> data(n_rows);
         vector<bool> undefs(n_rows);
         for (int i=0; i<n_rows; i++) {
-            int import_rid = i; // default merge by row
-            
-            if (!rowid_map.empty()) {
-                // merge by key
-                import_rid = rowid_map.find(i) == rowid_map.end() ? -1 : rowid_map[i];
-            }
-            
-            if (import_rid >=0) {
-                data[i] = wxString(merge_layer_proxy->GetValueAt(import_rid,fid));
-                undefs[i] = false;
+            if (import_rid[i] >=0) {
+                data[i] = import_data[import_rid[i]];
+                undefs[i] = import_undefs[import_rid[i]];
             } else {
                 data[i] = wxEmptyString;
                 undefs[i] = true;
@@ -464,18 +629,15 @@ void MergeTableDlg::AppendNewField(wxString field_name,
         
     } else if ( ftype == GdaConst::long64_type ) {
         int add_pos = table_int->InsertCol(ftype, field_name);
+        vector<wxInt64> import_data;
+        vector<bool> import_undefs;
+        GetImportColData(fid, import_data, import_undefs);
         vector<wxInt64> data(n_rows);
         vector<bool> undefs(n_rows);
         for (int i=0; i<n_rows; i++) {
-            int import_rid = i;
-            if (!rowid_map.empty()) {
-                //import_rid = rowid_map[i];
-                import_rid = rowid_map.find(i) == rowid_map.end() ? -1 : rowid_map[i];
-            }
-            if (import_rid >=0 ) {
-                OGRFeature* feat = merge_layer_proxy->GetFeatureAt(import_rid);
-                data[i] = feat->GetFieldAsInteger64(fid);
-                undefs[i] = false;
+            if (import_rid[i] >=0 ) {
+                data[i] = import_data[import_rid[i]];
+                undefs[i] = import_undefs[import_rid[i]];
             } else {
                 data[i] = 0;
                 undefs[i] = true;
@@ -485,18 +647,15 @@ void MergeTableDlg::AppendNewField(wxString field_name,
         
     } else if ( ftype == GdaConst::double_type ) {
         int add_pos=table_int->InsertCol(ftype, field_name);
+        vector<double> import_data;
+        vector<bool> import_undefs;
+        GetImportColData(fid, import_data, import_undefs);
         vector<double> data(n_rows);
         vector<bool> undefs(n_rows);
         for (int i=0; i<n_rows; i++) {
-            int import_rid = i;
-            if (!rowid_map.empty()) {
-                //import_rid = rowid_map[i];
-                import_rid = rowid_map.find(i) == rowid_map.end() ? -1 : rowid_map[i];
-            }
-            if (import_rid >=0 ) {
-                OGRFeature* feat = merge_layer_proxy->GetFeatureAt(import_rid);
-                data[i] = feat->GetFieldAsDouble(fid);
-                undefs[i] = false;
+            if (import_rid[i] >=0 ) {
+                data[i] = import_data[import_rid[i]];
+                undefs[i] = import_undefs[import_rid[i]];
             } else {
                 data[i] = 0.0;
                 undefs[i] = true;
@@ -32,10 +32,14 @@
 #include <wx/grid.h>
 
 #include "DataSource.h"
+#include "../GdaAsyncTask.h"
 #include "../ShapeOperations/OGRLayerProxy.h"
 #include "../ShapeOperations/OGRDatasourceProxy.h"
 #include "../DataViewer/TableInterface.h"
 
+class CsvImporter;
+class OGRTable;
+
 class MergeTableDlg: public wxDialog
 {    
 public:
@@ -96,6 +100,33 @@ private:
     void AppendNewField(wxString field_name, wxString real_field_name,
                         int n_rows, std::map<int,int>& rowid_map);
     
+    void OpenOGRLayer(const wxString& ds_name,
+                      GdaConst::DataSourceType ds_type,
+                      const wxString& layer_name);
+    bool ReadCsv(const GdaCancelToken& token);
+    void ReadCsvDone(bool ok);
+    void FillImportFields();
+    
+    // the import table is read either by OGR or, for CSV files, into
+    // merge_csv_table; these read from whichever is open
+    int GetImportNumFields();
+    int GetImportNumRecords();
+    int GetImportFieldPos(const wxString& name);
+    wxString GetImportFieldName(int fid);
+    GdaConst::FieldType GetImportFieldType(int fid);
+    void GetImportColData(int fid, std::vector<wxString>& data,
+                          std::vector<bool>& undefs);
+    void GetImportColData(int fid, std::vector<wxInt64>& data,
+                          std::vector<bool>& undefs);
+    void GetImportColData(int fid, std::vector<double>& data,
+                          std::vector<bool>& undefs);
+    
+    OGRTable* merge_csv_table;
+    CsvImporter* csv_importer;
+    bool csv_read_ok;
+    wxString csv_layer_name;
+    GdaAsyncTask csv_task;
+    
     
 	DECLARE_EVENT_TABLE()
 };
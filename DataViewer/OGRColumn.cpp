@@ -22,6 +22,9 @@
 #include <algorithm>
 #include <vector>
 #include <set>
+#include <map>
+#include <string>
+#include <string.h>
 #include <boost/foreach.hpp>
 #include <locale>
 #include <wx/regex.h>
@@ -249,12 +252,8 @@ OGRColumnInteger::OGRColumnInteger(wxString name, int field_length, int decimals
 {
     // a new in-memory integer column
     is_new = true;
-    new_data.resize(rows);
-    undef_markers.resize(rows);
-    for (int i=0; i<rows; ++i) {
-        new_data[i] = 0;
-        undef_markers[i] = false;
-    }
+    col_data.resize(rows, 0);
+    undef_markers.resize(rows, false);
 }
 
 OGRColumnInteger::OGRColumnInteger(OGRLayerProxy* ogr_layer, wxString name,
@@ -263,89 +262,74 @@ OGRColumnInteger::OGRColumnInteger(OGRLayerProxy* ogr_layer, wxString name,
 {
     // a new integer column
     is_new = true;
-    new_data.resize(rows);
-    undef_markers.resize(rows);
-    for (int i=0; i<rows; ++i) {
-        new_data[i] = 0;
-        undef_markers[i] = false;
-    }
+    col_data.resize(rows, 0);
+    undef_markers.resize(rows, false);
 }
 
 OGRColumnInteger::OGRColumnInteger(OGRLayerProxy* ogr_layer, int idx)
 :OGRColumn(ogr_layer, idx)
 {
-    // a integer column from OGRLayer
+    // a integer column from OGRLayer: the values are read from the features
+    // once here, all reads afterwards come from col_data
     is_new = false;
+    col_data.resize(rows);
     undef_markers.resize(rows);
     for (int i=0; i<rows; ++i) {
+        OGRFeature* feature = ogr_layer->data[i];
         // for non-undefined value
-        if ( ogr_layer->data[i]->IsFieldSet(idx) )
-            undef_markers[i] = false;
-        else
-            undef_markers[i] = true;
+        undef_markers[i] = !feature->IsFieldSet(idx);
+        col_data[i] = (wxInt64)feature->GetFieldAsInteger64(idx);
     }
 }
 
+OGRColumnInteger::OGRColumnInteger(wxString name, int field_length,
+                                   int decimals, vector<wxInt64>& data,
+                                   vector<bool>& undefs)
+: OGRColumn(name, field_length, decimals, data.size())
+{
+    is_new = true;
+    col_data.swap(data);
+    undef_markers.swap(undefs);
+    undef_markers.resize(rows, false);
+}
+
 OGRColumnInteger::~OGRColumnInteger()
 {
-    if (new_data.size() > 0 ) new_data.clear();
-    if (undef_markers.size() > 0) undef_markers.clear();
 }
 
 // Return this column to a vector of wxInt64
 void OGRColumnInteger::FillData(vector<wxInt64> &data)
 {
-    if (is_new) {
-        for (int i=0; i<rows; ++i) {
-            data[i] = new_data[i];
-        }
-    } else {
-        int col_idx = GetColIndex();
-        for (int i=0; i<rows; ++i) {
-            data[i] = (wxInt64)ogr_layer->data[i]->GetFieldAsInteger64(col_idx);
-        }
-    }
+    data.resize(rows);
+    if (rows > 0) memcpy(&data[0], &col_data[0], sizeof(wxInt64) * rows);
 }
 
 // Return this column to a vector of double
 void OGRColumnInteger::FillData(vector<double> &data)
 {
-    if (is_new) {
-        for (int i=0; i<rows; ++i) {
-            data[i] = (double)new_data[i];
-        }
-    } else {
-        int col_idx = GetColIndex();
-        for (int i=0; i<rows; ++i) {
-            data[i] = (double)ogr_layer->data[i]->GetFieldAsInteger64(col_idx);
-        }
+    data.resize(rows);
+    for (int i=0; i<rows; ++i) {
+        data[i] = (double)col_data[i];
     }
 }
 
 // Return this column to a vector of wxString
 void OGRColumnInteger::FillData(vector<wxString> &data)
 {
-    if (is_new) {
-        for (int i=0; i<rows; ++i) {
-            data[i] = wxString::Format(wxT("%")  wxT(wxLongLongFmtSpec)  wxT("d"), new_data[i]);
-        }
-    } else {
-        int col_idx = GetColIndex();
-        for (int i=0; i<rows; ++i) {
-            data[i] = wxString::Format(wxT("%") wxT(wxLongLongFmtSpec) wxT("d"),
-                ogr_layer->data[i]->GetFieldAsInteger64(col_idx));
-        }
+    data.resize(rows);
+    for (int i=0; i<rows; ++i) {
+        data[i] = wxString::Format(wxT("%") wxT(wxLongLongFmtSpec) wxT("d"),
+                                   col_data[i]);
     }
 }
 
 // Update this column from a vector of wxInt64
 void OGRColumnInteger::UpdateData(const vector<wxInt64>& data)
 {
-    if (is_new) {
-        for (int i=0; i<rows; ++i) {
-            new_data[i] = data[i];
-        }
-    } else {
+    for (int i=0; i<rows; ++i) {
+        col_data[i] = data[i];
+    }
+    if (!is_new) {
         int col_idx = GetColIndex();
         for (int i=0; i<rows; ++i) {
             ogr_layer->data[i]->SetField(col_idx, (GIntBig)data[i]);
@@ -355,19 +339,17 @@ void OGRColumnInteger::UpdateData(const vector<wxInt64>& data)
 
 void OGRColumnInteger::UpdateData(const vector<double>& data)
 {
-    if (is_new) {
-        for (int i=0; i<rows; ++i) {
-            new_data[i] = (int)data[i];
-        }
-    } else {
+    for (int i=0; i<rows; ++i) {
+        col_data[i] = (wxInt64)data[i];
+    }
+    if (!is_new) {
         int col_idx = GetColIndex();
         for (int i=0; i<rows; ++i) {
-            ogr_layer->data[i]->SetField(col_idx, (GIntBig)data[i]);
+            ogr_layer->data[i]->SetField(col_idx, (GIntBig)col_data[i]);
         }
     }
 }
 
-
 // Return an integer value from a cell at position (row)
 bool OGRColumnInteger::GetCellValue(int row, wxInt64& val)
 {
@@ -375,15 +357,7 @@ bool OGRColumnInteger::GetCellValue(int row, wxInt64& val)
         val = 0;
         return false;
     }
-    
-    if (is_new) {
-        val = new_data[row];
-        
-    } else {
-        int col_idx = GetColIndex();
-        val = (wxInt64)ogr_layer->data[row]->GetFieldAsInteger64(col_idx);
-    }
-    
+    val = col_data[row];
     return true;
 }
 
@@ -396,17 +370,8 @@ wxString OGRColumnInteger::GetValueAt(int row_idx, int disp_decimals,
     if ( undef_markers[row_idx] == true)
         return wxEmptyString;
     
-    if (is_new) {
-        return wxString::Format("%lld",new_data[row_idx]);
-        
-    } else {
-        int col_idx = GetColIndex();
-        if (col_idx == -1)
-            return wxEmptyString;
-        wxLongLong val(ogr_layer->data[row_idx]->GetFieldAsInteger64(col_idx));
-        
-        return val.ToString();
-    }
+    wxLongLong val(col_data[row_idx]);
+    return val.ToString();
 }
 
 // Set a cell value from user input wxString (in Table/wxGrid)
@@ -420,14 +385,13 @@ void OGRColumnInteger::SetValueAt(int row_idx, const wxString &value)
     wxInt64 l_val;
     if ( GenUtils::validInt(value) ) {
         GenUtils::strToInt64(value, &l_val);
-        if (is_new) {
-            new_data[row_idx] = l_val;
-        } else {
+        if (!is_new) {
             int col_idx = GetColIndex();
             if (col_idx == -1)
                 return;
             ogr_layer->data[row_idx]->SetField(col_idx, (GIntBig)l_val);
         }
+        col_data[row_idx] = l_val;
         undef_markers[row_idx] = false;
     }
 }
@@ -442,13 +406,10 @@ OGRColumnDouble::OGRColumnDouble(wxString name, int field_length,
     if ( decimals < 0)
         decimals = GdaConst::default_dbf_double_decimals;
     is_new = true;
-    new_data.resize(rows);
-    undef_markers.resize(rows);
-    for (int i=0; i<rows; ++i) {
-        new_data[i] = 0.0;
-        undef_markers[i] = false;
-    }
+    col_data.resize(rows, 0.0);
+    undef_markers.resize(rows, false);
 }
+
 OGRColumnDouble::OGRColumnDouble(OGRLayerProxy* ogr_layer, wxString name,
                                  int field_length, int decimals)
 : OGRColumn(ogr_layer, name, field_length, decimals)
@@ -458,95 +419,74 @@ OGRColumnDouble::OGRColumnDouble(OGRLayerProxy* ogr_layer, wxString name,
         decimals = GdaConst::default_dbf_double_decimals;
     
     is_new = true;
-    new_data.resize(rows);
-    undef_markers.resize(rows);
-    for (int i=0; i<rows; ++i) {
-        new_data[i] = 0.0;
-        undef_markers[i] = false;
-    }
+    col_data.resize(rows, 0.0);
+    undef_markers.resize(rows, false);
 }
 
 OGRColumnDouble::OGRColumnDouble(OGRLayerProxy* ogr_layer, int idx)
 :OGRColumn(ogr_layer, idx)
 {
-    // a double column from OGRLayer
+    // a double column from OGRLayer: the values are read from the features
+    // once here, all reads afterwards come from col_data
     if ( decimals < 0)
         decimals = GdaConst::default_dbf_double_decimals;
     is_new = false;
+    col_data.resize(rows);
     undef_markers.resize(rows);
     for (int i=0; i<rows; ++i) {
+        OGRFeature* feature = ogr_layer->data[i];
         // for non-undefined value
-        if ( ogr_layer->data[i]->IsFieldSet(idx) )
-            undef_markers[i] = false;
-        else
-            undef_markers[i] = true;
+        undef_markers[i] = !feature->IsFieldSet(idx);
+        col_data[i] = feature->GetFieldAsDouble(idx);
     }
 }
 
-OGRColumnDouble::~OGRColumnDouble()
+OGRColumnDouble::OGRColumnDouble(wxString name, int field_length,
+                                 int decimals, vector<double>& data,
+                                 vector<bool>& undefs)
+: OGRColumn(name, field_length, decimals, data.size())
 {
-    if (new_data.size() > 0 )
-        new_data.clear();
-    if (undef_markers.size() > 0)
-        undef_markers.clear();
+    is_new = true;
+    col_data.swap(data);
+    undef_markers.swap(undefs);
+    undef_markers.resize(rows, false);
 }
 
+OGRColumnDouble::~OGRColumnDouble()
+{
+}
 
 // Assign this column to a vector of wxInt64
 void OGRColumnDouble::FillData(vector<wxInt64> &data)
 {
-    if (is_new) {
-        for (int i=0; i<rows; ++i) {
-            data[i] = (wxInt64)new_data[i];
-        }
-        
-    } else {
-        int col_idx = GetColIndex();
-        for (int i=0; i<rows; ++i) {
-            data[i] = (wxInt64)ogr_layer->data[i]->GetFieldAsDouble(col_idx);
-        }
-        
+    data.resize(rows);
+    for (int i=0; i<rows; ++i) {
+        data[i] = (wxInt64)col_data[i];
     }
 }
 
 // Assign this column to a vector of double
 void OGRColumnDouble::FillData(vector<double> &data)
 {
-    if (is_new) {
-        for (int i=0; i<rows; ++i) {
-            data[i] = new_data[i];
-        }
-    } else {
-        int col_idx = GetColIndex();
-        for (int i=0; i<rows; ++i) {
-            data[i] = ogr_layer->data[i]->GetFieldAsDouble(col_idx);
-        }
-    }
+    data.resize(rows);
+    if (rows > 0) memcpy(&data[0], &col_data[0], sizeof(double) * rows);
 }
 
 void OGRColumnDouble::FillData(vector<wxString> &data)
 {
-    if (is_new) {
-        for (int i=0; i<rows; ++i) {
-            data[i] = wxString::Format("%f", new_data[i]);
-        }
-    } else {
-        int col_idx = GetColIndex();
-        for (int i=0; i<rows; ++i) {
-            data[i] = wxString::Format("%f",
-                ogr_layer->data[i]->GetFieldAsDouble(col_idx));
-        }
+    data.resize(rows);
+    for (int i=0; i<rows; ++i) {
+        data[i] = wxString::Format("%f", col_data[i]);
     }
 }
 
 // Update this column from a vector of double
 void OGRColumnDouble::UpdateData(const vector<double>& data)
 {
-    if (is_new) {
-        for (int i=0; i<rows; ++i) {
-            new_data[i] = data[i];
-        }
-    } else {
+    for (int i=0; i<rows; ++i) {
+        col_data[i] = data[i];
+    }
+    if (!is_new) {
         int col_idx = GetColIndex();
         for (int i=0; i<rows; ++i) {
             ogr_layer->data[i]->SetField(col_idx, data[i]);
@@ -556,21 +496,18 @@ void OGRColumnDouble::UpdateData(const vector<double>& data)
 
 void OGRColumnDouble::UpdateData(const vector<wxInt64>& data)
 {
-    if (is_new) {
-        for (int i=0; i<rows; ++i) {
-            new_data[i] = (double)data[i];
-            undef_markers[i] = false;
-        }
-    } else {
+    for (int i=0; i<rows; ++i) {
+        col_data[i] = (double)data[i];
+        undef_markers[i] = false;
+    }
+    if (!is_new) {
         int col_idx = GetColIndex();
         for (int i=0; i<rows; ++i) {
-            ogr_layer->data[i]->SetField(col_idx, (double)data[i]);
-            undef_markers[i] = false;
+            ogr_layer->data[i]->SetField(col_idx, col_data[i]);
         }
     }
 }
 
-
 // Fill a double value from a cell at position (row)
 bool OGRColumnDouble::GetCellValue(int row, double& val)
 {
@@ -578,13 +515,7 @@ bool OGRColumnDouble::GetCellValue(int row, double& val)
         val = 0.0;
         return false;
     }
-    
-    if (is_new) {
-        val = new_data[row];
-    } else {
-        int col_idx = GetColIndex();
-        val = ogr_layer->data[row]->GetFieldAsDouble(col_idx);
-    }
+    val = col_data[row];
     return true;
 }
 
@@ -599,29 +530,8 @@ wxString OGRColumnDouble::GetValueAt(int row_idx, int disp_decimals,
     if ( disp_decimals < 0)
         disp_decimals = GdaConst::default_dbf_double_decimals;
     
-    double val;
-    if (is_new) {
-        
-        val = new_data[row_idx];
-        wxString rst = wxNumberFormatter::ToString(val, disp_decimals,
-                                                   wxNumberFormatter::Style_None);
-        return rst;
-        
-    } else {
-        int col_idx = GetColIndex();
-        if (col_idx == -1)
-            return wxEmptyString;
-        
-        const char* tmp = ogr_layer->data[row_idx]->GetFieldAsString(col_idx);
-        if (*tmp == '\0' ) {
-            return wxEmptyString;
-        }
-        
-        val = ogr_layer->data[row_idx]->GetFieldAsDouble(col_idx);
-        wxString rst = wxNumberFormatter::ToString(val, disp_decimals,
-                                                   wxNumberFormatter::Style_None);
-        return rst;
-    }
+    return wxNumberFormatter::ToString(col_data[row_idx], disp_decimals,
+                                       wxNumberFormatter::Style_None);
 }
 
 // Set a cell value from user input wxString (in Table/wxGrid)
@@ -630,306 +540,259 @@ void OGRColumnDouble::SetValueAt(int row_idx, const wxString &value)
     // if user inputs nothing for a double valued cell, GeoDa treats it as NULL
     if ( value.IsEmpty() ) {
         undef_markers[row_idx] = true;
-        if (is_new ) {
-            new_data[row_idx] = 0.0;
-        } else {
+        col_data[row_idx] = 0.0;
+        if (!is_new) {
             // set undefined/null
-            ogr_layer->data[row_idx]->UnsetField(row_idx);
+            int col_idx = GetColIndex();
+            ogr_layer->data[row_idx]->UnsetField(col_idx);
         }
         return;
     }
     
     double d_val;
     if ( value.ToDouble(&d_val) ) {
-        if (is_new) {
-            new_data[row_idx] = d_val;
-        } else {
+        if (!is_new) {
             int col_idx = GetColIndex();
             ogr_layer->data[row_idx]->SetField(col_idx, d_val);
         }
+        col_data[row_idx] = d_val;
         undef_markers[row_idx] = false;
     }
 }
 
 ////////////////////////////////////////////////////////////////////////////////
 //
+namespace {
+    // Conversions used to read a string column as numbers.  Empty strings
+    // are read as 0.
+    bool string_to_number(const wxString& s, double& val)
+    {
+        if (s.IsEmpty()) {
+            val = 0.0;
+            return true;
+        }
+        return s.ToDouble(&val);
+    }
+    
+    bool string_to_number(const wxString& s, wxInt64& val)
+    {
+        if (s.IsEmpty()) {
+            val = 0;
+            return true;
+        }
+        if (s.ToLongLong(&val))
+            return true;
+        double val_d;
+        if (s.ToDouble(&val_d)) {
+            val = static_cast<wxInt64>(val_d);
+            return true;
+        }
+        return false;
+    }
+    
+    // Convert the dictionary entries flagged in used.  If one can't be
+    // converted, try again without the GDAL thousands separator, or with
+    // comma as decimal point if no separator is configured.  On failure
+    // bad_val is the entry that couldn't be converted.
+    template <class T>
+    bool convert_dict(const vector<wxString>& dict, const vector<bool>& used,
+                      vector<T>& vals, wxString& bad_val)
+    {
+        size_t n = dict.size();
+        vals.resize(n);
+        
+        // default C locale
+        bool conv_success = true;
+        for (size_t i=0; i<n && conv_success; ++i) {
+            if (!used[i]) continue;
+            if (!string_to_number(dict[i], vals[i])) {
+                conv_success = false;
+                bad_val = dict[i];
+            }
+        }
+        if (conv_success)
+            return true;
+        
+        // try usong different locale
+        conv_success = true;
+        wxString thousands_sep = CPLGetConfigOption("GDAL_LOCALE_SEPARATOR", "");
+        if (thousands_sep == ",") {
+            for (size_t i=0; i<n && conv_success; ++i) {
+                if (!used[i]) continue;
+                wxString tmp = dict[i];
+                tmp.Replace(thousands_sep, "");
+                if (!string_to_number(tmp, vals[i])) {
+                    conv_success = false;
+                    bad_val = tmp;
+                }
+            }
+        } else {
+            // try comma as decimal point
+            setlocale(LC_NUMERIC, "de_DE");
+            for (size_t i=0; i<n && conv_success; ++i) {
+                if (!used[i]) continue;
+                if (!string_to_number(dict[i], vals[i])) {
+                    conv_success = false;
+                    bad_val = dict[i];
+                }
+            }
+            setlocale(LC_NUMERIC, "C");
+        }
+        return conv_success;
+    }
+}
+
 OGRColumnString::OGRColumnString(wxString name, int field_length,
                                  int decimals, int n_rows)
 : OGRColumn(name, field_length, decimals, n_rows)
 {
     // a new in-memory string column
     is_new = true;
-    new_data.resize(rows);
-    undef_markers.resize(rows);
-    for (int i=0; i<rows; ++i) {
-        new_data[i] = wxEmptyString;
-        undef_markers[i] = false;
-    }
+    InitMemoryData();
 }
+
 OGRColumnString::OGRColumnString(OGRLayerProxy* ogr_layer, wxString name,
                                  int field_length, int decimals)
 : OGRColumn(ogr_layer, name, field_length, decimals)
 {
     // a new string column
     is_new = true;
-    new_data.resize(rows);
-    undef_markers.resize(rows);
-    for (int i=0; i<rows; ++i) {
-        new_data[i] = wxEmptyString;
-        undef_markers[i] = false;
-    }
+    InitMemoryData();
 }
 
 OGRColumnString::OGRColumnString(OGRLayerProxy* ogr_layer, int idx)
 :OGRColumn(ogr_layer, idx)
 {
-    // a string column from OGRLayer
+    // a string column from OGRLayer: each distinct string is converted to
+    // wxString once, rows only keep its position in the dictionary
     is_new = false;
+    codes.resize(rows);
     undef_markers.resize(rows);
+    map<std::string, int> raw_index;
     for (int i=0; i<rows; ++i) {
-        if ( ogr_layer->data[i]->IsFieldSet(idx) )
-            undef_markers[i] = false;
-        else
-            undef_markers[i] = true;
+        OGRFeature* feature = ogr_layer->data[i];
+        undef_markers[i] = !feature->IsFieldSet(idx);
+        std::string raw(feature->GetFieldAsString(idx));
+        map<std::string, int>::iterator it = raw_index.find(raw);
+        if (it == raw_index.end()) {
+            it = raw_index.insert(std::make_pair(raw, (int)dict.size())).first;
+            dict.push_back(wxString(raw.c_str()));
+        }
+        codes[i] = it->second;
+    }
+    for (size_t i=0; i<dict.size(); ++i) {
+        dict_index.insert(std::make_pair(dict[i], (int)i));
     }
 }
 
+OGRColumnString::OGRColumnString(wxString name, int field_length,
+                                 int decimals, vector<wxString>& data,
+                                 vector<bool>& undefs)
+: OGRColumn(name, field_length, decimals, data.size())
+{
+    is_new = true;
+    codes.resize(rows);
+    Reencode(data);
+    vector<wxString>().swap(data);
+    undef_markers.swap(undefs);
+    undef_markers.resize(rows, false);
+}
+
 OGRColumnString::~OGRColumnString()
 {
-    if (new_data.size() > 0 )
-        new_data.clear();
-    if (undef_markers.size() > 0)
-        undef_markers.clear();
+}
+
+void OGRColumnString::InitMemoryData()
+{
+    dict.clear();
+    dict_index.clear();
+    codes.resize(rows);
+    undef_markers.resize(rows);
+    int empty_code = Encode(wxEmptyString);
+    for (int i=0; i<rows; ++i) {
+        codes[i] = empty_code;
+        undef_markers[i] = false;
+    }
+}
+
+int OGRColumnString::Encode(const wxString& val)
+{
+    map<wxString, int>::iterator it = dict_index.find(val);
+    if (it != dict_index.end())
+        return it->second;
+    int code = (int)dict.size();
+    dict.push_back(val);
+    dict_index[val] = code;
+    return code;
+}
+
+void OGRColumnString::Reencode(const vector<wxString>& data)
+{
+    dict.clear();
+    dict_index.clear();
+    for (int i=0; i<rows; ++i) {
+        codes[i] = Encode(data[i]);
+    }
+}
+
+void OGRColumnString::GetUsedCodes(vector<bool>& used)
+{
+    // entries that are only referenced by undefined cells, or not at all
+    // after cells were edited, are never converted
+    used.assign(dict.size(), false);
+    for (int i=0; i<rows; ++i) {
+        if (!undef_markers[i]) used[codes[i]] = true;
+    }
 }
 
 // This column -> vector<double>
 void OGRColumnString::FillData(vector<double>& data)
 {
-    if (is_new) {
-        for (int i=0; i<rows; ++i) {
-            double val = 0.0;
-            if ( !new_data[i].ToDouble(&val) ) {
-                // internal is always local "C"
-                wxString error_msg = wxString::Format( "Fill data error: can't convert '%s' to floating-point number.", new_data[i]);
-                throw GdaException(error_msg.c_str());
-            }
-            data[i] = val;
-        }
-        
-    } else {
-        int col_idx = GetColIndex();
-        bool conv_success = true;
-        wxString tmp;
-        
-        // default C locale
-        for (int i=0; i<rows; ++i) {
-            if ( undef_markers[i] == true) {
-                data[i] = 0.0;
-                continue;
-            }
-            
-            tmp = wxString(ogr_layer->data[i]->GetFieldAsString(col_idx));
-            
-            double val;
-            if (tmp.IsEmpty()) {
-                data[i] = 0.0;
-            } else if (tmp.ToDouble(&val)) {
-                data[i] = val;
-            } else {
-                conv_success = false;
-                break;
-            }
-        }
-        
-        // try usong different locale
-        if (conv_success == false) {
-            conv_success = true;
-            // test if C thousands separator inside
-            wxString thousands_sep = CPLGetConfigOption("GDAL_LOCALE_SEPARATOR", "");
-            if (thousands_sep == ",") {
-                for (int i=0; i<rows; ++i) {
-                    if ( undef_markers[i] == true) {
-                        data[i] = 0.0;
-                        continue;
-                    }
-                    tmp = wxString(ogr_layer->data[i]->GetFieldAsString(col_idx));
-                    tmp.Replace(thousands_sep, "");
-                    double val;
-                    if (tmp.IsEmpty()) {
-                        data[i] = 0;
-                    } else if (tmp.ToDouble(&val)) {
-                        data[i] = val;
-                    } else {
-                        conv_success = false;
-                        break;
-                    }
-                }
-            } else {
-                // try comma as decimal point
-                setlocale(LC_NUMERIC, "de_DE");
-                for (int i=0; i<rows; ++i) {
-                    if ( undef_markers[i] == true) {
-                        data[i] = 0.0;
-                        continue;
-                    }
-                    tmp = wxString(ogr_layer->data[i]->GetFieldAsString(col_idx));
-                    double val;
-                    if (tmp.IsEmpty()) {
-                        data[i] = 0.0;
-                    } else if (tmp.ToDouble(&val)) {
-                        data[i] = val;
-                    } else {
-                        conv_success = false;
-                        break;
-                    }
-                }
-                setlocale(LC_NUMERIC, "C");
-            }
-        }
-        
-        if ( conv_success == false ) {
-            wxString error_msg = wxString::Format("Fill data error: can't convert '%s' to floating-point number.", tmp);
-            throw GdaException(error_msg.mb_str());
-        }
+    vector<bool> used;
+    GetUsedCodes(used);
+    vector<double> vals;
+    wxString bad_val;
+    if (!convert_dict(dict, used, vals, bad_val)) {
+        wxString error_msg = wxString::Format("Fill data error: can't convert '%s' to floating-point number.", bad_val);
+        throw GdaException(error_msg.mb_str());
+    }
+    data.resize(rows);
+    for (int i=0; i<rows; ++i) {
+        data[i] = undef_markers[i] ? 0.0 : vals[codes[i]];
     }
-    
 }
 
 // This column -> vector<wxInt64>
 void OGRColumnString::FillData(vector<wxInt64> &data)
 {
-    if (is_new) {
-        for (int i=0; i<rows; ++i) {
-            wxInt64 val = 0;
-            if (!new_data[i].ToLongLong(&val)) {
-                wxString error_msg = wxString::Format("Fill data error: can't convert '%s' to integer number.", new_data[i]);
-                throw GdaException(error_msg.mb_str());
-            }
-            data[i] = val;
-        }
-    } else {
-        int col_idx = GetColIndex();
-        bool conv_success = true;
-        wxString tmp;
-        
-        // default C locale
-        for (int i=0; i<rows; ++i) {
-            if ( undef_markers[i] == true) {
-                data[i] = 0;
-                continue;
-            }
-            
-            tmp = wxString(ogr_layer->data[i]->GetFieldAsString(col_idx));
-            wxInt64 val;
-            double val_d;
-            
-            if (tmp.IsEmpty()) {
-                data[i] = 0;
-                
-            } else if (tmp.ToLongLong(&val)) {
-                data[i] = val;
-                
-            } else if (tmp.ToDouble(&val_d)) {
-                val = static_cast<wxInt64>(val_d);
-                data[i] = val;
-                    
-            } else {
-                conv_success = false;
-                break;
-            }
-        }
-        
-        if (conv_success == false) {
-            conv_success = true;
-            // test if C thousands separator inside
-            wxString thousands_sep = CPLGetConfigOption("GDAL_LOCALE_SEPARATOR", "");
-            if (thousands_sep == ",") {
-                for (int i=0; i<rows; ++i) {
-                    if ( undef_markers[i] == true) {
-                        data[i] = 0;
-                        continue;
-                    }
-                    tmp = wxString(ogr_layer->data[i]->GetFieldAsString(col_idx));
-                    tmp.Replace(thousands_sep, "");
-                    wxInt64 val;
-                    double val_d;
-                    
-                    if (tmp.IsEmpty()) {
-                        data[i] = 0;
-                        
-                    } else if (tmp.ToLongLong(&val)) {
-                        data[i] = val;
-                        
-                    } else if (tmp.ToDouble(&val_d)) {
-                        val = static_cast<wxInt64>(val_d);
-                        data[i] = val;
-                        
-                    } else {
-                        conv_success = false;
-                        break;
-                    }
-                }
-            } else {
-                // try comma as decimal point
-                setlocale(LC_NUMERIC, "de_DE");
-                for (int i=0; i<rows; ++i) {
-                    if ( undef_markers[i] == true) {
-                        data[i] = 0;
-                        continue;
-                    }
-                    
-                    tmp = wxString(ogr_layer->data[i]->GetFieldAsString(col_idx));
-                    wxInt64 val;
-                    double val_d;
-                    if (tmp.IsEmpty()) {
-                        data[i] = 0;
-                        
-                    } else if (tmp.ToLongLong(&val)) {
-                        data[i] = val;
-                        
-                    } else if (tmp.ToDouble(&val_d)) {
-                        val = static_cast<wxInt64>(val_d);
-                        data[i] = val;
-                        
-                    } else {
-                        conv_success = false;
-                        break;
-                    }
-                }
-                setlocale(LC_NUMERIC, "C");
-            }
-        }
-        
-        if (conv_success == false ) {
-            wxString error_msg = wxString::Format("Fill data error: can't convert '%s' to numeric.", tmp);
-            throw GdaException(error_msg.mb_str());
-        }
+    vector<bool> used;
+    GetUsedCodes(used);
+    vector<wxInt64> vals;
+    wxString bad_val;
+    if (!convert_dict(dict, used, vals, bad_val)) {
+        wxString error_msg = wxString::Format("Fill data error: can't convert '%s' to numeric.", bad_val);
+        throw GdaException(error_msg.mb_str());
+    }
+    data.resize(rows);
+    for (int i=0; i<rows; ++i) {
+        data[i] = undef_markers[i] ? 0 : vals[codes[i]];
     }
 }
 
 // This column -> vector<wxString>
 void OGRColumnString::FillData(vector<wxString> &data)
 {
-    if (is_new) {
-        for (int i=0; i<rows; ++i) {
-            data[i] = new_data[i];
-        }
-    } else {
-        int col_idx = GetColIndex();
-        for (int i=0; i<rows; ++i) {
-            data[i] = wxString(ogr_layer->data[i]->GetFieldAsString(col_idx));
-        }
+    data.resize(rows);
+    for (int i=0; i<rows; ++i) {
+        data[i] = dict[codes[i]];
     }
 }
 
 // vector<wxString> -> this column
 void OGRColumnString::UpdateData(const vector<wxString>& data)
 {
-    if (is_new) {
-        for (int i=0; i<rows; ++i) {
-            new_data[i] = data[i];
-        }
-    } else {
+    Reencode(data);
+    if (!is_new) {
         int col_idx = GetColIndex();
         for (int i=0; i<rows; ++i) {
             ogr_layer->data[i]->SetField(col_idx, data[i].c_str());
@@ -939,38 +802,20 @@ void OGRColumnString::UpdateData(const vector<wxString>& data)
 
 void OGRColumnString::UpdateData(const vector<wxInt64>& data)
 {
-    if (is_new) {
-        for (int i=0; i<rows; ++i) {
-            wxString tmp;
-            tmp << data[i];
-            new_data[i] = tmp.c_str();
-        }
-    } else {
-        int col_idx = GetColIndex();
-        for (int i=0; i<rows; ++i) {
-            wxString tmp;
-            tmp << data[i];
-            ogr_layer->data[i]->SetField(col_idx, tmp.c_str());
-        }
+    vector<wxString> s_data(rows);
+    for (int i=0; i<rows; ++i) {
+        s_data[i] << data[i];
     }
+    UpdateData(s_data);
 }
 
 void OGRColumnString::UpdateData(const vector<double>& data)
 {
-    if (is_new) {
-        for (int i=0; i<rows; ++i) {
-            wxString tmp;
-            tmp << data[i];
-            new_data[i] = tmp.c_str();
-        }
-    } else {
-        int col_idx = GetColIndex();
-        for (int i=0; i<rows; ++i) {
-            wxString tmp;
-            tmp << data[i];
-            ogr_layer->data[i]->SetField(col_idx, tmp.c_str());
-        }
+    vector<wxString> s_data(rows);
+    for (int i=0; i<rows; ++i) {
+        s_data[i] << data[i];
     }
+    UpdateData(s_data);
 }
 
 // Fill a wxString value from a cell at position (row)
@@ -980,15 +825,7 @@ bool OGRColumnString::GetCellValue(int row, wxString& val)
         val = wxEmptyString;
         return false;
     }
-    
-    if (is_new) {
-        val = new_data[row];
-        
-    } else {
-        int col_idx = GetColIndex();
-        const char* val = ogr_layer->data[row]->GetFieldAsString(col_idx);
-        val = wxString(val);
-    }
+    val = dict[codes[row]];
     return true;
 }
 
@@ -998,21 +835,16 @@ wxString OGRColumnString::GetValueAt(int row_idx, int disp_decimals,
     if (undef_markers[row_idx] == true)
         return wxEmptyString;
     
-    if (is_new) {
-        return new_data[row_idx];
+    if (is_new || m_wx_encoding == NULL) {
+        return dict[codes[row_idx]];
     } else {
+        // the dictionary holds the strings in the default conversion, so
+        // other encodings are read from the feature
         int col_idx = GetColIndex();
         if (col_idx == -1)
             return wxEmptyString;
         const char* val = ogr_layer->data[row_idx]->GetFieldAsString(col_idx);
-        
-        wxString rtn;
-        if (m_wx_encoding == NULL)
-            rtn = wxString(val);
-        else
-            rtn = wxString(val,*m_wx_encoding);
-        
-        return rtn;
+        return wxString(val,*m_wx_encoding);
     }
 }
 
@@ -1023,12 +855,11 @@ void OGRColumnString::SetValueAt(int row_idx, const wxString &value)
         return;
     }
     
-    if (is_new) {
-        new_data[row_idx] = value;
-    } else {
+    if (!is_new) {
         int col_idx = GetColIndex();
         ogr_layer->data[row_idx]->SetField(col_idx, value.c_str());
     }
+    codes[row_idx] = Encode(value);
     undef_markers[row_idx] = false;
 }
 
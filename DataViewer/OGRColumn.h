@@ -57,7 +57,13 @@ public:
     // Get column index from loaded ogr_layer
     int GetColIndex();
     
-    vector<bool> GetUndefinedMarkers() { return undef_markers;}
+    const vector<bool>& GetUndefinedMarkers() { return undef_markers;}
+    
+    // Contiguous values of a numeric column (undefined cells hold 0), or NULL
+    // if the column has no storage of that type.  Valid until the column is
+    // updated or deleted.
+    virtual const double* GetDoubleSpan() { return NULL; }
+    virtual const wxInt64* GetInt64Span() { return NULL; }
     
     //  When SaveAs current datasource to a new datasource, the underneath OGRLayer will be replaced.
     void UpdateOGRLayer(OGRLayerProxy* new_ogr_layer);
@@ -133,8 +139,8 @@ public:
 class OGRColumnInteger : public OGRColumn
 {
 private:
-    vector<wxInt64> new_data;
-    void InitMemoryData();
+    // values of all rows, read from the OGR features once when loaded
+    vector<wxInt64> col_data;
     
 public:
     OGRColumnInteger(wxString name, int field_length, int decimals, int n_rows);
@@ -144,10 +150,18 @@ public:
     
     OGRColumnInteger(OGRLayerProxy* ogr_layer, int idx);
     
+    // In-memory column that takes over the contents of data and undefs,
+    // which are left empty.
+    OGRColumnInteger(wxString name, int field_length, int decimals,
+                     vector<wxInt64>& data, vector<bool>& undefs);
+    
     ~OGRColumnInteger();
     
     virtual GdaConst::FieldType GetType() {return GdaConst::long64_type;}
     
+    virtual const wxInt64* GetInt64Span()
+        { return col_data.empty() ? NULL : &col_data[0]; }
+    
     virtual void FillData(vector<double>& data);
     
     virtual void FillData(vector<wxInt64>& data);
@@ -174,8 +188,8 @@ public:
 class OGRColumnDouble : public OGRColumn
 {
 private:
-    vector<double> new_data;
-    void InitMemoryData();
+    // values of all rows, read from the OGR features once when loaded
+    vector<double> col_data;
     
 public:
     OGRColumnDouble(wxString name, int field_length, int decimals, int n_rows);
@@ -185,10 +199,18 @@ public:
     
     OGRColumnDouble(OGRLayerProxy* ogr_layer, int idx);
     
+    // In-memory column that takes over the contents of data and undefs,
+    // which are left empty.
+    OGRColumnDouble(wxString name, int field_length, int decimals,
+                    vector<double>& data, vector<bool>& undefs);
+    
     ~OGRColumnDouble();
     
     virtual GdaConst::FieldType GetType() {return GdaConst::double_type;}
     
+    virtual const double* GetDoubleSpan()
+        { return col_data.empty() ? NULL : &col_data[0]; }
+    
     virtual void FillData(vector<double>& data);
     
     virtual void FillData(vector<wxInt64>& data);
@@ -215,9 +237,15 @@ public:
 class OGRColumnString : public OGRColumn
 {
 private:
-    vector<wxString> new_data;
+    // dictionary encoded values: row i holds dict[codes[i]]
+    vector<int> codes;
+    vector<wxString> dict;
+    map<wxString, int> dict_index;
     
     void InitMemoryData();
+    int Encode(const wxString& val);
+    void Reencode(const vector<wxString>& data);
+    void GetUsedCodes(vector<bool>& used);
     
 public:
     OGRColumnString(wxString name, int field_length, int decimals, int n_rows);
@@ -227,6 +255,11 @@ public:
     
     OGRColumnString(OGRLayerProxy* ogr_layer, int idx);
     
+    // In-memory column that takes over the contents of data and undefs,
+    // which are left empty.
+    OGRColumnString(wxString name, int field_length, int decimals,
+                    vector<wxString>& data, vector<bool>& undefs);
+    
     ~OGRColumnString();
     
     virtual GdaConst::FieldType GetType() {return GdaConst::string_type;}
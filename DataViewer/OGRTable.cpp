@@ -40,6 +40,41 @@
 
 using namespace std;
 
+namespace {
+	// Min and max of the defined values in x[0..n-1], false if there are
+	// none.  Without undefined values the loop has no branches, so the
+	// compiler can vectorize it.
+	template <class T>
+	bool defined_min_max(const T* x, const vector<bool>& undefs, size_t n,
+						 double& min_val, double& max_val)
+	{
+		bool any_undef = (std::find(undefs.begin(), undefs.end(), true)
+						  != undefs.end());
+		size_t i = 0;
+		if (any_undef) {
+			while (i < n && undefs[i]) ++i;
+		}
+		if (i >= n) return false;
+		T mn = x[i];
+		T mx = x[i];
+		if (!any_undef) {
+			for (++i; i<n; ++i) {
+				mn = x[i] < mn ? x[i] : mn;
+				mx = x[i] > mx ? x[i] : mx;
+			}
+		} else {
+			for (++i; i<n; ++i) {
+				if (undefs[i]) continue;
+				if (x[i] < mn) mn = x[i];
+				if (x[i] > mx) mx = x[i];
+			}
+		}
+		min_val = (double) mn;
+		max_val = (double) mx;
+		return true;
+	}
+}
+
 OGRTable::OGRTable(int n_rows)
 : TableInterface(NULL, NULL)
 {
@@ -648,6 +683,11 @@ void OGRTable::GetColData(int col, GdaFlexValue& data)
 	for (size_t t=0; t<tms; ++t) {
 		if (ftr_c[t] != -1) {
             int col_idx = ftr_c[t];
+            const double* span = columns[col_idx]->GetDoubleSpan();
+            if (span != NULL) {
+                V[std::slice(t,rows,tms)] = std::valarray<double>(span, rows);
+                continue;
+            }
             std::vector<double> data(rows, quiet_nan);
             columns[col_idx]->FillData(data);
 			for (size_t i=0; i<rows; ++i) {
@@ -681,6 +721,11 @@ void OGRTable::GetColData(int col, d_array_type& data)
 	for (size_t t=0; t<tms; ++t) {
 		if (ftr_c[t] != -1) {
             int col_idx = ftr_c[t];
+            const double* span = columns[col_idx]->GetDoubleSpan();
+            if (span != NULL) {
+                std::copy(span, span + rows, data[t].begin());
+                continue;
+            }
             std::vector<double> d(rows, 0);
             columns[col_idx]->FillData(d);
 			for (size_t i=0; i<rows; ++i) {
@@ -710,6 +755,11 @@ void OGRTable::GetColData(int col, l_array_type& data)
 	for (size_t t=0; t<tms; ++t) {
 		if (ftr_c[t] != -1) {
             int col_idx = ftr_c[t];
+            const wxInt64* span = columns[col_idx]->GetInt64Span();
+            if (span != NULL) {
+                std::copy(span, span + rows, data[t].begin());
+                continue;
+            }
             std::vector<wxInt64> d(rows, 0);
             columns[col_idx]->FillData(d);
 			for (size_t i=0; i<rows; ++i) {
@@ -787,6 +837,30 @@ void OGRTable::GetColData(int col, int time, std::vector<wxString>& data)
     ogr_col->FillData(data);
 }
 
+bool OGRTable::GetColDataSpan(int col, int time, const double*& data,
+							  const std::vector<bool>*& undefs)
+{
+	OGRColumn* ogr_col = FindOGRColumn(col, time);
+	if (ogr_col == NULL) return false;
+	const double* span = ogr_col->GetDoubleSpan();
+	if (span == NULL) return false;
+	data = span;
+	undefs = &ogr_col->GetUndefinedMarkers();
+	return true;
+}
+
+bool OGRTable::GetColDataSpan(int col, int time, const wxInt64*& data,
+							  const std::vector<bool>*& undefs)
+{
+	OGRColumn* ogr_col = FindOGRColumn(col, time);
+	if (ogr_col == NULL) return false;
+	const wxInt64* span = ogr_col->GetInt64Span();
+	if (span == NULL) return false;
+	data = span;
+	undefs = &ogr_col->GetUndefinedMarkers();
+	return true;
+}
+
 bool OGRTable::GetColUndefined(int col, b_array_type& undefined)
 {
     if (col < 0 || col >= var_order.GetNumVarGroups())
@@ -813,7 +887,8 @@ bool OGRTable::GetColUndefined(int col, b_array_type& undefined)
     for (size_t t=0; t<tms; ++t) {
         if (ftr_c[t] != -1) {
             int col_idx = ftr_c[t];
-            std::vector<bool> markers = columns[col_idx]->GetUndefinedMarkers();
+            const std::vector<bool>& markers =
+                columns[col_idx]->GetUndefinedMarkers();
             for (size_t i=0; i<rows; ++i) {
                 undefined[t][i] = markers[i];
                 if (undefined[t][i])
@@ -859,7 +934,6 @@ void OGRTable::GetMinMaxVals(int col, vector<double>& min_vals,
 	if (!IsColNumeric(col)) return;
 	min_vals.clear();
 	max_vals.clear();
-	double tmp_min_val, tmp_max_val, tmp;
 	
 	VarGroup vg = var_order.FindVarGroup(col);
 	if (vg.IsEmpty()) return;
@@ -871,28 +945,22 @@ void OGRTable::GetMinMaxVals(int col, vector<double>& min_vals,
 	for (size_t t=0; t<times; ++t) {
 		int col_idx = vars[t].IsEmpty() ? -1 : FindOGRColId(vars[t]);
 		if (col_idx != -1) {
-            vector<double> data(rows, 0);
-            vector<bool> undef(rows, false);
-            columns[col_idx]->FillData(data, undef);
-            
-            bool has_init = false;
+            OGRColumn* ogr_col = columns[col_idx];
+            const vector<bool>& undef = ogr_col->GetUndefinedMarkers();
+            double tmp_min_val = 0;
+            double tmp_max_val = 0;
             
-			for (size_t i=0; i<rows; ++i) {
-                if (undef[i])
-                    continue;
-                
-				tmp = data[i];
-                
-                if (!has_init) {
-                    has_init = true;
-                    tmp_min_val = tmp;
-                    tmp_max_val = tmp;
-                    continue;
-                }
-                
-                if ( tmp_min_val > tmp ) tmp_min_val = tmp;
-                if ( tmp_max_val < tmp ) tmp_max_val = tmp;
-			}
+            // scan the column storage directly when there is one
+            if (const double* d_span = ogr_col->GetDoubleSpan()) {
+                defined_min_max(d_span, undef, rows, tmp_min_val, tmp_max_val);
+            } else if (const wxInt64* l_span = ogr_col->GetInt64Span()) {
+                defined_min_max(l_span, undef, rows, tmp_min_val, tmp_max_val);
+            } else if (rows > 0) {
+                vector<double> data(rows, 0);
+                ogr_col->FillData(data);
+                defined_min_max(&data[0], undef, rows,
+                                tmp_min_val, tmp_max_val);
+            }
             min_vals.push_back(tmp_min_val);
             max_vals.push_back(tmp_max_val);
 		}
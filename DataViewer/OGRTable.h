@@ -138,6 +138,10 @@ public:
 	virtual void GetColData(int col, int time, std::vector<double>& data);
 	virtual void GetColData(int col, int time, std::vector<wxInt64>& data);
 	virtual void GetColData(int col, int time, std::vector<wxString>& data);
+	virtual bool GetColDataSpan(int col, int time, const double*& data,
+								const std::vector<bool>*& undefs);
+	virtual bool GetColDataSpan(int col, int time, const wxInt64*& data,
+								const std::vector<bool>*& undefs);
 	virtual bool GetColUndefined(int col, b_array_type& undefined);
 	virtual bool GetColUndefined(int col, int time,
 								 std::vector<bool>& undefined);
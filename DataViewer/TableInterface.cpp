@@ -258,3 +258,15 @@ void TableInterface::GetColData(int col, int time, std::vector<wxString>& data,
     GetColData(col, time, data);
     GetColUndefined(col, time, undefs);
 }
+
+bool TableInterface::GetColDataSpan(int col, int time, const double*& data,
+									const std::vector<bool>*& undefs)
+{
+	return false;
+}
+
+bool TableInterface::GetColDataSpan(int col, int time, const wxInt64*& data,
+									const std::vector<bool>*& undefs)
+{
+	return false;
+}
@@ -155,6 +155,16 @@ public:
                             std::vector<bool>& undefs);
 	virtual void GetColData(int col, int time, std::vector<wxString>& data,
                             std::vector<bool>& undefs);
+
+	/** Read-only view of the values and undefined markers of a simple
+	 column without copying them.  Undefined values are 0.  The pointers
+	 stay valid until the column is changed, deleted or its type is
+	 changed.  Returns false if the table does not keep the column as a
+	 contiguous array of that type, use GetColData() then. */
+	virtual bool GetColDataSpan(int col, int time, const double*& data,
+								const std::vector<bool>*& undefs);
+	virtual bool GetColDataSpan(int col, int time, const wxInt64*& data,
+								const std::vector<bool>*& undefs);
     
 	virtual bool GetColUndefined(int col, b_array_type& undefined) = 0;
 	virtual bool GetColUndefined(int col, int time,
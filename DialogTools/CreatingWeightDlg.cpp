@@ -21,6 +21,7 @@
 #include <vector>
 #include <set>
 #include <string>
+#include <boost/bind.hpp>
 #include <wx/wx.h>
 #include <wx/filedlg.h>
 #include <wx/msgdlg.h>
@@ -31,7 +32,9 @@
 #include <wx/regex.h>
 #include "../FramesManager.h"
 #include "../ShapeOperations/PolysToContigWeights.h"
+#include "../ShapeOperations/CsrWeight.h"
 #include "../ShapeOperations/GalWeight.h"
+#include "../ShapeOperations/GwbWeight.h"
 #include "../ShapeOperations/VoronoiUtils.h"
 #include "../ShapeOperations/WeightUtils.h"
 #include "../Project.h"
@@ -96,6 +99,8 @@ m_cbx_precision_threshold_first_click(true),
 suspend_table_state_updates(false)
 {
     wxLogMessage("Open CreatingWeightDlg");
+	build_gal = 0;
+	build_gwt = 0;
 	Create(parent, id, caption, pos, size, style);
 	all_init = true;
 	frames_manager->registerObserver(this);
@@ -105,6 +110,9 @@ suspend_table_state_updates(false)
 
 CreatingWeightDlg::~CreatingWeightDlg()
 {
+	// the build writes to build_gal and build_gwt until it is joined
+	build_task.Stop();
+	FreeBuild();
 	frames_manager->removeObserver(this);
 	table_state->removeObserver(this);
 	w_man_state->removeObserver(this);
@@ -208,6 +216,7 @@ void CreatingWeightDlg::OnCreateNewIdClick( wxCommandEvent& event )
 void CreatingWeightDlg::OnCreateClick( wxCommandEvent& event )
 {
     wxLogMessage("Click CreatingWeightDlg::OnCreateClick");
+    if (build_task.IsRunning()) return;
     try {
         CreateWeights();
     } catch(GdaException e) {
@@ -254,6 +263,7 @@ void CreatingWeightDlg::CreateWeights()
 		defaultFile += ".gal";
 		wildcard = "GAL files (*.gal)|*.gal";
 	}
+	wildcard += "|GeoDa binary weights files (*.gwb)|*.gwb";
 	
 	wxFileDialog dlg(this,
                      _("Choose an output weights file name."),
@@ -283,8 +293,6 @@ void CreatingWeightDlg::CreateWeights()
 	int m_kNN = m_spinneigh->GetValue();
 	int m_alpha = 1;
 	
-	bool done = false;
-	
 	wxString str_X = m_X->GetString(m_X->GetSelection());
 	wxString str_Y = m_Y->GetString(m_Y->GetSelection());
 	if (m_X->GetSelection() < 0) {
@@ -299,10 +307,20 @@ void CreatingWeightDlg::CreateWeights()
 	
 	bool m_check1 = m_include_lower->GetValue();
 	
+	// everything the build reads is copied here, so that the dialog may
+	// change while the weights are computed in the background
+	build_radio = m_radio;
+	build_file = outputfile;
+	build_id = id;
+	build_order = m_ooC;
+	build_lower = m_check1;
+	build_gal = 0;
+	build_gwt = 0;
+	build_error = wxEmptyString;
+	
 	switch (m_radio) {
 		case THRESH:
 		{
-			GwtWeight* Wp = 0;
 			double t_val = m_threshold_val;
             if (t_val <= 0) {
                 t_val = std::numeric_limits<float>::min();
@@ -313,20 +331,10 @@ void CreatingWeightDlg::CreateWeights()
 				//t_val /= GenGeomAlgs::one_mi_in_km; // convert km to mi
 			}
             
-			if (t_val > 0) {
-				using namespace SpatialIndAlgs;
-				Wp = thresh_build(m_XCOO, m_YCOO, t_val * m_thres_delta_factor, m_is_arc, !m_arc_in_km);
-				if (!Wp || !Wp->gwt) {
-					wxString m = _("No weights file was created due to all observations being isolates for the specified threshold value. Increase the threshold to create a non-empty weights file.");
-					wxMessageDialog dlg(this, m, _("Error"), wxOK | wxICON_ERROR);
-					dlg.ShowModal();
-					return;
-				}
-				
-				WriteWeightFile(0, Wp->gwt, project->GetProjectTitle(), outputfile, id, wmi);
-				if (Wp) delete Wp;
-				done = true;
-			}
+			if (!(t_val > 0)) return;
+			build_thresh = t_val * m_thres_delta_factor;
+			build_is_arc = m_is_arc;
+			build_is_mi = !m_arc_in_km;
 		}
 			break;
 			
@@ -334,36 +342,31 @@ void CreatingWeightDlg::CreateWeights()
 		{
 			wmi.SetToKnn(id, dist_metric, dist_units, dist_units_str, dist_values, m_kNN, dist_var_1, dist_tm_1, dist_var_2, dist_tm_2);
             
-			if (m_kNN > 0 && m_kNN < m_num_obs) {
-				GwtWeight* Wp = 0;
-				Wp = SpatialIndAlgs::knn_build(m_XCOO, m_YCOO, m_kNN, dist_metric == WeightsMetaInfo::DM_arc, dist_units == WeightsMetaInfo::DU_mile);
-                
-				if (!Wp->gwt)
-                    return;
-                Wp->id_field = id;
-                
-				WriteWeightFile(0, Wp->gwt, project->GetProjectTitle(), outputfile, id, wmi);
-				if (Wp) delete Wp;
-				done = true;
-                
-			} else {
+			if (m_kNN <= 0 || m_kNN >= m_num_obs) {
 				wxString s = wxString::Format(_("Error: Maximum number of neighbors %d exceeded."), m_num_obs-1);
 				wxMessageBox(s);
+				return;
 			}
+			build_knn = m_kNN;
+			build_is_arc = dist_metric == WeightsMetaInfo::DM_arc;
+			build_is_mi = dist_units == WeightsMetaInfo::DU_mile;
 		}
 			break;
 			
 		case ROOK:
 		case QUEEN:
 		{
-			GalElement *gal = 0;
 			bool is_rook = (m_radio == ROOK);
 			if (is_rook) {
 				wmi.SetToRook(id, m_ooC, m_check1);
 			} else {
 				wmi.SetToQueen(id, m_ooC, m_check1);
 			}
+			build_precision = 0.0;
 			if (project->main_data.header.shape_type == Shapefile::POINT_TYP) {
+				// the Voronoi neighbors are cached by the project, so they
+				// are found here and only higher orders are left to the
+				// background
 				if (project->IsPointDuplicates()) {
 					project->DisplayPointDupsWarning();
 				}
@@ -374,87 +377,167 @@ void CreatingWeightDlg::CreateWeights()
 				} else {
 					project->GetVoronoiQueenNeighborMap(nbr_map);
 				}
-				gal = Gda::VoronoiUtils::NeighborMapToGal(nbr_map);
-				if (!gal) {
+				build_gal = Gda::VoronoiUtils::NeighborMapToGal(nbr_map);
+				if (!build_gal) {
 					wxString msg = _("There was a problem generating voronoi contiguity neighbors. Please report this.");
 					wxMessageDialog dlg(NULL, msg, _("Voronoi Contiguity Error"), wxOK | wxICON_ERROR);
 					dlg.ShowModal();
-					break;
+					return;
 				}
 			} else {
-				double precision_threshold = 0.0;
 				if ( m_cbx_precision_threshold->IsChecked()) {
 					if (!m_txt_precision_threshold->IsEmpty()) {
 						wxString prec_thres =
 						m_txt_precision_threshold->GetValue();
 						double value;
                         if ( prec_thres.ToDouble(&value) ) {
-							precision_threshold = value;
+							build_precision = value;
                         }
-					} else {
-						precision_threshold = 0.0;
 					}
 				}
-				gal = PolysToContigWeights(project->main_data, !is_rook, precision_threshold);
 			}
-		
-            bool empty_w = true;
-            bool has_island = false;
-            
-        	for (size_t i=0; i<m_num_obs; ++i) {
-                if (gal[i].Size() >0) {
-                    empty_w = false;
-                } else {
-                    has_island = true;
-                }
-            }
-            
-			if (empty_w) {
-				// could be an empty weights file, and should prompt user
-				// to setup Precision Threshold
-				wxString msg = _("None of your observations have neighbors. This could be related to digitizing problems, which can be fixed by adjusting the precision threshold.");
-				wxMessageDialog dlg(NULL, msg, "Empty Contiguity Weights", wxOK | wxICON_WARNING);
+		}
+			break;
+			
+		default:
+			return;
+	};
+	build_wmi = wmi;
+	if (m_radio == THRESH || m_radio == KNN) {
+		build_x = m_XCOO;
+		build_y = m_YCOO;
+	}
+	
+	build_task.Start(boost::bind(&CreatingWeightDlg::BuildWeights, this, _1),
+					 boost::bind(&CreatingWeightDlg::BuildWeightsDone, this,
+								 _1));
+	build_task.ShowProgress(this, _("Weights File Creation"),
+							_("Creating weights..."));
+}
+
+/** Computes the weights set up by CreateWeights.  Runs on a background
+ thread, so it only touches the build_* members and the shapes in
+ project->main_data, which do not change while a project is open. */
+bool CreatingWeightDlg::BuildWeights(const GdaCancelToken& token)
+{
+	try {
+		// the builders check token once per task and return 0 if it
+		// was cancelled, so closing the dialog does not wait long
+		if (build_radio == THRESH) {
+			build_gwt = SpatialIndAlgs::thresh_build(build_x, build_y,
+													 build_thresh,
+													 build_is_arc,
+													 build_is_mi, &token);
+		} else if (build_radio == KNN) {
+			build_gwt = SpatialIndAlgs::knn_build(build_x, build_y, build_knn,
+												  build_is_arc, build_is_mi,
+												  &token);
+		} else {
+			if (!build_gal) {
+				build_gal = PolysToContigWeights(project->main_data,
+												 build_radio == QUEEN,
+												 build_precision, &token);
+				if (!build_gal) return false;
+			}
+			build_empty = true;
+			build_has_island = false;
+			for (size_t i=0; i<m_num_obs; ++i) {
+				if (build_gal[i].Size() >0) {
+					build_empty = false;
+				} else {
+					build_has_island = true;
+				}
+			}
+			if (!build_empty && build_order > 1 && !token.IsCancelled()) {
+				Gda::MakeHigherOrdContiguity(build_order, m_num_obs, build_gal,
+											 build_lower, &token);
+			}
+		}
+	} catch (GdaException& e) {
+		build_error << e.what();
+	}
+	return !token.IsCancelled();
+}
+
+void CreatingWeightDlg::BuildWeightsDone(bool ok)
+{
+	if (!ok) {
+		FreeBuild();
+		return;
+	}
+	if (!build_error.IsEmpty()) {
+		wxMessageDialog dlg(this, build_error, _("Error"), wxOK | wxICON_ERROR);
+		dlg.ShowModal();
+		FreeBuild();
+		return;
+	}
+	try {
+		if (build_radio == THRESH) {
+			if (!build_gwt || !build_gwt->gwt) {
+				wxString m = _("No weights file was created due to all observations being isolates for the specified threshold value. Increase the threshold to create a non-empty weights file.");
+				wxMessageDialog dlg(this, m, _("Error"), wxOK | wxICON_ERROR);
 				dlg.ShowModal();
-				
-				m_cbx_precision_threshold->SetValue(true);
-				m_txt_precision_threshold->Enable(true);
-				// give a suggested value
-				double shp_min_x = (double)project->main_data.header.bbox_x_min;
-				double shp_max_x = (double)project->main_data.header.bbox_x_max;
-				double shp_min_y = (double)project->main_data.header.bbox_y_min;
-				double shp_max_y = (double)project->main_data.header.bbox_y_max;
-				double shp_x_len = shp_max_x - shp_min_x;
-				double shp_y_len = shp_max_y - shp_min_y;
-				double pixel_len = MIN(shp_x_len, shp_y_len) / 4096.0; // 4K LCD
-				double suggest_precision = pixel_len * 10E-7;
-				// round it to power of 10
-				suggest_precision = log10(suggest_precision);
-				suggest_precision = ceil(suggest_precision);
-				suggest_precision = pow(10, suggest_precision);
-				wxString tmpTxt;
-				tmpTxt << suggest_precision;
-				m_txt_precision_threshold->SetValue(tmpTxt);
-				break;
+			} else {
+				WriteWeightFile(0, build_gwt->gwt, project->GetProjectTitle(),
+								build_file, build_id, build_wmi);
+			}
+		} else if (build_radio == KNN) {
+			if (build_gwt && build_gwt->gwt) {
+				build_gwt->id_field = build_id;
+				WriteWeightFile(0, build_gwt->gwt, project->GetProjectTitle(),
+								build_file, build_id, build_wmi);
 			}
-            if (has_island) {
+		} else if (build_empty) {
+			// could be an empty weights file, and should prompt user
+			// to setup Precision Threshold
+			wxString msg = _("None of your observations have neighbors. This could be related to digitizing problems, which can be fixed by adjusting the precision threshold.");
+			wxMessageDialog dlg(NULL, msg, "Empty Contiguity Weights", wxOK | wxICON_WARNING);
+			dlg.ShowModal();
+			
+			m_cbx_precision_threshold->SetValue(true);
+			m_txt_precision_threshold->Enable(true);
+			// give a suggested value
+			double shp_min_x = (double)project->main_data.header.bbox_x_min;
+			double shp_max_x = (double)project->main_data.header.bbox_x_max;
+			double shp_min_y = (double)project->main_data.header.bbox_y_min;
+			double shp_max_y = (double)project->main_data.header.bbox_y_max;
+			double shp_x_len = shp_max_x - shp_min_x;
+			double shp_y_len = shp_max_y - shp_min_y;
+			double pixel_len = MIN(shp_x_len, shp_y_len) / 4096.0; // 4K LCD
+			double suggest_precision = pixel_len * 10E-7;
+			// round it to power of 10
+			suggest_precision = log10(suggest_precision);
+			suggest_precision = ceil(suggest_precision);
+			suggest_precision = pow(10, suggest_precision);
+			wxString tmpTxt;
+			tmpTxt << suggest_precision;
+			m_txt_precision_threshold->SetValue(tmpTxt);
+		} else {
+            if (build_has_island) {
                 wxString msg = _("There is at least one neighborless observation. Check the weights histogram and linked map to see if the islands are real or not. If not, adjust the distance threshold (points) or the precision threshold (polygons).");
                 wxMessageDialog dlg(NULL, msg, "Neighborless Observation", wxOK | wxICON_WARNING);
                 dlg.ShowModal();
             }
-			if (m_ooC > 1) {
-				Gda::MakeHigherOrdContiguity(m_ooC, m_num_obs, gal, m_check1);
-				WriteWeightFile(gal, 0, project->GetProjectTitle(), outputfile, id, wmi);
-			} else {
-				WriteWeightFile(gal, 0, project->GetProjectTitle(), outputfile, id, wmi);
-			}
-			if (gal) delete [] gal; gal = 0;
-			done = true;
+			WriteWeightFile(build_gal, 0, project->GetProjectTitle(),
+							build_file, build_id, build_wmi);
 		}
-			break;
-			
-		default:
-			break;
-	};
+	} catch(GdaException e) {
+		wxString msg;
+		msg << e.what();
+		wxMessageDialog dlg(this, msg , _("Error"), wxOK | wxICON_ERROR);
+		dlg.ShowModal();
+	}
+	FreeBuild();
+}
+
+void CreatingWeightDlg::FreeBuild()
+{
+	if (build_gal) delete [] build_gal;
+	build_gal = 0;
+	if (build_gwt) delete build_gwt;
+	build_gwt = 0;
+	build_x.clear();
+	build_y.clear();
 }
 
 void CreatingWeightDlg::OnPrecisionThresholdCheck( wxCommandEvent& event )
@@ -1166,7 +1249,22 @@ bool CreatingWeightDlg::WriteWeightFile(GalElement *gal, GwtElement *gwt,
     
     int col = table_int->FindColId(idd);
     
-	if (gal) { // gal
+	if (wxFileName(ofn).GetExt().Lower() == "gwb" && (gal || gwt)) {
+		CsrWeight* w = gal ? new CsrWeight(gal, m_num_obs)
+			: new CsrWeight(gwt, m_num_obs);
+        if (table_int->GetColType(col) == GdaConst::long64_type){
+            std::vector<wxInt64> id_vec(m_num_obs);
+            table_int->GetColData(col, 0, id_vec);
+            flag = Gda::SaveGwb(*w, gwt != 0, layer_name, ofn, idd, id_vec);
+            
+        } else if (table_int->GetColType(col) == GdaConst::string_type) {
+            std::vector<wxString> id_vec(m_num_obs);
+            table_int->GetColData(col, 0, id_vec);
+            flag = Gda::SaveGwb(*w, gwt != 0, layer_name, ofn, idd, id_vec);
+        }
+		delete w;
+		
+	} else if (gal) { // gal
         
         if (table_int->GetColType(col) == GdaConst::long64_type){
             std::vector<wxInt64> id_vec(m_num_obs);
@@ -1211,14 +1309,17 @@ bool CreatingWeightDlg::WriteWeightFile(GalElement *gal, GwtElement *gwt,
 		wxFileName t_ofn(ofn);
 		wxString ext = t_ofn.GetExt().Lower();
 		GalWeight* w = 0;
-		if (ext != "gal" && ext != "gwt") {
-			//LOG_MSG("File extention not gal or gwt");
+		if (ext != "gal" && ext != "gwt" && ext != "gwb") {
+			//LOG_MSG("File extention not gal, gwt or gwb");
 		} else {
 			GalElement* tempGal = 0;
+			CsrWeight* tempCsr = 0;
 			if (ext == "gal") {
 				tempGal=WeightUtils::ReadGal(ofn, table_int);
-			} else { // ext == "gwt"
+			} else if (ext == "gwt") {
 				tempGal=WeightUtils::ReadGwtAsGal(ofn, table_int);
+			} else { // ext == "gwb"
+				tempGal=WeightUtils::ReadGwbAsGal(ofn, table_int, &tempCsr);
 			}
 			if (tempGal != 0) {
 				w = new GalWeight();
@@ -1235,6 +1336,10 @@ bool CreatingWeightDlg::WriteWeightFile(GalElement *gal, GwtElement *gwt,
 				if (success) {
 					// deep copy of w
 					GalWeight* dcw = new GalWeight(*w);
+					if (tempCsr) {
+						dcw->SetCsr(tempCsr);
+						tempCsr = 0;
+					}
 					success = ((WeightsNewManager*) w_man_int)->AssociateGal(uid, dcw);
                     
 					if (success) {
@@ -1247,6 +1352,7 @@ bool CreatingWeightDlg::WriteWeightFile(GalElement *gal, GwtElement *gwt,
 					//GdaFrame::GetGdaFrame()->ShowConnectivityMapView(uid);
 				}
                 delete w;
+				if (tempCsr) delete tempCsr;
 			} else {
 				success = false;
 			}
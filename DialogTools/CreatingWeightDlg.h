@@ -29,6 +29,7 @@
 #include <wx/spinbutt.h>
 #include <wx/spinctrl.h>
 #include <wx/textctrl.h>
+#include "../GdaAsyncTask.h"
 #include "../FramesManagerObserver.h"
 #include "../DataViewer/TableStateObserver.h"
 #include "../ShapeOperations/WeightsManStateObserver.h"
@@ -38,6 +39,7 @@ class wxSpinButton;
 class FramesManager;
 class GalElement;
 class GwtElement;
+class GwtWeight;
 class Project;
 class TableInterface;
 class TableState;
@@ -182,10 +184,34 @@ private:
                          const wxString& idd,
                          const WeightsMetaInfo& wmi);
     void CreateWeights();
+	bool BuildWeights(const GdaCancelToken& token);
+	void BuildWeightsDone(bool ok);
+	void FreeBuild();
 	
 	wxString s_int;
 	bool suspend_table_state_updates;
 	
+	// set up by CreateWeights for the weights computed by build_task
+	RadioBtnId build_radio;
+	wxString build_file;
+	wxString build_id;
+	WeightsMetaInfo build_wmi;
+	std::vector<double> build_x;
+	std::vector<double> build_y;
+	bool build_is_arc;
+	bool build_is_mi;
+	double build_thresh;
+	int build_knn;
+	int build_order;
+	bool build_lower;
+	double build_precision;
+	GalElement* build_gal;
+	GwtWeight* build_gwt;
+	bool build_empty;
+	bool build_has_island;
+	wxString build_error;
+	GdaAsyncTask build_task;
+	
 	DECLARE_EVENT_TABLE()
 };
 
@@ -137,12 +137,17 @@ void FieldNewCalcLagDlg::Apply()
 		time_list[0] = tm;
 	}
 	
-	std::vector<double> data(table_int->GetNumberRows(), 0);
-	std::vector<bool> undefined(table_int->GetNumberRows(), false);
+	// read the variable in place when the table keeps it as a double
+	// array, otherwise (or when the result overwrites it) from a copy
+	bool in_place = (var_col != result_col);
+	std::vector<double> data_copy(table_int->GetNumberRows(), 0);
+	std::vector<bool> undefined_copy(table_int->GetNumberRows(), false);
+	const double* data = &data_copy[0];
+	const std::vector<bool>* undefined = &undefined_copy;
 	if (!IsAllTime(var_col, m_var_tm->GetSelection())) {
 		int tm = IsTimeVariant(var_col) ? m_var_tm->GetSelection() : 0;
-		table_int->GetColData(var_col, tm, data);
-		table_int->GetColUndefined(var_col, tm, undefined);
+		GetVarData(var_col, tm, in_place, data, undefined,
+				   data_copy, undefined_copy);
 	}
 	
 	int rows = table_int->GetNumberRows();
@@ -168,8 +173,8 @@ void FieldNewCalcLagDlg::Apply()
 			r_undefined[i] = false;
 		}
 		if (IsAllTime(var_col, m_var_tm->GetSelection())) {
-			table_int->GetColData(var_col, time_list[t], data);
-			table_int->GetColUndefined(var_col, time_list[t], undefined);
+			GetVarData(var_col, time_list[t], in_place, data, undefined,
+					   data_copy, undefined_copy);
 		}
 		// Row-standardized lag calculation.
 		for (int i=0, iend=table_int->GetNumberRows(); i<iend; i++) {
@@ -177,7 +182,7 @@ void FieldNewCalcLagDlg::Apply()
 			const GalElement& elm_i = W[i];
 			if (elm_i.Size() == 0) r_undefined[i] = true;
 			for (int j=0, sz=W[i].Size(); j<sz && !r_undefined[i]; j++) {
-				if (undefined[elm_i[j]]) {
+				if ((*undefined)[elm_i[j]]) {
 					r_undefined[i] = true;
 				} else {
 					lag += data[elm_i[j]];
@@ -274,6 +279,21 @@ bool FieldNewCalcLagDlg::IsTimeVariant(int col_id)
 	return (table_int->IsColTimeVariant(col_id));
 }
 
+void FieldNewCalcLagDlg::GetVarData(int col, int tm, bool in_place,
+									const double*& data,
+									const std::vector<bool>*& undefined,
+									std::vector<double>& data_copy,
+									std::vector<bool>& undefined_copy)
+{
+	if (in_place && table_int->GetColDataSpan(col, tm, data, undefined)) {
+		return;
+	}
+	table_int->GetColData(col, tm, data_copy);
+	table_int->GetColUndefined(col, tm, undefined_copy);
+	data = &data_copy[0];
+	undefined = &undefined_copy;
+}
+
 bool FieldNewCalcLagDlg::IsAllTime(int col_id, int tm_sel)
 {
 	if (!is_space_time) return false;
@@ -68,6 +68,10 @@ public:
 	
 	bool IsTimeVariant(int col_id);
 	bool IsAllTime(int col_id, int tm_sel);
+	void GetVarData(int col, int tm, bool in_place, const double*& data,
+					const std::vector<bool>*& undefined,
+					std::vector<double>& data_copy,
+					std::vector<bool>& undefined_copy);
 	void InitWeightsList();
 	boost::uuids::uuid GetWeightsId();
 	
@@ -18,6 +18,7 @@
  */
 
 #include <time.h>
+#include <boost/bind.hpp>
 #include <boost/foreach.hpp>
 #include <wx/wx.h>
 #include <wx/grid.h>
@@ -47,6 +48,7 @@
 #include "../Regression/PowerLag.h"
 #include "../Regression/mix.h"
 #include "../Regression/ML_im.h"
+#include "../Regression/LogJacobian.h"
 #include "../Regression/smile.h"
 #include "RegressionDlg.h"
 #include "RegressionReportDlg.h"
@@ -61,7 +63,8 @@ bool classicalRegression(GalElement *g,
                          bool InclConstant,
 						 bool m_moranz,
                          wxGauge* gauge,
-						 bool do_white_test);
+						 bool do_white_test,
+						 double w_trace = -1);
 
 bool spatialLagRegression(GalElement *g,
                           int num_obs,
@@ -71,7 +74,11 @@ bool spatialLagRegression(GalElement *g,
                           int deps,
                           DiagnosticReport *dr,
 						  bool InclConstant,
-                          wxGauge* p_bar = 0) ;
+                          wxGauge* p_bar = 0,
+						  LogJacobian::Method lj_method = LogJacobian::char_poly,
+						  bool lj_grid = false,
+						  const GdaCancelToken* token = 0,
+						  MLError* error = 0);
 
 bool spatialErrorRegression(GalElement *g,
                             int num_obs,
@@ -81,7 +88,15 @@ bool spatialErrorRegression(GalElement *g,
                             int deps,
 							DiagnosticReport *rr, 
 							bool InclConstant,
-                            wxGauge* p_bar = 0);
+                            wxGauge* p_bar = 0,
+							LogJacobian::Method lj_method = LogJacobian::char_poly,
+							bool lj_grid = false,
+							const GdaCancelToken* token = 0,
+							MLError* error = 0);
+
+// SimulationLag and SimulationError keep their state in the globals of
+// polym.h, so at most one ML estimation may run at a time across dialogs
+static bool ml_run_in_flight = false;
 
 BEGIN_EVENT_TABLE( RegressionDlg, wxDialog )
     EVT_BUTTON( XRCID("ID_RUN"), RegressionDlg::OnRunClick )
@@ -146,6 +161,13 @@ regReportDlg(0)
 	m_output1 = m_output2 = false;
 	b_done1 = b_done2 = b_done3 = false;
 	m_nCount = 0;
+	x = 0;
+	y = 0;
+	run_dr = 0;
+	run_gal = 0;
+	run_x_rows = 0;
+	run_ml_error = ml_no_error;
+	run_holds_ml = false;
 
 	m_output1 = false;
 	m_output2 = false;
@@ -161,6 +183,9 @@ regReportDlg(0)
 
 RegressionDlg::~RegressionDlg()
 {
+	// the run reads x, y and run_gal until it is joined
+	run_task.Stop();
+	FreeRun();
 	frames_manager->removeObserver(this);
 	table_state->removeObserver(this);
 	w_man_state->removeObserver(this);
@@ -191,6 +216,8 @@ bool RegressionDlg::Create(wxWindow* parent, wxWindowID id,
     m_gauge = NULL;
 	m_gauge_text = NULL;
 	m_white_test_cb = NULL;
+	m_log_jacobian_choice = NULL;
+	m_log_jacobian_grid_cb = NULL;
 
     SetParent(parent);
     CreateControls();
@@ -223,6 +250,12 @@ void RegressionDlg::CreateControls()
 	m_coef_var_matrix_cb = XRCCTRL(*this, "ID_COEF_VAR_MATRIX_CB", wxCheckBox);
 	m_white_test_cb = XRCCTRL(*this, "ID_WHITE_TEST_CB", wxCheckBox);
 	m_white_test_cb->SetValue(false);
+	m_log_jacobian_choice = XRCCTRL(*this, "ID_LOG_JACOBIAN_CHOICE", wxChoice);
+	m_log_jacobian_choice->SetSelection(0);
+	m_log_jacobian_choice->Enable(false);
+	m_log_jacobian_grid_cb = XRCCTRL(*this, "ID_LOG_JACOBIAN_GRID_CB", wxCheckBox);
+	m_log_jacobian_grid_cb->SetValue(false);
+	m_log_jacobian_grid_cb->Enable(false);
 	
 	m_gauge = XRCCTRL(*this, "IDC_GAUGE", wxGauge);
 	m_gauge->SetRange(200);
@@ -268,6 +301,7 @@ void RegressionDlg::OnSetupAutoModel(wxCommandEvent& event )
 void RegressionDlg::OnRunClick( wxCommandEvent& event )
 {
 	wxLogMessage("Click RegressionDlg::OnRunClick");
+	if (run_task.IsRunning()) return;
 
     m_gauge->Show();
 	UpdateMessageBox("calculating...");
@@ -419,6 +453,9 @@ void RegressionDlg::OnRunClick( wxCommandEvent& event )
 	
 	const int n = valid_obs;
 	bool do_white_test = m_white_test_cb->GetValue();
+	LogJacobian::Method lj_method =
+		(LogJacobian::Method) m_log_jacobian_choice->GetSelection();
+	bool lj_grid = m_log_jacobian_grid_cb->GetValue();
     if (m_constant_term) {
         if (RegressModel == 2) {
             wxString W_name = "W_" + m_Yname;
@@ -460,18 +497,38 @@ void RegressionDlg::OnRunClick( wxCommandEvent& event )
         }
     }
     
+	run_x_rows = sz + 1 + ix;
+	run_constant_term = m_constant_term;
+	run_weighted = m_WeightCheck;
+	run_white_test = do_white_test;
+	run_lj_method = lj_method;
+	run_lj_grid = lj_grid;
+	run_n = n;
+	run_nX = nX;
+	run_w_trace = -1;
+	run_w_name = wxEmptyString;
+	
 	if (m_WeightCheck) {
 		boost::uuids::uuid id = GetWeightsId();
-        GalElement* gal_weight = NULL;
         GalWeight* gw = w_man_int->GetGal(id);
         
+        // tr[(W'+W)*W] for the LM tests, -1 lets classicalRegression
+        // compute it for a weights subset
         if (valid_obs == m_obs) {
-    		gal_weight = gw ? gw->gal : NULL;
-            
-        } else {
-            // construct a new weights with only valid records
-            if (gw) {
-                gal_weight = new GalElement[valid_obs];
+            double tr_WW, tr_WtW;
+            if (gw && w_man_int->GetTraces(id, tr_WW, tr_WtW)) {
+                run_w_trace = tr_WtW + tr_WW;
+            }
+        }
+        
+        // the model is estimated in the background on a copy of the
+        // weights with only valid records, since the weights manager may
+        // drop gw in the meantime
+        if (gw) {
+            run_gal = new GalElement[valid_obs];
+            if (valid_obs == m_obs) {
+                for (int i=0; i<m_obs; i++) run_gal[i] = gw->gal[i];
+            } else {
                 int cnt = 0;
                 for (int i=0; i<m_obs; i++) {
                     if (!undefs[i]) {
@@ -484,7 +541,7 @@ void RegressionDlg::OnRunClick( wxCommandEvent& event )
                             if ( !undefs[nid] ) {
                                 double w = nbrs_w[j];
                                 int new_nid = orig_valid_map[nid];
-                                gal_weight[cnt].SetNbr(n_idx++, new_nid, w);
+                                run_gal[cnt].SetNbr(n_idx++, new_nid, w);
                             }
                         }
                         
@@ -493,6 +550,7 @@ void RegressionDlg::OnRunClick( wxCommandEvent& event )
                 }
             }
         }
+        run_num_obs = valid_obs;
 		
         bool isAuto = false;
         if (RegressModel == 4) {
@@ -502,13 +560,14 @@ void RegressionDlg::OnRunClick( wxCommandEvent& event )
 
             DiagnosticReport m_DR(n, nX, m_constant_term, true, 1);
             
-            if (gal_weight &&
-				!classicalRegression(gal_weight, valid_obs, y, n, x, nX, &m_DR,
+            if (run_gal &&
+				!classicalRegression(run_gal, valid_obs, y, n, x, nX, &m_DR,
 									 m_constant_term, true, m_gauge,
-									 do_white_test)) 
+									 do_white_test, run_w_trace)) 
             {
                 wxMessageBox(_("Error: the inverse matrix is ill-conditioned"));
                 m_OpenDump = false;
+                FreeRun();
                 OnCResetClick(event);
                 UpdateMessageBox("");
                 return;
@@ -553,11 +612,11 @@ void RegressionDlg::OnRunClick( wxCommandEvent& event )
                     RegressModel = 1;
                     if (HetFlag) {
                         // get White error variance
-                        do_white_test = true;
+                        run_white_test = true;
                         wxMessageBox(_("OLS Model with White test has been selected."));
                     } else {
                         // stick with original one
-                        do_white_test = false;
+                        run_white_test = false;
                         wxMessageBox(_("OLS Model has been selected."));
                     }
                 }
@@ -565,40 +624,16 @@ void RegressionDlg::OnRunClick( wxCommandEvent& event )
             m_DR.release_Var();
         }
         
-        
 		if (RegressModel == 1) {
             wxLogMessage("OLS model");
-			DiagnosticReport m_DR(n, nX, m_constant_term, true, RegressModel);
-			SetXVariableNames(&m_DR);
-			m_DR.SetMeanY(ComputeMean(y, n));
-			m_DR.SetSDevY(ComputeSdev(y, n));
-
-			if (gal_weight &&
-				!classicalRegression(gal_weight, valid_obs, y, n, x, nX, &m_DR,
-									 m_constant_term, true, m_gauge,
-									 do_white_test)) {
-				wxMessageBox(_("Error: the inverse matrix is ill-conditioned"));
-				m_OpenDump = false;
-				OnCResetClick(event);
-				UpdateMessageBox("");
-				return;
-			} else {
-				m_resid1= m_DR.GetResidual();
-				printAndShowClassicalResults(table_int->GetTableName(),
-											 w_man_int->GetLongDispName(id),
-											 &m_DR,
-											 n, nX, do_white_test);
-				m_yhat1 = m_DR.GetYHAT();
-				m_OpenDump = true;
-				m_Run = true;
-				b_done1 = false;
-			}
-
-			m_DR.release_Var();
-			gal_weight = NULL;
-
-		} else if (RegressModel == 2) {
-            wxLogMessage("Spatial Lag model");
+			run_dr = new DiagnosticReport(n, nX, m_constant_term, true,
+										  RegressModel);
+		} else if (RegressModel == 2 || RegressModel == 3) {
+            if (RegressModel == 2) {
+                wxLogMessage("Spatial Lag model");
+            } else {
+                wxLogMessage("Spatial Error model");
+            }
 			// Check for Symmetry first
 			WeightsMetaInfo::SymmetryEnum sym = w_man_int->IsSym(id);
 			if (sym == WeightsMetaInfo::SYM_unknown) {
@@ -612,150 +647,158 @@ void RegressionDlg::OnRunClick( wxCommandEvent& event )
 			}
 			if (sym != WeightsMetaInfo::SYM_symmetric) {
 				wxMessageBox(_("Only symmetric weights are supported for this operation, please choose a symmetric weights file. You can still choose Classic regression for non-symmetric weights."));
+				FreeRun();
 				UpdateMessageBox("");
 				return;
 			}
-			
-			DiagnosticReport m_DR(n, nX + 1, m_constant_term, true,
-								  RegressModel);
-			
-			SetXVariableNames(&m_DR);
-			m_DR.SetMeanY(ComputeMean(y, n));
-			m_DR.SetSDevY(ComputeSdev(y, n));
-
-			if (gal_weight && !spatialLagRegression(gal_weight, valid_obs,
-													y, n, x, nX, &m_DR, true,
-													m_gauge)) {
-				wxMessageBox(_("Error: the inverse matrix is ill-conditioned."));
-				m_OpenDump = false;
-				OnCResetClick(event);
-				UpdateMessageBox("");
-				return;
-			} else {
-				printAndShowLagResults(table_int->GetTableName(),
-									   w_man_int->GetLongDispName(id),
-									   &m_DR, n, nX);
-				m_yhat2 = m_DR.GetYHAT();
-				m_resid2= m_DR.GetResidual();
-				m_prederr2 = m_DR.GetPredError();
-				m_Run = true;
-				m_OpenDump = true;
-				b_done2 = false;
-			}
-			
-			m_DR.release_Var();
-			gal_weight = NULL;
-            
-		} else if (RegressModel == 3) {
-            wxLogMessage("Spatial Error model");
-			// Check for Symmetry first
-			WeightsMetaInfo::SymmetryEnum sym = w_man_int->IsSym(id);
-			if (sym == WeightsMetaInfo::SYM_unknown) {
-				ProgressDlg* p_dlg = new ProgressDlg(this, wxID_ANY,
-													 _("Weights Symmetry Check"));
-				p_dlg->Show();
-				p_dlg->StatusUpdate(0, _("Checking Symmetry..."));
-				sym = w_man_int->CheckSym(id, p_dlg);
-				p_dlg->StatusUpdate(1, "Finished");
-				p_dlg->Destroy();
-			}
-			if (sym != WeightsMetaInfo::SYM_symmetric) {
-				wxMessageBox(_("Only symmetric weights are supported for this operation, please choose a symmetric weights file. You can still choose Classic regression for non-symmetric weights."));
-				UpdateMessageBox("");
-				return;
-			}			
-			
-			// Error Model
-			DiagnosticReport m_DR(n, nX + 1, m_constant_term, true,
-								  RegressModel);
-			SetXVariableNames(&m_DR);
-			m_DR.SetMeanY(ComputeMean(y, n));
-			m_DR.SetSDevY(ComputeSdev(y, n));
-
-			if (gal_weight && !spatialErrorRegression(gal_weight, valid_obs,
-													  y, n, x, nX,
-													  &m_DR, true, m_gauge)) {
-				wxMessageBox(_("Error: the inverse matrix is ill-conditioned."));
-				m_OpenDump = false;
-				OnCResetClick(event);
-				UpdateMessageBox("");
-				return;
-			} else {
-	  			printAndShowErrorResults(table_int->GetTableName(),
-										 w_man_int->GetLongDispName(id),
-										 &m_DR, n, nX);
-				m_yhat3 = m_DR.GetYHAT();
-				m_resid3= m_DR.GetResidual();
-				m_prederr3 = m_DR.GetPredError();
-				m_Run = true;
-				m_OpenDump = true;
-				b_done3 = false;
-			}
-
-			m_DR.release_Var();
-			gal_weight = NULL;
-
+			run_dr = new DiagnosticReport(n, nX + 1, m_constant_term, true,
+										  RegressModel);
 		} else {
 			wxMessageBox(_("wrong model number"));
+			FreeRun();
 			UpdateMessageBox("");
 			return;
 		}
+		run_model = RegressModel;
+		run_w_name = w_man_int->GetLongDispName(id);
         
         if (isAuto)  {
             // reset regressModel after auto
             RegressModel = 4;
         }
         
-        
-        if (valid_obs == m_obs) {
-            delete[] gal_weight;
-        }
-        
 	} else {
-		DiagnosticReport m_DR(n, nX, m_constant_term, false, RegressModel);
-		SetXVariableNames(&m_DR);
-		m_DR.SetMeanY(ComputeMean(y, n));
-		m_DR.SetSDevY(ComputeSdev(y, n));
-
-		if (!classicalRegression((GalElement*)NULL, m_obs, y, n, x, nX, &m_DR, 
-								 m_constant_term, false, m_gauge,
-								 do_white_test)) {
-			wxMessageBox(_("Error: the inverse matrix is ill-conditioned."));
-			m_OpenDump = false;
-			OnCResetClick(event);
+		run_model = 1;
+		run_num_obs = m_obs;
+		run_dr = new DiagnosticReport(n, nX, m_constant_term, false,
+									  RegressModel);
+	}
+	SetXVariableNames(run_dr);
+	run_dr->SetMeanY(ComputeMean(y, n));
+	run_dr->SetSDevY(ComputeSdev(y, n));
+	
+	if (run_model != 1) {
+		if (ml_run_in_flight) {
+			wxMessageBox(_("Another spatial lag or spatial error model is being estimated. Please wait until it is done."));
+			FreeRun();
 			UpdateMessageBox("");
 			return;
-		} else {
-			printAndShowClassicalResults(table_int->GetTableName(),
-										 wxEmptyString, &m_DR, n, nX,
-										 do_white_test);
-			m_yhat1 = m_DR.GetYHAT();
-			m_resid1= m_DR.GetResidual();
-			m_OpenDump = true;
-			m_Run = true;
-			b_done1 = false;
 		}
-		m_DR.release_Var();
+		ml_run_in_flight = true;
+		run_holds_ml = true;
 	}
+	run_ml_error = ml_no_error;
+	run_task.Start(boost::bind(&RegressionDlg::EstimateRun, this, _1),
+				   boost::bind(&RegressionDlg::EstimateRunDone, this, _1));
+	run_task.ShowProgress(this, _("Regression"), _("Estimating the model..."));
+}
 
-	if (m_OpenDump) {
-		//GdaFrame::GetGdaFrame()->DisplayRegression(logReport);
-		DisplayRegression(logReport);
+/** Runs on a background thread, and only uses what OnRunClick set up for
+ the run.  The gauge is left alone, it belongs to the GUI thread. */
+bool RegressionDlg::EstimateRun(const GdaCancelToken& token)
+{
+	LogJacobian::Method lj_method = (LogJacobian::Method) run_lj_method;
+	if (!run_weighted) {
+		run_ok = classicalRegression((GalElement*)NULL, run_num_obs, y, run_n,
+									 x, run_nX, run_dr, run_constant_term,
+									 false, NULL, run_white_test);
+	} else if (!run_gal) {
+		run_ok = true;
+	} else if (run_model == 1) {
+		run_ok = classicalRegression(run_gal, run_num_obs, y, run_n, x,
+									 run_nX, run_dr, run_constant_term, true,
+									 NULL, run_white_test, run_w_trace);
+	} else if (run_model == 2) {
+		MLError ml_error = ml_no_error;
+		run_ok = spatialLagRegression(run_gal, run_num_obs, y, run_n, x,
+									  run_nX, run_dr, true, NULL, lj_method,
+									  run_lj_grid, &token, &ml_error);
+		run_ml_error = ml_error;
+	} else {
+		MLError ml_error = ml_no_error;
+		run_ok = spatialErrorRegression(run_gal, run_num_obs, y, run_n, x,
+										run_nX, run_dr, true, NULL, lj_method,
+										run_lj_grid, &token, &ml_error);
+		run_ml_error = ml_error;
 	}
+	return !token.IsCancelled();
+}
 
-    
-	for (int i = 0; i < sz + 1; i++) {
-        delete [] x[i];
-    }
-    delete[] x;
-    delete [] y;
-
-    
+void RegressionDlg::EstimateRunDone(bool ok)
+{
+	if (!ok) {
+		// cancelled, the results are dropped
+		FreeRun();
+		UpdateMessageBox("");
+		return;
+	}
+	if (!run_ok) {
+		if (run_ml_error == ml_eigen_error) {
+			wxMessageBox(_("Error: There was an error computing eigenvalues."));
+		} else {
+			wxMessageBox(_("Error: the inverse matrix is ill-conditioned."));
+		}
+		m_OpenDump = false;
+		FreeRun();
+		wxCommandEvent event;
+		OnCResetClick(event);
+		UpdateMessageBox("");
+		return;
+	}
+	
+	wxString tbl_name = table_int->GetTableName();
+	if (run_model == 1) {
+		m_resid1 = run_dr->GetResidual();
+		printAndShowClassicalResults(tbl_name, run_w_name, run_dr, run_n,
+									 run_nX, run_white_test);
+		m_yhat1 = run_dr->GetYHAT();
+		b_done1 = false;
+	} else if (run_model == 2) {
+		printAndShowLagResults(tbl_name, run_w_name, run_dr, run_n, run_nX);
+		m_yhat2 = run_dr->GetYHAT();
+		m_resid2 = run_dr->GetResidual();
+		m_prederr2 = run_dr->GetPredError();
+		b_done2 = false;
+	} else {
+		printAndShowErrorResults(tbl_name, run_w_name, run_dr, run_n, run_nX);
+		m_yhat3 = run_dr->GetYHAT();
+		m_resid3 = run_dr->GetResidual();
+		m_prederr3 = run_dr->GetPredError();
+		b_done3 = false;
+	}
+	m_OpenDump = true;
+	m_Run = true;
+	FreeRun();
+	
+	DisplayRegression(logReport);
 	EnablingItems();
-	//FindWindow(XRCID("ID_RUN"))->Enable(false);
 	UpdateMessageBox("done");
 }
 
+/** Frees what OnRunClick allocated for the last run, and lets the next
+ ML run start. */
+void RegressionDlg::FreeRun()
+{
+	if (run_holds_ml) {
+		ml_run_in_flight = false;
+		run_holds_ml = false;
+	}
+	if (run_dr) {
+		run_dr->release_Var();
+		delete run_dr;
+		run_dr = 0;
+	}
+	if (run_gal) delete [] run_gal;
+	run_gal = 0;
+	if (x) {
+		for (int i=0; i<run_x_rows; i++) delete [] x[i];
+		delete [] x;
+		x = 0;
+	}
+	if (y) delete [] y;
+	y = 0;
+}
+
 void RegressionDlg::DisplayRegression(wxString dump)
 {
     wxDateTime now = wxDateTime::Now();
@@ -907,6 +950,8 @@ void RegressionDlg::OnCResetClick( wxCommandEvent& event )
 	RegressModel = 1;
 	m_white_test_cb->SetValue(false);
 	m_white_test_cb->Enable(true);
+	m_log_jacobian_choice->Enable(false);
+	m_log_jacobian_grid_cb->Enable(false);
 	
 	m_gauge->SetValue(0);
 
@@ -1645,6 +1690,8 @@ void RegressionDlg::OnCRadio1Selected( wxCommandEvent& event )
 	RegressModel = 1;
 	UpdateMessageBox(" ");
     EnablingItems();
+	m_log_jacobian_choice->Enable(false);
+	m_log_jacobian_grid_cb->Enable(false);
 	m_white_test_cb->Enable(true);
 	m_gauge->SetValue(0);
 }
@@ -1657,6 +1704,8 @@ void RegressionDlg::OnCRadio2Selected( wxCommandEvent& event )
 	RegressModel = 2;
 	UpdateMessageBox(" ");
     EnablingItems();
+	m_log_jacobian_choice->Enable(true);
+	m_log_jacobian_grid_cb->Enable(true);
 	m_white_test_cb->Enable(false);
 	m_gauge->SetValue(0);
 }
@@ -1669,6 +1718,8 @@ void RegressionDlg::OnCRadio3Selected( wxCommandEvent& event )
 	RegressModel = 3;
 	UpdateMessageBox(" ");
     EnablingItems();
+	m_log_jacobian_choice->Enable(true);
+	m_log_jacobian_grid_cb->Enable(true);
 	m_white_test_cb->Enable(false);
 	m_gauge->SetValue(0);
 }
@@ -1681,6 +1732,8 @@ void RegressionDlg::OnCRadio4Selected( wxCommandEvent& event )
 	RegressModel = 4;
 	UpdateMessageBox(" ");
     EnablingItems();
+	m_log_jacobian_choice->Enable(true);
+	m_log_jacobian_grid_cb->Enable(true);
 	m_white_test_cb->Enable(false);
 	m_gauge->SetValue(0);
 }
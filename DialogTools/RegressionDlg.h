@@ -28,6 +28,7 @@
 #include <wx/radiobut.h>
 #include <wx/gauge.h>
 #include <wx/stattext.h>
+#include "../GdaAsyncTask.h"
 #include "../FramesManagerObserver.h"
 #include "../DataViewer/TableStateObserver.h"
 #include "../ShapeOperations/WeightsManStateObserver.h"
@@ -36,6 +37,7 @@
 class FramesManager;
 class TableState;
 class DiagnosticReport;
+class GalElement;
 class TableInterface;
 class Project;
 class WeightsManState;
@@ -127,6 +129,8 @@ public:
 	wxCheckBox* m_pred_val_cb;
 	wxCheckBox* m_coef_var_matrix_cb;
 	wxCheckBox* m_white_test_cb;
+	wxChoice* m_log_jacobian_choice;
+	wxCheckBox* m_log_jacobian_grid_cb;
 	int			lastSelection;
 	int			nVarName;
 	double		*m_resid1, *m_yhat1;
@@ -155,6 +159,10 @@ public:
 
 	void UpdateMessageBox(wxString msg);
 
+	bool EstimateRun(const GdaCancelToken& token);
+	void EstimateRunDone(bool ok);
+	void FreeRun();
+	
 	void SetXVariableNames(DiagnosticReport *dr);
 	void printAndShowClassicalResults(const wxString& datasetname,
 									  const wxString& wname,
@@ -189,6 +197,27 @@ private:
 	TableState* table_state;
 	WeightsManState* w_man_state;
 	WeightsManInterface* w_man_int;
+	
+	// set up by OnRunClick for the model estimated by run_task, which
+	// also reads x and y
+	DiagnosticReport* run_dr;
+	GalElement* run_gal; // copy of the weights restricted to valid obs
+	int run_x_rows;
+	int run_model;
+	int run_num_obs;
+	int run_n;
+	int run_nX;
+	bool run_constant_term;
+	bool run_weighted;
+	bool run_white_test;
+	double run_w_trace;
+	int run_lj_method;
+	bool run_lj_grid;
+	wxString run_w_name;
+	bool run_ok;
+	int run_ml_error; // MLError of a lag or error run
+	bool run_holds_ml; // this run set ml_run_in_flight
+	GdaAsyncTask run_task;
 };
 
 #endif
@@ -33,6 +33,7 @@
 #include "../Explore/ConnectivityHistView.h"
 #include "../Explore/ConnectivityMapView.h"
 #include "../HighlightState.h"
+#include "../ShapeOperations/CsrWeight.h"
 #include "../ShapeOperations/GalWeight.h"
 #include "../ShapeOperations/WeightsManState.h"
 #include "../ShapeOperations/WeightUtils.h"
@@ -217,14 +218,14 @@ void WeightsManFrame::OnCreateBtn(wxCommandEvent& ev)
 void WeightsManFrame::OnLoadBtn(wxCommandEvent& ev)
 {
 	wxFileDialog dlg( this, "Choose Weights File", "", "",
-					 "Weights Files (*.gal, *.gwt)|*.gal;*.gwt");
+					 "Weights Files (*.gal, *.gwt, *.gwb)|*.gal;*.gwt;*.gwb");
 	
     if (dlg.ShowModal() != wxID_OK) return;
 	wxString path  = dlg.GetPath();
 	wxString ext = GenUtils::GetFileExt(path).Lower();
 	
-	if (ext != "gal" && ext != "gwt") {
-		wxString msg("Only 'gal' and 'gwt' weights files supported.");
+	if (ext != "gal" && ext != "gwt" && ext != "gwb") {
+		wxString msg("Only 'gal', 'gwt' and 'gwb' weights files supported.");
 		wxMessageDialog dlg(this, msg, "Error", wxOK|wxICON_ERROR);
 		dlg.ShowModal();
 		return;
@@ -254,10 +255,13 @@ void WeightsManFrame::OnLoadBtn(wxCommandEvent& ev)
 
 	
 	GalElement* tempGal = 0;
+	CsrWeight* tempCsr = 0;
 	if (ext == "gal") {
 		tempGal = WeightUtils::ReadGal(path, table_int);
-	} else {
+	} else if (ext == "gwt") {
 		tempGal = WeightUtils::ReadGwtAsGal(path, table_int);
+	} else {
+		tempGal = WeightUtils::ReadGwbAsGal(path, table_int, &tempCsr);
 	}
 	if (tempGal == NULL) {
 		// WeightsUtils read functions already reported any issues
@@ -271,6 +275,8 @@ void WeightsManFrame::OnLoadBtn(wxCommandEvent& ev)
         wxString msg("There was a problem requesting the weights file.");
         wxMessageDialog dlg(this, msg, "Error", wxOK|wxICON_ERROR);
         dlg.ShowModal();
+        delete [] tempGal;
+        delete tempCsr;
         suspend_w_man_state_updates = false;
         return;
     }
@@ -280,6 +286,7 @@ void WeightsManFrame::OnLoadBtn(wxCommandEvent& ev)
 	gw->wflnm = wmi.filename;
     gw->id_field = id_field;
 	gw->gal = tempGal;
+	if (tempCsr) gw->SetCsr(tempCsr);
 
 	if (!((WeightsNewManager*) w_man_int)->AssociateGal(id, gw)) {
 		wxString msg("There was a problem associating the weights file.");
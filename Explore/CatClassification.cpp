@@ -20,17 +20,18 @@
 #include <iostream>
 #include <iomanip>
 #include <float.h>
-#include <set>
+#include <deque>
+#include <map>
+#include <string.h>
+#include <boost/bind.hpp>
 #include <boost/foreach.hpp>
-#include <boost/random.hpp>
-#include <boost/random/uniform_01.hpp>
-#include <boost/random/normal_distribution.hpp>
-#include <boost/random/uniform_int_distribution.hpp>
+#include <boost/thread/mutex.hpp>
 #include <wx/msgdlg.h>
 #include "../DataViewer/TableInterface.h"
 #include "../DialogTools/NumCategoriesDlg.h"
 #include "../logger.h"
 #include "../GdaConst.h"
+#include "../GdaThreadPool.h"
 #include "CatClassification.h"
 
 using namespace std;
@@ -68,65 +69,6 @@ void create_unique_val_mapping(std::vector<UniqueValElem>& uv_mapping,
 	}
 }
 
-/** Assume that b.size() <= N-1 */
-void pick_rand_breaks(std::vector<int>& b, int N)
-{
-	int num_breaks = b.size();
-	if (num_breaks > N-1) return;
-	// Mersenne Twister random number generator, randomly seeded
-	// with current time in seconds since Jan 1 1970.
-	static boost::mt19937 rng(std::time(0));
-	static boost::uniform_01<boost::mt19937> X(rng);
-	
-	std::set<int> s;
-	while (s.size() != num_breaks) s.insert(1 + (N-1)*X());
-	int cnt=0;
-	for (std::set<int>::iterator it=s.begin(); it != s.end(); it++) {
-		b[cnt++] = *it;
-	}
-	std::sort(b.begin(), b.end());
-}
-
-// translate unique value breaks into normal breaks given unique value mapping
-void unique_to_normal_breaks(const std::vector<int>& u_val_breaks,
-							 const std::vector<UniqueValElem>& u_val_mapping,
-							 std::vector<int>& n_breaks)
-{
-	if (n_breaks.size() != u_val_breaks.size()) {
-		n_breaks.resize(u_val_breaks.size());
-	}
-	for (int i=0, iend=u_val_breaks.size(); i<iend; i++) {
-		n_breaks[i] = u_val_mapping[u_val_breaks[i]].first;
-	}	
-}
-
-/** Assume input b and v is sorted.  If not, can sort
- with std::sort(v.begin(), v.end())
- We assume that b and v are sorted in ascending order and are
- valid (ie, no break indicies out of range and all categories
- have at least one value.
- gssd is the global sum of squared differences from the mean */
-double calc_gvf(const std::vector<int>& b, const std::vector<double>& v,
-				double gssd)
-{
-	int N = v.size();
-	int num_cats = b.size()+1;
-	double tssd=0; // total sum of local sums of squared differences
-	for (int i=0; i<num_cats; i++) {
-		int s = (i == 0) ? 0 : b[i-1];
-		int t = (i == num_cats-1) ? N : b[i];
-		
-		double m=0; // local mean
-		double ssd=0; // local sum of squared differences (variance)
-		for (int j=s; j<t; j++) m += v[j];
-		m /= ((double) t-s);
-		for (int j=s; j<t; j++) ssd += (v[j]-m)*(v[j]-m);
-		tssd += ssd;
-	}
-	
-	return 1-(tssd/gssd);
-}
-
 void CatClassification::CatLabelsFromBreaks(const std::vector<double>& breaks,
 											std::vector<wxString>& cat_labels,
                                             bool useScientificNotation)
@@ -1251,9 +1193,16 @@ bool CatClassification::CorrectCatClassifFromTable(CatClassifDef& _cc,
 		}
         
 	} else {
-		std::vector<double> v;
-		table_int->GetColData(col, tm, v);
-        table_int->GetColUndefined(col, tm, data_undef);
+		const double* v = NULL;
+		const std::vector<bool>* v_undef = NULL;
+		std::vector<double> v_copy;
+		if (table_int->GetColDataSpan(col, tm, v, v_undef)) {
+			data_undef = *v_undef;
+		} else {
+			table_int->GetColData(col, tm, v_copy);
+			table_int->GetColUndefined(col, tm, data_undef);
+			v = v_copy.empty() ? NULL : &v_copy[0];
+		}
 		for (int i=0; i<num_obs; ++i) {
 			data[i].first = v[i];
 			data[i].second = i;
@@ -1375,78 +1324,238 @@ bool CatClassification::CorrectCatClassifFromTable(CatClassifDef& _cc,
 	return changed;
 }
 
-void CatClassification::FindNaturalBreaks(int num_cats,
-                                          const Gda::dbl_int_pair_vec_type& var,
-                                          const std::vector<bool>& var_undef,
-                                          std::vector<double>& nat_breaks)
+namespace {
+
+/** Natural breaks already computed, keyed by two independent 64-bit
+ hashes of the defined sorted values and their count.  The breaks only
+ depend on those values, not on which column or time period they came
+ from, so an edited column simply gets a new key and the entry of the old
+ values is never hit again.  With two 64-bit hashes the chance that two
+ different value lists share a key is far below that of a hardware
+ error, so the values themselves are not kept for comparison. */
+struct NatBreaksKey {
+	uint64_t h1, h2;
+	int num_obs;
+	int num_cats;
+	bool operator<(const NatBreaksKey& k) const {
+		if (h1 != k.h1) return h1 < k.h1;
+		if (h2 != k.h2) return h2 < k.h2;
+		if (num_obs != k.num_obs) return num_obs < k.num_obs;
+		return num_cats < k.num_cats;
+	}
+};
+typedef std::map<NatBreaksKey, std::vector<double> > NatBreaksCache;
+
+// at most this many entries, the oldest one is dropped first
+const size_t nat_breaks_cache_max_size = 64;
+NatBreaksCache nat_breaks_cache;
+std::deque<NatBreaksKey> nat_breaks_cache_order;
+boost::mutex nat_breaks_cache_mutex;
+
+void nat_breaks_fingerprint(const std::vector<double>& x, NatBreaksKey& key)
 {
-	int num_obs = var.size();
-	std::vector<double> v(num_obs);
-	std::vector<bool> v_undef(num_obs);
-    
-    for (int i=0; i<num_obs; i++) {
-        v[i] = var[i].first;
-        int ind = var[i].second;
-        v_undef[i] = var_undef[ind];
-    }
-	// if there are fewer unique values than number of categories,
-	// we will automatically reduce the number of categories to the
-	// number of unique values.
+	uint64_t h1 = 14695981039346656037ULL;
+	uint64_t h2 = 0x9E3779B97F4A7C15ULL;
+	for (size_t i=0, n=x.size(); i<n; i++) {
+		uint64_t b;
+		memcpy(&b, &x[i], sizeof(b));
+		h1 = (h1 ^ b) * 1099511628211ULL;
+		h1 ^= h1 >> 29;
+		h2 = Gda::ThomasWangHashUInt64(h2 + b);
+	}
+	key.h1 = h1;
+	key.h2 = h2;
+}
+
+/**
+ Exact Fisher-Jenks optimization over the unique values u[0..m-1] with
+ counts w.  D[c][j], the smallest within-class sum of squared deviations
+ of the first j unique values in c classes, is the minimum over i of
+ D[c-1][i] + ssd(i,j), where ssd comes from prefix sums in O(1).  The
+ cost is a Monge matrix, so the best i never decreases with j and each
+ row is filled by divide and conquer with O(m log m) cost evaluations.
+ */
+class JenksSolver {
+public:
+	JenksSolver(const std::vector<double>& u, const std::vector<int>& w)
+	: m(u.size()), s0(m+1, 0), s1(m+1, 0), s2(m+1, 0)
+	{
+		// shift by the mean to limit cancellation in ssd()
+		double mean = 0, cnt = 0;
+		for (int i=0; i<m; i++) { mean += w[i]*u[i]; cnt += w[i]; }
+		mean /= cnt;
+		for (int i=0; i<m; i++) {
+			double y = u[i] - mean;
+			s0[i+1] = s0[i] + w[i];
+			s1[i+1] = s1[i] + w[i]*y;
+			s2[i+1] = s2[i] + w[i]*y*y;
+		}
+	}
 	
-	std::vector<UniqueValElem> uv_mapping;
-	create_unique_val_mapping(uv_mapping, v, v_undef);
-	int num_unique_vals = uv_mapping.size();
-	int t_cats = GenUtils::min<int>(num_unique_vals, num_cats);
+	/** Fills first with the indices of the first unique value of classes
+	 1 through k-1.  Requires 2 <= k <= m. */
+	void Solve(int k, std::vector<int>& first)
+	{
+		prev.resize(m+1);
+		cur.resize(m+1);
+		split.resize(k-1);
+		for (int j=1; j<=m; j++) prev[j] = ssd(0, j);
+		for (int c=2; c<=k; c++) {
+			std::vector<int>& sp = split[c-2];
+			sp.resize(m+1);
+			FillRow(c, m, c-1, m-1, sp);
+			prev.swap(cur);
+		}
+		first.resize(k-1);
+		int j = m;
+		for (int c=k; c>=2; c--) {
+			j = split[c-2][j];
+			first[c-2] = j;
+		}
+	}
 	
-	double mean = 0;
-    int valid_obs = 0;
-    for (int i=0; i<num_obs; i++) {
-        if (v_undef[i]) {
-            continue;
-        }
-        valid_obs += 1;
-        mean += v[i];
-    }
-	mean /= (double) valid_obs;
-    
-	double gssd = 0;
-    for (int i=0; i<num_obs; i++) {
-        if (v_undef[i]) {
-            continue;
-        }
-        gssd += (v[i]-mean)*(v[i]-mean);
-    }
+private:
+	double ssd(int i, int j) const {
+		double n = s0[j]-s0[i];
+		double s = s1[j]-s1[i];
+		double r = (s2[j]-s2[i]) - s*s/n;
+		return r > 0 ? r : 0;
+	}
 	
-	std::vector<int> rand_b(t_cats-1);
-	std::vector<int> best_breaks(t_cats-1);
-	std::vector<int> uv_rand_b(t_cats-1);
-	double max_gvf_found = 0;
-	int max_gvf_ind = 0;
-    
-	// for 5000 permutations, 2200 obs, and 4 time periods, slow enough
-	// make sure permutations is such that this total is not exceeded.
-	double c = 5000*2200*4;
-	int perms = c / ((double) num_obs);
-	if (perms < 10) perms = 10;
-	if (perms > 10000) perms = 10000;
+	/** cur[j] for j in [lo, hi], knowing the best split is in
+	 [opt_lo, opt_hi]. */
+	void FillRow(int lo, int hi, int opt_lo, int opt_hi, std::vector<int>& sp)
+	{
+		while (lo <= hi) {
+			int mid = lo + (hi-lo)/2;
+			int i_end = std::min(opt_hi, mid-1);
+			int best = opt_lo;
+			double best_v = prev[opt_lo] + ssd(opt_lo, mid);
+			for (int i=opt_lo+1; i<=i_end; i++) {
+				double v = prev[i] + ssd(i, mid);
+				if (v < best_v) { best_v = v; best = i; }
+			}
+			cur[mid] = best_v;
+			sp[mid] = best;
+			// recurse on the smaller half, loop on the other
+			if (mid-lo < hi-mid) {
+				FillRow(lo, mid-1, opt_lo, best, sp);
+				lo = mid+1;
+				opt_lo = best;
+			} else {
+				FillRow(mid+1, hi, best, opt_hi, sp);
+				hi = mid-1;
+				opt_hi = best;
+			}
+		}
+	}
+	
+	int m;
+	std::vector<double> s0, s1, s2;
+	std::vector<double> prev, cur;
+	std::vector<std::vector<int> > split;
+};
+
+/** Natural breaks of the sorted values x, all of them defined.  The
+ break values are the smallest values of classes 1 through k-1, where k
+ is num_cats or the number of unique values if that is smaller. */
+void calc_nat_breaks(const std::vector<double>& x, int num_cats,
+					 std::vector<double>& nat_breaks)
+{
+	nat_breaks.clear();
+	int n = x.size();
+	if (n == 0 || num_cats < 2) return;
+	
+	NatBreaksKey key;
+	nat_breaks_fingerprint(x, key);
+	key.num_obs = n;
+	key.num_cats = num_cats;
+	{
+		boost::mutex::scoped_lock lock(nat_breaks_cache_mutex);
+		NatBreaksCache::const_iterator it = nat_breaks_cache.find(key);
+		if (it != nat_breaks_cache.end()) {
+			nat_breaks = it->second;
+			return;
+		}
+	}
 	
-	for (int i=0; i<perms; i++) {
-		pick_rand_breaks(uv_rand_b, num_unique_vals);
-		// translate uv_rand_b into normal breaks
-		unique_to_normal_breaks(uv_rand_b, uv_mapping, rand_b);
-		double new_gvf = calc_gvf(rand_b, v, gssd);
-		if (new_gvf > max_gvf_found) {
-			max_gvf_found = new_gvf;
-			max_gvf_ind = i;
-			best_breaks = rand_b;
+	// unique values and their counts
+	std::vector<double> u;
+	std::vector<int> w;
+	for (int i=0; i<n; i++) {
+		if (u.empty() || u.back() != x[i]) {
+			u.push_back(x[i]);
+			w.push_back(1);
+		} else {
+			w.back()++;
 		}
 	}
-    
-	nat_breaks.resize(best_breaks.size());
-	for (int i=0, iend=best_breaks.size(); i<iend; i++) {
-		nat_breaks[i] = var[best_breaks[i]].first;
+	
+	int m = u.size();
+	int k = GenUtils::min<int>(m, num_cats);
+	if (k > 1) {
+		std::vector<int> first;
+		JenksSolver solver(u, w);
+		solver.Solve(k, first);
+		nat_breaks.resize(k-1);
+		for (int c=0; c<k-1; c++) nat_breaks[c] = u[first[c]];
+	}
+	
+	boost::mutex::scoped_lock lock(nat_breaks_cache_mutex);
+	// another thread may have added the same values meanwhile
+	if (nat_breaks_cache.find(key) != nat_breaks_cache.end()) return;
+	if (nat_breaks_cache_order.size() >= nat_breaks_cache_max_size) {
+		nat_breaks_cache.erase(nat_breaks_cache_order.front());
+		nat_breaks_cache_order.pop_front();
+	}
+	nat_breaks_cache[key] = nat_breaks;
+	nat_breaks_cache_order.push_back(key);
+}
+
+void defined_sorted_vals(const Gda::dbl_int_pair_vec_type& var,
+						 const std::vector<bool>& var_undef,
+						 std::vector<double>& x)
+{
+	x.clear();
+	x.reserve(var.size());
+	for (size_t i=0, n=var.size(); i<n; i++) {
+		if (!var_undef[var[i].second]) x.push_back(var[i].first);
+	}
+}
+
+void nat_breaks_range(int num_cats,
+					  const std::vector<Gda::dbl_int_pair_vec_type>* var,
+					  const std::vector<std::vector<bool> >* var_undef,
+					  const std::vector<bool>* cats_valid,
+					  std::vector<std::vector<double> >* breaks,
+					  int t_start, int t_end)
+{
+	std::vector<double> x;
+	for (int t=t_start; t<=t_end; t++) {
+		if (!(*cats_valid)[t]) continue;
+		defined_sorted_vals((*var)[t], (*var_undef)[t], x);
+		calc_nat_breaks(x, num_cats, (*breaks)[t]);
 	}
 }
+
+} // anonymous namespace
+
+void CatClassification::FindNaturalBreaks(int num_cats,
+                                          const Gda::dbl_int_pair_vec_type& var,
+                                          const std::vector<bool>& var_undef,
+                                          std::vector<double>& nat_breaks)
+{
+	std::vector<double> x;
+	defined_sorted_vals(var, var_undef, x);
+	calc_nat_breaks(x, num_cats, nat_breaks);
+}
+
+void CatClassification::ClearNaturalBreaksCache()
+{
+	boost::mutex::scoped_lock lock(nat_breaks_cache_mutex);
+	nat_breaks_cache.clear();
+	nat_breaks_cache_order.clear();
+}
 	
 void
 CatClassification::
@@ -1462,105 +1571,58 @@ SetNaturalBreaksCats(int num_cats,
 	// user supplied number of categories
 	cat_data.CreateEmptyCategories(num_time_vals, num_obs);
     
-	// if there are fewer unique values than number of categories,
-	// we will automatically reduce the number of categories to the
-	// number of unique values.
-
-    std::vector<int> undef_cnts_tms(num_time_vals, 0);
-    for (int t=0; t<num_time_vals; t++) {
-        for (int i=0; i<var_undef[t].size(); i++) {
-            if (var_undef[t][i]) {
-                undef_cnts_tms[t] += 1;
-            }
-        }
-    }
+	// breaks of all time periods first, these are independent
+	std::vector<std::vector<double> > breaks(num_time_vals);
+	GdaThreadPool::GetInstance()->ParallelFor(0, num_time_vals-1, 1,
+		boost::bind(nat_breaks_range, num_cats, &var, &var_undef,
+					&cats_valid, &breaks, _1, _2));
     
 	for (int t=0; t<num_time_vals; t++) {
-        std::vector<double> v(num_obs);
-        
-        for (int i=0; i<num_obs; i++) {
-            double val = var[t][i].first;
-            int ind = var[t][i].second;
-            v[ind] = val;
-        }
-        
 		if (!cats_valid[t])
             continue;
         
-		std::vector<UniqueValElem> uv_mapping;
-		create_unique_val_mapping(uv_mapping, v, var_undef[t]);
-        
-		int num_unique_vals = uv_mapping.size();
-		int t_cats = GenUtils::min<int>(num_unique_vals, num_cats);
-		
-		double mean = 0;
-        int valid_obs = 0;
-        for (int i=0; i<num_obs; i++) {
-            double val = var[t][i].first;
-            int ind = var[t][i].second;
-            if (var_undef[t][ind])
-                continue;
-            mean += val;
-            valid_obs += 1;
-        }
-		mean /= (double) valid_obs;
-        
-		double gssd = 0;
-        for (int i=0; i<num_obs; i++) {
-            double val = var[t][i].first;
-            int ind = var[t][i].second;
-            if (var_undef[t][ind])
-                continue;
-            gssd += (val-mean)*(val-mean);
-        }
-		
-		std::vector<int> rand_b(t_cats-1);
-		std::vector<int> best_breaks(t_cats-1);
-		std::vector<int> uv_rand_b(t_cats-1);
-        
-		double max_gvf_found = 0;
-		int max_gvf_ind = 0;
-        
-		// for 5000 permutations, 2200 obs, and 4 time periods, slow enough
-		// make sure permutations is such that this total is not exceeded.
-		double c = 5000*2200*4;
-		int perms = c / ((double) num_time_vals * (double) valid_obs);
-		if (perms < 10) perms = 10;
-		if (perms > 10000) perms = 10000;
-		
-		for (int i=0; i<perms; i++) {
-			pick_rand_breaks(uv_rand_b, num_unique_vals);
-			// translate uv_rand_b into normal breaks
-			unique_to_normal_breaks(uv_rand_b, uv_mapping, rand_b);
-			double new_gvf = calc_gvf(rand_b, v, gssd);
-			if (new_gvf > max_gvf_found) {
-				max_gvf_found = new_gvf;
-				max_gvf_ind = i;
-				best_breaks = rand_b;
-			}
+		// if there are fewer unique values than number of categories,
+		// the number of categories is reduced to the number of unique values.
+		const std::vector<double>& b = breaks[t];
+		int t_cats = b.size()+1;
+		int undef_cnt = 0;
+		for (int i=0; i<num_obs; i++) {
+			if (var_undef[t][i]) undef_cnt += 1;
 		}
 		
 		cat_data.SetCategoryBrushesAtCanvasTm(coltype, t_cats, false, t);
         
-        if (undef_cnts_tms[t]>0)
-            cat_data.AppendUndefCategory(t, undef_cnts_tms[t]);
+        if (undef_cnt>0)
+            cat_data.AppendUndefCategory(t, undef_cnt);
 		
-		for (int i=0, nb=best_breaks.size(); i<=nb; i++) {
-			int ss = (i == 0) ? 0 : best_breaks[i-1];
-			int tt = (i == nb) ? v.size() : best_breaks[i];
-			for (int j=ss; j<tt; j++) {
-                double val = var[t][j].first;
-                int ind = var[t][j].second;
-                int c = var_undef[t][ind] ? i : t_cats;
-				cat_data.AppendIdToCategory(t, c, ind);
+		std::vector<double> cat_min(t_cats), cat_max(t_cats);
+		std::vector<bool> cat_init(t_cats, false);
+		int c = 0;
+		for (int j=0; j<num_obs; j++) {
+			double val = var[t][j].first;
+			int ind = var[t][j].second;
+			if (var_undef[t][ind]) {
+				cat_data.AppendIdToCategory(t, t_cats, ind);
+				continue;
+			}
+			while (c < t_cats-1 && val >= b[c]) c++;
+			cat_data.AppendIdToCategory(t, c, ind);
+			if (!cat_init[c]) {
+				cat_min[c] = val;
+				cat_init[c] = true;
 			}
+			cat_max[c] = val;
+		}
+		
+		for (int i=0; i<t_cats; i++) {
+			if (!cat_init[i])
+				continue;
 			wxString l;
-			l << "[" << GenUtils::DblToStr(var[t][ss].first);
-			l << ":" << GenUtils::DblToStr(var[t][tt-1].first) << "]";
+			l << "[" << GenUtils::DblToStr(cat_min[i]);
+			l << ":" << GenUtils::DblToStr(cat_max[i]) << "]";
 			cat_data.SetCategoryLabel(t, i, l);
 			cat_data.SetCategoryCount(t, i, cat_data.GetNumObsInCategory(t, i));
-			cat_data.SetCategoryMinMax(t, i, var[t][ss].first,
-									   var[t][tt-1].first);
+			cat_data.SetCategoryMinMax(t, i, cat_min[i], cat_max[i]);
 		}
 	}
 }
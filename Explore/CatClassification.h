@@ -75,17 +75,27 @@ namespace CatClassification {
 	bool CorrectCatClassifFromTable(CatClassifDef& cc,
 									TableInterface* table_int);
 	
+	/** Exact Fisher-Jenks natural breaks of the defined values of var,
+	 which must be sorted.  nat_breaks gets the smallest value of every
+	 category but the first, and has fewer than num_cats-1 entries if
+	 there are fewer unique values than categories.  Results are memoized
+	 by the values themselves, see ClearNaturalBreaksCache(). */
 	void FindNaturalBreaks(int num_cats,
 						   const Gda::dbl_int_pair_vec_type& var,
                            const std::vector<bool>& var_undef,
 						   std::vector<double>& nat_breaks);
     
+	/** FindNaturalBreaks for every valid time period, then fills
+	 cat_data with the categories. */
     void SetNaturalBreaksCats(int num_cats,
                               const std::vector<Gda::dbl_int_pair_vec_type>& var,
                               const std::vector<std::vector<bool> >& var_undef,
                               CatClassifData& cat_data, std::vector<bool>& cats_valid,
                               ColorScheme coltype=CatClassification::sequential_color_scheme);
 	
+	/** Forget all memoized natural breaks. */
+	void ClearNaturalBreaksCache();
+	
 	ColorScheme GetColSchmForType(CatClassifType theme_type);
 	
 	wxString CatClassifTypeToString(CatClassifType theme_type);
@@ -721,6 +721,7 @@ void ConditionalMapCanvas::DrawLayer0()
 	}
     
     DrawSelectableShapes(dc);
+	sel_index_dirty = true;
 	
 	layer0_valid = true;
 	layer1_valid = false;
@@ -752,7 +753,7 @@ void ConditionalMapCanvas::PopulateCanvas()
 
 	if (map_valid[canvas_ts]) {
 		if (full_map_redraw_needed) {
-			CreateSelShpsFromProj(selectable_shps, project);
+			CreateSelShpsFromProj(selectable_shps, project, &sel_screen_pts);
 			BOOST_FOREACH( GdaShape* shp, selectable_shps ) {
 				shp->setPen(bin_bg_map_pen);
 				shp->setBrush(bin_bg_map_brush);
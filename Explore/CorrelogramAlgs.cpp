@@ -17,17 +17,18 @@
  * along with this program.  If not, see <http://www.gnu.org/licenses/>.
  */
 
+#include <algorithm>
 #include <list>
 #include <map>
 #include <set>
+#include <math.h>
+#include <boost/bind.hpp>
 #include <boost/foreach.hpp>
-#include <boost/random.hpp>
-#include <boost/random/uniform_01.hpp>
-#include <boost/random/normal_distribution.hpp>
-#include <boost/random/uniform_int_distribution.hpp>
 #include <wx/stopwatch.h>
 #include "../SpatialIndAlgs.h"
+#include "../GdaThreadPool.h"
 #include "../GenGeomAlgs.h"
+#include "../GenUtils.h"
 #include "../PointSetAlgs.h"
 #include "../logger.h"
 #include "CorrelogramAlgs.h"
@@ -64,31 +65,261 @@ void CorrelogramAlgs::GetSampMeanAndVar(const std::vector<double>& Z_,
 	var = smpl_var;
 }
 
+namespace {
+	/** Observations with defined Z, prepared for distance binning.  Planar
+	 points are kept as x,y and arc points as unit vectors x,y,z, in
+	 separate arrays.  Pairs are binned by their squared straight line
+	 distance, which for arc points is the squared chord through the unit
+	 sphere.  Both are monotone in the distance, so with the bin edges
+	 converted the same way no sqrt or haversine is needed per pair. */
+	struct PairBinner {
+		PairBinner(const std::vector<wxRealPoint>& pts,
+				   const std::vector<double>& Z,
+				   const std::vector<bool>& Z_undef,
+				   bool is_arc, bool calc_prods,
+				   double mean, double var);
+		
+		/** Bins of width binw, in radians for arc points. */
+		void SetBins(double binw, int num_bins);
+		
+		/** Bin of squared distance q, num_bins if q is beyond the last
+		 edge and -1 if q is NaN. */
+		int Bin(double q) const {
+			if (!(q < q_edge[num_bins])) return (q >= 0) ? num_bins : -1;
+			int b = lut[(int) (q*lut_scale)];
+			while (q >= q_edge[b+1]) ++b;
+			return b;
+		}
+		
+		/** q[k] = squared distance of i and j0+k for k < len.  A loop
+		 without branches or calls that the compiler can vectorize. */
+		void SqDists(int i, int j0, int len, double* q) const {
+			const double* xs = &x[j0];
+			const double* ys = &y[j0];
+			double xi = x[i], yi = y[i];
+			if (is_arc) {
+				const double* zs = &z[j0];
+				double zi = z[i];
+				for (int k=0; k<len; ++k) {
+					double dx = xs[k]-xi;
+					double dy = ys[k]-yi;
+					double dz = zs[k]-zi;
+					q[k] = dx*dx + dy*dy + dz*dz;
+				}
+			} else {
+				for (int k=0; k<len; ++k) {
+					double dx = xs[k]-xi;
+					double dy = ys[k]-yi;
+					q[k] = dx*dx + dy*dy;
+				}
+			}
+		}
+		
+		double SqDist(int i, int j) const {
+			double dx = x[j]-x[i], dy = y[j]-y[i];
+			double dz = is_arc ? z[j]-z[i] : 0;
+			return dx*dx + dy*dy + dz*dz;
+		}
+		
+		int n; // number of defined observations
+		bool is_arc;
+		std::vector<wxRealPoint> pts; // input points of defined observations
+		std::vector<double> x, y, z;
+		std::vector<double> zs; // standardized Z, empty if !calc_prods
+		int num_bins;
+		std::vector<double> q_edge; // num_bins+1 squared bin edges
+		// lut[t] is the bin of squared distance t/lut_scale or a bin
+		// before it, so Bin() only has to walk forward
+		std::vector<int> lut;
+		double lut_scale;
+	};
+	
+	PairBinner::PairBinner(const std::vector<wxRealPoint>& pts_,
+						   const std::vector<double>& Z,
+						   const std::vector<bool>& Z_undef,
+						   bool is_arc_, bool calc_prods,
+						   double mean, double var)
+	: n(0), is_arc(is_arc_), num_bins(0), lut_scale(0)
+	{
+		double sd = calc_prods ? sqrt(var) : 1;
+		for (size_t i=0, sz=pts_.size(); i<sz; ++i) {
+			if (Z_undef.size() > 0 && Z_undef[i]) continue;
+			pts.push_back(pts_[i]);
+			if (calc_prods) zs.push_back((Z[i]-mean)/sd);
+		}
+		n = (int) pts.size();
+		x.resize(n);
+		y.resize(n);
+		if (is_arc) z.resize(n);
+		for (int i=0; i<n; ++i) {
+			if (is_arc) {
+				GenGeomAlgs::LongLatDegToUnit(pts[i].x, pts[i].y,
+											  x[i], y[i], z[i]);
+			} else {
+				x[i] = pts[i].x;
+				y[i] = pts[i].y;
+			}
+		}
+	}
+	
+	void PairBinner::SetBins(double binw, int num_bins_)
+	{
+		num_bins = num_bins_;
+		q_edge.resize(num_bins+1);
+		for (int k=0; k<=num_bins; ++k) {
+			double d = binw*((double) k);
+			if (is_arc) {
+				// chord of arc d, edges past half the globe are all at 2
+				d = GenGeomAlgs::RadToUnitDist(std::min(d, GenGeomAlgs::pi));
+			}
+			q_edge[k] = d*d;
+		}
+		for (int k=1; k<=num_bins; ++k) {
+			if (q_edge[k] < q_edge[k-1]) q_edge[k] = q_edge[k-1];
+		}
+		// Bins get wider with squared distance, so 64 cells per bin on
+		// average leave Bin() at most one step for all but the first few
+		int lut_size = 64*num_bins;
+		lut.resize(lut_size+1);
+		lut_scale = (q_edge[num_bins] > 0) ? lut_size / q_edge[num_bins] : 0;
+		int b = 0;
+		for (int t=0; t<=lut_size; ++t) {
+			// half a cell of slack against rounding in Bin()
+			double q = (t > 0 && lut_scale > 0) ? (t-0.5) / lut_scale : 0;
+			while (b < num_bins-1 && q >= q_edge[b+1]) ++b;
+			lut[t] = b;
+		}
+	}
+	
+	/** Bin counts and sums of standardized products */
+	struct BinAcc {
+		BinAcc() {}
+		BinAcc(int num_bins) : cnt(num_bins, 0), sum(num_bins, 0) {}
+		std::vector<wxInt64> cnt;
+		std::vector<double> sum;
+	};
+	
+	const int all_pairs_tile = 256;
+	
+	/** Task p of MakeCorrAllPairs: all pairs i<j with i in tile row p or
+	 tile row num_tiles-1-p.  Pairing a short row with a long one gives
+	 every task about the same amount of work. */
+	void AllPairsTask(const PairBinner* pb, int num_tiles,
+					  std::vector<BinAcc>* accs, int p_start, int p_end)
+	{
+		const int T = all_pairs_tile;
+		const int n = pb->n;
+		const int nb = pb->num_bins;
+		const bool calc_prods = !pb->zs.empty();
+		const double* zs = calc_prods ? &pb->zs[0] : 0;
+		double q[all_pairs_tile];
+		int bin[all_pairs_tile];
+		for (int p=p_start; p<=p_end; ++p) {
+			BinAcc& acc = (*accs)[p];
+			wxInt64* cnt = &acc.cnt[0];
+			double* sum = &acc.sum[0];
+			int rows[2] = { p, num_tiles-1-p };
+			int num_rows = (rows[0] == rows[1]) ? 1 : 2;
+			for (int r=0; r<num_rows; ++r) {
+				int i0 = rows[r]*T;
+				int i1 = std::min(i0+T, n);
+				// cache blocking: tile J of points stays hot while every i
+				// of the row tile is run against it
+				for (int j0=i0; j0<n; j0+=T) {
+					int j1 = std::min(j0+T, n);
+					for (int i=i0; i<i1; ++i) {
+						int js = (j0 == i0) ? i+1 : j0;
+						int len = j1-js;
+						if (len <= 0) continue;
+						pb->SqDists(i, js, len, q);
+						for (int k=0; k<len; ++k) {
+							int b = pb->Bin(q[k]);
+							// the diameter pair lands on the last edge
+							bin[k] = (b >= nb) ? nb-1 : b;
+						}
+						double zi = calc_prods ? zs[i] : 0;
+						for (int k=0; k<len; ++k) {
+							int b = bin[k];
+							if (b < 0) continue;
+							++cnt[b];
+							if (calc_prods) sum[b] += zi*zs[js+k];
+						}
+					}
+				}
+			}
+		}
+	}
+	
+	/** Chunk c of MakeCorrRandSamp: samples c*chunk_size up to iters-1 at
+	 most.  Beyond the last bin the pair is thrown away. */
+	void RandSampTask(const PairBinner* pb, int iters, int chunk_size,
+					  uint64_t seed, std::vector<BinAcc>* accs,
+					  int c_start, int c_end)
+	{
+		const int n = pb->n;
+		const int nb = pb->num_bins;
+		const bool calc_prods = !pb->zs.empty();
+		for (int c=c_start; c<=c_end; ++c) {
+			BinAcc& acc = (*accs)[c];
+			int t_start = c*chunk_size;
+			int t_end = std::min(t_start+chunk_size, iters);
+			for (int t=t_start; t<t_end; ++t) {
+				uint64_t s = seed + 2*((uint64_t) t);
+				int i = (int) (Gda::SplitMix64Double(s)*n);
+				int j = (int) (Gda::SplitMix64Double(s+1)*n);
+				int b = pb->Bin(pb->SqDist(i, j));
+				if (b < 0 || b >= nb) continue;
+				++acc.cnt[b];
+				if (calc_prods) acc.sum[b] += pb->zs[i]*pb->zs[j];
+			}
+		}
+	}
+	
+	void InitBins(std::vector<CorrelogramAlgs::CorreloBin>& out,
+				  int num_bins, double binw, bool calc_prods)
+	{
+		out.clear();
+		out.resize(num_bins);
+		for (int i=0; i<num_bins; ++i) {
+			out[i].dist_min = binw*((double) i);
+			out[i].dist_max = binw*((double) (i+1));
+			out[i].corr_avg_valid = calc_prods;
+		}
+	}
+	
+	/** Adds the accumulators to out in index order, which keeps the sums
+	 independent of how the tasks were scheduled. */
+	void ReduceBins(const std::vector<BinAcc>& accs, bool calc_prods,
+					std::vector<CorrelogramAlgs::CorreloBin>& out)
+	{
+		for (size_t a=0; a<accs.size(); ++a) {
+			for (size_t b=0; b<out.size(); ++b) {
+				out[b].num_pairs += accs[a].cnt[b];
+				out[b].corr_avg += accs[a].sum[b];
+			}
+		}
+		for (size_t b=0; b<out.size(); ++b) {
+			if (out[b].num_pairs > 0 && calc_prods) {
+				out[b].corr_avg /= ((double) out[b].num_pairs);
+			}
+		}
+	}
+}
+
 bool CorrelogramAlgs::MakeCorrRandSamp(const std::vector<wxRealPoint>& pts,
 									   const std::vector<double>& Z,
 									   const std::vector<bool>& Z_undef,
 									   bool is_arc,
 									   double dist_cutoff,
 									   int num_bins, int iters,
-									   std::vector<CorreloBin>& out)
+									   std::vector<CorreloBin>& out,
+									   uint64_t seed)
 {
 	using namespace std;
 	using namespace GenGeomAlgs;
 	LOG_MSG("Entering CorrelogramAlgs::MakeCorrRandSamp");
 	wxStopWatch sw;
 	
-	// Mersenne Twister random number generator, randomly seeded
-	// with current time in seconds since Jan 1 1970.
-	static boost::mt19937 rng(std::time(0));
-	static boost::random::uniform_int_distribution<> X(0, pts.size()-1);
-	
-	double nbins_d = (double) num_bins;
-	if (dist_cutoff <= 0) {
-		wxRealPoint a,b;
-		dist_cutoff = PointSetAlgs::EstDiameter(pts, is_arc, a, b);
-		if (is_arc) dist_cutoff = DegToRad(dist_cutoff);
-	}
-	
 	bool calc_prods = (Z.size() == pts.size());
 	double mean = 0;
 	double var = 0;
@@ -98,67 +329,31 @@ bool CorrelogramAlgs::MakeCorrRandSamp(const std::vector<wxRealPoint>& pts,
 			return false;
 		}
 	}
+	// pairs are drawn among the defined observations only
+	PairBinner pb(pts, Z, Z_undef, is_arc, calc_prods, mean, var);
+	if (pb.n == 0) return false;
+	
+	if (dist_cutoff <= 0) {
+		wxRealPoint a,b;
+		dist_cutoff = PointSetAlgs::EstDiameter(pb.pts, is_arc, a, b);
+		if (is_arc) dist_cutoff = DegToRad(dist_cutoff);
+	}
 	if (num_bins <= 0)
         num_bins = 1;
-	out.clear();
-	out.resize(num_bins);
-	double binw = dist_cutoff/nbins_d; // bin width
-	out[0].dist_min = 0;
-	out[0].dist_max = binw;
-	for (int i=1; i<num_bins; ++i) {
-		out[i].dist_min = binw*((double) i);
-		out[i].dist_max = binw*((double) (i+1));
-		out[i].corr_avg_valid = calc_prods;
-	}
+	double binw = dist_cutoff/((double) num_bins); // bin width
+	InitBins(out, num_bins, binw, calc_prods);
+	pb.SetBins(binw, num_bins);
 	
-	int ta_cnt = 0; // throw away count
-    int t = 0;
-    int t_max = 0;
-    int t_max_const = iters + 9999999;
-    while (t < iters ) {
-		size_t i=X(rng);
-		size_t j=X(rng);
-        
-        // potential hangs here
-        if (Z_undef.size() > 0 && (Z_undef[i] || Z_undef[j])) {
-            if (t_max < t_max_const) {
-                continue;
-            } else {
-                // ERROR: too many undefined values, computing hangs and exits.
-                return false;
-            }
-            t_max += 1;
-        }
-        
-        t += 1;
-        
-		const wxRealPoint& p1(pts[i]);
-		const wxRealPoint& p2(pts[j]);
-		double d;
-        
-        // NOTE: performance boost here: cache the computed distance
-        // the cache could have a limited size e.g. 10000
-		if (is_arc) {
-			d = ComputeArcDistRad(p1.x, p1.y, p2.x, p2.y);
-		} else {
-			d = ComputeEucDist(p1.x, p1.y, p2.x, p2.y);
-		}
-		int b = (int) (d/binw);
-		if (b >= num_bins || b<0) {
-			ta_cnt++;
-			continue;
-		}
-		out[b].num_pairs++;
-		if (calc_prods && var != 0) {
-			double prod = (Z[i]-mean)*(Z[j]-mean)/var;
-			out[b].corr_avg += prod;
-		}
-	}
-	for (size_t b=0; b<num_bins; ++b) {
-		if (out[b].num_pairs >0 && calc_prods) {
-			out[b].corr_avg /= ((double) out[b].num_pairs);
-		}
-	}
+	// fixed chunks so that the sums do not depend on the thread count
+	if (iters <= 0) return true;
+	int chunk_size = std::max(16384, iters/256 + 1);
+	int num_chunks = (iters-1)/chunk_size + 1;
+	vector<BinAcc> accs(num_chunks, BinAcc(num_bins));
+	GdaThreadPool::GetInstance()->
+		ParallelFor(0, num_chunks-1, 1,
+					boost::bind(RandSampTask, &pb, iters, chunk_size, seed,
+								&accs, _1, _2));
+	ReduceBins(accs, calc_prods, out);
 
 	LOG_MSG("Exiting CorrelogramAlgs::MakeCorrRandSamp");
 	return true;
@@ -176,9 +371,7 @@ bool CorrelogramAlgs::MakeCorrAllPairs(const std::vector<wxRealPoint>& pts,
 	LOG_MSG("Entering CorrelogramAlgs::MakeCorrAllPairs");
 	wxStopWatch sw;
 
-	size_t nobs = pts.size();
-
-	bool calc_prods = (Z.size() == nobs);
+	bool calc_prods = (Z.size() == pts.size());
 	double mean = 0;
 	double var = 0;
     
@@ -188,89 +381,34 @@ bool CorrelogramAlgs::MakeCorrAllPairs(const std::vector<wxRealPoint>& pts,
 			return false;
 		}
 	}
-
-	double min_d, max_d;
-	min_d = (is_arc ?
-             ComputeArcDistRad(pts[0].x, pts[0].y, pts[1].x, pts[1].y) :
-			 ComputeEucDist(pts[0].x, pts[0].y, pts[1].x, pts[1].y));
-	max_d = min_d;
-
-	size_t pairs = ((nobs-1)*nobs)/2;
-	vector<double> Zdist(pairs);
-	vector<double> Zprod(calc_prods ? pairs : 0);
-	vector<double> Zprod_undef(calc_prods ? pairs : 0);
-	size_t pc = 0;
-	for (size_t i=0; i<nobs; ++i) {
-		for (size_t j=i+1; j<nobs; ++j) {
-            
-            if (Z_undef.size() > 0 && (Z_undef[i] || Z_undef[j])) {
-                Zprod_undef[pc] = true;
-                Zdist[pc] = 0;
-                Zprod[pc] = 0;
-                continue;
-            }
-            
-            Zprod_undef[pc] = false;
-			double d = (is_arc ?
-                        ComputeArcDistRad(pts[i].x, pts[i].y,pts[j].x, pts[j].y) :
-						ComputeEucDist(pts[i].x, pts[i].y, pts[j].x, pts[j].y));
-			if (d < min_d) {
-				min_d = d;
-			} else if (d > max_d) {
-				max_d = d;
-			}
-			Zdist[pc] = d;
-            if (calc_prods && var != 0) {
-                Zprod[pc] = (Z[i]-mean)*(Z[j]-mean)/var;
-            }
-			++pc;
-		}
-	}
+	PairBinner pb(pts, Z, Z_undef, is_arc, calc_prods, mean, var);
+	if (pb.n < 2) return false;
+	
+	// the largest pair distance is the diameter of the point set, so no
+	// pass over the pairs is needed to find it
+	wxRealPoint a, b;
+	double max_d = PointSetAlgs::EstDiameter(pb.pts, is_arc, a, b);
+	if (is_arc) max_d = DegToRad(max_d);
 	
     if (num_bins <= 0) {
         num_bins = 1;
     }
-	out.clear();
-	out.resize(num_bins);
-	double nbins_d = (double) num_bins;
-	double binw = max_d/nbins_d; // bin width
-	out[0].dist_min = 0;
-	out[0].dist_max = binw;
-	for (int i=1; i<num_bins; ++i) {
-		out[i].dist_min = binw*((double) i);
-		out[i].dist_max = binw*((double) (i+1));
-		out[i].corr_avg_valid = calc_prods;
-	}
-
-	size_t ta_cnt = 0;
-	for (size_t i=0, sz=Zdist.size(); i<sz; ++i) {
-        if (wxIsNaN(Zdist[i]) || Zprod_undef[i]) {
-            // todo something wrong here, Zdist value is NaN
-            continue;
-        }
-        
-		int b = (int) (Zdist[i]/binw);
-		if (b >= num_bins) {
-			b=num_bins-1;
-			ta_cnt++;
-		}
-		out[b].num_pairs++;
-        if (calc_prods) {
-            out[b].corr_avg += Zprod[i];
-        }
-	}
-	LOG(ta_cnt); // should be at most 1
+	double binw = max_d/((double) num_bins); // bin width
+	InitBins(out, num_bins, binw, calc_prods);
+	pb.SetBins(binw, num_bins);
 	
-	for (size_t b=0; b<num_bins; ++b) {
-		if (out[b].num_pairs != 0 && calc_prods) {
-            out[b].corr_avg /= ((double) out[b].num_pairs);
-        }
-	}
+	int num_tiles = (pb.n-1)/all_pairs_tile + 1;
+	int num_tasks = (num_tiles+1)/2;
+	vector<BinAcc> accs(num_tasks, BinAcc(num_bins));
+	GdaThreadPool::GetInstance()->
+		ParallelFor(0, num_tasks-1, 1,
+					boost::bind(AllPairsTask, &pb, num_tiles, &accs, _1, _2));
+	ReduceBins(accs, calc_prods, out);
     
 	/*
 		stringstream ss;
-		ss << "MakeCorrMakeCorrAllPairs with " << pairs
-		   << " pairs finished in " << sw.Time() << " ms.";
+		ss << "MakeCorrMakeCorrAllPairs with " << pb.n
+		   << " points finished in " << sw.Time() << " ms.";
 		LOG_MSG(ss.str());
 	*/
 	LOG_MSG("Exiting CorrelogramAlgs::MakeCorrAllPairs");
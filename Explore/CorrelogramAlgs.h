@@ -21,6 +21,7 @@
 #define __GEODA_CENTER_CORRELOGRAM_ALGS_H__
 
 #include <vector>
+#include <stdint.h>
 #include <wx/gdicmn.h> // for wxRealPoint
 
 namespace CorrelogramAlgs {
@@ -35,7 +36,7 @@ namespace CorrelogramAlgs {
 		bool corr_avg_valid; // If corr_avg is valid, then true.  If false,
 		// only num_pairs count is valid.  Can be useful for displaying just
 		// the histogram of number of pairs in each distance band bin.
-		int num_pairs; // number of pairs sampled
+		wxInt64 num_pairs; // number of pairs sampled
 	};
 	
 	void GetSampMeanAndVar(const std::vector<double>& Z,
@@ -52,6 +53,9 @@ namespace CorrelogramAlgs {
 									throw away results for distances > dist_cutoff
 	   num_bins: number of distance band categories
 	   iters: number of random trials
+	   seed: pair t is drawn with Gda::SplitMix64Double(seed+2t) and
+	     Gda::SplitMix64Double(seed+2t+1), so the result only depends on
+	     the seed and not on the number of threads.
 	 Output:
 	   out: vector of CorreloBin output objects of size num_cats
 		 true if success, false if sample variance <= 0
@@ -61,8 +65,13 @@ namespace CorrelogramAlgs {
                           const std::vector<bool>& Z_undef,
                           bool is_arc, double dist_cutoff,
                           int num_bins, int iters,
-                          std::vector<CorreloBin>& out);
+                          std::vector<CorreloBin>& out,
+                          uint64_t seed = 123456789);
 
+	/** Exact correlogram over all pairs of observations with defined Z.
+	 The bins span the diameter of the point set.  Pairs are streamed
+	 through per-thread bin accumulators tile by tile, so memory use is
+	 O(n) and not O(n^2). */
 	bool MakeCorrAllPairs(const std::vector<wxRealPoint>& pts,
 						  const std::vector<double>& Z,
                           const std::vector<bool>& Z_undef,
@@ -18,6 +18,7 @@
  */
 
 #include <math.h>
+#include <time.h>
 #include <iostream>
 #include <iomanip>
 #include <utility> // std::pair
@@ -52,7 +53,8 @@ CorrelogramFrame::CorrelogramFrame(wxFrame *parent, Project* project,
 : TemplateFrame(parent, project, title, pos, size, wxDEFAULT_FRAME_STYLE),
 correl_params_frame(0), panel(0),
 panel_v_szr(0), bag_szr(0), top_h_sizer(0),
-hist_plot(0), local_hl_state(0), message_win(0), project(project)
+hist_plot(0), local_hl_state(0), message_win(0), project(project),
+last_seed_used(0), reuse_last_seed(false)
 {
     wxLogMessage("Open CorrelogramFrame.");
 	local_hl_state = new HighlightState();
@@ -507,7 +509,7 @@ void CorrelogramFrame::SetupPanelForNumVariables(int num_vars)
 			for (size_t i=0; i<cbins.size(); ++i) {
 				hist_bins[i].min = cbins[i].dist_min;
 				hist_bins[i].max = cbins[i].dist_max;
-				hist_bins[i].count = cbins[i].num_pairs;
+				hist_bins[i].count = (int) cbins[i].num_pairs;
 			}
 			sh_can = new SimpleBinsHistCanvas(panel, this, project, 
 											  local_hl_state,
@@ -766,12 +768,16 @@ bool CorrelogramFrame::UpdateCorrelogramData()
                                      par.threshold, par.bins, cbins);
 		}
 	} else if (par.method == CorrelParams::RAND_SAMP) {
+		if (!reuse_last_seed) last_seed_used = time(0);
 		success = MakeCorrRandSamp(pts, Z, Z_undef, is_arc, -1,
-                                   par.bins,  par.max_iterations, cbins);
+                                   par.bins,  par.max_iterations, cbins,
+                                   last_seed_used);
 	}	else if (par.method == CorrelParams::RAND_SAMP_THRESH) {
+		if (!reuse_last_seed) last_seed_used = time(0);
 		success = MakeCorrRandSamp(pts, Z, Z_undef, is_arc,
                                    (is_arc ? th_rad : par.threshold),
-                                   par.bins,  par.max_iterations, cbins);
+                                   par.bins,  par.max_iterations, cbins,
+                                   last_seed_used);
 	}
     
     if (success == false) {
@@ -89,6 +89,14 @@ public:
 	virtual void notifyNewHistHover(const std::vector<int>& hover_obs,
 															int total_hover_obs);
 	
+	uint64_t GetLastUsedSeed() { return last_seed_used; }
+	
+	void SetLastUsedSeed(uint64_t seed) { last_seed_used = seed; }
+	
+	bool IsReuseLastSeed() { return reuse_last_seed; }
+	
+	void SetReuseLastSeed(bool reuse) { reuse_last_seed = reuse; }
+	
 protected:
     void ReDraw();
 	void SetupPanelForNumVariables(int num_vars);
@@ -108,6 +116,8 @@ protected:
 	std::vector<SimpleAxisCanvas*> horiz_labels;
 	SimpleBinsHistCanvas* hist_plot;
 	HLStateInt* local_hl_state;
+	uint64_t last_seed_used; // seed of the last random sample
+	bool reuse_last_seed;
 	
 	wxBoxSizer* top_h_sizer;
 	wxPanel* panel;
@@ -25,7 +25,8 @@
 
 CovSpHLStateProxy::CovSpHLStateProxy(HighlightState* hl_state,
 																		 const pairs_bimap_type& pairsBiMap)
-: pbm(pairsBiMap)
+: pbm(pairsBiMap), total_newly_highlighted(0), total_newly_unhighlighted(0),
+event_type(empty), delta_exact(false)
 {
 	delete_self_when_empty = false;
 	highlight_state = hl_state;
@@ -94,6 +95,7 @@ void CovSpHLStateProxy::notifyObservers()
 	using namespace std;
 	for_each(observers.begin(), observers.end(),
 					 bind2nd(mem_fun(&HighlightStateObserver::update), this));
+	delta_exact = false;
 	notifyHighlightState();
 }
 
@@ -110,6 +112,7 @@ void CovSpHLStateProxy::notifyObservers(HighlightStateObserver* exclude)
 			(*i)->update(this);
 		}
 	}
+	delta_exact = false;
 	notifyHighlightState();
 }
 
@@ -151,9 +154,12 @@ void CovSpHLStateProxy::update(HLStateInt* o)
 		}
 	}
 	if (event_type != HLStateInt::empty) {
+		// the lists above hold every pair that changed
+		delta_exact = (event_type == HLStateInt::delta);
 		using namespace std;
 		for_each(observers.begin(), observers.end(),
 						 bind2nd(mem_fun(&HighlightStateObserver::update), this));
+		delta_exact = false;
 	}
 }
 
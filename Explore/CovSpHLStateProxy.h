@@ -64,6 +64,8 @@ public:
 	virtual wxString GetEventTypeStr();
 	virtual void SetEventType( EventType e ) { event_type = e; }
 	virtual int GetTotalHighlighted() { return total_highlighted; }
+	virtual bool IsDeltaExact() { return delta_exact; }
+	virtual void SetDeltaExact(bool b) { delta_exact = b; }
 	
 	virtual void registerObserver(HighlightStateObserver* o);
 	virtual void removeObserver(HighlightStateObserver* o);
@@ -104,6 +106,8 @@ private:
 	 valid entries on the #newly_unhighlighted 'stack'. */
 	int total_newly_unhighlighted;
 	EventType event_type;
+	/** See HighlightState::delta_exact */
+	bool delta_exact;
 	void ApplyChanges(); // called by notifyObservers to update highlight vec
 	
 	/** When this is set to true and the list of observers is empty, the
@@ -18,6 +18,7 @@
  */
 
 #include <time.h>
+#include <boost/bind.hpp>
 #include <boost/math/distributions/normal.hpp> // for normal_distribution
 #include <algorithm>
 #include <functional>
@@ -25,9 +26,13 @@
 #include <wx/filename.h>
 #include <wx/stopwatch.h>
 #include "../DataViewer/TableInterface.h"
+#include "../ShapeOperations/CsrWeight.h"
 #include "../ShapeOperations/Randik.h"
 #include "../ShapeOperations/WeightsManState.h"
 #include "../VarCalc/WeightsManInterface.h"
+#include "../GdaConst.h"
+#include "../GdaThreadPool.h"
+#include "../PermutationSampler.h"
 #include "../logger.h"
 #include "../Project.h"
 #include "GetisOrdMapNewView.h"
@@ -80,49 +85,6 @@
  */
 
 
-GStatWorkerThread::GStatWorkerThread(const GalElement* W_,
-                                     int obs_start_s, int obs_end_s,
-									 uint64_t seed_start_s,
-									 GStatCoordinator* gstat_coord_s,
-									 wxMutex* worker_list_mutex_s,
-									 wxCondition* worker_list_empty_cond_s,
-									 std::list<wxThread*> *worker_list_s,
-									 int thread_id_s)
-: wxThread(),
-W(W_),
-obs_start(obs_start_s), obs_end(obs_end_s), seed_start(seed_start_s),
-gstat_coord(gstat_coord_s),
-worker_list_mutex(worker_list_mutex_s),
-worker_list_empty_cond(worker_list_empty_cond_s),
-worker_list(worker_list_s),
-thread_id(thread_id_s)
-{
-}
-
-GStatWorkerThread::~GStatWorkerThread()
-{
-}
-
-wxThread::ExitCode GStatWorkerThread::Entry()
-{
-	LOG_MSG(wxString::Format("GStatWorkerThread %d started", thread_id));
-	
-	// call work for assigned range of observations
-	gstat_coord->CalcPseudoP_range(W, obs_start, obs_end, seed_start);
-	
-	wxMutexLocker lock(*worker_list_mutex);
-	// remove ourself from the list
-	worker_list->remove(this);
-	// if empty, signal on empty condition since only main thread
-	// should be waiting on this condition
-	if (worker_list->empty()) {
-		worker_list_empty_cond->Signal();
-	}
-	
-	return NULL;
-}
-
-
 GStatCoordinator::
 GStatCoordinator(boost::uuids::uuid weights_id,
                  Project* project,
@@ -138,7 +100,9 @@ permutations(999),
 var_info(var_info_s),
 data(var_info_s.size()),
 data_undef(var_info_s.size()),
-last_seed_used(0), reuse_last_seed(false)
+last_seed_used(0), reuse_last_seed(false),
+use_perm_table(false), perm_table(0),
+use_adaptive_perms(false), adaptive_cutoff(1.0)
 {
 	TableInterface* table_int = project->GetTableInt();
 	for (int i=0; i<var_info.size(); i++) {
@@ -158,6 +122,39 @@ last_seed_used(0), reuse_last_seed(false)
 	w_man_state->registerObserver(this);
 }
 
+GStatCoordinator::
+GStatCoordinator(boost::uuids::uuid weights_id,
+				 WeightsManInterface* w_man_int_s,
+				 WeightsManState* w_man_state_s,
+				 const std::vector<GdaVarTools::VarInfo>& var_info_s,
+				 const std::vector<d_array_type>& data_s,
+				 const std::vector<b_array_type>& data_undef_s,
+				 bool row_standardize_weights, uint64_t seed)
+: w_man_state(w_man_state_s),
+w_man_int(w_man_int_s),
+w_id(weights_id),
+num_obs(data_s[0].shape()[1]),
+row_standardize(row_standardize_weights),
+permutations(999),
+var_info(var_info_s),
+data(data_s),
+data_undef(data_undef_s),
+last_seed_used(seed), reuse_last_seed(true),
+use_perm_table(false), perm_table(0),
+use_adaptive_perms(false), adaptive_cutoff(1.0)
+{
+	weight_name = w_man_int->GetLongDispName(w_id);
+	SetSignificanceFilter(1);
+	
+	InitFromVarInfo();
+	
+	maps.resize(8);
+	for (int i=0, iend=maps.size(); i<iend; i++) {
+		maps[i] = (GetisOrdMapFrame*) 0;
+	}
+	w_man_state->registerObserver(this);
+}
+
 GStatCoordinator::~GStatCoordinator()
 {
 	LOG_MSG("In GStatCoordinator::~GStatCoordinator");
@@ -167,6 +164,8 @@ GStatCoordinator::~GStatCoordinator()
 
 void GStatCoordinator::DeallocateVectors()
 {
+	// a background run reads most of the arrays below
+	CancelPseudoP();
 	for (int i=0; i<G_vecs.size(); i++) if (G_vecs[i]) delete [] G_vecs[i];
 	G_vecs.clear();
 
@@ -206,6 +205,11 @@ void GStatCoordinator::DeallocateVectors()
 	}
 	pseudo_p_star_vecs.clear();
 	
+	for (int i=0; i<num_perms_used_vecs.size(); i++) {
+		if (num_perms_used_vecs[i]) delete [] num_perms_used_vecs[i];
+	}
+	num_perms_used_vecs.clear();
+	
 	for (int i=0; i<x_vecs.size(); i++) if (x_vecs[i]) delete [] x_vecs[i];
 	x_vecs.clear();
    
@@ -232,6 +236,7 @@ void GStatCoordinator::AllocateVectors()
 	p_star_vecs.resize(tms);
 	pseudo_p_vecs.resize(tms);
 	pseudo_p_star_vecs.resize(tms);
+	num_perms_used_vecs.resize(tms);
 	x_vecs.resize(tms);
     
     x_undefs.resize(tms);
@@ -264,6 +269,7 @@ void GStatCoordinator::AllocateVectors()
 		p_star_vecs[i] = new double[num_obs];
 		pseudo_p_vecs[i] = new double[num_obs];
 		pseudo_p_star_vecs[i] = new double[num_obs];
+		num_perms_used_vecs[i] = new int[num_obs];
 		x_vecs[i] = new double[num_obs];
 		
 		map_valid[i] = true;
@@ -311,7 +317,6 @@ void GStatCoordinator::InitFromVarInfo()
 	}
     
 	for (int t=0; t<num_time_vals; t++) {
-        GalElement* W  = NULL;
         if (Gal_vecs.empty() || Gal_vecs[t] == NULL) {
             // local weights copy
             GalWeight* gw = NULL;
@@ -321,13 +326,13 @@ void GStatCoordinator::InitFromVarInfo()
             } else {
                 gw = w_man_int->GetGal(w_id);
             }
-            W = gw->gal ;
             Gal_vecs[t] = gw;
         }
+        const CsrWeight* W = Gal_vecs[t]->GetCsr();
         
 		x = x_vecs[t];
 		for (int i=0; i<num_obs; i++) {
-			if ( W[i].Size() > 0 ) {
+			if ( W->Size(i) > 0 ) {
 				n[t]++;
 				x_star[t] += x[i];
 				x_sstar[t] += x[i] * x[i];
@@ -391,14 +396,14 @@ void GStatCoordinator::FillClusterCats(int canvas_time,
 	if (!is_gi && !is_perm) p_val = p_star_vecs[t];
 	double* z_val = is_gi ? z_vecs[t] : z_star_vecs[t];
 	
-    const GalElement* W = Gal_vecs[t]->gal;
+    const CsrWeight* W = Gal_vecs[t]->GetCsr();
     
 	c_val.resize(num_obs);
 	for (int i=0; i<num_obs; i++) {
         if (!G_defined_vecs[t][i]) {
             c_val[i] = 4; // undefined
             
-        } else if (W[i].Size() == 0) {
+        } else if (W->Size(i) == 0) {
 			c_val[i] = 3; // isolate
             
 		} else if (p_val[i] <= significance_cutoff) {
@@ -434,7 +439,7 @@ void GStatCoordinator::CalcGs()
 		has_undefined[t] = false;
 		has_isolates[t] = false;
         
-        const GalElement* W = Gal_vecs[t]->gal;
+        const CsrWeight* W = Gal_vecs[t]->GetCsr();
 
 		double n_expr = sqrt((n[t]-1)*(n[t]-1)*(n[t]-2));
 		for (long i=0; i<num_obs; i++) {
@@ -444,21 +449,22 @@ void GStatCoordinator::CalcGs()
                 continue;
             }
             
-			const GalElement& elm_i = W[i];
-			if ( elm_i.Size() > 0 ) {
+			const int* elm_i = W->GetNbrs(i);
+			const int sz_i = W->Size(i);
+			if ( sz_i > 0 ) {
 				double lag = 0;
 				bool self_neighbor = false;
-				for (size_t j=0, sz=W[i].Size(); j<sz; j++) {
+				for (int j=0; j<sz_i; j++) {
 					if (elm_i[j] != i) {
 						lag += x[elm_i[j]];
 					} else {
 						self_neighbor = true;
 					}
 				}
-				double Wi = self_neighbor ? W[i].Size()-1 : W[i].Size();
+				double Wi = self_neighbor ? sz_i-1 : sz_i;
 				if (row_standardize) {
-					lag /= elm_i.Size();
-					Wi /= elm_i.Size();
+					lag /= sz_i;
+					Wi /= sz_i;
 				}
 				double xd_i = x_star[t] - x[i];
 				if (xd_i != 0) {
@@ -505,10 +511,10 @@ void GStatCoordinator::CalcGs()
                     z_star[i] = 0;
                     continue;
                 }
-				const GalElement& elm_i = W[i];
+				const int* elm_i = W->GetNbrs(i);
 				double lag = 0;
 				bool self_neighbor = false;
-				int sz_i=W[i].Size();
+				int sz_i=W->Size(i);
 				for (int j=0; j<sz_i; j++) {
                     if (elm_i[j] == i) {
                         self_neighbor = true;
@@ -530,10 +536,10 @@ void GStatCoordinator::CalcGs()
                     z_star[i] = 0;
                     continue;
                 }
-				const GalElement& elm_i = W[i];
+				const int* elm_i = W->GetNbrs(i);
 				double lag = 0;
 				bool self_neighbor = false;
-				for (int j=0, sz=elm_i.Size(); j<sz; j++) {
+				for (int j=0, sz=W->Size(i); j<sz; j++) {
                     if (elm_i[j] == i) {
                         self_neighbor = true;
                     }
@@ -543,7 +549,7 @@ void GStatCoordinator::CalcGs()
                     lag += x[i];
                 }
 				G_star[i] = lag / x_star[t];
-				double Wi = self_neighbor ? W[i].Size() : W[i].Size()+1;
+				double Wi = self_neighbor ? W->Size(i) : W->Size(i)+1;
 				// location-specific mean
 				double ExGi_star = Wi/n[t];
 				// location-specific variance
@@ -567,35 +573,13 @@ void GStatCoordinator::CalcPseudoP()
 {
 	LOG_MSG("Entering GStatCoordinator::CalcPseudoP");
 	wxStopWatch sw;
-	int nCPUs = wxThread::GetCPUCount();
 	
-	// To ensure thread safety, only work on one time slice of data
-	// at a time.  For each time period t:
-	// 1. copy data for time period t into data1 and data2 arrays
-	// 2. Perform multi-threaded computation
-	// 3. copy results into results array
-	
-	for (int t=0; t<num_time_vals; t++) {
-
-		G = G_vecs[t];
-		G_defined = G_defined_vecs[t];
-		G_star = G_star_vecs[t];
-		z = z_vecs[t];
-		p = p_vecs[t];
-		z_star = z_star_vecs[t];
-		p_star = p_star_vecs[t];
-		pseudo_p = pseudo_p_vecs[t];
-		pseudo_p_star = pseudo_p_star_vecs[t];
-		x = x_vecs[t];
-		x_star_t = x_star[t];
-		
-		if (nCPUs <= 1) {
-			if (!reuse_last_seed) last_seed_used = time(0);
-			CalcPseudoP_range(Gal_vecs[t]->gal, 0, num_obs-1, last_seed_used);
-		} else {
-			CalcPseudoP_threaded(Gal_vecs[t]->gal);
-		}
-	}
+	CancelPseudoP();
+	if (!reuse_last_seed) last_seed_used = time(0);
+	adaptive_cutoff = significance_cutoff;
+	AllocatePseudoP();
+	RunPseudoP(GdaCancelToken());
+	CommitPseudoP();
 	/*
 		wxString m;
 		m << "GStat on " << num_obs << " obs with " << permutations;
@@ -606,155 +590,202 @@ void GStatCoordinator::CalcPseudoP()
 	LOG_MSG("Exiting GStatCoordinator::CalcPseudoP");
 }
 
-void GStatCoordinator::CalcPseudoP_threaded(const GalElement* W)
+void GStatCoordinator::StartPseudoP(wxWindow* parent)
 {
-	LOG_MSG("Entering GStatCoordinator::CalcPseudoP_threaded");
-	int nCPUs = wxThread::GetCPUCount();
-	
-	// mutext protects access to the worker_list
-    wxMutex worker_list_mutex;
-	// signals that worker_list is empty
-	wxCondition worker_list_empty_cond(worker_list_mutex);
-	worker_list_mutex.Lock(); // mutex should be initially locked
-	
-    // List of all the threads currently alive.  As soon as the thread
-	// terminates, it removes itself from the list.
-	std::list<wxThread*> worker_list;
-	
-	// divide up work according to number of observations
-	// and number of CPUs
-	int work_chunk = num_obs / nCPUs;
-	int obs_start = 0;
-	int obs_end = obs_start + work_chunk;
-	
-	bool is_thread_error = false;
-	int quotient = num_obs / nCPUs;
-	int remainder = num_obs % nCPUs;
-	int tot_threads = (quotient > 0) ? nCPUs : remainder;
-	
+	CancelPseudoP();
 	if (!reuse_last_seed) last_seed_used = time(0);
-	for (int i=0; i<tot_threads && !is_thread_error; i++) {
-		int a=0;
-		int b=0;
-		if (i < remainder) {
-			a = i*(quotient+1);
-			b = a+quotient;
-		} else {
-			a = remainder*(quotient+1) + (i-remainder)*quotient;
-			b = a+quotient-1;
+	adaptive_cutoff = significance_cutoff;
+	AllocatePseudoP();
+	pseudo_p_task.Start(boost::bind(&GStatCoordinator::RunPseudoP, this, _1),
+						boost::bind(&GStatCoordinator::PseudoPDone, this, _1));
+	if (parent) {
+		wxString m;
+		m << "Running " << permutations << " permutations...";
+		pseudo_p_task.ShowProgress(parent, "Randomization", m);
+	}
+}
+
+void GStatCoordinator::CancelPseudoP()
+{
+	pseudo_p_task.Stop();
+	DiscardPseudoP();
+}
+
+void GStatCoordinator::PseudoPDone(bool ok)
+{
+	if (!ok) {
+		DiscardPseudoP();
+		return;
+	}
+	CommitPseudoP();
+	notifyObservers();
+}
+
+/** Fills the new_* arrays, returns false if token was cancelled first. */
+bool GStatCoordinator::RunPseudoP(const GdaCancelToken& token)
+{
+	// All time periods are submitted to the shared thread pool at once in
+	// fixed-size chunks, see LisaCoordinator::RunPseudoP for the details.
+	pseudo_p_token = token;
+	pseudo_p_token.SetTotal((double) num_time_vals * num_obs);
+	if (use_perm_table) {
+		int max_k = 0;
+		for (int t=0; t<num_time_vals; t++) {
+			const CsrWeight* W = Gal_vecs[t]->GetCsr();
+			for (int i=0; i<num_obs; i++) {
+				if (W->Size(i) > max_k) max_k = W->Size(i);
+			}
 		}
-		uint64_t seed_start = last_seed_used+a;
-		uint64_t seed_end = seed_start + ((uint64_t) (b-a));
-		int thread_id = i+1;
-		wxString msg;
-		msg << "thread " << thread_id << ": " << a << "->" << b;
-		msg << ", seed: " << seed_start << "->" << seed_end;
-		
-		GStatWorkerThread* thread =
-			new GStatWorkerThread(W, a, b, seed_start, this,
-								  &worker_list_mutex,
-								  &worker_list_empty_cond,
-								  &worker_list, thread_id);
-		if ( thread->Create() != wxTHREAD_NO_ERROR ) {
-			delete thread;
-			is_thread_error = true;
-		} else {
-			worker_list.push_front(thread);
+		// too large a table falls back to per-observation sampling
+		if (PermutationTable::Fits(num_obs, max_k, permutations)) {
+			perm_table = new PermutationTable(num_obs, max_k, permutations,
+								Gda::ThomasWangHashUInt64(last_seed_used));
 		}
 	}
-	if (is_thread_error) {
-		// fall back to single thread calculation mode
-		CalcPseudoP_range(W, 0, num_obs-1, last_seed_used);
-	} else {
-		std::list<wxThread*>::iterator it;
-		for (it = worker_list.begin(); it != worker_list.end(); it++) {
-			(*it)->Run();
-		}
-		
-		while (!worker_list.empty()) {
-			// wait until thread_list might be empty
-			worker_list_empty_cond.Wait();
-			// We have been woken up. If this was not a false
-			// alarm (spurious signal), the loop will exit.
+	int grain = GdaConst::pseudo_p_task_grain;
+	GdaTaskGroup group;
+	for (int t=0; t<num_time_vals; t++) {
+		for (int a=0; a<num_obs; a+=grain) {
+			int b = a + grain - 1;
+			if (b > num_obs-1) b = num_obs-1;
+			uint64_t seed_start = Gda::ThomasWangHashUInt64(last_seed_used+a);
+			group.Run(boost::bind(&GStatCoordinator::CalcPseudoP_range,
+								  this, t, a, b, seed_start));
 		}
 	}
-	
-	LOG_MSG("Exiting GStatCoordinator::CalcPseudoP_threaded");
+	group.Wait();
+	if (perm_table) {
+		delete perm_table;
+		perm_table = 0;
+	}
+	return !token.IsCancelled();
+}
+
+void GStatCoordinator::AllocatePseudoP()
+{
+	DiscardPseudoP();
+	new_pseudo_p_vecs.resize(num_time_vals);
+	new_pseudo_p_star_vecs.resize(num_time_vals);
+	new_num_perms_used_vecs.resize(num_time_vals);
+	for (int t=0; t<num_time_vals; t++) {
+		new_pseudo_p_vecs[t] = new double[num_obs];
+		new_pseudo_p_star_vecs[t] = new double[num_obs];
+		new_num_perms_used_vecs[t] = new int[num_obs];
+	}
+}
+
+void GStatCoordinator::CommitPseudoP()
+{
+	pseudo_p_vecs.swap(new_pseudo_p_vecs);
+	pseudo_p_star_vecs.swap(new_pseudo_p_star_vecs);
+	num_perms_used_vecs.swap(new_num_perms_used_vecs);
+	DiscardPseudoP();
+}
+
+void GStatCoordinator::DiscardPseudoP()
+{
+	for (size_t t=0; t<new_pseudo_p_vecs.size(); t++) {
+		if (new_pseudo_p_vecs[t]) delete [] new_pseudo_p_vecs[t];
+		if (new_pseudo_p_star_vecs[t]) delete [] new_pseudo_p_star_vecs[t];
+		if (new_num_perms_used_vecs[t]) delete [] new_num_perms_used_vecs[t];
+	}
+	new_pseudo_p_vecs.clear();
+	new_pseudo_p_star_vecs.clear();
+	new_num_perms_used_vecs.clear();
 }
 
 /** In the code that computes Gi and Gi*, we specifically checked for 
  self-neighbors and handled the situation appropriately.  For the
  permutation code, we will disallow self-neighbors. */
-void GStatCoordinator::CalcPseudoP_range(const GalElement* W,
-                                         int obs_start, int obs_end,
+void GStatCoordinator::CalcPseudoP_range(int t, int obs_start, int obs_end,
 										 uint64_t seed_start)
 {
-	GeoDaSet workPermutation(num_obs);
-    
-	int max_rand = num_obs-1;
+	// time period t only: local pointers instead of the shared temporaries
+	// so that several periods can be processed concurrently
+	const CsrWeight* W = Gal_vecs[t]->GetCsr();
+	double* G = G_vecs[t];
+	bool* G_defined = G_defined_vecs[t];
+	double* G_star = G_star_vecs[t];
+	double* pseudo_p = new_pseudo_p_vecs[t];
+	double* pseudo_p_star = new_pseudo_p_star_vecs[t];
+	double* x = x_vecs[t];
+	double x_star_t = x_star[t];
+	
+	PermutationSampler& sampler = PermutationSampler::ForThread(num_obs);
+	std::vector<double> permutedLags(permutations);
+	// with early stopping, draw in blocks and test after each block
+	int block = permutations;
+	if (use_adaptive_perms) block = PermutationSampler::batch_size;
+	int* permsUsed = new_num_perms_used_vecs[t];
     
 	for (long i=obs_start; i<=obs_end; i++) {
+		if ((i-obs_start) % 16 == 0 && pseudo_p_token.IsCancelled()) return;
         
-		const int numNeighsI = W[i].Size();
-		const double numNeighsD = W[i].Size();
+		const int numNeighsI = W->Size(i);
+		const double numNeighsD = W->Size(i);
+		permsUsed[i] = 0;
         
         //only compute for non-isolates
 		if ( numNeighsI > 0 && G_defined[i]) {
             // know != 0 since G_defined[i] true
 			double xd_i = x_star_t - x[i];
+			// own random stream per observation, see LisaCoordinator
+			uint64_t obs_seed = Gda::ThomasWangHashUInt64(seed_start+i-obs_start);
+			
+			// G = lag_i / wG and G* = (lag_i + x_i) / wGstar
+			double wG = xd_i;
+			double wGstar = x_star_t;
+			if (row_standardize) {
+				wG *= numNeighsD;
+				wGstar *= numNeighsD+1;
+			} // else binary weights, Wi = numNeighsD, no self-neighbors
 			
 			int countGLarger = 0;
 			int countGStarLarger = 0;
-			double permutedG = 0;
-			double permutedGStar = 0;
-            
-			for (int perm=0; perm < permutations; perm++) {
-				int rand = 0;
-				while (rand < numNeighsI) {
-					// computing 'perfect' permutation of given size
-                    double rng_val = Gda::ThomasWangHashDouble(seed_start++) * max_rand;
-                    // round is needed to fix issue
-                    //https://github.com/GeoDaCenter/geoda/issues/488
-                    int newRandom = (int) (rng_val < 0.0 ? ceil(rng_val - 0.5) : floor(rng_val + 0.5));
-                    
-					if (newRandom != i && !workPermutation.Belongs(newRandom))
-					{
-						workPermutation.Push(newRandom);
-						rand++;
-					}
+			int perms_done = 0;
+			while (perms_done < permutations) {
+				int nb = permutations - perms_done;
+				if (nb > block) nb = block;
+				if (perm_table) {
+					perm_table->PermutedSums(i, numNeighsI, perms_done, nb,
+											 x, &permutedLags[0]);
+				} else {
+					obs_seed = sampler.PermutedSums(i, numNeighsI, nb,
+													obs_seed, x,
+													&permutedLags[0]);
 				}
-				
-				double lag_i=0;
-				// use permutation to compute the lags
-				for (int j=0; j<numNeighsI; j++) {
-					lag_i += x[workPermutation.Pop()];
+				for (int perm=0; perm < nb; perm++) {
+					const double lag_i = permutedLags[perm];
+					countGLarger += (lag_i / wG >= G[i]);
+					countGStarLarger += ((lag_i+x[i]) / wGstar >= G_star[i]);
 				}
-				
-				if (row_standardize) {
-					permutedG = lag_i / (numNeighsD * xd_i);
-					permutedGStar = (lag_i+x[i]) / ((numNeighsD+1)*x_star_t);	
-				} else { // binary weights
-					// Wi = numNeighsD // assume no self-neighbors
-					permutedG = lag_i / xd_i;
-					permutedGStar = (lag_i+x[i]) / x_star_t;
+				perms_done += nb;
+				// only stop once neither G nor G* can become significant
+				if (use_adaptive_perms && perms_done < permutations &&
+					PermutationSampler::CannotReachCutoff(countGLarger,
+							perms_done, permutations, adaptive_cutoff) &&
+					PermutationSampler::CannotReachCutoff(countGStarLarger,
+							perms_done, permutations, adaptive_cutoff))
+				{
+					break;
 				}
-				
-				if (permutedG >= G[i]) countGLarger++;
-				if (permutedGStar >= G_star[i]) countGStarLarger++;
 			}
-			// pick the smallest
-			if (permutations-countGLarger < countGLarger) { 
-				countGLarger=permutations-countGLarger;
+			permsUsed[i] = perms_done;
+			// pick the smallest.  After an early stop these are the
+			// Besag-Clifford estimates from the draws actually made.
+			if (perms_done-countGLarger < countGLarger) { 
+				countGLarger=perms_done-countGLarger;
 			}
-			pseudo_p[i] = (countGLarger + 1.0)/(permutations+1.0);
+			pseudo_p[i] = (countGLarger + 1.0)/(perms_done+1.0);
 			//if (i == DBGI) LOG(pseudo_p[i]);
 			
-			if (permutations-countGStarLarger < countGStarLarger) { 
-				countGStarLarger=permutations-countGStarLarger;
+			if (perms_done-countGStarLarger < countGStarLarger) { 
+				countGStarLarger=perms_done-countGStarLarger;
 			}
-			pseudo_p_star[i] = (countGStarLarger + 1.0)/(permutations+1.0);
+			pseudo_p_star[i] = (countGStarLarger + 1.0)/(perms_done+1.0);
 		}
 	}
+	pseudo_p_token.AddProgress(obs_end - obs_start + 1);
 }
 
 void GStatCoordinator::SetSignificanceFilter(int filter_id)
@@ -766,6 +797,12 @@ void GStatCoordinator::SetSignificanceFilter(int filter_id)
 	if (filter_id == 2) significance_cutoff = 0.01;
 	if (filter_id == 3) significance_cutoff = 0.001;
 	if (filter_id == 4) significance_cutoff = 0.0001;
+	
+	// early-stopped p-values are only exact on the side of the cutoff
+	// they were computed for, so loosening the cutoff needs a new run
+	if (use_adaptive_perms && significance_cutoff > adaptive_cutoff) {
+		CalcPseudoP();
+	}
 }
 
 void GStatCoordinator::update(WeightsManState* o)
@@ -35,43 +35,19 @@
 #include <vector>
 #include <boost/multi_array.hpp>
 #include <wx/string.h>
-#include <wx/thread.h>
+#include "../GdaAsyncTask.h"
 #include "../VarTools.h"
 #include "../ShapeOperations/GalWeight.h"
 #include "../ShapeOperations/WeightsManStateObserver.h"
 
 class GetisOrdMapFrame; // instead of GStatCoordinatorObserver
 class GStatCoordinator;
+class PermutationTable;
 class Project;
 class WeightsManState;
 typedef boost::multi_array<double, 2> d_array_type;
 typedef boost::multi_array<bool, 2> b_array_type;
 
-class GStatWorkerThread : public wxThread
-{
-public:
-    GStatWorkerThread(const GalElement* W,
-                      int obs_start, int obs_end, uint64_t seed_start,
-                      GStatCoordinator* gstat_coord,
-                      wxMutex* worker_list_mutex,
-                      wxCondition* worker_list_empty_cond,
-                      std::list<wxThread*> *worker_list,
-                      int thread_id);
-	virtual ~GStatWorkerThread();
-	virtual void* Entry();  // thread execution starts here
-
-    const GalElement* W;
-	int obs_start;
-	int obs_end;
-	uint64_t seed_start;
-	int thread_id;
-	
-	GStatCoordinator* gstat_coord;
-	wxMutex* worker_list_mutex;
-	wxCondition* worker_list_empty_cond;
-	std::list<wxThread*> *worker_list;
-};
-
 class GStatCoordinator : public WeightsManStateObserver
 {
 public:
@@ -79,6 +55,15 @@ public:
 					 const std::vector<GdaVarTools::VarInfo>& var_info,
 					 const std::vector<int>& col_ids,
 					 bool row_standardize_weights);
+	/** For use without a Project, see the corresponding LisaCoordinator
+	 constructor. */
+	GStatCoordinator(boost::uuids::uuid weights_id,
+					 WeightsManInterface* w_man_int,
+					 WeightsManState* w_man_state,
+					 const std::vector<GdaVarTools::VarInfo>& var_info,
+					 const std::vector<d_array_type>& data,
+					 const std::vector<b_array_type>& data_undef,
+					 bool row_standardize_weights, uint64_t seed);
 	virtual ~GStatCoordinator();
 	
 	bool IsOk() { return true; }
@@ -94,6 +79,15 @@ public:
 	void SetLastUsedSeed(uint64_t seed) { last_seed_used = seed; }
 	bool IsReuseLastSeed() { return reuse_last_seed; }
 	void SetReuseLastSeed(bool reuse) { reuse_last_seed = reuse; }
+	/** Opt-in: draw one permutation table for all observations instead of
+	 separate random neighbor sets per observation.  See PermutationTable. */
+	bool IsUsePermutationTable() { return use_perm_table; }
+	void SetUsePermutationTable(bool use) { use_perm_table = use; }
+	/** Opt-in: stop permuting an observation as soon as neither G nor G*
+	 can be significant at significance_cutoff.  The number of
+	 permutations actually used is kept in num_perms_used_vecs. */
+	bool IsUseAdaptivePermutations() { return use_adaptive_perms; }
+	void SetUseAdaptivePermutations(bool use) { use_adaptive_perms = use; }
 	
 	/** Implementation of WeightsManStateObserver interface */
 	virtual void update(WeightsManState* o);
@@ -102,7 +96,6 @@ public:
 	
 	std::vector<double> n; // # non-neighborless observations
 	
-	double x_star_t; // temporary x_star for use in worker threads
 	std::vector<double> x_star; // sum of all x_i // threaded
 	std::vector<double> x_sstar; // sum of all (x_i)^2
 		
@@ -149,6 +142,7 @@ public:
 	std::vector<double*> p_star_vecs;
 	std::vector<double*> pseudo_p_vecs; //threaded
 	std::vector<double*> pseudo_p_star_vecs; //threaded
+	std::vector<int*> num_perms_used_vecs; //threaded
 	std::vector<double*> x_vecs; //threaded
     std::vector<std::vector<bool> > x_undefs;
 
@@ -182,8 +176,14 @@ public:
 	std::vector<GetisOrdMapFrame*> maps;
 	
 	void CalcPseudoP();
-	void CalcPseudoP_range(const GalElement* W, int obs_start,
-                           int obs_end, uint64_t seed_start);
+	void CalcPseudoP_range(int t, int obs_start, int obs_end,
+						   uint64_t seed_start);
+	/** CalcPseudoP() on a background thread, see
+	 LisaCoordinator::StartPseudoP(). */
+	void StartPseudoP(wxWindow* parent);
+	/** Stops a background run and drops its partial results. */
+	void CancelPseudoP();
+	bool IsPseudoPRunning() { return pseudo_p_task.IsRunning(); }
 	
 	void InitFromVarInfo();
 	void VarInfoAttributeChange();
@@ -194,13 +194,27 @@ protected:
 	void DeallocateVectors();
 	void AllocateVectors();
 	
-	void CalcPseudoP_threaded(const GalElement* W);
 	void CalcGs();
+	bool RunPseudoP(const GdaCancelToken& token);
+	void PseudoPDone(bool ok);
+	void AllocatePseudoP();
+	void CommitPseudoP();
+	void DiscardPseudoP();
 	std::vector<bool> has_undefined;
 	std::vector<bool> has_isolates;
 	bool row_standardize;
 	uint64_t last_seed_used;
 	bool reuse_last_seed;
+	bool use_perm_table;
+	PermutationTable* perm_table; // only set while CalcPseudoP runs
+	bool use_adaptive_perms;
+	double adaptive_cutoff; // significance_cutoff used by last CalcPseudoP
+	// filled by pseudo p-value runs, swapped in by CommitPseudoP()
+	std::vector<double*> new_pseudo_p_vecs;
+	std::vector<double*> new_pseudo_p_star_vecs;
+	std::vector<int*> new_num_perms_used_vecs;
+	GdaCancelToken pseudo_p_token; // of the run filling the new_* arrays
+	GdaAsyncTask pseudo_p_task;
 	
 	WeightsManState* w_man_state;
 	WeightsManInterface* w_man_int;
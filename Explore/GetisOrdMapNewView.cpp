@@ -153,6 +153,10 @@ void GetisOrdMapCanvas::SetCheckMarks(wxMenu* menu)
 	
 	GeneralWxUtils::CheckMenuItem(menu, XRCID("ID_USE_SPECIFIED_SEED"),
 								  gs_coord->IsReuseLastSeed());
+	GeneralWxUtils::CheckMenuItem(menu, XRCID("ID_USE_PERMUTATION_TABLE"),
+								  gs_coord->IsUsePermutationTable());
+	GeneralWxUtils::CheckMenuItem(menu, XRCID("ID_USE_ADAPTIVE_PERMUTATIONS"),
+								  gs_coord->IsUseAdaptivePermutations());
 }
 
 void GetisOrdMapCanvas::TimeChange()
@@ -525,10 +529,13 @@ void GetisOrdMapFrame::UpdateContextMenuItems(wxMenu* menu)
 void GetisOrdMapFrame::RanXPer(int permutation)
 {
 	if (permutation < 9) permutation = 9;
-	if (permutation > 99999) permutation = 99999;
+	// a shared permutation table makes much longer runs affordable
+	int max_perms = gs_coord->IsUsePermutationTable() ? 999999 : 99999;
+	if (permutation > max_perms) permutation = max_perms;
+	gs_coord->CancelPseudoP();
 	gs_coord->permutations = permutation;
-	gs_coord->CalcPseudoP();
-	gs_coord->notifyObservers();
+	// observers are notified once the run has finished
+	gs_coord->StartPseudoP(this);
 }
 
 void GetisOrdMapFrame::OnRan99Per(wxCommandEvent& event)
@@ -586,9 +593,14 @@ void GetisOrdMapFrame::OnSpecifySeedDlg(wxCommandEvent& event)
 	dlg_val.Trim(false);
 	if (dlg_val.IsEmpty()) return;
 	if (dlg_val.ToULongLong(&val)) {
+		// a run in flight reads the seed, so it is stopped first and
+		// started again with the new seed
+		bool restart = gs_coord->IsPseudoPRunning();
+		gs_coord->CancelPseudoP();
 		if (!gs_coord->IsReuseLastSeed()) gs_coord->SetLastUsedSeed(true);
 		uint64_t new_seed_val = val;
 		gs_coord->SetLastUsedSeed(new_seed_val);
+		if (restart) gs_coord->StartPseudoP(this);
 	} else {
 		wxString m;
 		m << "\"" << dlg_val << "\" is not a valid seed. Seed unchanged.";
@@ -597,6 +609,20 @@ void GetisOrdMapFrame::OnSpecifySeedDlg(wxCommandEvent& event)
 	}
 }
 
+void GetisOrdMapFrame::OnUsePermutationTable(wxCommandEvent& event)
+{
+	gs_coord->CancelPseudoP();
+	gs_coord->SetUsePermutationTable(!gs_coord->IsUsePermutationTable());
+	gs_coord->StartPseudoP(this);
+}
+
+void GetisOrdMapFrame::OnUseAdaptivePermutations(wxCommandEvent& event)
+{
+	gs_coord->CancelPseudoP();
+	gs_coord->SetUseAdaptivePermutations(!gs_coord->IsUseAdaptivePermutations());
+	gs_coord->StartPseudoP(this);
+}
+
 void GetisOrdMapFrame::SetSigFilterX(int filter)
 {
 	if (filter == gs_coord->GetSignificanceFilter()) return;
@@ -96,6 +96,8 @@ public:
 	
 	void OnUseSpecifiedSeed(wxCommandEvent& event);
 	void OnSpecifySeedDlg(wxCommandEvent& event);
+	void OnUsePermutationTable(wxCommandEvent& event);
+	void OnUseAdaptivePermutations(wxCommandEvent& event);
 	
 	void SetSigFilterX(int filter);
 	void OnSigFilter05(wxCommandEvent& event);
@@ -50,7 +50,7 @@ bool classicalRegression(GalElement *g, int num_obs, double * Y,
 						 int dim, double ** X, 
 						 int expl, DiagnosticReport *dr, bool InclConstant,
 						 bool m_moranz, wxGauge* gauge,
-						 bool do_white_test);
+						 bool do_white_test, double w_trace = -1);
 
 BEGIN_EVENT_TABLE(LineChartFrame, TemplateFrame)
 	EVT_ACTIVATE(LineChartFrame::OnActivate)
@@ -0,0 +1,257 @@
+/**
+ * GeoDa TM, Copyright (C) 2011-2015 by Luc Anselin - all rights reserved
+ *
+ * This file is part of GeoDa.
+ * 
+ * GeoDa is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+ *
+ * GeoDa is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program.  If not, see <http://www.gnu.org/licenses/>.
+ */
+
+
+#include <time.h>
+#include <map>
+#include <boost/bind.hpp>
+#include <wx/stopwatch.h>
+#include "../DataViewer/TableInterface.h"
+#include "../ShapeOperations/CsrWeight.h"
+#include "../ShapeOperations/GalWeight.h"
+#include "../VarCalc/WeightsManInterface.h"
+#include "../GdaConst.h"
+#include "../GdaThreadPool.h"
+#include "../GenUtils.h"
+#include "../PermutationSampler.h"
+#include "../logger.h"
+#include "../Project.h"
+#include "LisaBatchCoordinator.h"
+
+LisaBatchCoordinator::
+LisaBatchCoordinator(boost::uuids::uuid weights_id, Project* project,
+					 const std::vector<GdaVarTools::VarInfo>& var_info_s,
+					 const std::vector<int>& col_ids)
+: permutations(999),
+num_obs(project->GetNumRecords()),
+num_vars(var_info_s.size()),
+var_info(var_info_s),
+last_seed_used(0), reuse_last_seed(false),
+w_id(weights_id),
+w_man_int(project->GetWManInt()),
+table_int(project->GetTableInt())
+{
+	data.resize(num_vars);
+	undefs.resize(num_vars);
+	for (int v=0; v<num_vars; v++) {
+		table_int->GetColData(col_ids[v], var_info[v].time, data[v]);
+		table_int->GetColUndefined(col_ids[v], var_info[v].time, undefs[v]);
+		undefs[v].resize(num_obs, false);
+	}
+	local_moran.resize(num_vars, std::vector<double>(num_obs, 0));
+	lags.resize(num_vars, std::vector<double>(num_obs, 0));
+	sig_local_moran.resize(num_vars, std::vector<double>(num_obs, 0));
+	cluster.resize(num_vars, std::vector<int>(num_obs, 0));
+}
+
+LisaBatchCoordinator::~LisaBatchCoordinator()
+{
+}
+
+bool LisaBatchCoordinator::Run()
+{
+	LOG_MSG("Entering LisaBatchCoordinator::Run");
+	if (!w_man_int->GetGal(w_id)) return false;
+	wxStopWatch sw;
+	if (!reuse_last_seed) last_seed_used = time(0);
+	
+	// variables with the same undefined observations use the same weights
+	std::map<std::vector<bool>, std::vector<int> > groups;
+	for (int v=0; v<num_vars; v++) groups[undefs[v]].push_back(v);
+	std::map<std::vector<bool>, std::vector<int> >::iterator it;
+	for (it=groups.begin(); it!=groups.end(); ++it) CalcGroup(it->second);
+	
+	{
+		wxString m;
+		m << "Batch LISA on " << num_obs << " obs and " << num_vars;
+		m << " variables with " << permutations << " perms took ";
+		m << sw.Time() << " ms. Last seed used: " << last_seed_used;
+		LOG_MSG(m);
+	}
+	LOG_MSG("Exiting LisaBatchCoordinator::Run");
+	return true;
+}
+
+/** Local Moran and pseudo p-values for variables vars, which all have the
+ same undefined observations. */
+void LisaBatchCoordinator::CalcGroup(const std::vector<int>& vars)
+{
+	std::vector<bool> undef(undefs[vars[0]]);
+	bool has_undef = false;
+	for (int i=0; i<num_obs && !has_undef; i++) has_undef = undef[i];
+	
+	// local weights copy, as in LisaCoordinator::CalcLisa
+	GalWeight* gw = w_man_int->GetGal(w_id);
+	GalWeight* gw_undef = 0;
+	if (has_undef) {
+		gw_undef = new GalWeight(*gw);
+		gw_undef->Update(undef);
+		gw = gw_undef;
+	}
+	const CsrWeight* W = gw->GetCsr();
+	
+	// standardized variables side by side: x[i*m + j] is observation i of
+	// variable vars[j]
+	int m = vars.size();
+	std::vector<double> x((size_t) num_obs*m);
+	for (int j=0; j<m; j++) {
+		std::vector<double> col(data[vars[j]]);
+		GenUtils::StandardizeData(num_obs, &col[0], undef);
+		for (int i=0; i<num_obs; i++) x[(size_t) i*m + j] = col[i];
+	}
+	
+	std::vector<double> lag(m);
+	for (int i=0; i<num_obs; i++) {
+		if (undef[i]) {
+			for (int j=0; j<m; j++) cluster[vars[j]][i] = 6; // undefined
+			continue;
+		}
+		// same order of operations as CsrWeight::SpatialLag
+		const int* nbrs = W->GetNbrs(i);
+		const double* w = W->GetNbrWeights(i);
+		for (int j=0; j<m; j++) lag[j] = 0;
+		for (int k=0, sz=W->Size(i); k<sz; k++) {
+			const double* row = &x[(size_t) nbrs[k]*m];
+			for (int j=0; j<m; j++) lag[j] += row[j] * w[k];
+		}
+		double sum_w = W->GetRowSum(i);
+		const double* xi = &x[(size_t) i*m];
+		for (int j=0; j<m; j++) {
+			int v = vars[j];
+			double Wdata = sum_w == 0 ? 0 : lag[j] / sum_w;
+			lags[v][i] = Wdata;
+			local_moran[v][i] = xi[j] * Wdata;
+			if (W->Size(i) == 0) cluster[v][i] = 5; // neighborless
+			else if (xi[j] > 0 && Wdata < 0) cluster[v][i] = 4;
+			else if (xi[j] < 0 && Wdata > 0) cluster[v][i] = 3;
+			else if (xi[j] < 0 && Wdata < 0) cluster[v][i] = 2;
+			else cluster[v][i] = 1; //xi[j] > 0 && Wdata > 0
+		}
+	}
+	
+	// chunks and seeds as in LisaCoordinator::CalcPseudoP
+	int grain = GdaConst::pseudo_p_task_grain;
+	GdaTaskGroup group;
+	for (int a=0; a<num_obs; a+=grain) {
+		int b = a + grain - 1;
+		if (b > num_obs-1) b = num_obs-1;
+		group.Run(boost::bind(&LisaBatchCoordinator::CalcPseudoP_range,
+							  this, W, &vars, &x[0], a, b,
+							  Gda::ThomasWangHashUInt64(last_seed_used+a)));
+	}
+	group.Wait();
+	if (gw_undef) delete gw_undef;
+}
+
+/** Pseudo p-values of observations obs_start through obs_end for all
+ variables of a group.  Writes to disjoint ranges of sig_local_moran
+ only. */
+void LisaBatchCoordinator::CalcPseudoP_range(const CsrWeight* W,
+											 const std::vector<int>* vars,
+											 const double* x,
+											 int obs_start, int obs_end,
+											 uint64_t seed_start)
+{
+	int m = vars->size();
+	const std::vector<bool>& undef = undefs[(*vars)[0]];
+	PermutationSampler& sampler = PermutationSampler::ForThread(num_obs);
+	std::vector<double> permutedLags((size_t) permutations*m);
+	for (int cnt=obs_start; cnt<=obs_end; cnt++) {
+		if (undef[cnt]) continue;
+		const int numNeighbors = W->Size(cnt);
+		uint64_t obs_seed = Gda::ThomasWangHashUInt64(seed_start+cnt-obs_start);
+		sampler.PermutedSums(cnt, numNeighbors, permutations, obs_seed, x, m,
+							 &permutedLags[0]);
+		for (int j=0; j<m; j++) {
+			int v = (*vars)[j];
+			double scale = x[(size_t) cnt*m + j];
+			if (numNeighbors) scale /= numNeighbors;
+			const double lisa_cnt = local_moran[v][cnt];
+			uint64_t countLarger = 0;
+			const double* lag = &permutedLags[j];
+			for (int perm=0; perm<permutations; perm++) {
+				countLarger += (lag[(size_t) perm*m] * scale >= lisa_cnt);
+			}
+			// pick the smallest
+			if (permutations-countLarger <= countLarger) {
+				countLarger = permutations-countLarger;
+			}
+			sig_local_moran[v][cnt] = (countLarger+1.0)/(permutations+1);
+		}
+	}
+}
+
+/** base if it is free, otherwise base followed by the first free suffix
+ _2, _3, ... */
+wxString LisaBatchCoordinator::GetNewColName(const wxString& base)
+{
+	wxString name = base;
+	for (int n=2; table_int->DoesNameExist(name, false); n++) {
+		name = base;
+		name << "_" << n;
+	}
+	return name;
+}
+
+std::vector<wxString> LisaBatchCoordinator::SaveToTable(double cutoff)
+{
+	std::vector<wxString> names;
+	std::vector<wxInt64> clust(num_obs);
+	for (int v=0; v<num_vars; v++) {
+		wxString suffix;
+		suffix << v+1;
+		wxString i_name = GetNewColName("LISA_I" + suffix);
+		int col = table_int->InsertCol(GdaConst::double_type, i_name,
+									   table_int->GetNumberCols(), 1,
+									   GdaConst::default_dbf_double_len,
+									   GdaConst::default_dbf_double_decimals);
+		if (col < 0) break;
+		table_int->SetColData(col, 0, local_moran[v]);
+		table_int->SetColUndefined(col, 0, undefs[v]);
+		names.push_back(i_name);
+		
+		for (int i=0; i<num_obs; i++) {
+			if (sig_local_moran[v][i] > cutoff && cluster[v][i] != 5 &&
+				cluster[v][i] != 6) {
+				clust[i] = 0; // not significant
+			} else {
+				clust[i] = cluster[v][i];
+			}
+		}
+		wxString cl_name = GetNewColName("LISA_CL" + suffix);
+		col = table_int->InsertCol(GdaConst::long64_type, cl_name,
+								   table_int->GetNumberCols(), 1,
+								   GdaConst::default_dbf_long_len, 0);
+		if (col < 0) break;
+		table_int->SetColData(col, 0, clust);
+		table_int->SetColUndefined(col, 0, undefs[v]);
+		names.push_back(cl_name);
+		
+		wxString p_name = GetNewColName("LISA_P" + suffix);
+		col = table_int->InsertCol(GdaConst::double_type, p_name,
+								   table_int->GetNumberCols(), 1,
+								   GdaConst::default_dbf_double_len,
+								   GdaConst::default_dbf_double_decimals);
+		if (col < 0) break;
+		table_int->SetColData(col, 0, sig_local_moran[v]);
+		table_int->SetColUndefined(col, 0, undefs[v]);
+		names.push_back(p_name);
+	}
+	return names;
+}
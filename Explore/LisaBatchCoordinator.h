@@ -0,0 +1,100 @@
+/**
+ * GeoDa TM, Copyright (C) 2011-2015 by Luc Anselin - all rights reserved
+ *
+ * This file is part of GeoDa.
+ * 
+ * GeoDa is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+ *
+ * GeoDa is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program.  If not, see <http://www.gnu.org/licenses/>.
+ */
+
+
+#ifndef __GEODA_CENTER_LISA_BATCH_COORDINATOR_H__
+#define __GEODA_CENTER_LISA_BATCH_COORDINATOR_H__
+
+#include <stdint.h>
+#include <vector>
+#include <boost/uuid/uuid.hpp>
+#include <wx/string.h>
+#include "../VarTools.h"
+
+class CsrWeight;
+class Project;
+class TableInterface;
+class WeightsManInterface;
+
+/**
+ * Univariate local Moran's I for many variables against the same weights.
+ * Running one LisaCoordinator per variable draws the same random neighbor
+ * sets and walks the same weights once per variable.  Here the
+ * standardized variables are stored side by side, so each weights row and
+ * each random neighbor set is visited once and applied to all variables.
+ *
+ * Variables with the same undefined observations share one weights copy
+ * and one pass.  Observation i draws from the same random stream as in
+ * LisaCoordinator::CalcPseudoP, so with the same seed every variable gets
+ * the pseudo p-values of a separate univariate run.
+ */
+class LisaBatchCoordinator
+{
+public:
+	LisaBatchCoordinator(boost::uuids::uuid weights_id, Project* project,
+						 const std::vector<GdaVarTools::VarInfo>& var_info,
+						 const std::vector<int>& col_ids);
+	virtual ~LisaBatchCoordinator();
+	
+	int permutations; // any number from 9 to 99999, 999 is the default
+	
+	uint64_t GetLastUsedSeed() { return last_seed_used; }
+	void SetLastUsedSeed(uint64_t seed) { last_seed_used = seed; }
+	bool IsReuseLastSeed() { return reuse_last_seed; }
+	void SetReuseLastSeed(bool reuse) { reuse_last_seed = reuse; }
+	
+	/** Computes local Moran's I, clusters and pseudo p-values of every
+	 variable.  Returns false if the weights are not available. */
+	bool Run();
+	
+	/** Adds three columns per variable to the Table: local Moran's I,
+	 clusters (0 where not significant at significance_cutoff) and pseudo
+	 p-values, named LISA_I, LISA_CL and LISA_P followed by the position
+	 of the variable.  Returns the names of the new columns. */
+	std::vector<wxString> SaveToTable(double significance_cutoff);
+	
+	int num_obs;
+	int num_vars;
+	std::vector<GdaVarTools::VarInfo> var_info;
+	// results, indexed [variable][obs]
+	std::vector<std::vector<double> > local_moran;
+	std::vector<std::vector<double> > lags;
+	std::vector<std::vector<double> > sig_local_moran;
+	// not-sig=0 HH=1, LL=2, HL=3, LH=4, isolate=5, undef=6, as in
+	// LisaCoordinator
+	std::vector<std::vector<int> > cluster;
+	std::vector<std::vector<bool> > undefs;
+	
+protected:
+	void CalcGroup(const std::vector<int>& vars);
+	void CalcPseudoP_range(const CsrWeight* W, const std::vector<int>* vars,
+						   const double* x, int obs_start, int obs_end,
+						   uint64_t seed_start);
+	wxString GetNewColName(const wxString& base);
+	
+	std::vector<std::vector<double> > data; // data[variable][obs]
+	uint64_t last_seed_used;
+	bool reuse_last_seed;
+	
+	boost::uuids::uuid w_id;
+	WeightsManInterface* w_man_int;
+	TableInterface* table_int;
+};
+
+#endif
@@ -17,64 +17,26 @@
  * along with this program.  If not, see <http://www.gnu.org/licenses/>.
  */
 
+#include <algorithm>
 #include <time.h>
 #include <math.h>
+#include <boost/bind.hpp>
 #include <wx/filename.h>
 #include <wx/stopwatch.h>
 #include "../DataViewer/TableInterface.h"
+#include "../ShapeOperations/CsrWeight.h"
 #include "../ShapeOperations/RateSmoothing.h"
 #include "../ShapeOperations/Randik.h"
 #include "../ShapeOperations/WeightsManState.h"
 #include "../VarCalc/WeightsManInterface.h"
+#include "../GdaConst.h"
+#include "../GdaThreadPool.h"
+#include "../PermutationSampler.h"
 #include "../logger.h"
 #include "../Project.h"
 #include "LisaCoordinatorObserver.h"
 #include "LisaCoordinator.h"
 
-LisaWorkerThread::LisaWorkerThread(const GalElement* W_,
-                                   int obs_start_s, int obs_end_s,
-								   uint64_t	seed_start_s,
-								   LisaCoordinator* lisa_coord_s,
-								   wxMutex* worker_list_mutex_s,
-								   wxCondition* worker_list_empty_cond_s,
-								   std::list<wxThread*> *worker_list_s,
-								   int thread_id_s)
-: wxThread(),
-W(W_),
-obs_start(obs_start_s), obs_end(obs_end_s), seed_start(seed_start_s),
-lisa_coord(lisa_coord_s),
-worker_list_mutex(worker_list_mutex_s),
-worker_list_empty_cond(worker_list_empty_cond_s),
-worker_list(worker_list_s),
-thread_id(thread_id_s)
-{
-}
-
-LisaWorkerThread::~LisaWorkerThread()
-{
-}
-
-wxThread::ExitCode LisaWorkerThread::Entry()
-{
-	LOG_MSG(wxString::Format("LisaWorkerThread %d started", thread_id));
-
-	// call work for assigned range of observations
-	lisa_coord->CalcPseudoP_range(W, obs_start, obs_end, seed_start);
-	
-	wxMutexLocker lock(*worker_list_mutex);
-    
-	// remove ourself from the list
-	worker_list->remove(this);
-	
-    // if empty, signal on empty condition since only main thread
-	// should be waiting on this condition
-	if (worker_list->empty()) {
-		worker_list_empty_cond->Signal();
-	}
-	
-	return NULL;
-}
-
 /** 
  Since the user has the ability to synchronise either variable over time,
  we must be able to reapply weights and recalculate lisa values as needed.
@@ -105,13 +67,15 @@ LisaCoordinator::
 LisaCoordinator(boost::uuids::uuid weights_id,
                 Project* project,
                 const std::vector<GdaVarTools::VarInfo>& var_info_s,
-                const std::vector<int>& col_ids,
+                const std::vector<int>& col_ids_s,
                 LisaType lisa_type_s,
                 bool calc_significances_s,
                 bool row_standardize_s)
 : w_man_state(project->GetWManState()),
 w_man_int(project->GetWManInt()),
 w_id(weights_id),
+table_int(project->GetTableInt()),
+col_ids(col_ids_s),
 num_obs(project->GetNumRecords()),
 permutations(999),
 lisa_type(lisa_type_s),
@@ -121,10 +85,11 @@ var_info(var_info_s),
 data(var_info_s.size()),
 undef_data(var_info_s.size()),
 last_seed_used(0), reuse_last_seed(false),
+use_perm_table(false), perm_table(0),
+use_adaptive_perms(false), adaptive_cutoff(1.0),
 row_standardize(row_standardize_s)
 {
     
-	TableInterface* table_int = project->GetTableInt();
 	for (int i=0; i<var_info.size(); i++) {
 		table_int->GetColData(col_ids[i], data[i]);
         table_int->GetColUndefined(col_ids[i], undef_data[i]);
@@ -140,6 +105,43 @@ row_standardize(row_standardize_s)
 	w_man_state->registerObserver(this);
 }
 
+LisaCoordinator::
+LisaCoordinator(boost::uuids::uuid weights_id,
+				WeightsManInterface* w_man_int_s,
+				WeightsManState* w_man_state_s,
+				const std::vector<GdaVarTools::VarInfo>& var_info_s,
+				const std::vector<d_array_type>& data_s,
+				const std::vector<b_array_type>& undef_data_s,
+				LisaType lisa_type_s, uint64_t seed,
+				bool calc_significances_s,
+				bool row_standardize_s)
+: w_man_state(w_man_state_s),
+w_man_int(w_man_int_s),
+w_id(weights_id),
+table_int(0),
+num_obs(data_s[0].shape()[1]),
+permutations(999),
+lisa_type(lisa_type_s),
+calc_significances(calc_significances_s),
+isBivariate(lisa_type_s == bivariate),
+var_info(var_info_s),
+data(data_s),
+undef_data(undef_data_s),
+last_seed_used(seed), reuse_last_seed(true),
+use_perm_table(false), perm_table(0),
+use_adaptive_perms(false), adaptive_cutoff(1.0),
+row_standardize(row_standardize_s)
+{
+	for (int i=0; i<var_info.size(); i++) var_info[i].is_moran = true;
+	undef_tms.resize(var_info_s[0].time_max - var_info_s[0].time_min + 1);
+
+	weight_name = w_man_int->GetLongDispName(w_id);
+	SetSignificanceFilter(1);
+
+	InitFromVarInfo();
+	w_man_state->registerObserver(this);
+}
+
 
 LisaCoordinator::~LisaCoordinator()
 {
@@ -149,6 +151,8 @@ LisaCoordinator::~LisaCoordinator()
 
 void LisaCoordinator::DeallocateVectors()
 {
+	// a background run reads most of the arrays below
+	CancelPseudoP();
 	for (int i=0; i<lags_vecs.size(); i++) {
 		if (lags_vecs[i]) delete [] lags_vecs[i];
 	}
@@ -166,6 +170,10 @@ void LisaCoordinator::DeallocateVectors()
 		if (sig_cat_vecs[i]) delete [] sig_cat_vecs[i];
 	}
 	sig_cat_vecs.clear();
+	for (int i=0; i<num_perms_used_vecs.size(); i++) {
+		if (num_perms_used_vecs[i]) delete [] num_perms_used_vecs[i];
+	}
+	num_perms_used_vecs.clear();
 	for (int i=0; i<cluster_vecs.size(); i++) {
 		if (cluster_vecs[i]) delete [] cluster_vecs[i];
 	}
@@ -198,6 +206,7 @@ void LisaCoordinator::AllocateVectors()
 	local_moran_vecs.resize(tms);
 	sig_local_moran_vecs.resize(tms);
 	sig_cat_vecs.resize(tms);
+	num_perms_used_vecs.resize(tms);
 	cluster_vecs.resize(tms);
 	data1_vecs.resize(tms);
 	map_valid.resize(tms);
@@ -211,6 +220,7 @@ void LisaCoordinator::AllocateVectors()
 		if (calc_significances) {
 			sig_local_moran_vecs[i] = new double[num_obs];
 			sig_cat_vecs[i] = new int[num_obs];
+			num_perms_used_vecs[i] = new int[num_obs];
 		}
 		cluster_vecs[i] = new int[num_obs];
 		data1_vecs[i] = new double[num_obs];
@@ -355,6 +365,110 @@ void LisaCoordinator::VarInfoAttributeChange()
 	//GdaVarTools::PrintVarInfoVector(var_info);
 }
 
+/** Called after values of the variables were edited in the Table.  Only
+ the time periods that use an edited column are brought up to date.
+ Standardized data, lags, local Moran's I and clusters of those periods
+ are recomputed, and so are the pseudo p-values of all observations in
+ those periods, since every reference distribution moves with the new
+ mean and variance.  The p-values use the chunk seeds of the last full
+ run, so they match a full CalcPseudoP run with the same seed.  Changes to
+ undefined values and the EB rate and differential types are computed
+ from scratch.  Returns false if no values changed. */
+bool LisaCoordinator::UpdateFromTable()
+{
+	if (!table_int) return false;
+	std::vector<d_array_type> new_data(var_info.size());
+	std::vector<b_array_type> new_undef(var_info.size());
+	for (int i=0; i<var_info.size(); i++) {
+		table_int->GetColData(col_ids[i], new_data[i]);
+		table_int->GetColUndefined(col_ids[i], new_undef[i]);
+	}
+	
+	bool any_change = false;
+	bool full_update = (lisa_type == eb_rate_standardized ||
+						lisa_type == differential);
+	// edited[v][tm] lists the edited observations of variable v at time tm
+	std::vector<std::vector<std::vector<int> > > edited(var_info.size());
+	for (int v=0; v<var_info.size(); v++) {
+		if (new_data[v].shape()[0] != data[v].shape()[0] ||
+			new_undef[v].shape()[0] != undef_data[v].shape()[0]) {
+			any_change = true;
+			full_update = true;
+			continue;
+		}
+		int tms = new_data[v].shape()[0];
+		edited[v].resize(tms);
+		for (int tm=0; tm<tms; tm++) {
+			for (int i=0; i<num_obs; i++) {
+				if (new_undef[v][tm][i] != undef_data[v][tm][i]) {
+					full_update = true;
+					edited[v][tm].push_back(i);
+				} else if (!new_undef[v][tm][i] &&
+						   new_data[v][tm][i] != data[v][tm][i]) {
+					edited[v][tm].push_back(i);
+				}
+			}
+			if (!edited[v][tm].empty()) any_change = true;
+		}
+	}
+	if (!any_change) return false;
+	// a background run was started on the old data, it is restarted below
+	bool restart_pseudo_p = IsPseudoPRunning();
+	CancelPseudoP();
+	data.swap(new_data);
+	undef_data.swap(new_undef);
+	
+	if (full_update) {
+		// StandardizeData only ever adds to undef_tms
+		for (int t=0; t<undef_tms.size(); t++) undef_tms[t].clear();
+		InitFromVarInfo();
+		return true;
+	}
+	
+	// periods[t] is set if time period t uses an edited column
+	std::vector<bool> periods(num_time_vals, false);
+	for (int t=0; t<num_time_vals; t++) {
+		int tm = var_info[0].time_min + t;
+		if (tm > var_info[0].time_max || edited[0][tm].empty()) continue;
+		periods[t] = true;
+		for (int i=0; i<num_obs; i++) data1_vecs[t][i] = data[0][tm][i];
+		GenUtils::StandardizeData(num_obs, data1_vecs[t], undef_tms[t]);
+	}
+	if (isBivariate) {
+		bool sync = (var_info[1].is_time_variant &&
+					 var_info[1].sync_with_global_time);
+		for (int d2_t=0; d2_t<data2_vecs.size(); d2_t++) {
+			int tm = var_info[1].time_min + d2_t;
+			if (edited[1][tm].empty()) continue;
+			for (int i=0; i<num_obs; i++) data2_vecs[d2_t][i] = data[1][tm][i];
+			// same periods StandardizeData covers
+			if (d2_t < data1_vecs.size()) {
+				GenUtils::StandardizeData(num_obs, data2_vecs[d2_t],
+										  undef_tms[d2_t]);
+			}
+			// unsynchronized data2_vecs[0] is shared by every period
+			int t_start = sync ? d2_t : 0;
+			int t_end = sync ? d2_t : num_time_vals-1;
+			for (int t=t_start; t<=t_end && t<num_time_vals; t++) {
+				periods[t] = true;
+			}
+		}
+	}
+	
+	for (int t=0; t<num_time_vals; t++) {
+		if (!periods[t]) continue;
+		std::vector<bool> undefs;
+		GetUndefsAtTime(t, undefs);
+		CalcLisaAtTime(t, undefs);
+	}
+	if (restart_pseudo_p) {
+		StartPseudoP(0);
+	} else {
+		CalcPseudoP_periods(periods);
+	}
+	return true;
+}
+
 void LisaCoordinator::StandardizeData()
 {
 	for (int t=0; t<data1_vecs.size(); t++) {
@@ -378,35 +492,34 @@ void LisaCoordinator::StandardizeData()
 	}
 }
 
+/** Fills undefs with the observations that are undefined at time t for
+ any of the variables and returns true if there is at least one. */
+bool LisaCoordinator::GetUndefsAtTime(int t, std::vector<bool>& undefs)
+{
+	undefs.clear();
+	bool has_undef = false;
+	for (int i=0; i<undef_data[0][t].size(); i++){
+		bool is_undef = undef_data[0][t][i];
+		if (isBivariate) {
+			is_undef = is_undef || undef_data[1][t][i];
+		}
+		if (is_undef && !has_undef) {
+			has_undef = true;
+		}
+		undefs.push_back(is_undef);
+	}
+	return has_undef;
+}
+
 /** assumes StandardizeData already called on data1 and data2 */
 void LisaCoordinator::CalcLisa()
 {
 	for (int t=0; t<num_time_vals; t++) {
-		data1 = data1_vecs[t];
-		if (isBivariate) {
-			data2 = data2_vecs[0];
-			if (var_info[1].is_time_variant && var_info[1].sync_with_global_time)
-                data2 = data2_vecs[t];
-		}
-		lags = lags_vecs[t];
-		localMoran = local_moran_vecs[t];
-		cluster = cluster_vecs[t];
-	
 		has_isolates[t] = false;
     
         // get undefs of objects/values at this time step
         std::vector<bool> undefs;
-        bool has_undef = false;
-        for (int i=0; i<undef_data[0][t].size(); i++){
-            bool is_undef = undef_data[0][t][i];
-            if (isBivariate) {
-                is_undef = is_undef || undef_data[1][t][i];
-            }
-            if (is_undef && !has_undef) {
-                has_undef = true;
-            }
-            undefs.push_back(is_undef);
-        }
+        bool has_undef = GetUndefsAtTime(t, undefs);
         has_undefined[t] = has_undef;
        
         // local weights copy
@@ -417,81 +530,73 @@ void LisaCoordinator::CalcLisa()
         } else {
             gw = w_man_int->GetGal(w_id);
         }
-        GalElement* W = gw->gal;
         Gal_vecs.push_back(gw);
-	
-		for (int i=0; i<num_obs; i++) {
-            
-            if (undefs[i] == true) {
-                lags[i] = 0;
-                localMoran[i] = 0;
-                cluster[i] = 6; // undefined value
-                continue;
-            }
-            
-			double Wdata = 0;
-			if (isBivariate) {
-				Wdata = W[i].SpatialLag(data2);
-			} else {
-				Wdata = W[i].SpatialLag(data1);
-			}
-			lags[i] = Wdata;
-			localMoran[i] = data1[i] * Wdata;
-					
-			// assign the cluster
-			if (W[i].Size() > 0) {
-				if (data1[i] > 0 && Wdata < 0) cluster[i] = 4;
-				else if (data1[i] < 0 && Wdata > 0) cluster[i] = 3;
-				else if (data1[i] < 0 && Wdata < 0) cluster[i] = 2;
-				else cluster[i] = 1; //data1[i] > 0 && Wdata > 0
-			} else {
-				has_isolates[t] = true;
-				cluster[i] = 5; // neighborless
-			}
-		}
+		
+		CalcLisaAtTime(t, undefs);
 	}
 }
 
-void LisaCoordinator::CalcPseudoP()
+/** Local Moran, lags and clusters for time period t using the weights
+ already in Gal_vecs[t].  O(number of neighbor pairs). */
+void LisaCoordinator::CalcLisaAtTime(int t, const std::vector<bool>& undefs)
 {
-	LOG_MSG("Entering LisaCoordinator::CalcPseudoP");
-	if (!calc_significances) return;
-	wxStopWatch sw;
-	int nCPUs = wxThread::GetCPUCount();
-	
-	// To ensure thread safety, only work on one time slice of data
-	// at a time.  For each time period t:
-	// 1. copy data for time period t into data1 and data2 arrays
-	// 2. Perform multi-threaded computation
-	// 3. copy results into results array
+	data1 = data1_vecs[t];
+	if (isBivariate) {
+		data2 = data2_vecs[0];
+		if (var_info[1].is_time_variant && var_info[1].sync_with_global_time)
+			data2 = data2_vecs[t];
+	}
+	lags = lags_vecs[t];
+	localMoran = local_moran_vecs[t];
+	cluster = cluster_vecs[t];
 	
+	has_isolates[t] = false;
+	const CsrWeight* W = Gal_vecs[t]->GetCsr();
 	
-	for (int t=0; t<num_time_vals; t++) {
+	for (int i=0; i<num_obs; i++) {
 		
-		data1 = data1_vecs[t];
-		if (isBivariate) {
-			data2 = data2_vecs[0];
-			if (var_info[1].is_time_variant &&
-				var_info[1].sync_with_global_time)
-                data2 = data2_vecs[t];
+		if (undefs[i] == true) {
+			lags[i] = 0;
+			localMoran[i] = 0;
+			cluster[i] = 6; // undefined value
+			continue;
 		}
-		lags = lags_vecs[t];
-		localMoran = local_moran_vecs[t];
-		sigLocalMoran = sig_local_moran_vecs[t];
-		sigCat = sig_cat_vecs[t];
-		cluster = cluster_vecs[t];
 		
-		if (nCPUs <= 1 || num_obs <= nCPUs * 10) {
-            if (!reuse_last_seed) {
-                last_seed_used = time(0);
-            }
-			CalcPseudoP_range(Gal_vecs[t]->gal, 0, num_obs-1, last_seed_used);
+		double Wdata = 0;
+		if (isBivariate) {
+			Wdata = W->SpatialLag(i, data2);
 		} else {
-			CalcPseudoP_threaded(Gal_vecs[t]->gal);
+			Wdata = W->SpatialLag(i, data1);
+		}
+		lags[i] = Wdata;
+		localMoran[i] = data1[i] * Wdata;
+				
+		// assign the cluster
+		if (W->Size(i) > 0) {
+			if (data1[i] > 0 && Wdata < 0) cluster[i] = 4;
+			else if (data1[i] < 0 && Wdata > 0) cluster[i] = 3;
+			else if (data1[i] < 0 && Wdata < 0) cluster[i] = 2;
+			else cluster[i] = 1; //data1[i] > 0 && Wdata > 0
+		} else {
+			has_isolates[t] = true;
+			cluster[i] = 5; // neighborless
 		}
 	}
-    
-    
+}
+
+void LisaCoordinator::CalcPseudoP()
+{
+	LOG_MSG("Entering LisaCoordinator::CalcPseudoP");
+	if (!calc_significances) return;
+	wxStopWatch sw;
+	
+	CancelPseudoP();
+	if (!reuse_last_seed) last_seed_used = time(0);
+	adaptive_cutoff = significance_cutoff;
+	AllocatePseudoP(false);
+	RunPseudoP(GdaCancelToken());
+	CommitPseudoP();
+	
 	{
 		wxString m;
 		m << "LISA on " << num_obs << " obs with " << permutations;
@@ -501,141 +606,244 @@ void LisaCoordinator::CalcPseudoP()
 	LOG_MSG("Exiting LisaCoordinator::CalcPseudoP");
 }
 
-void LisaCoordinator::CalcPseudoP_threaded(const GalElement* W)
+void LisaCoordinator::StartPseudoP(wxWindow* parent)
 {
-	LOG_MSG("Entering LisaCoordinator::CalcPseudoP_threaded");
-	int nCPUs = wxThread::GetCPUCount();
-	
-	// mutext protects access to the worker_list
-    wxMutex worker_list_mutex;
-	// signals that worker_list is empty
-	wxCondition worker_list_empty_cond(worker_list_mutex);
-	worker_list_mutex.Lock(); // mutex should be initially locked
-	
-    // List of all the threads currently alive.  As soon as the thread
-	// terminates, it removes itself from the list.
-	std::list<wxThread*> worker_list;
-	
-	// divide up work according to number of observations
-	// and number of CPUs
-	int work_chunk = num_obs / nCPUs;
-    
-    if (work_chunk == 0) {
-        work_chunk = 1;
-    }
-    
-	int obs_start = 0;
-	int obs_end = obs_start + work_chunk;
-	
-	bool is_thread_error = false;
-	int quotient = num_obs / nCPUs;
-	int remainder = num_obs % nCPUs;
-	int tot_threads = (quotient > 0) ? nCPUs : remainder;
-	
+	if (!calc_significances) return;
+	CancelPseudoP();
+	// everything the GUI may change later is settled here, the worker
+	// only reads the snapshot
 	if (!reuse_last_seed) last_seed_used = time(0);
-	for (int i=0; i<tot_threads && !is_thread_error; i++) {
-		int a=0;
-		int b=0;
-		if (i < remainder) {
-			a = i*(quotient+1);
-			b = a+quotient;
-		} else {
-			a = remainder*(quotient+1) + (i-remainder)*quotient;
-			b = a+quotient-1;
-		}
-		uint64_t seed_start = last_seed_used+a;
-		uint64_t seed_end = seed_start + ((uint64_t) (b-a));
-		int thread_id = i+1;
-		wxString msg;
-		msg << "thread " << thread_id << ": " << a << "->" << b;
-		msg << ", seed: " << seed_start << "->" << seed_end;
-		
-		LisaWorkerThread* thread =
-			new LisaWorkerThread(W, a, b, seed_start, this,
-								 &worker_list_mutex,
-								 &worker_list_empty_cond,
-								 &worker_list, thread_id);
-		if ( thread->Create() != wxTHREAD_NO_ERROR ) {
-			delete thread;
-			is_thread_error = true;
-		} else {
-			worker_list.push_front(thread);
+	adaptive_cutoff = significance_cutoff;
+	AllocatePseudoP(false);
+	pseudo_p_task.Start(boost::bind(&LisaCoordinator::RunPseudoP, this, _1),
+						boost::bind(&LisaCoordinator::PseudoPDone, this, _1));
+	if (parent) {
+		wxString m;
+		m << "Running " << permutations << " permutations...";
+		pseudo_p_task.ShowProgress(parent, "Randomization", m);
+	}
+}
+
+void LisaCoordinator::CancelPseudoP()
+{
+	pseudo_p_task.Stop();
+	DiscardPseudoP();
+}
+
+void LisaCoordinator::PseudoPDone(bool ok)
+{
+	if (!ok) {
+		DiscardPseudoP();
+		return;
+	}
+	CommitPseudoP();
+	notifyObservers();
+}
+
+/** Fills the new_* arrays, returns false if token was cancelled first.
+ Runs on whatever thread calls it, and only writes to the new_* arrays
+ and perm_table. */
+bool LisaCoordinator::RunPseudoP(const GdaCancelToken& token)
+{
+	// Time periods are independent of each other, so every period is cut
+	// into fixed-size chunks and all chunks are handed to the shared
+	// thread pool at once.  Idle workers steal chunks from busy ones, so
+	// a chunk of high-degree observations no longer holds up the others.
+	// Each observation draws from its own hashed seed, and since the
+	// chunking does not depend on the number of CPUs, a reused seed gives
+	// the same p-values on every machine.
+	pseudo_p_token = token;
+	pseudo_p_token.SetTotal((double) num_time_vals * num_obs);
+	if (use_perm_table) CreatePermutationTable();
+	int grain = GdaConst::pseudo_p_task_grain;
+	GdaTaskGroup group;
+	for (int t=0; t<num_time_vals; t++) {
+		for (int a=0; a<num_obs; a+=grain) {
+			int b = a + grain - 1;
+			if (b > num_obs-1) b = num_obs-1;
+			group.Run(boost::bind(&LisaCoordinator::CalcPseudoP_range,
+								  this, t, a, b, GetChunkSeed(a)));
 		}
 	}
-	if (is_thread_error) {
-		// fall back to single thread calculation mode
-		CalcPseudoP_range(W, 0, num_obs-1, last_seed_used);
-	} else {
-		std::list<wxThread*>::iterator it;
-		for (it = worker_list.begin(); it != worker_list.end(); it++) {
-			(*it)->Run();
+	group.Wait();
+	if (perm_table) {
+		delete perm_table;
+		perm_table = 0;
+	}
+	return !token.IsCancelled();
+}
+
+void LisaCoordinator::AllocatePseudoP(bool copy_current)
+{
+	DiscardPseudoP();
+	new_sig_local_moran_vecs.resize(num_time_vals);
+	new_sig_cat_vecs.resize(num_time_vals);
+	new_num_perms_used_vecs.resize(num_time_vals);
+	for (int t=0; t<num_time_vals; t++) {
+		new_sig_local_moran_vecs[t] = new double[num_obs];
+		new_sig_cat_vecs[t] = new int[num_obs];
+		new_num_perms_used_vecs[t] = new int[num_obs];
+		if (!copy_current) continue;
+		for (int i=0; i<num_obs; i++) {
+			new_sig_local_moran_vecs[t][i] = sig_local_moran_vecs[t][i];
+			new_sig_cat_vecs[t][i] = sig_cat_vecs[t][i];
+			new_num_perms_used_vecs[t][i] = num_perms_used_vecs[t][i];
 		}
-	
-		while (!worker_list.empty()) {
-			// wait until thread_list might be empty
-			worker_list_empty_cond.Wait();
-			// We have been woken up. If this was not a false
-			// alarm (sprious signal), the loop will exit.
+	}
+}
+
+void LisaCoordinator::CommitPseudoP()
+{
+	sig_local_moran_vecs.swap(new_sig_local_moran_vecs);
+	sig_cat_vecs.swap(new_sig_cat_vecs);
+	num_perms_used_vecs.swap(new_num_perms_used_vecs);
+	DiscardPseudoP();
+}
+
+void LisaCoordinator::DiscardPseudoP()
+{
+	for (size_t t=0; t<new_sig_local_moran_vecs.size(); t++) {
+		if (new_sig_local_moran_vecs[t]) delete [] new_sig_local_moran_vecs[t];
+		if (new_sig_cat_vecs[t]) delete [] new_sig_cat_vecs[t];
+		if (new_num_perms_used_vecs[t]) delete [] new_num_perms_used_vecs[t];
+	}
+	new_sig_local_moran_vecs.clear();
+	new_sig_cat_vecs.clear();
+	new_num_perms_used_vecs.clear();
+}
+
+/** The permutation table only depends on last_seed_used and the largest
+ neighbor count, so rebuilding it reproduces the table of the last full
+ CalcPseudoP run. */
+void LisaCoordinator::CreatePermutationTable()
+{
+	int max_k = 0;
+	for (int t=0; t<num_time_vals; t++) {
+		const CsrWeight* W = Gal_vecs[t]->GetCsr();
+		for (int i=0; i<num_obs; i++) {
+			if (W->Size(i) > max_k) max_k = W->Size(i);
 		}
 	}
+	// too large a table falls back to per-observation sampling
+	if (!PermutationTable::Fits(num_obs, max_k, permutations)) return;
+	perm_table = new PermutationTable(num_obs, max_k, permutations,
+							Gda::ThomasWangHashUInt64(last_seed_used));
+}
+
+/** Seed handed to CalcPseudoP_range for the chunk starting at obs a. */
+uint64_t LisaCoordinator::GetChunkSeed(int a)
+{
+	return Gda::ThomasWangHashUInt64(last_seed_used + a);
+}
 
-	LOG_MSG("Exiting LisaCoordinator::CalcPseudoP_threaded");
+/** Recomputes the pseudo p-values of every observation in the flagged
+ time periods, chunked and seeded exactly as RunPseudoP does, so each
+ period ends up as a full run with last_seed_used would leave it.  The
+ other periods are copied over unchanged. */
+void LisaCoordinator::CalcPseudoP_periods(const std::vector<bool>& periods)
+{
+	if (!calc_significances) return;
+	if (std::find(periods.begin(), periods.end(), true) == periods.end()) {
+		return;
+	}
+	if (use_adaptive_perms && adaptive_cutoff != significance_cutoff) {
+		// kept p-values were stopped at a different cutoff
+		CalcPseudoP();
+		return;
+	}
+	AllocatePseudoP(true);
+	pseudo_p_token = GdaCancelToken();
+	if (use_perm_table) CreatePermutationTable();
+	int grain = GdaConst::pseudo_p_task_grain;
+	GdaTaskGroup group;
+	for (int t=0; t<num_time_vals; t++) {
+		if (!periods[t]) continue;
+		for (int a=0; a<num_obs; a+=grain) {
+			int b = a + grain - 1;
+			if (b > num_obs-1) b = num_obs-1;
+			group.Run(boost::bind(&LisaCoordinator::CalcPseudoP_range,
+								  this, t, a, b, GetChunkSeed(a)));
+		}
+	}
+	group.Wait();
+	if (perm_table) {
+		delete perm_table;
+		perm_table = 0;
+	}
+	CommitPseudoP();
 }
 
-void LisaCoordinator::CalcPseudoP_range(const GalElement* W,
-                                        int obs_start, int obs_end,
+/** Computes pseudo p-values for observations obs_start through obs_end of
+ time period t.  Only reads the per-period arrays and writes to
+ disjoint ranges of new_sig_local_moran_vecs[t] and new_sig_cat_vecs[t],
+ so it may run concurrently for different periods and ranges. */
+void LisaCoordinator::CalcPseudoP_range(int t, int obs_start, int obs_end,
 										uint64_t seed_start)
 {
-	GeoDaSet workPermutation(num_obs);
-	//Randik rng;
-	int max_rand = num_obs-1;
+	const CsrWeight* W = Gal_vecs[t]->GetCsr();
+	double* data1 = data1_vecs[t];
+	double* data2 = 0;
+	if (isBivariate) {
+		data2 = data2_vecs[0];
+		if (var_info[1].is_time_variant && var_info[1].sync_with_global_time)
+			data2 = data2_vecs[t];
+	}
+	double* localMoran = local_moran_vecs[t];
+	double* sigLocalMoran = new_sig_local_moran_vecs[t];
+	int* sigCat = new_sig_cat_vecs[t];
+	
+	PermutationSampler& sampler = PermutationSampler::ForThread(num_obs);
+	std::vector<double> permutedLags(permutations);
+	const double* lag_data = isBivariate ? data2 : data1;
+	// with early stopping, draw in blocks and test after each block
+	int block = permutations;
+	if (use_adaptive_perms) block = PermutationSampler::batch_size;
+	int* permsUsed = new_num_perms_used_vecs[t];
 	for (int cnt=obs_start; cnt<=obs_end; cnt++) {
-		const int numNeighbors = W[cnt].Size();
+		if ((cnt-obs_start) % 16 == 0 && pseudo_p_token.IsCancelled()) return;
+		const int numNeighbors = W->Size(cnt);
+		// every observation has its own random stream, so stopping one
+		// early does not change the draws of the next
+		uint64_t obs_seed = Gda::ThomasWangHashUInt64(seed_start+cnt-obs_start);
 		
+		//NOTE: we shouldn't have to row-standardize or
+		// multiply by data1[cnt]
+		double scale = data1[cnt];
+		if (numNeighbors && row_standardize) scale /= numNeighbors;
+		const double lisa_cnt = localMoran[cnt];
 		uint64_t countLarger = 0;
-		for (int perm=0; perm<permutations; perm++) {
-			int rand=0;
-			while (rand < numNeighbors) {
-				// computing 'perfect' permutation of given size
-                double rng_val = Gda::ThomasWangHashDouble(seed_start++) * max_rand;
-                // round is needed to fix issue
-                //https://github.com/GeoDaCenter/geoda/issues/488
-				int newRandom = (int) (rng_val < 0.0 ? ceil(rng_val - 0.5) : floor(rng_val + 0.5));
-				if (newRandom != cnt && !workPermutation.Belongs(newRandom))
-				{
-					workPermutation.Push(newRandom);
-					rand++;
-				}
-			}
-			double permutedLag=0;
-			// use permutation to compute the lag
-			// compute the lag for binary weights
-			if (isBivariate) {
-				for (int cp=0; cp<numNeighbors; cp++) {
-					permutedLag += data2[workPermutation.Pop()];
-				}
+		int perms_done = 0;
+		while (perms_done < permutations) {
+			int nb = permutations - perms_done;
+			if (nb > block) nb = block;
+			// sums of the data over random neighbor sets, cnt excluded
+			if (perm_table) {
+				perm_table->PermutedSums(cnt, numNeighbors, perms_done, nb,
+										 lag_data, &permutedLags[0]);
 			} else {
-				for (int cp=0; cp<numNeighbors; cp++) {
-					permutedLag += data1[workPermutation.Pop()];
-				}
+				obs_seed = sampler.PermutedSums(cnt, numNeighbors, nb,
+												obs_seed, lag_data,
+												&permutedLags[0]);
+			}
+			for (int perm=0; perm<nb; perm++) {
+				countLarger += (permutedLags[perm] * scale >= lisa_cnt);
+			}
+			perms_done += nb;
+			if (use_adaptive_perms && perms_done < permutations &&
+				PermutationSampler::CannotReachCutoff(countLarger, perms_done,
+													  permutations,
+													  adaptive_cutoff))
+			{
+				break;
 			}
-			
-			//NOTE: we shouldn't have to row-standardize or
-			// multiply by data1[cnt]
-            if (numNeighbors && row_standardize) {
-                permutedLag /= numNeighbors;
-            }
-			const double localMoranPermuted = permutedLag * data1[cnt];
-            if (localMoranPermuted >= localMoran[cnt]) {
-                countLarger++;
-            }
 		}
-		// pick the smallest
-		if (permutations-countLarger <= countLarger) { 
-			countLarger = permutations-countLarger;
+		permsUsed[cnt] = perms_done;
+		// pick the smallest.  After an early stop this is the
+		// Besag-Clifford estimate from the draws actually made.
+		if (perms_done-countLarger <= countLarger) {
+			countLarger = perms_done-countLarger;
 		}
-		
-		sigLocalMoran[cnt] = (countLarger+1.0)/(permutations+1);
+		sigLocalMoran[cnt] = (countLarger+1.0)/(perms_done+1);
 		// 'significance' of local Moran
 		if (sigLocalMoran[cnt] <= 0.0001) sigCat[cnt] = 4;
 		else if (sigLocalMoran[cnt] <= 0.001) sigCat[cnt] = 3;
@@ -649,6 +857,7 @@ void LisaCoordinator::CalcPseudoP_range(const GalElement* W,
 			sigCat[cnt] = 5;
 		}
 	}
+	pseudo_p_token.AddProgress(obs_end - obs_start + 1);
 }
 
 void LisaCoordinator::SetSignificanceFilter(int filter_id)
@@ -660,6 +869,13 @@ void LisaCoordinator::SetSignificanceFilter(int filter_id)
 	if (filter_id == 2) significance_cutoff = 0.01;
 	if (filter_id == 3) significance_cutoff = 0.001;
 	if (filter_id == 4) significance_cutoff = 0.0001;
+	
+	// early-stopped p-values are only exact on the side of the cutoff
+	// they were computed for, so loosening the cutoff needs a new run
+	if (use_adaptive_perms && calc_significances &&
+		significance_cutoff > adaptive_cutoff) {
+		CalcPseudoP();
+	}
 }
 
 void LisaCoordinator::update(WeightsManState* o)
@@ -24,7 +24,7 @@
 #include <vector>
 #include <boost/multi_array.hpp>
 #include <wx/string.h>
-#include <wx/thread.h>
+#include "../GdaAsyncTask.h"
 #include "../VarTools.h"
 #include "../ShapeOperations/GeodaWeight.h"
 #include "../ShapeOperations/GalWeight.h"
@@ -32,36 +32,13 @@
 
 class LisaCoordinatorObserver;
 class LisaCoordinator;
+class PermutationTable;
 class Project;
+class TableInterface;
 class WeightsManState;
 typedef boost::multi_array<double, 2> d_array_type;
 typedef boost::multi_array<bool, 2> b_array_type;
 
-class LisaWorkerThread : public wxThread
-{
-public:
-	LisaWorkerThread(const GalElement* W,
-                     int obs_start, int obs_end, uint64_t seed_start,
-					 LisaCoordinator* lisa_coord,
-					 wxMutex* worker_list_mutex,
-					 wxCondition* worker_list_empty_cond,
-					 std::list<wxThread*> *worker_list,
-					 int thread_id);
-	virtual ~LisaWorkerThread();
-	virtual void* Entry();  // thread execution starts here
-
-    const GalElement* W;
-	int obs_start;
-	int obs_end;
-	uint64_t seed_start;
-	int thread_id;
-	
-	LisaCoordinator* lisa_coord;
-	wxMutex* worker_list_mutex;
-	wxCondition* worker_list_empty_cond;
-	std::list<wxThread*> *worker_list;
-};
-
 class LisaCoordinator : public WeightsManStateObserver
 {
 public:
@@ -74,7 +51,22 @@ public:
 					const std::vector<int>& col_ids,
 					LisaType lisa_type, bool calc_significances = true,
                     bool row_standardize_s = true);
-    
+
+	/** For use without a Project, e.g. by the benchmark suite.  The
+	 data[variable][time][obs] arrays are given directly instead of being
+	 read from the Table, and pseudo p-values are computed with the given
+	 seed so that runs are reproducible.  UpdateFromTable() does nothing
+	 for such a coordinator. */
+	LisaCoordinator(boost::uuids::uuid weights_id,
+					WeightsManInterface* w_man_int,
+					WeightsManState* w_man_state,
+					const std::vector<GdaVarTools::VarInfo>& var_info,
+					const std::vector<d_array_type>& data,
+					const std::vector<b_array_type>& undef_data,
+					LisaType lisa_type, uint64_t seed,
+					bool calc_significances = true,
+					bool row_standardize_s = true);
+
 	virtual ~LisaCoordinator();
 	
 	bool IsOk() { return true; }
@@ -97,6 +89,17 @@ public:
 	bool IsReuseLastSeed() { return reuse_last_seed; }
     
 	void SetReuseLastSeed(bool reuse) { reuse_last_seed = reuse; }
+    
+	/** Opt-in: draw one permutation table for all observations instead of
+	 separate random neighbor sets per observation.  See PermutationTable. */
+	bool IsUsePermutationTable() { return use_perm_table; }
+	void SetUsePermutationTable(bool use) { use_perm_table = use; }
+    
+	/** Opt-in: stop permuting an observation as soon as it provably cannot
+	 be significant at significance_cutoff.  The number of permutations
+	 actually used is kept in num_perms_used_vecs. */
+	bool IsUseAdaptivePermutations() { return use_adaptive_perms; }
+	void SetUseAdaptivePermutations(bool use) { use_adaptive_perms = use; }
 
 	/** Implementation of WeightsManStateObserver interface */
 	virtual void update(WeightsManState* o);
@@ -129,6 +132,7 @@ public:
 	std::vector<double*> local_moran_vecs;
 	std::vector<double*> sig_local_moran_vecs;
 	std::vector<int*> sig_cat_vecs;
+	std::vector<int*> num_perms_used_vecs;
 	std::vector<int*> cluster_vecs;
 	std::vector<double*> data1_vecs;
 	std::vector<double*> data2_vecs;
@@ -168,27 +172,60 @@ public:
 	std::list<LisaCoordinatorObserver*> observers;
 	
 	void CalcPseudoP();
-	void CalcPseudoP_range(const GalElement* W, int obs_start, int obs_end, uint64_t seed_start);
+	void CalcPseudoP_range(int t, int obs_start, int obs_end,
+						   uint64_t seed_start);
+	/** CalcPseudoP() on a background thread.  The current pseudo p-values
+	 stay in place until the run has finished, then observers are
+	 notified.  With a parent, a progress dialog with a Cancel button is
+	 shown over it.  A run in flight is replaced, and the permutation
+	 settings must only be changed after CancelPseudoP(). */
+	void StartPseudoP(wxWindow* parent);
+	/** Stops a background run and drops its partial results. */
+	void CancelPseudoP();
+	bool IsPseudoPRunning() { return pseudo_p_task.IsRunning(); }
 
 	void InitFromVarInfo();
 	void VarInfoAttributeChange();
+	bool UpdateFromTable();
 
 protected:
 	void DeallocateVectors();
 	void AllocateVectors();
 	
-	void CalcPseudoP_threaded(const GalElement* W);
 	void CalcLisa();
+	void CalcLisaAtTime(int t, const std::vector<bool>& undefs);
+	bool GetUndefsAtTime(int t, std::vector<bool>& undefs);
 	void StandardizeData();
+	void CreatePermutationTable();
+	uint64_t GetChunkSeed(int a);
+	void CalcPseudoP_periods(const std::vector<bool>& periods);
+	void AllocatePseudoP(bool copy_current);
+	bool RunPseudoP(const GdaCancelToken& token);
+	void PseudoPDone(bool ok);
+	void CommitPseudoP();
+	void DiscardPseudoP();
 	std::vector<bool> has_undefined;
 	std::vector<bool> has_isolates;
 	bool row_standardize;
 	bool calc_significances; // if false, then p-vals will never be needed
 	uint64_t last_seed_used;
 	bool reuse_last_seed;
+	bool use_perm_table;
+	PermutationTable* perm_table; // only set while CalcPseudoP runs
+	bool use_adaptive_perms;
+	double adaptive_cutoff; // significance_cutoff used by last CalcPseudoP
+	// Pseudo p-value runs write here, and CommitPseudoP() swaps the arrays
+	// with sig_local_moran_vecs, sig_cat_vecs and num_perms_used_vecs.
+	std::vector<double*> new_sig_local_moran_vecs;
+	std::vector<int*> new_sig_cat_vecs;
+	std::vector<int*> new_num_perms_used_vecs;
+	GdaCancelToken pseudo_p_token; // of the run filling the new_* arrays
+	GdaAsyncTask pseudo_p_task;
 	
 	WeightsManState* w_man_state;
 	WeightsManInterface* w_man_int;
+	TableInterface* table_int;
+	std::vector<int> col_ids;
 };
 
 #endif
@@ -24,6 +24,7 @@
 #include <wx/splitter.h>
 #include <wx/xrc/xmlres.h>
 #include "../DataViewer/TableInterface.h"
+#include "../DataViewer/TableState.h"
 #include "../DataViewer/TimeState.h"
 #include "../GeneralWxUtils.h"
 #include "../GeoDa.h"
@@ -161,6 +162,10 @@ void LisaMapCanvas::SetCheckMarks(wxMenu* menu)
 	
 	GeneralWxUtils::CheckMenuItem(menu, XRCID("ID_USE_SPECIFIED_SEED"),
 								  lisa_coord->IsReuseLastSeed());
+	GeneralWxUtils::CheckMenuItem(menu, XRCID("ID_USE_PERMUTATION_TABLE"),
+								  lisa_coord->IsUsePermutationTable());
+	GeneralWxUtils::CheckMenuItem(menu, XRCID("ID_USE_ADAPTIVE_PERMUTATIONS"),
+								  lisa_coord->IsUseAdaptivePermutations());
 }
 
 void LisaMapCanvas::TimeChange()
@@ -527,10 +532,13 @@ void LisaMapFrame::UpdateContextMenuItems(wxMenu* menu)
 void LisaMapFrame::RanXPer(int permutation)
 {
 	if (permutation < 9) permutation = 9;
-	if (permutation > 99999) permutation = 99999;
+	// a shared permutation table makes much longer runs affordable
+	int max_perms = lisa_coord->IsUsePermutationTable() ? 999999 : 99999;
+	if (permutation > max_perms) permutation = max_perms;
+	lisa_coord->CancelPseudoP();
 	lisa_coord->permutations = permutation;
-	lisa_coord->CalcPseudoP();
-	lisa_coord->notifyObservers();
+	// observers are notified once the run has finished
+	lisa_coord->StartPseudoP(this);
 }
 
 void LisaMapFrame::OnRan99Per(wxCommandEvent& event)
@@ -588,9 +596,14 @@ void LisaMapFrame::OnSpecifySeedDlg(wxCommandEvent& event)
 	dlg_val.Trim(false);
 	if (dlg_val.IsEmpty()) return;
 	if (dlg_val.ToULongLong(&val)) {
+		// a run in flight reads the seed, so it is stopped first and
+		// started again with the new seed
+		bool restart = lisa_coord->IsPseudoPRunning();
+		lisa_coord->CancelPseudoP();
 		if (!lisa_coord->IsReuseLastSeed()) lisa_coord->SetLastUsedSeed(true);
 		uint64_t new_seed_val = val;
 		lisa_coord->SetLastUsedSeed(new_seed_val);
+		if (restart) lisa_coord->StartPseudoP(this);
 	} else {
 		wxString m;
 		m << "\"" << dlg_val << "\" is not a valid seed. Seed unchanged.";
@@ -599,6 +612,20 @@ void LisaMapFrame::OnSpecifySeedDlg(wxCommandEvent& event)
 	}
 }
 
+void LisaMapFrame::OnUsePermutationTable(wxCommandEvent& event)
+{
+	lisa_coord->CancelPseudoP();
+	lisa_coord->SetUsePermutationTable(!lisa_coord->IsUsePermutationTable());
+	lisa_coord->StartPseudoP(this);
+}
+
+void LisaMapFrame::OnUseAdaptivePermutations(wxCommandEvent& event)
+{
+	lisa_coord->CancelPseudoP();
+	lisa_coord->SetUseAdaptivePermutations(!lisa_coord->IsUseAdaptivePermutations());
+	lisa_coord->StartPseudoP(this);
+}
+
 void LisaMapFrame::SetSigFilterX(int filter)
 {
 	if (filter == lisa_coord->GetSignificanceFilter()) return;
@@ -832,6 +859,28 @@ void LisaMapFrame::closeObserver(LisaCoordinator* o)
 	Close(true);
 }
 
+/** Implementation of TableStateObserver interface.  Edited values of the
+ LISA variables are passed on to the coordinator, which only recomputes
+ the time periods and observations they affect. */
+void LisaMapFrame::update(TableState* o)
+{
+	if (!lisa_coord || o->GetEventType() != TableState::col_data_change) {
+		return;
+	}
+	for (int i=0; i<lisa_coord->var_info.size(); i++) {
+		if (lisa_coord->var_info[i].name == o->GetModifiedColName()) {
+			if (lisa_coord->UpdateFromTable()) lisa_coord->notifyObservers();
+			return;
+		}
+	}
+}
+
+/** The map follows edits to its variables, see update(TableState*). */
+bool LisaMapFrame::AllowGroupModify(const wxString& grp_nm)
+{
+	return true;
+}
+
 void LisaMapFrame::GetVizInfo(std::vector<int>& clusters)
 {
 	if (lisa_coord) {
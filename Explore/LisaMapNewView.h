@@ -88,6 +88,8 @@ public:
 	
 	void OnUseSpecifiedSeed(wxCommandEvent& event);
 	void OnSpecifySeedDlg(wxCommandEvent& event);
+	void OnUsePermutationTable(wxCommandEvent& event);
+	void OnUseAdaptivePermutations(wxCommandEvent& event);
 	
 	void SetSigFilterX(int filter);
 	void OnSigFilter05(wxCommandEvent& event);
@@ -104,6 +106,10 @@ public:
 	virtual void update(LisaCoordinator* o);
 	virtual void closeObserver(LisaCoordinator* o);
 	
+	/** Implementation of TableStateObserver interface */
+	virtual void update(TableState* o);
+	virtual bool AllowGroupModify(const wxString& grp_nm);
+	
 	void GetVizInfo(std::vector<int>& clusters);
 protected:
 	void CoreSelectHelper(const std::vector<bool>& elem);
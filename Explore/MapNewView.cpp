@@ -43,6 +43,7 @@
 #include "../DialogTools/ExportDataDlg.h"
 #include "../DialogTools/ConnectDatasourceDlg.h"
 #include "../GdaConst.h"
+#include "../GdaRaster.h"
 #include "../GeneralWxUtils.h"
 #include "../logger.h"
 #include "../GeoDa.h"
@@ -479,7 +480,7 @@ void MapCanvas::DrawLayers()
     if (!layer0_valid)
         DrawLayer0();
     
-    if (!layer1_valid) {
+    if (!layer1_valid || !layer1_dirty.IsEmpty()) {
         DrawLayer1();
     }
     
@@ -517,6 +518,7 @@ void MapCanvas::DrawLayer0()
     }
 
     DrawSelectableShapes(dc);
+    sel_index_dirty = true;
     
     layer0_valid = true;
     layer1_valid = false;
@@ -527,7 +529,13 @@ void MapCanvas::DrawLayer1()
     if (layer1_bm == NULL)
         return;
     wxMemoryDC dc(*layer1_bm);
-    dc.Clear();
+    if (!layer1_valid) layer1_dirty = wxRect();
+    if (!layer1_dirty.IsEmpty()) {
+        // partial repaint, everything below is drawn clipped
+        dc.SetClippingRegion(layer1_dirty);
+    } else {
+        dc.Clear();
+    }
     
     if (isDrawBasemap) {
         dc.DrawBitmap(*basemap_bm,0,0);
@@ -572,6 +580,7 @@ void MapCanvas::DrawLayer1()
     DrawHighlightedShapes(dc, revert);
     
     dc.SelectObject(wxNullBitmap);
+    layer1_dirty = wxRect();
     layer1_valid = true;
     layer2_valid = false;
 }
@@ -583,6 +592,20 @@ void MapCanvas::DrawHighlightedShapes(wxMemoryDC &dc, bool revert)
         return;
     
     //if (GdaConst::transparency_highlighted == 255 || GdaConst::use_cross_hatching) {
+        if (use_category_brushes && !GdaConst::use_cross_hatching) {
+            // rendered on the thread pool, then blended in one go
+            wxSize sz = dc.GetSize();
+            GdaRaster raster(sz.GetWidth(), sz.GetHeight());
+            if (RasterizeSelectableShapes(raster, true, revert)) {
+                if (!raster.IsEmpty()) {
+                    raster.Render();
+                    wxImage image;
+                    raster.ToImage(image);
+                    dc.DrawBitmap(wxBitmap(image), 0, 0, true);
+                }
+                return;
+            }
+        }
         if (use_category_brushes) {
             bool highlight_only = true;
             DrawSelectableShapes_dc(dc, highlight_only, revert, GdaConst::use_cross_hatching);
@@ -694,6 +717,20 @@ void MapCanvas::DrawSelectableShapes(wxMemoryDC &dc)
 {
     if ( map_bm == NULL ) {
         wxSize sz = dc.GetSize();
+        int alpha_value = 255;
+        if (isDrawBasemap) { alpha_value = transparency * 255; }
+        if (background_shps.empty()) {
+            // rendered on the thread pool straight into an RGBA image, no
+            // mask colour needed
+            GdaRaster raster(sz.GetWidth(), sz.GetHeight());
+            if (RasterizeSelectableShapes(raster)) {
+                raster.Render();
+                wxImage image;
+                raster.ToImage(image, alpha_value / 255.0);
+                map_bm = new wxBitmap(image);
+                return;
+            }
+        }
         wxBitmap bmp(sz.GetWidth(), sz.GetHeight());
         wxMemoryDC _dc;
         // use a special color for mask transparency: 244, 243, 242c
@@ -714,8 +751,6 @@ void MapCanvas::DrawSelectableShapes(wxMemoryDC &dc)
         if (!image.HasAlpha()) {
             image.InitAlpha();
         }
-        int alpha_value = 255;
-        if (isDrawBasemap) { alpha_value = transparency * 255; }
         unsigned char *alpha=image.GetAlpha();
         unsigned char* pixel_data = image.GetData();
         int n_pixel = image.GetWidth() * image.GetHeight();
@@ -1299,7 +1334,7 @@ void MapCanvas::PopulateCanvas()
 
 	if (map_valid[canvas_ts]) {		
 		if (full_map_redraw_needed) {
-			CreateSelShpsFromProj(selectable_shps, project);
+			CreateSelShpsFromProj(selectable_shps, project, &sel_screen_pts);
 			full_map_redraw_needed = false;
 			
 			if (selectable_shps_type == polygons &&
@@ -0,0 +1,149 @@
+/**
+ * GeoDa TM, Copyright (C) 2011-2015 by Luc Anselin - all rights reserved
+ *
+ * This file is part of GeoDa.
+ *
+ * GeoDa is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+ *
+ * GeoDa is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program.  If not, see <http://www.gnu.org/licenses/>.
+ */
+
+#include <boost/bind.hpp>
+#include "GdaAsyncTask.h"
+
+GdaCancelToken::GdaCancelToken() : state(new State)
+{
+}
+
+void GdaCancelToken::Cancel()
+{
+	boost::mutex::scoped_lock lock(state->mutex);
+	state->cancelled = true;
+}
+
+bool GdaCancelToken::IsCancelled() const
+{
+	boost::mutex::scoped_lock lock(state->mutex);
+	return state->cancelled;
+}
+
+void GdaCancelToken::SetTotal(double total)
+{
+	boost::mutex::scoped_lock lock(state->mutex);
+	state->total = total;
+}
+
+void GdaCancelToken::AddProgress(double done)
+{
+	boost::mutex::scoped_lock lock(state->mutex);
+	state->done += done;
+}
+
+double GdaCancelToken::GetProgress() const
+{
+	boost::mutex::scoped_lock lock(state->mutex);
+	if (state->total <= 0) return 0;
+	double p = state->done / state->total;
+	return p > 1 ? 1 : p;
+}
+
+GdaAsyncTask::GdaAsyncTask()
+: run_id(0), running(false), timer(0)
+{
+	Bind(wxEVT_TIMER, &GdaAsyncTask::OnTimer, this);
+}
+
+GdaAsyncTask::~GdaAsyncTask()
+{
+	Stop();
+	if (timer) delete timer;
+}
+
+void GdaAsyncTask::Start(const Work& work, const Done& done_s)
+{
+	Stop();
+	token = GdaCancelToken();
+	done = done_s;
+	running = true;
+	thread = boost::thread(boost::bind(&GdaAsyncTask::Run, this, work,
+									   token, run_id));
+}
+
+void GdaAsyncTask::Run(Work work, GdaCancelToken tok, int id)
+{
+	bool ok = work(tok);
+	// queued for the GUI thread, dropped with the task if it is deleted
+	CallAfter(&GdaAsyncTask::OnFinished, id, ok);
+}
+
+void GdaAsyncTask::OnFinished(int id, bool ok)
+{
+	// a completion of a run that was stopped and replaced since
+	if (id != run_id || !running) return;
+	thread.join();
+	running = false;
+	CloseProgress();
+	Done d;
+	d.swap(done);
+	if (d) d(ok && !token.IsCancelled());
+}
+
+void GdaAsyncTask::Cancel()
+{
+	token.Cancel();
+}
+
+void GdaAsyncTask::Stop()
+{
+	token.Cancel();
+	if (thread.joinable()) thread.join();
+	++run_id;
+	running = false;
+	done = Done();
+	CloseProgress();
+}
+
+void GdaAsyncTask::ShowProgress(wxWindow* parent, const wxString& title,
+								const wxString& message)
+{
+	if (!running) return;
+	CloseProgress();
+	// no wxPD_APP_MODAL: only the parent is disabled while the dialog
+	// is up, every other window keeps working
+	progress_dlg = new wxProgressDialog(title, message, 100, parent,
+										wxPD_CAN_ABORT | wxPD_AUTO_HIDE |
+										wxPD_ELAPSED_TIME);
+	if (!timer) timer = new wxTimer(this);
+	timer->Start(100);
+}
+
+void GdaAsyncTask::OnTimer(wxTimerEvent& event)
+{
+	if (!progress_dlg) {
+		// closed along with its parent
+		timer->Stop();
+		return;
+	}
+	int pct = (int) (token.GetProgress() * 100);
+	if (pct > 99) pct = 99; // 100 would hide the dialog before done runs
+	if (!progress_dlg->Update(pct)) {
+		Cancel();
+		CloseProgress();
+	}
+}
+
+void GdaAsyncTask::CloseProgress()
+{
+	if (timer) timer->Stop();
+	if (progress_dlg) progress_dlg->Destroy();
+	progress_dlg.Release();
+}
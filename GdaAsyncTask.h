@@ -0,0 +1,138 @@
+/**
+ * GeoDa TM, Copyright (C) 2011-2015 by Luc Anselin - all rights reserved
+ *
+ * This file is part of GeoDa.
+ *
+ * GeoDa is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+ *
+ * GeoDa is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program.  If not, see <http://www.gnu.org/licenses/>.
+ */
+
+#ifndef __GEODA_CENTER_GDA_ASYNC_TASK_H__
+#define __GEODA_CENTER_GDA_ASYNC_TASK_H__
+
+#include <boost/function.hpp>
+#include <boost/shared_ptr.hpp>
+#include <boost/thread.hpp>
+#include <wx/event.h>
+#include <wx/progdlg.h>
+#include <wx/string.h>
+#include <wx/timer.h>
+#include <wx/weakref.h>
+
+/**
+ * Cooperative cancellation and progress for long running computations.
+ * A token is a cheap handle: copies share the same state, so the GUI
+ * thread can cancel a computation that a worker is polling.  A fresh
+ * token can only be cancelled through its copies, so synchronous callers
+ * simply pass GdaCancelToken().
+ *
+ * Computations should call IsCancelled() every few milliseconds of work,
+ * e.g. once per chunk handed to the GdaThreadPool, and return early when
+ * it is true.  The state is protected by a mutex, so it should not be
+ * polled in the innermost loop.
+ */
+class GdaCancelToken {
+public:
+	GdaCancelToken();
+
+	void Cancel();
+	bool IsCancelled() const;
+
+	/** Total amount of work, in whatever units AddProgress() uses. */
+	void SetTotal(double total);
+	/** Called by workers, from any thread, as work gets done. */
+	void AddProgress(double done);
+	/** Fraction of the work done so far, between 0 and 1. */
+	double GetProgress() const;
+
+protected:
+	struct State {
+		State() : cancelled(false), total(0), done(0) {}
+		mutable boost::mutex mutex;
+		bool cancelled;
+		double total;
+		double done;
+	};
+	boost::shared_ptr<State> state;
+};
+
+/**
+ * GdaAsyncTask runs one computation at a time on a background thread and
+ * hands the outcome back to the wx event loop.  It plays the role of a
+ * future for the GUI: the work function runs off the GUI thread, the done
+ * function is called later on the GUI thread with true if the work
+ * returned true and was not cancelled in the meantime.  The work function
+ * may use the GdaThreadPool as usual; the background thread helps with
+ * the queued tasks while it waits.
+ *
+ * Results must be written to memory the GUI does not read until done is
+ * called, typically buffers that done then swaps in.  This is what lets
+ * the maps stay interactive, and several tasks (one per coordinator) run
+ * at the same time.
+ *
+ * \code
+ * task.Start(boost::bind(&Foo::Calc, this, _1),
+ *            boost::bind(&Foo::CalcDone, this, _1));
+ * task.ShowProgress(frame, "Permutations", "Computing pseudo p-values...");
+ * \endcode
+ *
+ * The task itself receives the completion event, so deleting it (or the
+ * object it is a member of) drops a completion that has not yet been
+ * delivered.  The destructor cancels and joins a running computation.
+ */
+class GdaAsyncTask : public wxEvtHandler {
+public:
+	typedef boost::function<bool (const GdaCancelToken&)> Work;
+	typedef boost::function<void (bool)> Done;
+
+	GdaAsyncTask();
+	virtual ~GdaAsyncTask();
+
+	/** Starts work on a new thread.  A run still in flight is stopped
+	 first, without calling its done function. */
+	void Start(const Work& work, const Done& done);
+	/** Shows a progress dialog with a Cancel button for the current run.
+	 The dialog only disables parent, other windows stay usable.  It is
+	 closed when the run finishes or is stopped. */
+	void ShowProgress(wxWindow* parent, const wxString& title,
+					  const wxString& message);
+
+	/** Asks the running computation to stop.  done is still called, with
+	 false, once the work function has returned. */
+	void Cancel();
+	/** Cancels, waits for the work function to return and forgets about
+	 the run: done is not called. */
+	void Stop();
+	/** True from Start() until done has been called or Stop() returned. */
+	bool IsRunning() const { return running; }
+
+	GdaCancelToken GetToken() const { return token; }
+
+protected:
+	void Run(Work work, GdaCancelToken token, int run_id);
+	void OnFinished(int run_id, bool ok);
+	void OnTimer(wxTimerEvent& event);
+	void CloseProgress();
+
+	boost::thread thread;
+	GdaCancelToken token;
+	Done done;
+	int run_id; // increased by every Start() and Stop()
+	bool running;
+
+	wxTimer* timer; // created by the first ShowProgress()
+	// the dialog goes away with its parent window
+	wxWeakRef<wxProgressDialog> progress_dlg;
+};
+
+#endif
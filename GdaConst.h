@@ -108,6 +108,11 @@ public:
 	static const int max_dbf_date_len = 8;
 	static const int min_dbf_date_len = 8;
 	static const int default_dbf_date_len = 8;
+	
+	// Number of observations per task when permutation tests are submitted
+	// to GdaThreadPool.  Kept independent of the CPU count so that results
+	// for a given seed are the same on every machine.
+	static const int pseudo_p_task_grain = 64;
     
     
 	
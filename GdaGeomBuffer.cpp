@@ -0,0 +1,141 @@
+/**
+ * GeoDa TM, Copyright (C) 2011-2015 by Luc Anselin - all rights reserved
+ *
+ * This file is part of GeoDa.
+ * 
+ * GeoDa is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+ *
+ * GeoDa is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program.  If not, see <http://www.gnu.org/licenses/>.
+ */
+
+
+#include <cfloat>
+#include <boost/bind.hpp>
+#include "GdaShape.h"
+#include "GdaThreadPool.h"
+#include "GdaGeomBuffer.h"
+
+GdaGeomBuffer::GdaGeomBuffer() : vtx_start(1, 0), part_start(1, 0)
+{
+}
+
+bool GdaGeomBuffer::Build(const Shapefile::Main& main)
+{
+	using namespace Shapefile;
+	x.clear();
+	y.clear();
+	lod_tol.clear();
+	vtx_start.assign(1, 0);
+	part_start.assign(1, 0);
+	part_count.clear();
+	center.clear();
+	bb_ll.clear();
+	bb_ur.clear();
+	if (main.header.shape_type != Shapefile::POLYGON) return false;
+	
+	int num_recs = main.records.size();
+	int num_vtx = 0;
+	int num_parts = 0;
+	for (int i=0; i<num_recs; i++) {
+		PolygonContents* pc = (PolygonContents*) main.records[i].contents_p;
+		if (pc->shape_type == 0 || pc->num_points == 0) continue;
+		num_vtx += pc->num_points;
+		num_parts += pc->num_parts;
+	}
+	x.resize(num_vtx);
+	y.resize(num_vtx);
+	lod_tol.resize(num_vtx);
+	vtx_start.resize(num_recs+1);
+	part_start.resize(num_recs+1);
+	part_count.resize(num_parts);
+	center.resize(num_recs);
+	bb_ll.resize(num_recs);
+	bb_ur.resize(num_recs);
+	
+	int v = 0;
+	int p = 0;
+	for (int i=0; i<num_recs; i++) {
+		vtx_start[i] = v;
+		part_start[i] = p;
+		PolygonContents* pc = (PolygonContents*) main.records[i].contents_p;
+		if (pc->shape_type == 0 || pc->num_points == 0) continue;
+		for (int j=0; j<pc->num_points; j++) {
+			x[v+j] = pc->points[j].x;
+			y[v+j] = pc->points[j].y;
+		}
+		if (pc->num_parts > 0) {
+			GdaShapeAlgs::partsToCount(pc->parts, pc->num_points,
+									   &part_count[p]);
+		}
+		v += pc->num_points;
+		p += pc->num_parts;
+	}
+	vtx_start[num_recs] = v;
+	part_start[num_recs] = p;
+	
+	// the records are independent, tolerances are the costly part
+	GdaThreadPool::GetInstance()->
+		ParallelFor(0, num_recs-1, 256,
+					boost::bind(&GdaGeomBuffer::CalcRange, this, _1, _2));
+	return true;
+}
+
+/** Centers, bounding boxes and level-of-detail tolerances of records
+ first_rec to last_rec */
+void GdaGeomBuffer::CalcRange(int first_rec, int last_rec)
+{
+	for (int i=first_rec; i<=last_rec; i++) {
+		int v0 = vtx_start[i];
+		int n = vtx_start[i+1] - v0;
+		if (n == 0) continue;
+		wxRealPoint c(0, 0);
+		for (int j=v0; j<v0+n; j++) {
+			c.x += x[j];
+			c.y += y[j];
+		}
+		c.x /= (double) n;
+		c.y /= (double) n;
+		center[i] = c;
+		// as in GdaPolygon, the box starts at the mean center
+		wxRealPoint ll(c), ur(c);
+		for (int j=v0; j<v0+n; j++) {
+			if (x[j] < ll.x) ll.x = x[j];
+			if (x[j] > ur.x) ur.x = x[j];
+			if (y[j] < ll.y) ll.y = y[j];
+			if (y[j] > ur.y) ur.y = y[j];
+		}
+		bb_ll[i] = ll;
+		bb_ur[i] = ur;
+		int v = v0;
+		for (int k=part_start[i]; k<part_start[i+1] && v<v0+n; k++) {
+			int m = GenUtils::min<int>(part_count[k], v0+n-v);
+			GdaShapeAlgs::calcLodTolerances(m, &x[v], &y[v], &lod_tol[v]);
+			v += m;
+		}
+		for (; v<v0+n; v++) lod_tol[v] = FLT_MAX;
+	}
+}
+
+void GdaGeomBuffer::Transform(const GdaScaleTrans& A, int first, int last,
+							  wxPoint* out) const
+{
+	const double sx = A.scale_x;
+	const double sy = A.scale_y;
+	const double tx = A.trans_x;
+	const double ty = A.trans_y;
+	const double* px = &x[0] + first;
+	const double* py = &y[0] + first;
+	for (int i=0, m=last-first+1; i<m; i++) {
+		out[i].x = (int) (px[i] * sx + tx);
+		out[i].y = (int) (py[i] * sy + ty);
+	}
+}
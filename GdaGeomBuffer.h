@@ -0,0 +1,78 @@
+/**
+ * GeoDa TM, Copyright (C) 2011-2015 by Luc Anselin - all rights reserved
+ *
+ * This file is part of GeoDa.
+ * 
+ * GeoDa is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+ *
+ * GeoDa is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program.  If not, see <http://www.gnu.org/licenses/>.
+ */
+
+
+#ifndef __GEODA_CENTER_GDA_GEOM_BUFFER_H__
+#define __GEODA_CENTER_GDA_GEOM_BUFFER_H__
+
+#include <vector>
+#include <wx/gdicmn.h>
+#include "ShpFile.h"
+
+struct GdaScaleTrans;
+
+/**
+ * GdaGeomBuffer holds the polygons of a layer as columns: all vertices in
+ * two contiguous coordinate arrays, and per record the range of vertices,
+ * the ring sizes, the bounding box and the mean center.  It is built once
+ * per Project and is never changed afterwards, so every view of the layer
+ * (map, conditional map, ...) shares it: a GdaPolygon created from the
+ * buffer borrows its ring sizes and level-of-detail tolerances, and only
+ * its screen coordinates belong to the view.
+ *
+ * Record i has vertices vtx_start[i] to vtx_start[i+1]-1 and rings
+ * part_start[i] to part_start[i+1]-1 of part_count.  A null record has no
+ * vertices.
+ */
+class GdaGeomBuffer {
+public:
+	GdaGeomBuffer();
+	
+	/** Copies the polygon records of main.  Returns false, and leaves the
+	 buffer empty, unless main is a polygon layer. */
+	bool Build(const Shapefile::Main& main);
+	
+	int GetNumRecords() const { return (int) vtx_start.size()-1; }
+	int GetNumVertices() const { return (int) x.size(); }
+	bool IsNull(int rec) const { return vtx_start[rec] == vtx_start[rec+1]; }
+	
+	/** Screen coordinates of vertices first to last (inclusive), written
+	 to out[0] onwards.  Gives the same result as GdaScaleTrans::transform
+	 one vertex at a time, but runs over the coordinate arrays in a loop
+	 the compiler can vectorize. */
+	void Transform(const GdaScaleTrans& A, int first, int last,
+				   wxPoint* out) const;
+	
+	std::vector<double> x;
+	std::vector<double> y;
+	// Douglas-Peucker tolerance of each vertex, see
+	// GdaShapeAlgs::calcLodTolerances
+	std::vector<float> lod_tol;
+	std::vector<int> vtx_start;
+	std::vector<int> part_start;
+	std::vector<int> part_count;
+	std::vector<wxRealPoint> center;
+	std::vector<wxRealPoint> bb_ll;
+	std::vector<wxRealPoint> bb_ur;
+	
+protected:
+	void CalcRange(int first_rec, int last_rec);
+};
+
+#endif
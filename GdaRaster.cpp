@@ -0,0 +1,297 @@
+/**
+ * GeoDa TM, Copyright (C) 2011-2015 by Luc Anselin - all rights reserved
+ *
+ * This file is part of GeoDa.
+ * 
+ * GeoDa is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+ *
+ * GeoDa is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program.  If not, see <http://www.gnu.org/licenses/>.
+ */
+
+
+#include <algorithm>
+#include <cmath>
+#include <boost/bind.hpp>
+#include "GdaThreadPool.h"
+#include "GdaRaster.h"
+
+// sub-scanlines sampled per row of pixels
+static const int sub_rows = 4;
+static const double two_pi = 6.283185307179586;
+
+bool GdaRaster::EdgeAbove(const Edge& a, const Edge& b)
+{
+	return a.y0 < b.y0;
+}
+
+GdaRaster::GdaRaster(int width_s, int height_s)
+: width(width_s > 0 ? width_s : 0), height(height_s > 0 ? height_s : 0),
+pixels((size_t) width * height * 4, 0)
+{
+}
+
+void GdaRaster::BeginShape(const wxColour& c, bool nonzero)
+{
+	EndShape();
+	Shape s;
+	s.r = c.Red();
+	s.g = c.Green();
+	s.b = c.Blue();
+	s.a = c.Alpha();
+	s.nonzero = nonzero;
+	s.first_edge = edges.size();
+	s.last_edge = edges.size();
+	s.y_min = 0;
+	s.y_max = -1;
+	shapes.push_back(s);
+}
+
+/** Sorts the edges of the current shape and records its extent. */
+void GdaRaster::EndShape()
+{
+	if (shapes.empty()) return;
+	Shape& s = shapes.back();
+	if (s.last_edge == (int) edges.size()) return;
+	s.last_edge = edges.size();
+	std::sort(edges.begin() + s.first_edge, edges.end(), EdgeAbove);
+	s.y_min = edges[s.first_edge].y0;
+	s.y_max = s.y_min;
+	for (int i=s.first_edge; i<s.last_edge; i++) {
+		if (edges[i].y1 > s.y_max) s.y_max = edges[i].y1;
+	}
+}
+
+void GdaRaster::AddEdge(double x0, double y0, double x1, double y1)
+{
+	if (y0 == y1) return; // horizontal edges never cross a scanline
+	// pixel (i, j) covers [i, i+1) x [j, j+1), so i+0.5 is its center
+	x0 += 0.5; y0 += 0.5; x1 += 0.5; y1 += 0.5;
+	if (y0 < y1) {
+		edges.push_back(Edge(x0, y0, x1, y1, 1));
+	} else {
+		edges.push_back(Edge(x1, y1, x0, y0, -1));
+	}
+}
+
+void GdaRaster::AddRing(int n, const wxPoint* pts)
+{
+	if (shapes.empty() || n < 2) return;
+	for (int i=0; i<n; i++) {
+		const wxPoint& p = pts[i];
+		const wxPoint& q = pts[i+1 < n ? i+1 : 0];
+		AddEdge(p.x, p.y, q.x, q.y);
+	}
+}
+
+void GdaRaster::AddPolygon(int n, const double* x, const double* y)
+{
+	for (int i=0; i<n; i++) {
+		int j = i+1 < n ? i+1 : 0;
+		AddEdge(x[i], y[i], x[j], y[j]);
+	}
+}
+
+void GdaRaster::AddStroke(int n, const wxPoint* pts, double width_s,
+						  bool closed)
+{
+	if (shapes.empty() || n < 1) return;
+	double h = width_s / 2.0;
+	if (n == 1) {
+		AddSquare(pts[0], width_s);
+		return;
+	}
+	// one rectangle per segment, lengthened by h at both ends so that the
+	// joints are covered.  They all turn the same way, so with the nonzero
+	// rule overlaps are painted once.
+	double x[4], y[4];
+	int segs = closed ? n : n-1;
+	for (int i=0; i<segs; i++) {
+		const wxPoint& p = pts[i];
+		const wxPoint& q = pts[i+1 < n ? i+1 : 0];
+		double dx = q.x - p.x;
+		double dy = q.y - p.y;
+		double len = sqrt(dx*dx + dy*dy);
+		if (len == 0) continue;
+		double ux = dx / len * h;
+		double uy = dy / len * h;
+		x[0] = p.x - ux - uy; y[0] = p.y - uy + ux;
+		x[1] = q.x + ux - uy; y[1] = q.y + uy + ux;
+		x[2] = q.x + ux + uy; y[2] = q.y + uy - ux;
+		x[3] = p.x - ux + uy; y[3] = p.y - uy - ux;
+		AddPolygon(4, x, y);
+	}
+}
+
+void GdaRaster::AddCircleStroke(const wxPoint& center, double radius,
+								double width_s)
+{
+	if (shapes.empty()) return;
+	int segs = (int) ceil(two_pi * radius);
+	if (segs < 8) segs = 8;
+	if (segs > 64) segs = 64;
+	double r_out = radius + width_s / 2.0;
+	double r_in = radius - width_s / 2.0;
+	std::vector<double> x(segs), y(segs);
+	for (int i=0; i<segs; i++) {
+		double t = two_pi * i / segs;
+		x[i] = center.x + r_out * cos(t);
+		y[i] = center.y + r_out * sin(t);
+	}
+	AddPolygon(segs, &x[0], &y[0]);
+	if (r_in <= 0) return;
+	// the inner circle runs the other way and cuts the hole
+	for (int i=0; i<segs; i++) {
+		double t = -two_pi * i / segs;
+		x[i] = center.x + r_in * cos(t);
+		y[i] = center.y + r_in * sin(t);
+	}
+	AddPolygon(segs, &x[0], &y[0]);
+}
+
+void GdaRaster::AddSquare(const wxPoint& center, double size)
+{
+	if (shapes.empty()) return;
+	double h = size / 2.0;
+	double x[4] = { center.x-h, center.x+h, center.x+h, center.x-h };
+	double y[4] = { center.y-h, center.y-h, center.y+h, center.y+h };
+	AddPolygon(4, x, y);
+}
+
+void GdaRaster::Render()
+{
+	EndShape();
+	if (width == 0 || height == 0 || shapes.empty()) return;
+	int num_bands = (height + band_height - 1) / band_height;
+	GdaThreadPool::GetInstance()->
+		ParallelFor(0, num_bands-1, 1,
+					boost::bind(&GdaRaster::RenderBands, this, _1, _2));
+}
+
+void GdaRaster::RenderBands(int first_band, int last_band)
+{
+	// partial coverage of a pixel, and running coverage of the pixels
+	// fully inside a span; one past the last pixel for the span ends
+	std::vector<float> cover(2*(width+1), 0);
+	std::vector<const Edge*> active;
+	std::vector<Crossing> xs;
+	for (int b=first_band; b<=last_band; b++) {
+		int row_start = b * band_height;
+		int row_end = std::min(row_start + band_height, height);
+		for (size_t i=0, iend=shapes.size(); i<iend; i++) {
+			const Shape& s = shapes[i];
+			if (s.a == 0 || s.y_max <= row_start || s.y_min >= row_end) {
+				continue;
+			}
+			RenderShape(s, row_start, row_end, cover, active, xs);
+		}
+	}
+}
+
+void GdaRaster::RenderShape(const Shape& s, int row_start, int row_end,
+							std::vector<float>& cover,
+							std::vector<const Edge*>& active,
+							std::vector<Crossing>& xs)
+{
+	float* part = &cover[0];
+	float* delta = &cover[width+1];
+	const float step = 1.0f / sub_rows;
+	int y0 = (int) std::max<double>(row_start, floor(s.y_min));
+	int y1 = (int) std::min<double>(row_end, ceil(s.y_max));
+	active.clear();
+	int next = s.first_edge;
+	for (int y=y0; y<y1; y++) {
+		int cx0 = width+1;
+		int cx1 = -1;
+		for (int k=0; k<sub_rows; k++) {
+			double sy = y + (k + 0.5) / sub_rows;
+			while (next < s.last_edge && edges[next].y0 <= sy) {
+				active.push_back(&edges[next++]);
+			}
+			size_t m = 0;
+			for (size_t j=0; j<active.size(); j++) {
+				if (active[j]->y1 > sy) active[m++] = active[j];
+			}
+			active.resize(m);
+			if (m == 0) continue;
+			xs.clear();
+			for (size_t j=0; j<m; j++) {
+				const Edge* e = active[j];
+				double x = (e->x0 +
+							(sy - e->y0) * (e->x1 - e->x0) / (e->y1 - e->y0));
+				xs.push_back(Crossing(x, e->dir));
+			}
+			std::sort(xs.begin(), xs.end());
+			int wind = 0;
+			double span_x = 0;
+			for (size_t j=0; j<xs.size(); j++) {
+				bool was_in = s.nonzero ? wind != 0 : (wind & 1) != 0;
+				wind += xs[j].dir;
+				bool is_in = s.nonzero ? wind != 0 : (wind & 1) != 0;
+				if (!was_in && is_in) {
+					span_x = xs[j].x;
+					continue;
+				}
+				if (!was_in || is_in) continue;
+				double a = std::max(span_x, 0.0);
+				double b = std::min(xs[j].x, (double) width);
+				if (b <= a) continue;
+				int ia = (int) a;
+				int ib = (int) b;
+				if (ia == ib) {
+					part[ia] += (float) (b - a) * step;
+				} else {
+					part[ia] += (float) (ia + 1 - a) * step;
+					delta[ia+1] += step;
+					delta[ib] -= step;
+					part[ib] += (float) (b - ib) * step;
+				}
+				if (ia < cx0) cx0 = ia;
+				if (ib > cx1) cx1 = ib;
+			}
+		}
+		if (cx1 < cx0) continue;
+		unsigned char* row = &pixels[(size_t) y * width * 4];
+		float run = 0;
+		for (int x=cx0; x<=cx1; x++) {
+			run += delta[x];
+			float c = run + part[x];
+			delta[x] = 0;
+			part[x] = 0;
+			if (x >= width || c <= 0.001f) continue;
+			if (c > 1) c = 1;
+			// source over destination, straight alpha
+			float sa = c * s.a / 255.0f;
+			unsigned char* px = row + 4*x;
+			float f = px[3] / 255.0f * (1 - sa);
+			float oa = sa + f;
+			px[0] = (unsigned char) ((s.r * sa + px[0] * f) / oa + 0.5f);
+			px[1] = (unsigned char) ((s.g * sa + px[1] * f) / oa + 0.5f);
+			px[2] = (unsigned char) ((s.b * sa + px[2] * f) / oa + 0.5f);
+			px[3] = (unsigned char) (oa * 255 + 0.5f);
+		}
+	}
+}
+
+void GdaRaster::ToImage(wxImage& image, double opacity) const
+{
+	image.Create(width, height, false);
+	if (width == 0 || height == 0) return;
+	image.SetAlpha();
+	unsigned char* rgb = image.GetData();
+	unsigned char* alpha = image.GetAlpha();
+	for (size_t i=0, iend=(size_t) width*height; i<iend; i++) {
+		rgb[3*i] = pixels[4*i];
+		rgb[3*i+1] = pixels[4*i+1];
+		rgb[3*i+2] = pixels[4*i+2];
+		alpha[i] = (unsigned char) (pixels[4*i+3] * opacity + 0.5);
+	}
+}
@@ -0,0 +1,121 @@
+/**
+ * GeoDa TM, Copyright (C) 2011-2015 by Luc Anselin - all rights reserved
+ *
+ * This file is part of GeoDa.
+ * 
+ * GeoDa is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+ *
+ * GeoDa is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program.  If not, see <http://www.gnu.org/licenses/>.
+ */
+
+
+#ifndef __GEODA_CENTER_GDA_RASTER_H__
+#define __GEODA_CENTER_GDA_RASTER_H__
+
+#include <vector>
+#include <wx/colour.h>
+#include <wx/gdicmn.h>
+#include <wx/image.h>
+
+/**
+ * GdaRaster draws filled and stroked shapes into an RGBA image in memory,
+ * off the GUI thread.  Shapes are recorded first, on the GUI thread, as
+ * lists of edges with a colour, in drawing order:
+ *
+ * \code
+ * GdaRaster raster(w, h);
+ * raster.BeginShape(brush_colour);
+ * raster.AddRing(n, points);
+ * raster.BeginShape(pen_colour, true);
+ * raster.AddStroke(n, points, 1, true);
+ * raster.Render();
+ * wxImage image;
+ * raster.ToImage(image);
+ * \endcode
+ *
+ * Render() splits the image into bands of rows and rasterizes the bands
+ * on the GdaThreadPool.  A band only writes its own rows, and within a
+ * band the shapes are drawn in the order they were recorded, so the
+ * result does not depend on the number of threads.
+ *
+ * The rasterizer is a scanline filler with four sub-scanlines per row and
+ * exact horizontal coverage, which gives anti-aliased edges.  Integer
+ * coordinates are taken to be pixel centers, as with wxDC.
+ */
+class GdaRaster {
+public:
+	GdaRaster(int width, int height);
+	
+	int GetWidth() const { return width; }
+	int GetHeight() const { return height; }
+	bool IsEmpty() const { return shapes.empty(); }
+	
+	/** Starts a new shape drawn with colour c, alpha included.  The even
+	 odd rule is used unless nonzero is true, strokes need nonzero. */
+	void BeginShape(const wxColour& c, bool nonzero = false);
+	/** Adds a closed ring to the current shape. */
+	void AddRing(int n, const wxPoint* pts);
+	/** Adds the outline of the polyline pts, width pixels wide. */
+	void AddStroke(int n, const wxPoint* pts, double width, bool closed);
+	/** Adds the outline of a circle, width pixels wide. */
+	void AddCircleStroke(const wxPoint& center, double radius, double width);
+	/** Adds a filled axis aligned square of side size. */
+	void AddSquare(const wxPoint& center, double size);
+	
+	/** Rasterizes all recorded shapes. */
+	void Render();
+	/** Copies the pixels to image, multiplying alpha by opacity. */
+	void ToImage(wxImage& image, double opacity = 1.0) const;
+	
+	// rows per band handed to a worker
+	static const int band_height = 32;
+	
+protected:
+	struct Edge {
+		Edge(double x0_s, double y0_s, double x1_s, double y1_s, int dir_s)
+		: x0(x0_s), y0(y0_s), x1(x1_s), y1(y1_s), dir(dir_s) {}
+		double x0, y0, x1, y1; // y0 < y1
+		int dir; // +1 if the edge went downwards, -1 otherwise
+	};
+	struct Shape {
+		unsigned char r, g, b, a;
+		bool nonzero;
+		int first_edge; // edges first_edge to last_edge-1, sorted by y0
+		int last_edge;
+		double y_min;
+		double y_max;
+	};
+	struct Crossing {
+		Crossing(double x_s, int dir_s) : x(x_s), dir(dir_s) {}
+		bool operator<(const Crossing& c) const { return x < c.x; }
+		double x;
+		int dir;
+	};
+	
+	static bool EdgeAbove(const Edge& a, const Edge& b);
+	void AddEdge(double x0, double y0, double x1, double y1);
+	void AddPolygon(int n, const double* x, const double* y);
+	void EndShape();
+	void RenderBands(int first_band, int last_band);
+	void RenderShape(const Shape& s, int row_start, int row_end,
+					 std::vector<float>& cover,
+					 std::vector<const Edge*>& active,
+					 std::vector<Crossing>& xs);
+	
+	int width;
+	int height;
+	std::vector<unsigned char> pixels; // RGBA, straight alpha
+	std::vector<Shape> shapes;
+	std::vector<Edge> edges;
+};
+
+#endif
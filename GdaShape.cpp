@@ -27,6 +27,7 @@
 #include "GdaConst.h"
 #include "GenUtils.h"
 #include "GdaShape.h"
+#include "GdaGeomBuffer.h"
 
 
 GdaScaleTrans::GdaScaleTrans()
@@ -405,6 +406,14 @@ GdaShape& GdaShape::operator=(const GdaShape& s)
 	return *this;
 }
 
+bool GdaShape::getScreenBBox(wxPoint& min_pt, wxPoint& max_pt)
+{
+	if (null_shape) return false;
+	min_pt = center;
+	max_pt = center;
+	return true;
+}
+
 void GdaShape::applyScaleTrans(const GdaScaleTrans& A)
 {
 	A.transform(center_o, &center);
@@ -708,6 +717,83 @@ bool GdaShapeAlgs::pointInPolygon(const wxPoint& pt, int n, const wxPoint* pts)
 	return within;
 }
 
+void GdaShapeAlgs::extendBBox(int n, const wxPoint* pts, wxPoint& min_pt,
+							  wxPoint& max_pt)
+{
+	for (int i=0; i<n; i++) {
+		if (pts[i].x < min_pt.x) min_pt.x = pts[i].x;
+		if (pts[i].x > max_pt.x) max_pt.x = pts[i].x;
+		if (pts[i].y < min_pt.y) min_pt.y = pts[i].y;
+		if (pts[i].y > max_pt.y) max_pt.y = pts[i].y;
+	}
+}
+
+/** Douglas-Peucker span, see calcLodTolerances */
+struct LodSpan {
+	LodSpan(int a_s, int b_s, float t_s) : a(a_s), b(b_s), t(t_s) {}
+	int a;
+	int b;
+	float t;
+};
+
+/** Distance from point i to the segment from a to b. */
+static double lodSegDist(const double* x, const double* y, int i, int a, int b)
+{
+	double dx = x[b] - x[a];
+	double dy = y[b] - y[a];
+	double px = x[i] - x[a];
+	double py = y[i] - y[a];
+	double len2 = dx*dx + dy*dy;
+	if (len2 > 0) {
+		double u = (px*dx + py*dy) / len2;
+		if (u > 1) u = 1;
+		if (u > 0) {
+			px -= u*dx;
+			py -= u*dy;
+		}
+	}
+	return sqrt(px*px + py*py);
+}
+
+void GdaShapeAlgs::calcLodTolerances(int m, const double* x, const double* y,
+									 float* tol)
+{
+	for (int i=0; i<m; i++) tol[i] = FLT_MAX;
+	if (m <= 3) return;
+	int far = 1;
+	double far_d = -1;
+	for (int i=1; i<m-1; i++) {
+		double dx = x[i] - x[0];
+		double dy = y[i] - y[0];
+		if (dx*dx + dy*dy > far_d) {
+			far_d = dx*dx + dy*dy;
+			far = i;
+		}
+	}
+	std::vector<LodSpan> spans;
+	spans.push_back(LodSpan(0, far, FLT_MAX));
+	spans.push_back(LodSpan(far, m-1, FLT_MAX));
+	while (!spans.empty()) {
+		LodSpan sp = spans.back();
+		spans.pop_back();
+		if (sp.b - sp.a < 2) continue;
+		int k = sp.a+1;
+		double k_d = -1;
+		for (int i=sp.a+1; i<sp.b; i++) {
+			double d = lodSegDist(x, y, i, sp.a, sp.b);
+			if (d > k_d) {
+				k_d = d;
+				k = i;
+			}
+		}
+		// a vertex can not outlive the vertex that split its span
+		float t = k_d < sp.t ? (float) k_d : sp.t;
+		tol[k] = t;
+		spans.push_back(LodSpan(sp.a, k, t));
+		spans.push_back(LodSpan(k, sp.b, t));
+	}
+}
+
 void GdaShapeAlgs::getBoundingBoxOrig(const GdaPolygon* p, double& xmin,
 									 double& ymin, double& xmax, double& ymax)
 {
@@ -891,6 +977,15 @@ bool GdaCircle::regionIntersect(const wxRegion& r)
 	return false;
 }
 
+bool GdaCircle::getScreenBBox(wxPoint& min_pt, wxPoint& max_pt)
+{
+	if (null_shape) return false;
+	int r = (int) ceil(radius);
+	min_pt = wxPoint(center.x - r, center.y - r);
+	max_pt = wxPoint(center.x + r, center.y + r);
+	return true;
+}
+
 void GdaCircle::applyScaleTrans(const GdaScaleTrans& A)
 {
 	if (null_shape) return;
@@ -1013,6 +1108,16 @@ bool GdaRectangle::regionIntersect(const wxRegion& r)
 	return false;
 }
 
+bool GdaRectangle::getScreenBBox(wxPoint& min_pt, wxPoint& max_pt)
+{
+	if (null_shape) return false;
+	min_pt = center;
+	max_pt = center;
+	GdaShapeAlgs::extendBBox(1, &lower_left, min_pt, max_pt);
+	GdaShapeAlgs::extendBBox(1, &upper_right, min_pt, max_pt);
+	return true;
+}
+
 void GdaRectangle::applyScaleTrans(const GdaScaleTrans& A)
 {
 	if (null_shape) return;
@@ -1058,7 +1163,9 @@ void GdaRectangle::paintSelf(wxGraphicsContext* gc)
 //
 //
 ////////////////////////////////////////////////////////////////////////////////
-GdaPolygon::GdaPolygon() : points(0), points_o(0), count(0)
+GdaPolygon::GdaPolygon() : points(0), points_o(0), count(0),
+	lod_tol(0), draw_points(0), draw_count(0), draw_n_count(0),
+	draw_valid(false), geom(0), geom_rec(0), own_points(true)
 {
 	null_shape = true;
 }
@@ -1067,9 +1174,14 @@ GdaPolygon::GdaPolygon(const GdaPolygon& s)
 	: GdaShape(s), //region(s.region),
 	n(s.n), pc(s.pc), points_o(s.points_o),
 	n_count(s.n_count), all_points_same(s.all_points_same),
-	bb_ll_o(s.bb_ll_o), bb_ur_o(s.bb_ur_o), count(0)
+	bb_ll_o(s.bb_ll_o), bb_ur_o(s.bb_ur_o), count(0),
+	lod_tol(0), draw_points(0), draw_count(0), draw_n_count(0),
+	draw_valid(false), geom(s.geom), geom_rec(s.geom_rec), own_points(true)
 {
 	if (null_shape) return;
+	// the tolerances of the buffer are shared, the copy gets its own
+	// points and count
+	if (geom) lod_tol = s.lod_tol;
 	points = new wxPoint[n];
 	for (int i=0; i<n; i++) {
 		points[i].x = s.points[i].x;
@@ -1093,7 +1205,9 @@ GdaPolygon::GdaPolygon(const GdaPolygon& s)
  will be deleted when the constructor is called. */
 GdaPolygon::GdaPolygon(int n_s, wxRealPoint* points_o_s)
 	: n(n_s), points_o(0), pc(0), points(0), n_count(1),
-	all_points_same(false), count(0)
+	all_points_same(false), count(0),
+	lod_tol(0), draw_points(0), draw_count(0), draw_n_count(0),
+	draw_valid(false), geom(0), geom_rec(0), own_points(true)
 {
 	if (points_o_s == 0 || n == 0) {
 		null_shape = true;
@@ -1130,7 +1244,9 @@ GdaPolygon::GdaPolygon(int n_s, wxRealPoint* points_o_s)
  part might contain holes.  Only a pointer to the original data is
  kept, and this memory is not deleted in the destructor. */
 GdaPolygon::GdaPolygon(Shapefile::PolygonContents* pc_s)
-  : n(0), points_o(0), pc(pc_s), points(0), all_points_same(false), count(0)
+  : n(0), points_o(0), pc(pc_s), points(0), all_points_same(false), count(0),
+	lod_tol(0), draw_points(0), draw_count(0), draw_n_count(0),
+	draw_valid(false), geom(0), geom_rec(0), own_points(true)
 {
 	assert(pc);
 	if (pc->shape_type == 0 || pc->num_points == 0) {
@@ -1164,10 +1280,43 @@ GdaPolygon::GdaPolygon(Shapefile::PolygonContents* pc_s)
 	//region = wxRegion(n, points);
 }
 
+/** The same polygon as GdaPolygon(pc_s), with its geometry taken from
+ record geom_rec_s of geom_s.  points_s must have room for the record's
+ vertices and outlive the polygon, which does not delete it. */
+GdaPolygon::GdaPolygon(Shapefile::PolygonContents* pc_s,
+					   const GdaGeomBuffer* geom_s, int geom_rec_s,
+					   wxPoint* points_s)
+  : n(0), points_o(0), pc(pc_s), points(0), all_points_same(false), count(0),
+	lod_tol(0), draw_points(0), draw_count(0), draw_n_count(0),
+	draw_valid(false), geom(geom_s), geom_rec(geom_rec_s), own_points(false)
+{
+	assert(geom);
+	if (geom->IsNull(geom_rec)) {
+		null_shape = true;
+		return;
+	}
+	int v0 = geom->vtx_start[geom_rec];
+	int p0 = geom->part_start[geom_rec];
+	n = geom->vtx_start[geom_rec+1] - v0;
+	n_count = geom->part_start[geom_rec+1] - p0;
+	count = const_cast<int*>(&geom->part_count[0]) + p0;
+	lod_tol = const_cast<float*>(&geom->lod_tol[0]) + v0;
+	points = points_s;
+	for (int i=0; i<n; i++) {
+		points[i].x = (int) geom->x[v0+i];
+		points[i].y = (int) geom->y[v0+i];
+	}
+	center_o = geom->center[geom_rec];
+	center.x = (int) center_o.x;
+	center.y = (int) center_o.y;
+	bb_ll_o = geom->bb_ll[geom_rec];
+	bb_ur_o = geom->bb_ur[geom_rec];
+}
+
 
 GdaPolygon::~GdaPolygon()
 {
-	if (points) {
+	if (points && own_points) {
 		delete [] points;
 		points = 0;
 	}
@@ -1175,10 +1324,13 @@ GdaPolygon::~GdaPolygon()
 		delete [] points_o;
 		points_o = 0;
 	}
-	if (count) {
+	if (count && own_points) {
 		delete [] count;
 		count = 0;
 	}
+	if (lod_tol && !geom) delete [] lod_tol;
+	if (draw_points) delete [] draw_points;
+	if (draw_count) delete [] draw_count;
 }
 
 void GdaPolygon::Offset(double dx, double dy)
@@ -1187,6 +1339,7 @@ void GdaPolygon::Offset(double dx, double dy)
         points[i].x = points_o[i].x + dx;
         points[i].y = points_o[i].y + dy;
     }
+    if (!null_shape) updateDrawPoints(0);
 }
 
 void GdaPolygon::Offset(int dx, int dy)
@@ -1195,6 +1348,7 @@ void GdaPolygon::Offset(int dx, int dy)
         points[i].x = points_o[i].x + dx;
         points[i].y = points_o[i].y + dy;
     }
+    if (!null_shape) updateDrawPoints(0);
 }
 
 bool GdaPolygon::pointWithin(const wxPoint& pt)
@@ -1216,6 +1370,21 @@ bool GdaPolygon::regionIntersect(const wxRegion& r)
 	return false;
 }
 
+bool GdaPolygon::getScreenBBox(wxPoint& min_pt, wxPoint& max_pt)
+{
+	if (null_shape) return false;
+	if (draw_valid) {
+		min_pt = bb_min;
+		max_pt = bb_max;
+		return true;
+	}
+	min_pt = center;
+	max_pt = center;
+	// points are not updated when the polygon collapses to its center
+	if (!all_points_same) GdaShapeAlgs::extendBBox(n, points, min_pt, max_pt);
+	return true;
+}
+
 void GdaPolygon::applyScaleTrans(const GdaScaleTrans& A)
 {
 	if (null_shape) return;
@@ -1224,8 +1393,23 @@ void GdaPolygon::applyScaleTrans(const GdaScaleTrans& A)
 	wxPoint tpt;
 	A.transform(bb_ll_o, &tpt);
 	if (tpt == center) A.transform(bb_ur_o, &tpt);
-	if (tpt == center) return;
-	if (points_o) {
+	if (tpt == center) {
+		draw_valid = true;
+		draw_n_count = 0;
+		bb_min = center;
+		bb_max = center;
+		return;
+	}
+	if (geom) {
+		int v0 = geom->vtx_start[geom_rec];
+		geom->Transform(A, v0, v0+n-1, points);
+		for (int i=0; i<n; i++) {
+			if (points[i] != center) {
+				all_points_same = false;
+				break;
+			}
+		}
+	} else if (points_o) {
 		for (int i=0; i<n; i++) {
 			A.transform(points_o[i], &(points[i]));
 			if (points[i] != center) all_points_same = false;
@@ -1238,6 +1422,12 @@ void GdaPolygon::applyScaleTrans(const GdaScaleTrans& A)
 		}
 		//region = wxRegion(n, points);  // MMM: needs to support multi-part
 	}
+	// Vertices less than a quarter pixel off the simplified outline
+	// are not drawn.  Together with the pixel rounding above this keeps
+	// the rendered outline where it was.
+	double scale = GenUtils::max<double>(fabs(A.scale_x), fabs(A.scale_y));
+	if (!lod_tol) calcLodTolerances();
+	updateDrawPoints(scale > 0 ? 0.25 / scale : 0);
 }
 
 
@@ -1255,8 +1445,13 @@ void GdaPolygon::projectToBasemap(GDA::Basemap* basemap)
 	if (tpt == center) 
         basemap->LatLngToXY(bb_ur_o.x, bb_ur_o.y, tpt.x, tpt.y);
     
-	if (tpt == center) 
+	if (tpt == center) {
+		draw_valid = true;
+		draw_n_count = 0;
+		bb_min = center;
+		bb_max = center;
         return;
+	}
     
 	if (points_o) {
 		for (int i=0; i<n; i++) {
@@ -1275,6 +1470,92 @@ void GdaPolygon::projectToBasemap(GDA::Basemap* basemap)
 		}
 		//region = wxRegion(n, points);  // MMM: needs to support multi-part
 	}
+	// the projection is not affine, only exact pixel duplicates and
+	// collinear pixels are dropped
+	updateDrawPoints(0);
+}
+
+void GdaPolygon::calcLodTolerances()
+{
+	if (null_shape || lod_tol) return;
+	lod_tol = new float[n];
+	std::vector<double> x, y;
+	int start = 0;
+	for (int c=0; c<n_count && start<n; c++) {
+		int m = GenUtils::min<int>(count[c], n-start);
+		x.resize(m);
+		y.resize(m);
+		for (int i=0; i<m; i++) {
+			if (points_o) {
+				x[i] = points_o[start+i].x;
+				y[i] = points_o[start+i].y;
+			} else {
+				x[i] = pc->points[start+i].x;
+				y[i] = pc->points[start+i].y;
+			}
+		}
+		GdaShapeAlgs::calcLodTolerances(m, &x[0], &y[0], lod_tol + start);
+		start += m;
+	}
+	for (int i=start; i<n; i++) lod_tol[i] = FLT_MAX;
+}
+
+/** True if b lies on the segment from a to c and removing it does not
+ change the outline. */
+static bool lodIsBetween(const wxPoint& a, const wxPoint& b, const wxPoint& c)
+{
+	double abx = b.x - a.x;
+	double aby = b.y - a.y;
+	double bcx = c.x - b.x;
+	double bcy = c.y - b.y;
+	return abx*bcy == aby*bcx && abx*bcx + aby*bcy > 0;
+}
+
+/** Rebuilds draw_points and the screen bounding box from points, leaving
+ out the vertices whose Douglas-Peucker tolerance is below tol. */
+void GdaPolygon::updateDrawPoints(double tol)
+{
+	if (!draw_points) {
+		draw_points = new wxPoint[n];
+		draw_count = new int[n_count];
+	}
+	bb_min = center;
+	bb_max = center;
+	GdaShapeAlgs::extendBBox(n, points, bb_min, bb_max);
+	int draw_n = 0;
+	draw_n_count = 0;
+	int start = 0;
+	for (int c=0; c<n_count && start<n; c++) {
+		int first = draw_n;
+		int end = GenUtils::min<int>(start+count[c], n);
+		for (int i=start; i<end; i++) {
+			if (lod_tol && lod_tol[i] < tol) continue;
+			const wxPoint& pt = points[i];
+			if (draw_n > first && pt == draw_points[draw_n-1]) continue;
+			while (draw_n-first >= 2 &&
+				   lodIsBetween(draw_points[draw_n-2], draw_points[draw_n-1],
+								pt)) {
+				draw_n--;
+			}
+			draw_points[draw_n++] = pt;
+		}
+		start = end;
+		// a ring that shrank to a single pixel is left out
+		if (draw_n-first < 3) {
+			draw_n = first;
+		} else {
+			draw_count[draw_n_count++] = draw_n-first;
+		}
+	}
+	draw_valid = true;
+}
+
+bool GdaPolygon::isOffScreen(int w, int h, int margin) const
+{
+	if (null_shape) return true;
+	if (!draw_valid) return false;
+	return (bb_max.x < -margin || bb_min.x > w+margin ||
+			bb_max.y < -margin || bb_min.y > h+margin);
 }
 
 wxRealPoint GdaPolygon::CalculateCentroid(int n, wxRealPoint* pts)
@@ -1297,13 +1578,43 @@ void GdaPolygon::paintSelf(wxDC& dc)
 	if (null_shape) return;
 	dc.SetPen(getPen());
 	dc.SetBrush(getBrush());
-	if (n_count > 1) {
+	paintShape(dc);
+}
+
+void GdaPolygon::paintShape(wxDC& dc)
+{
+	if (null_shape) return;
+	if (all_points_same || (draw_valid && draw_n_count == 0)) {
+		dc.DrawPoint(center.x, center.y);
+	} else if (draw_valid) {
+		if (draw_n_count > 1) {
+			dc.DrawPolyPolygon(draw_n_count, draw_count, draw_points);
+		} else {
+			dc.DrawPolygon(draw_count[0], draw_points);
+		}
+	} else if (n_count > 1) {
 		dc.DrawPolyPolygon(n_count, count, points);
 	} else {
 		dc.DrawPolygon(n, points);
 	}
 }
 
+int GdaPolygon::getDrawRings(const wxPoint*& pts, const int*& cnt) const
+{
+	if (null_shape || all_points_same || (draw_valid && draw_n_count == 0)) {
+		return 0;
+	}
+	if (draw_valid) {
+		pts = draw_points;
+		cnt = draw_count;
+		return draw_n_count;
+	}
+	if (n_count < 1) return 0;
+	pts = points;
+	cnt = count;
+	return n_count;
+}
+
 void GdaPolygon::paintSelf(wxGraphicsContext* gc)
 {
 	if (null_shape) return;
@@ -1596,6 +1907,15 @@ bool GdaPolyLine::regionIntersect(const wxRegion& r)
 	return false;
 }
 
+bool GdaPolyLine::getScreenBBox(wxPoint& min_pt, wxPoint& max_pt)
+{
+	if (null_shape) return false;
+	min_pt = center;
+	max_pt = center;
+	GdaShapeAlgs::extendBBox(n, points, min_pt, max_pt);
+	return true;
+}
+
 void GdaPolyLine::applyScaleTrans(const GdaScaleTrans& A)
 {
 	if (null_shape) return;
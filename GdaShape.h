@@ -35,6 +35,7 @@
 #include "GdaConst.h"
 
 class GdaPolygon;
+class GdaGeomBuffer;
 
 struct GdaScaleTrans {
     GdaScaleTrans();
@@ -133,6 +134,16 @@ namespace GdaShapeAlgs {
 								int* pnts_array_size = 0);
 	wxRegion createLineRegion(wxPoint a, wxPoint b);
 	bool pointInPolygon(const wxPoint& pt, int n, const wxPoint* pts);
+	/** Grows [min_pt, max_pt] to cover the n points pts. */
+	void extendBBox(int n, const wxPoint* pts, wxPoint& min_pt,
+					wxPoint& max_pt);
+	/** Fills tol[i] with the largest tolerance for which Douglas-Peucker
+	 simplification of the ring (x[i], y[i]), i < m, keeps vertex i, so a
+	 single pass gives the simplification at every tolerance.  The first
+	 and last vertex and the vertex farthest from the first are always
+	 kept: a ring never simplifies to less than a triangle. */
+	void calcLodTolerances(int m, const double* x, const double* y,
+						   float* tol);
 	void getBoundingBoxOrig(const GdaPolygon* p, double& xmin,
 							double& ymin, double& xmax, double& ymax);
 }
@@ -172,6 +183,10 @@ public:
 	virtual bool pointWithin(const wxPoint& pt) { return false; };
 	virtual bool Contains(const wxPoint& pt) { return pointWithin(pt); };
 	virtual bool regionIntersect(const wxRegion& region) { return false; };
+	/** Screen bounding box of the shape after the last applyScaleTrans or
+	 projectToBasemap, always including center.  Returns false for null
+	 shapes.  Used by the spatial index of TemplateCanvas. */
+	virtual bool getScreenBBox(wxPoint& min_pt, wxPoint& max_pt);
 	virtual void applyScaleTrans(const GdaScaleTrans& A);
     virtual void projectToBasemap(GDA::Basemap* basemap);
 	virtual void paintSelf(wxDC& dc) = 0;
@@ -239,6 +254,7 @@ public:
 	virtual GdaCircle* clone() { return new GdaCircle(*this); }
 	virtual bool pointWithin(const wxPoint& pt);
 	virtual bool regionIntersect(const wxRegion& r);
+	virtual bool getScreenBBox(wxPoint& min_pt, wxPoint& max_pt);
 	virtual void applyScaleTrans(const GdaScaleTrans& A);
 	virtual void paintSelf(wxDC& dc);
 	virtual void paintSelf(wxGraphicsContext* gc);
@@ -268,6 +284,7 @@ public:
     
 	virtual bool pointWithin(const wxPoint& pt);
 	virtual bool regionIntersect(const wxRegion& r);
+	virtual bool getScreenBBox(wxPoint& min_pt, wxPoint& max_pt);
 	virtual void applyScaleTrans(const GdaScaleTrans& A);
     virtual void projectToBasemap(GDA::Basemap* basemap);
 	virtual void paintSelf(wxDC& dc);
@@ -288,6 +305,8 @@ public:
 	GdaPolygon(const GdaPolygon& s);
 	GdaPolygon(int n_s, wxRealPoint* points_o_s);
 	GdaPolygon(Shapefile::PolygonContents* pc_s);
+	GdaPolygon(Shapefile::PolygonContents* pc_s, const GdaGeomBuffer* geom_s,
+			   int geom_rec_s, wxPoint* points_s);
 	virtual ~GdaPolygon();
 	virtual GdaPolygon* clone() { return new GdaPolygon(*this); }
 	
@@ -296,16 +315,41 @@ public:
     
 	virtual bool pointWithin(const wxPoint& pt);
 	virtual bool regionIntersect(const wxRegion& r);
+	virtual bool getScreenBBox(wxPoint& min_pt, wxPoint& max_pt);
 	virtual void applyScaleTrans(const GdaScaleTrans& A);
 	virtual void projectToBasemap(GDA::Basemap* basemap);
 	static wxRealPoint CalculateCentroid(int n, wxRealPoint* pts);
 	virtual void paintSelf(wxDC& dc);
 	virtual void paintSelf(wxGraphicsContext* gc);
+	/** Draws the polygon with the current pen and brush, using the
+	 simplified screen outline when there is one. */
+	void paintShape(wxDC& dc);
+	/** The rings paintShape draws: sets pts and cnt and returns their
+	 number, or 0 when the polygon is drawn as a point at center. */
+	int getDrawRings(const wxPoint*& pts, const int*& cnt) const;
     
 	// All values in points array are the same.  Can render render
 	// as a single point at points[0]
 	bool all_points_same;
 	
+	// Level of detail for drawing.  lod_tol holds, for every vertex, the
+	// largest Douglas-Peucker tolerance (in data units) at which the vertex
+	// is still kept; it is computed once, the first time the polygon is
+	// scaled.  draw_points/draw_count are the screen rings that remain at
+	// the current scale once vertices within a fraction of a pixel of the
+	// outline, repeated pixels and collinear pixels are dropped.  points
+	// itself always keeps every vertex, for hit testing.
+	float* lod_tol;
+	wxPoint* draw_points;
+	int* draw_count;
+	int draw_n_count; // 0 when the polygon is smaller than a pixel
+	bool draw_valid; // draw_* and the screen bbox match points
+	wxPoint bb_min; // screen bounding box, valid with draw_valid
+	wxPoint bb_max;
+	/** True if the screen bounding box misses the rectangle from (0,0) to
+	 (w,h) grown by margin pixels. */
+	bool isOffScreen(int w, int h, int margin) const;
+	
 	wxPoint* points;
 	int n; // size of points array
 	int n_count; // size of count array
@@ -316,11 +360,23 @@ public:
     
 	// (pc == 0 && points_o !=0 ) || (pc != 0 && points_o ==0 )
 	Shapefile::PolygonContents* pc;
+	// Record geom_rec of a shared GdaGeomBuffer with the same vertices as
+	// pc, or 0.  Scaling then reads the buffer, and count and lod_tol
+	// point into it.
+	const GdaGeomBuffer* geom;
+	int geom_rec;
+	// false if points is a slice of an array owned by the canvas and
+	// count belongs to geom
+	bool own_points;
     
 	wxRealPoint* points_o;
 	wxRealPoint bb_ll_o; // bounding box lower left
 	wxRealPoint bb_ur_o; // bounding box upper right
 	//wxRegion region;
+	
+protected:
+	void calcLodTolerances();
+	void updateDrawPoints(double tol);
 };
 
 
@@ -342,6 +398,7 @@ public:
     
 	virtual bool pointWithin(const wxPoint& pt);
 	virtual bool regionIntersect(const wxRegion& r);
+	virtual bool getScreenBBox(wxPoint& min_pt, wxPoint& max_pt);
 	virtual void applyScaleTrans(const GdaScaleTrans& A);
     
 	virtual void paintSelf(wxDC& dc);
@@ -0,0 +1,236 @@
+/**
+ * GeoDa TM, Copyright (C) 2011-2015 by Luc Anselin - all rights reserved
+ *
+ * This file is part of GeoDa.
+ *
+ * GeoDa is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+ *
+ * GeoDa is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program.  If not, see <http://www.gnu.org/licenses/>.
+ */
+
+#include <boost/bind.hpp>
+#include "logger.h"
+#include "GdaThreadPool.h"
+
+boost::thread_specific_ptr<int> GdaThreadPool::worker_id;
+GdaThreadPool* GdaThreadPool::instance = 0;
+boost::once_flag GdaThreadPool::instance_flag = BOOST_ONCE_INIT;
+int GdaThreadPool::requested_workers = 0;
+
+void GdaThreadPool::CreateInstance()
+{
+	int n = requested_workers;
+	if (n < 1) n = boost::thread::hardware_concurrency();
+	if (n < 1) n = 1;
+	// never deleted: worker threads must outlive every static object that
+	// might still submit work during shutdown
+	instance = new GdaThreadPool(n);
+}
+
+GdaThreadPool* GdaThreadPool::GetInstance()
+{
+	boost::call_once(instance_flag, &GdaThreadPool::CreateInstance);
+	return instance;
+}
+
+GdaThreadPool::GdaThreadPool(int num_workers_s)
+: num_workers(num_workers_s), num_queued(0), next_queue(0), stop(false)
+{
+	for (int i=0; i<num_workers; i++) queues.push_back(new WorkQueue);
+	for (int i=0; i<num_workers; i++) {
+		workers.create_thread(boost::bind(&GdaThreadPool::WorkerLoop,
+										  this, i));
+	}
+}
+
+GdaThreadPool::~GdaThreadPool()
+{
+	{
+		boost::mutex::scoped_lock lock(idle_mutex);
+		stop = true;
+	}
+	idle_cond.notify_all();
+	workers.join_all();
+	for (size_t i=0; i<queues.size(); i++) delete queues[i];
+}
+
+void GdaThreadPool::Submit(const Task& task, GdaTaskGroup* group)
+{
+	TaskItem item;
+	item.task = task;
+	item.group = group;
+
+	int q = 0;
+	if (worker_id.get()) {
+		// nested submission from a worker: keep it local, others will
+		// steal it if they run dry
+		q = *worker_id;
+	} else {
+		boost::mutex::scoped_lock lock(idle_mutex);
+		q = next_queue;
+		next_queue = (next_queue + 1) % num_workers;
+	}
+	{
+		boost::mutex::scoped_lock lock(queues[q]->mutex);
+		queues[q]->tasks.push_back(item);
+	}
+	{
+		boost::mutex::scoped_lock lock(idle_mutex);
+		num_queued++;
+	}
+	idle_cond.notify_one();
+}
+
+bool GdaThreadPool::TryGetTask(int q, TaskItem& item)
+{
+	bool found = false;
+	if (q >= 0) {
+		boost::mutex::scoped_lock lock(queues[q]->mutex);
+		if (!queues[q]->tasks.empty()) {
+			item = queues[q]->tasks.back();
+			queues[q]->tasks.pop_back();
+			found = true;
+		}
+	}
+	for (int i=1; i<=num_workers && !found; i++) {
+		int victim = (q + i) % num_workers;
+		if (victim == q) continue;
+		boost::mutex::scoped_lock lock(queues[victim]->mutex);
+		if (!queues[victim]->tasks.empty()) {
+			item = queues[victim]->tasks.front();
+			queues[victim]->tasks.pop_front();
+			found = true;
+		}
+	}
+	if (found) {
+		boost::mutex::scoped_lock lock(idle_mutex);
+		num_queued--;
+	}
+	return found;
+}
+
+bool GdaThreadPool::RunPendingTask()
+{
+	TaskItem item;
+	int q = worker_id.get() ? *worker_id : -1;
+	if (!TryGetTask(q < 0 ? 0 : q, item)) return false;
+	Execute(item);
+	return true;
+}
+
+void GdaThreadPool::Execute(TaskItem& item)
+{
+	// a failing task must not take a worker down with it, and the group
+	// still has to be told the task is finished
+	try {
+		item.task();
+	} catch (std::exception& e) {
+		LOG_MSG("GdaThreadPool: task failed: " << e.what());
+		item.group->TaskFailed(boost::current_exception());
+	} catch (...) {
+		LOG_MSG("GdaThreadPool: task failed with an unknown exception");
+		item.group->TaskFailed(boost::current_exception());
+	}
+	item.group->TaskDone();
+}
+
+void GdaThreadPool::WorkerLoop(int id)
+{
+	worker_id.reset(new int(id));
+	while (true) {
+		TaskItem item;
+		if (TryGetTask(id, item)) {
+			Execute(item);
+			continue;
+		}
+		boost::mutex::scoped_lock lock(idle_mutex);
+		while (num_queued == 0 && !stop) idle_cond.wait(lock);
+		if (stop) break;
+	}
+}
+
+void GdaThreadPool::ParallelFor(int start, int end, int grain,
+								const RangeTask& fn)
+{
+	if (end < start) return;
+	if (grain < 1) grain = 1;
+	GdaTaskGroup group(this);
+	for (int a=start; a<=end; a+=grain) {
+		int b = a + grain - 1;
+		if (b > end) b = end;
+		group.Run(boost::bind(fn, a, b));
+	}
+	group.Wait();
+}
+
+GdaTaskGroup::GdaTaskGroup(GdaThreadPool* pool_s)
+: pool(pool_s), num_pending(0)
+{
+}
+
+GdaTaskGroup::~GdaTaskGroup()
+{
+	// no rethrow from a destructor, the failure has been logged
+	WaitPending();
+}
+
+void GdaTaskGroup::Run(const GdaThreadPool::Task& task)
+{
+	{
+		boost::mutex::scoped_lock lock(mutex);
+		num_pending++;
+	}
+	pool->Submit(task, this);
+}
+
+void GdaTaskGroup::Wait()
+{
+	WaitPending();
+	boost::exception_ptr e;
+	{
+		boost::mutex::scoped_lock lock(mutex);
+		e = error;
+		error = boost::exception_ptr();
+	}
+	if (e) boost::rethrow_exception(e);
+}
+
+void GdaTaskGroup::WaitPending()
+{
+	while (true) {
+		{
+			boost::mutex::scoped_lock lock(mutex);
+			if (num_pending == 0) return;
+		}
+		// help out instead of blocking: the tasks we are waiting for
+		// might still be queued
+		if (pool->RunPendingTask()) continue;
+		boost::mutex::scoped_lock lock(mutex);
+		if (num_pending == 0) return;
+		// tasks are in flight on other threads; sleep until one finishes,
+		// waking up periodically in case new (nested) work was queued
+		done_cond.timed_wait(lock, boost::posix_time::milliseconds(2));
+	}
+}
+
+void GdaTaskGroup::TaskFailed(const boost::exception_ptr& e)
+{
+	boost::mutex::scoped_lock lock(mutex);
+	if (!error) error = e;
+}
+
+void GdaTaskGroup::TaskDone()
+{
+	boost::mutex::scoped_lock lock(mutex);
+	num_pending--;
+	if (num_pending == 0) done_cond.notify_all();
+}
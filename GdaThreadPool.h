@@ -0,0 +1,143 @@
+/**
+ * GeoDa TM, Copyright (C) 2011-2015 by Luc Anselin - all rights reserved
+ *
+ * This file is part of GeoDa.
+ *
+ * GeoDa is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+ *
+ * GeoDa is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program.  If not, see <http://www.gnu.org/licenses/>.
+ */
+
+#ifndef __GEODA_CENTER_GDA_THREAD_POOL_H__
+#define __GEODA_CENTER_GDA_THREAD_POOL_H__
+
+#include <deque>
+#include <vector>
+#include <boost/exception_ptr.hpp>
+#include <boost/function.hpp>
+#include <boost/thread.hpp>
+
+class GdaTaskGroup;
+
+/**
+ * GdaThreadPool is a process-wide work-stealing thread pool.  It is created
+ * on first use with one worker per hardware thread and lives until the
+ * process exits.  Each worker owns a task deque: it pops its own work from
+ * the back and, when idle, steals from the front of the other deques.
+ *
+ * Tasks are always submitted through a GdaTaskGroup, which lets the caller
+ * wait for a batch of tasks.  While waiting, the calling thread executes
+ * queued tasks itself, so nested groups and calls from several coordinators
+ * at once cannot deadlock the pool.
+ *
+ * \code
+ * GdaTaskGroup group;
+ * for (int t=0; t<num_time_vals; t++) {
+ *     group.Run(boost::bind(&Foo::CalcRange, this, t, 0, num_obs-1));
+ * }
+ * group.Wait();
+ * \endcode
+ */
+class GdaThreadPool {
+public:
+	typedef boost::function<void ()> Task;
+	typedef boost::function<void (int, int)> RangeTask;
+
+	static GdaThreadPool* GetInstance();
+	/** Number of workers of the pool, one per hardware thread if n < 1.
+	 Only has an effect before the first call to GetInstance(), and is
+	 meant for the benchmark suite. */
+	static void SetNumWorkers(int n) { requested_workers = n; }
+
+	int GetNumWorkers() const { return num_workers; }
+
+	/** Split [start, end] into chunks of at most grain items and call
+	 fn(chunk_start, chunk_end) for each chunk, both ends inclusive as in
+	 the *_range methods of the coordinators.  Blocks until all chunks
+	 are finished.  The chunk boundaries only depend on start, end and
+	 grain, never on the number of workers. */
+	void ParallelFor(int start, int end, int grain, const RangeTask& fn);
+
+protected:
+	friend class GdaTaskGroup;
+
+	struct TaskItem {
+		Task task;
+		GdaTaskGroup* group;
+	};
+	struct WorkQueue {
+		boost::mutex mutex;
+		std::deque<TaskItem> tasks;
+	};
+
+	GdaThreadPool(int num_workers);
+	virtual ~GdaThreadPool();
+
+	void Submit(const Task& task, GdaTaskGroup* group);
+	/** Pop from the back of queue q, or steal from the front of any other
+	 queue.  Returns false if no task could be found. */
+	bool TryGetTask(int q, TaskItem& item);
+	/** Used by threads that are waiting on a GdaTaskGroup: run one queued
+	 task if there is any.  Returns false if the queues are empty. */
+	bool RunPendingTask();
+	void WorkerLoop(int worker_id);
+	static void Execute(TaskItem& item);
+
+	int num_workers;
+	std::vector<WorkQueue*> queues;
+	boost::thread_group workers;
+
+	// number of tasks sitting in any of the queues, protected by idle_mutex
+	int num_queued;
+	int next_queue;
+	bool stop;
+	boost::mutex idle_mutex;
+	boost::condition_variable idle_cond;
+
+	static boost::thread_specific_ptr<int> worker_id;
+	static GdaThreadPool* instance;
+	static boost::once_flag instance_flag;
+	static int requested_workers;
+	static void CreateInstance();
+};
+
+/**
+ * A batch of tasks submitted to a GdaThreadPool.  Wait() returns when every
+ * task passed to Run() has finished.  The destructor waits as well, so a
+ * group going out of scope never leaves tasks pointing at freed memory.
+ *
+ * If a task throws, the other tasks still run to completion and Wait()
+ * then rethrows the first exception on the waiting thread.  Exceptions
+ * that are never waited for are only logged.
+ */
+class GdaTaskGroup {
+public:
+	GdaTaskGroup(GdaThreadPool* pool = GdaThreadPool::GetInstance());
+	virtual ~GdaTaskGroup();
+
+	void Run(const GdaThreadPool::Task& task);
+	void Wait();
+
+protected:
+	friend class GdaThreadPool;
+	void TaskDone();
+	void TaskFailed(const boost::exception_ptr& e);
+	void WaitPending();
+
+	GdaThreadPool* pool;
+	int num_pending;
+	boost::exception_ptr error; // first exception thrown by a task
+	boost::mutex mutex;
+	boost::condition_variable done_cond;
+};
+
+#endif
@@ -48,28 +48,6 @@ wxColour GdaColorUtils::ChangeBrightness(const wxColour& input_col,
 	return wxColour(r,g,b,alpha);
 }
 
-uint64_t Gda::ThomasWangHashUInt64(uint64_t key) {
-	key = (~key) + (key << 21); // key = (key << 21) - key - 1;
-	key = key ^ (key >> 24);
-	key = (key + (key << 3)) + (key << 8); // key * 265
-	key = key ^ (key >> 14);
-	key = (key + (key << 2)) + (key << 4); // key * 21
-	key = key ^ (key >> 28);
-	key = key + (key << 31);
-	return key;
-}
-
-double Gda::ThomasWangHashDouble(uint64_t key) {
-	key = (~key) + (key << 21); // key = (key << 21) - key - 1;
-	key = key ^ (key >> 24);
-	key = (key + (key << 3)) + (key << 8); // key * 265
-	key = key ^ (key >> 14);
-	key = (key + (key << 2)) + (key << 4); // key * 21
-	key = key ^ (key >> 28);
-	key = key + (key << 31);
-	return 5.42101086242752217E-20 * key;
-}
-
 /** Use with std::sort for sorting in ascending order */
 bool Gda::dbl_int_pair_cmp_less(const dbl_int_pair_type& ind1,
 								  const dbl_int_pair_type& ind2)
@@ -63,14 +63,38 @@ namespace Gda {
 	 that seed, seed+1, seed+2, .... seed+n are good random numbers. This
 	 is useful for doing parallel Monte Carlo simulations with a common
 	 random seed for reproducibility. */
-	uint64_t ThomasWangHashUInt64(uint64_t key);
+	inline uint64_t ThomasWangHashUInt64(uint64_t key) {
+		key = (~key) + (key << 21); // key = (key << 21) - key - 1;
+		key = key ^ (key >> 24);
+		key = (key + (key << 3)) + (key << 8); // key * 265
+		key = key ^ (key >> 14);
+		key = (key + (key << 2)) + (key << 4); // key * 21
+		key = key ^ (key >> 28);
+		key = key + (key << 31);
+		return key;
+	}
 	
 	/** Returns a uniformly distributed
 	 random double on the unit interval given unsigned 64-bit integer as
 	 a seed.  Has the property that seed, seed+1, seed+2, .... seed+n are
 	 good random numbers. This is useful for doing parallel Monte Carlo
 	 simulations with a common random seed for reproducibility. */
-	double ThomasWangHashDouble(uint64_t key);
+	inline double ThomasWangHashDouble(uint64_t key) {
+		return 5.42101086242752217E-20 * ThomasWangHashUInt64(key);
+	}
+	
+	/** Returns a uniformly distributed random double in [0,1) from the
+	 SplitMix64 generator evaluated at position key.  Unlike the Thomas Wang
+	 hash, outputs at neighboring keys show no joint correlation, so
+	 key, key+1, ... can be used directly as a counter-based stream for
+	 sampling without replacement.  Never returns 1.0. */
+	inline double SplitMix64Double(uint64_t key) {
+		uint64_t z = key * 0x9E3779B97F4A7C15ULL;
+		z = (z ^ (z >> 30)) * 0xBF58476D1CE4E5B9ULL;
+		z = (z ^ (z >> 27)) * 0x94D049BB133111EBULL;
+		z = z ^ (z >> 31);
+		return (z >> 11) * (1.0 / 9007199254740992.0); // 53 bits / 2^53
+	}
 	
 	inline bool IsNaN(double x) { return x != x; }
 	inline bool IsFinite(double x) { return x-x == 0; }
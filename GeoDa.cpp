@@ -122,6 +122,7 @@
 #include "Explore/LisaMapNewView.h"
 #include "Explore/LisaScatterPlotView.h"
 #include "Explore/LisaCoordinator.h"
+#include "Explore/LisaBatchCoordinator.h"
 #include "Explore/ConditionalMapView.h"
 #include "Explore/ConditionalNewView.h"
 #include "Explore/ConditionalScatterPlotView.h"
@@ -181,7 +182,13 @@ extern void GdaInitXmlResource();
 
 const int ID_TEST_MAP_FRAME = wxID_HIGHEST + 10;
 
+// The benchmark suite links GeoDa.cpp built with GDA_NO_MAIN and provides
+// its own main()
+#ifdef GDA_NO_MAIN
+IMPLEMENT_APP_NO_MAIN(GdaApp)
+#else
 IMPLEMENT_APP(GdaApp)
+#endif
 
 GdaApp::GdaApp() : checker(0), server(0), m_pLogFile(0)
 {
@@ -616,6 +623,7 @@ void GdaFrame::UpdateToolbarAndMenus()
 	GeneralWxUtils::EnableMenuItem(mb, XRCID("IDM_MORAN_EBRATE"), proj_open);
 	EnableTool(XRCID("IDM_UNI_LISA"), shp_proj);
 	GeneralWxUtils::EnableMenuItem(mb, XRCID("IDM_UNI_LISA"), shp_proj);
+	GeneralWxUtils::EnableMenuItem(mb, XRCID("IDM_BATCH_LISA"), shp_proj);
 	EnableTool(XRCID("IDM_MULTI_LISA"), shp_proj);
 	GeneralWxUtils::EnableMenuItem(mb, XRCID("IDM_MULTI_LISA"), shp_proj);
 	EnableTool(XRCID("IDM_LISA_EBRATE"), shp_proj);
@@ -2947,6 +2955,55 @@ void GdaFrame::OnOpenUniLisa(wxCommandEvent& event)
 	}
 }
 
+void GdaFrame::OnOpenBatchLisa(wxCommandEvent& event)
+{
+    wxLogMessage("Open LisaBatchCoordinator (OnOpenBatchLisa).");
+    
+    Project* p = GetProject();
+    if (!p) return;
+    
+    std::vector<boost::uuids::uuid> weights_ids;
+    WeightsManInterface* w_man_int = p->GetWManInt();
+    w_man_int->GetIds(weights_ids);
+    if (weights_ids.size()==0) {
+        wxMessageDialog dlg (this, _("GeoDa could not find the required weights file. \nPlease specify weights in Tools > Weights Manager."), _("No Weights Found"), wxOK | wxICON_ERROR);
+        dlg.ShowModal();
+        return;
+    }
+    
+	PCPDlg dlg(p, this);
+	dlg.SetTitle(_("Univariate Local Moran's I Variables"));
+	if (dlg.ShowModal() != wxID_OK) return;
+	boost::uuids::uuid w_id = GetWeightsId();
+	if (w_id.is_nil()) return;
+	
+    GalWeight* gw = w_man_int->GetGal(w_id);
+    
+    if (gw == NULL) {
+        wxMessageDialog dlg (this, _("Invalid Weights Information:\n\n The selected weights file is not valid.\n Please choose another weights file, or use Tools > Weights > Weights Manager\n to define a valid weights file."), _("Warning"), wxOK | wxICON_WARNING);
+        dlg.ShowModal();
+        return;
+    }
+	
+	LisaBatchCoordinator lbc(w_id, p, dlg.var_info, dlg.col_ids);
+	{
+		wxBusyCursor wait;
+		if (!lbc.Run()) return;
+	}
+	std::vector<wxString> names = lbc.SaveToTable(0.05);
+	
+	wxString msg;
+	msg << _("Local Moran's I, clusters (significance 0.05) and pseudo p-values with 999 permutations were saved to the Table:");
+	msg << "\n";
+	for (int v=0; v<lbc.num_vars && 3*v+2<names.size(); v++) {
+		msg << "\n" << lbc.var_info[v].name << ": " << names[3*v] << ", ";
+		msg << names[3*v+1] << ", " << names[3*v+2];
+	}
+	wxMessageDialog msg_dlg(this, msg, _("Save Results: LISA"),
+							wxOK | wxICON_INFORMATION);
+	msg_dlg.ShowModal();
+}
+
 void GdaFrame::OnOpenMultiLisa(wxCommandEvent& event)
 {
     wxLogMessage("Open LisaMapFrame (OnOpenMultiLisa).");
@@ -4454,6 +4511,30 @@ void GdaFrame::OnSpecifySeedDlg(wxCommandEvent& event)
     }
 }
 
+void GdaFrame::OnUsePermutationTable(wxCommandEvent& event)
+{
+    wxLogMessage("In OnUsePermutationTable()");
+	TemplateFrame* t = TemplateFrame::GetActiveFrame();
+	if (!t) return;
+	if (LisaMapFrame* f = dynamic_cast<LisaMapFrame*>(t)) {
+		f->OnUsePermutationTable(event);
+	} else if (GetisOrdMapFrame* f = dynamic_cast<GetisOrdMapFrame*>(t)) {
+		f->OnUsePermutationTable(event);
+	}
+}
+
+void GdaFrame::OnUseAdaptivePermutations(wxCommandEvent& event)
+{
+    wxLogMessage("In OnUseAdaptivePermutations()");
+	TemplateFrame* t = TemplateFrame::GetActiveFrame();
+	if (!t) return;
+	if (LisaMapFrame* f = dynamic_cast<LisaMapFrame*>(t)) {
+		f->OnUseAdaptivePermutations(event);
+	} else if (GetisOrdMapFrame* f = dynamic_cast<GetisOrdMapFrame*>(t)) {
+		f->OnUseAdaptivePermutations(event);
+	}
+}
+
 void GdaFrame::OnSaveMoranI(wxCommandEvent& event)
 {
     wxLogMessage("In OnSaveMoranI()");
@@ -5782,6 +5863,7 @@ BEGIN_EVENT_TABLE(GdaFrame, wxFrame)
     EVT_MENU(XRCID("IDM_UNI_LISA"), GdaFrame::OnOpenUniLisa)
     EVT_TOOL(XRCID("IDM_UNI_LISA"), GdaFrame::OnOpenUniLisa)
     EVT_BUTTON(XRCID("IDM_UNI_LISA"), GdaFrame::OnOpenUniLisa)
+    EVT_MENU(XRCID("IDM_BATCH_LISA"), GdaFrame::OnOpenBatchLisa)
     EVT_MENU(XRCID("IDM_MULTI_LISA"), GdaFrame::OnOpenMultiLisa)
     EVT_TOOL(XRCID("IDM_MULTI_LISA"), GdaFrame::OnOpenMultiLisa)
     EVT_BUTTON(XRCID("IDM_MULTI_LISA"), GdaFrame::OnOpenMultiLisa)
@@ -5802,6 +5884,8 @@ BEGIN_EVENT_TABLE(GdaFrame, wxFrame)
     EVT_MENU(XRCID("ID_OPTIONS_RANDOMIZATION_OTHER"), GdaFrame::OnRanOtherPer)
     EVT_MENU(XRCID("ID_USE_SPECIFIED_SEED"), GdaFrame::OnUseSpecifiedSeed)
     EVT_MENU(XRCID("ID_SPECIFY_SEED_DLG"), GdaFrame::OnSpecifySeedDlg)
+    EVT_MENU(XRCID("ID_USE_PERMUTATION_TABLE"), GdaFrame::OnUsePermutationTable)
+    EVT_MENU(XRCID("ID_USE_ADAPTIVE_PERMUTATIONS"), GdaFrame::OnUseAdaptivePermutations)
     EVT_MENU(XRCID("ID_SAVE_MORANI"), GdaFrame::OnSaveMoranI)
     EVT_MENU(XRCID("ID_SIGNIFICANCE_FILTER_05"), GdaFrame::OnSigFilter05)
     EVT_MENU(XRCID("ID_SIGNIFICANCE_FILTER_01"), GdaFrame::OnSigFilter01)
@@ -230,6 +230,7 @@ public:
 	void OnLisaMenuChoices(wxCommandEvent& event);
 	void OnGetisMenuChoices(wxCommandEvent& event);
 	void OnOpenUniLisa(wxCommandEvent& event);
+	void OnOpenBatchLisa(wxCommandEvent& event);
 	void OnOpenMultiLisa(wxCommandEvent& event);
 	void OnOpenLisaEB(wxCommandEvent& event);
 	void OnOpenGetisOrd(wxCommandEvent& event);
@@ -540,6 +541,8 @@ public:
 	
 	void OnUseSpecifiedSeed(wxCommandEvent& event);
 	void OnSpecifySeedDlg(wxCommandEvent& event);
+	void OnUsePermutationTable(wxCommandEvent& event);
+	void OnUseAdaptivePermutations(wxCommandEvent& event);
 	
 	void OnSaveMoranI(wxCommandEvent& event);
 	
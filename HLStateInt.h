@@ -64,6 +64,11 @@ public:
 	virtual wxString GetEventTypeStr() = 0;
 	virtual void SetEventType( EventType e ) = 0;
 	virtual int GetTotalHighlighted() = 0;
+	/** True when the newly highlighted and unhighlighted lists hold
+	 exactly the observations changed by the current delta event.  When
+	 false, a delta may have changed any observation. */
+	virtual bool IsDeltaExact() = 0;
+	virtual void SetDeltaExact(bool b) = 0;
 	
 	virtual void registerObserver(HighlightStateObserver* o) = 0;
 	virtual void removeObserver(HighlightStateObserver* o) = 0;
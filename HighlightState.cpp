@@ -24,6 +24,8 @@
 #include "HighlightState.h"
 
 HighlightState::HighlightState()
+: total_highlighted(0), total_newly_highlighted(0),
+total_newly_unhighlighted(0), event_type(empty), delta_exact(false)
 {
 	delete_self_when_empty = false;
 	LOG_MSG("In HighlightState::HighlightState()");
@@ -46,11 +48,12 @@ void HighlightState::closeAndDeleteWhenEmpty()
 
 void HighlightState::SetSize(int n) {
 	total_highlighted = 0;
-	highlight.resize(n);
+	total_newly_highlighted = 0;
+	total_newly_unhighlighted = 0;
+	delta_exact = false;
+	highlight.assign(n, false);
 	newly_highlighted.resize(n);
 	newly_unhighlighted.resize(n);
-	std::vector<bool>::iterator it;
-	for ( it=highlight.begin(); it != highlight.end(); it++ ) (*it) = false;
 }
 
 
@@ -82,33 +85,31 @@ void HighlightState::removeObserver(HighlightStateObserver* o)
 void HighlightState::notifyObservers()
 {
 	ApplyChanges();
-	if (event_type == empty) return;
-    if (observers.empty()) return;
-	// See section 18.4.4.2 of Stroustrup
-	//std::for_each(observers.begin(), observers.end(),
-	//		 std::bind2nd(std::mem_fun(&HighlightStateObserver::update),this));
-   
-    std::list<HighlightStateObserver*>::iterator it;
-    for (it=observers.begin(); it != observers.end(); ++it) {
-        HighlightStateObserver* obj = *it;
-        obj->update(this);
-    }
-    
+	if (event_type != empty) {
+		// See section 18.4.4.2 of Stroustrup
+		//std::for_each(observers.begin(), observers.end(),
+		//		 std::bind2nd(std::mem_fun(&HighlightStateObserver::update),this));
+		
+		std::list<HighlightStateObserver*>::iterator it;
+		for (it=observers.begin(); it != observers.end(); ++it) {
+			HighlightStateObserver* obj = *it;
+			obj->update(this);
+		}
+	}
+	delta_exact = false;
 }
 
 void HighlightState::notifyObservers(HighlightStateObserver* exclude)
 {
 	ApplyChanges();
-	if (event_type == empty) return;
-	for (std::list<HighlightStateObserver*>::iterator i=observers.begin();
-		 i != observers.end(); ++i)
-	{
-		if ((*i) == exclude) {
-            
-		} else {
-			(*i)->update(this);
+	if (event_type != empty) {
+		for (std::list<HighlightStateObserver*>::iterator i=observers.begin();
+			 i != observers.end(); ++i)
+		{
+			if ((*i) != exclude) (*i)->update(this);
 		}
 	}
+	delta_exact = false;
 }
 
 void HighlightState::ApplyChanges()
@@ -116,13 +117,14 @@ void HighlightState::ApplyChanges()
 	switch (event_type) {
 		case delta:
 		{
-            total_highlighted = 0;
-            for (int i=0; i<highlight.size(); i++) {
-                if (highlight[i] == true) {
-                    total_highlighted += 1;
-                }
-            }
-            
+			if (delta_exact) {
+				total_highlighted += total_newly_highlighted;
+				total_highlighted -= total_newly_unhighlighted;
+			} else {
+				// the highlight vector was changed directly, recount
+				total_highlighted = std::count(highlight.begin(),
+											   highlight.end(), true);
+			}
 		}
 			break;
 		case unhighlight_all:
@@ -131,23 +133,14 @@ void HighlightState::ApplyChanges()
 				//MMM: figure out why this short-cut isn't always working
 				//event_type = empty;
 			}
-			for (int i=0, iend=highlight.size(); i<iend; i++) {
-				highlight[i] = false;
-			}
+			highlight.assign(highlight.size(), false);
 			total_highlighted = 0;
 		}
 			break;
 		case invert:
 		{
-            
-            total_highlighted = 0;
-            for (int i=0; i<highlight.size(); i++) {
-                if (highlight[i] == false) {
-                    total_highlighted += 1;
-                }
-                highlight[i] = !highlight[i];
-            }
-            
+			highlight.flip();
+			total_highlighted = highlight.size() - total_highlighted;
 		}
 			break;
 		default:
@@ -58,6 +58,8 @@ public:
 	virtual wxString GetEventTypeStr();
 	virtual void SetEventType( EventType e ) { event_type = e; }
 	virtual int GetTotalHighlighted() { return total_highlighted; }
+	virtual bool IsDeltaExact() { return delta_exact; }
+	virtual void SetDeltaExact(bool b) { delta_exact = b; }
 	
 	virtual void registerObserver(HighlightStateObserver* o);
 	virtual void removeObserver(HighlightStateObserver* o);
@@ -95,6 +97,12 @@ private:
     
 	EventType event_type;
     
+	/** Set by the view that filled the newly_highlighted and
+	 newly_unhighlighted lists for a delta event, cleared once the
+	 observers have been notified.  total_highlighted is then updated from
+	 the lists instead of being recounted. */
+	bool delta_exact;
+    
 	void ApplyChanges(); // called by notifyObservers to update highlight vec
 	
 	/** When this is set to true and the list of observers is empty, the
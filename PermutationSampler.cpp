@@ -0,0 +1,217 @@
+/**
+ * GeoDa TM, Copyright (C) 2011-2015 by Luc Anselin - all rights reserved
+ *
+ * This file is part of GeoDa.
+ *
+ * GeoDa is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+ *
+ * GeoDa is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program.  If not, see <http://www.gnu.org/licenses/>.
+ */
+
+#include <boost/bind.hpp>
+#include <boost/thread/tss.hpp>
+#include "GdaThreadPool.h"
+#include "GenUtils.h"
+#include "PermutationSampler.h"
+
+static boost::thread_specific_ptr<PermutationSampler> thread_sampler;
+
+PermutationSampler::PermutationSampler(int num_obs_s)
+: num_obs(num_obs_s), idx(num_obs_s)
+{
+	for (int i=0; i<num_obs; i++) idx[i] = i;
+}
+
+PermutationSampler::~PermutationSampler()
+{
+}
+
+PermutationSampler& PermutationSampler::ForThread(int num_obs)
+{
+	if (!thread_sampler.get() || thread_sampler->num_obs != num_obs) {
+		thread_sampler.reset(new PermutationSampler(num_obs));
+	}
+	return *thread_sampler;
+}
+
+uint64_t PermutationSampler::PermutedSums(int obs, int k, int num_perms,
+										  uint64_t seed,
+										  const double* x, double* sums)
+{
+	// idx[0..m-1] are the candidate positions, position v stands for
+	// observation v + (v >= obs) so that obs itself is never drawn
+	int m = num_obs-1;
+	if (k > m) k = m;
+	if (k <= 0) {
+		for (int p=0; p<num_perms; p++) sums[p] = 0;
+		return seed;
+	}
+	if ((int) rnd.size() < batch_size*k) rnd.resize(batch_size*k);
+	int* r = &rnd[0];
+	int* id = &idx[0];
+
+	for (int p0=0; p0<num_perms; p0+=batch_size) {
+		int nb = num_perms-p0 < batch_size ? num_perms-p0 : batch_size;
+
+		// generate all random numbers of the batch up front.  The j-th
+		// draw of a permutation picks a slot in [j, m-1].
+		for (int b=0; b<nb; b++) {
+			int* rb = r + b*k;
+			uint64_t s = seed + (uint64_t) b*k;
+			for (int j=0; j<k; j++) {
+				rb[j] = j + (int) (Gda::SplitMix64Double(s+j) * (m-j));
+			}
+		}
+		seed += (uint64_t) nb*k;
+
+		for (int b=0; b<nb; b++) {
+			const int* rb = r + b*k;
+			for (int j=0; j<k; j++) {
+				int t = id[j]; id[j] = id[rb[j]]; id[rb[j]] = t;
+			}
+			double lag = 0;
+			for (int j=0; j<k; j++) {
+				int v = id[j];
+				lag += x[v + (v >= obs)];
+			}
+			sums[p0+b] = lag;
+			// undo the swaps so idx is the identity again
+			for (int j=k-1; j>=0; j--) {
+				int t = id[j]; id[j] = id[rb[j]]; id[rb[j]] = t;
+			}
+		}
+	}
+	return seed;
+}
+
+uint64_t PermutationSampler::PermutedSums(int obs, int k, int num_perms,
+										  uint64_t seed, const double* x,
+										  int num_vars, double* sums)
+{
+	int m = num_obs-1;
+	if (k > m) k = m;
+	if (k <= 0) {
+		for (int p=0; p<num_perms*num_vars; p++) sums[p] = 0;
+		return seed;
+	}
+	if ((int) rnd.size() < batch_size*k) rnd.resize(batch_size*k);
+	int* r = &rnd[0];
+	int* id = &idx[0];
+	
+	for (int p0=0; p0<num_perms; p0+=batch_size) {
+		int nb = num_perms-p0 < batch_size ? num_perms-p0 : batch_size;
+		
+		// same draws as the single variable version
+		for (int b=0; b<nb; b++) {
+			int* rb = r + b*k;
+			uint64_t s = seed + (uint64_t) b*k;
+			for (int j=0; j<k; j++) {
+				rb[j] = j + (int) (Gda::SplitMix64Double(s+j) * (m-j));
+			}
+		}
+		seed += (uint64_t) nb*k;
+		
+		for (int b=0; b<nb; b++) {
+			const int* rb = r + b*k;
+			for (int j=0; j<k; j++) {
+				int t = id[j]; id[j] = id[rb[j]]; id[rb[j]] = t;
+			}
+			// one pass over the rows of the drawn neighbors adds them to
+			// all variables, in the same order as PermutedSums
+			double* lag = sums + (size_t) (p0+b)*num_vars;
+			for (int v=0; v<num_vars; v++) lag[v] = 0;
+			for (int j=0; j<k; j++) {
+				int u = id[j];
+				const double* row = x + (size_t) (u + (u >= obs))*num_vars;
+				for (int v=0; v<num_vars; v++) lag[v] += row[v];
+			}
+			for (int j=k-1; j>=0; j--) {
+				int t = id[j]; id[j] = id[rb[j]]; id[rb[j]] = t;
+			}
+		}
+	}
+	return seed;
+}
+
+void PermutationSampler::DrawPositions(int k, uint64_t seed, int* pos)
+{
+	int m = num_obs-1;
+	if (k > m) k = m;
+	if (k <= 0) return;
+	if ((int) rnd.size() < k) rnd.resize(k);
+	int* r = &rnd[0];
+	int* id = &idx[0];
+	for (int j=0; j<k; j++) {
+		r[j] = j + (int) (Gda::SplitMix64Double(seed+j) * (m-j));
+	}
+	for (int j=0; j<k; j++) {
+		int t = id[j]; id[j] = id[r[j]]; id[r[j]] = t;
+		pos[j] = id[j];
+	}
+	for (int j=k-1; j>=0; j--) {
+		int t = id[j]; id[j] = id[r[j]]; id[r[j]] = t;
+	}
+}
+
+PermutationTable::PermutationTable(int num_obs_s, int max_k_s, int num_perms_s,
+								   uint64_t seed_s)
+: num_obs(num_obs_s), max_k(max_k_s), num_perms(num_perms_s), seed(seed_s)
+{
+	if (max_k > num_obs-1) max_k = num_obs-1;
+	if (max_k < 0) max_k = 0;
+	if (max_k == 0 || num_perms <= 0) return;
+	table.resize((size_t) num_perms * max_k);
+	GdaThreadPool::GetInstance()->
+		ParallelFor(0, num_perms-1, 1024,
+					boost::bind(&PermutationTable::FillRows, this, _1, _2));
+}
+
+PermutationTable::~PermutationTable()
+{
+}
+
+bool PermutationTable::Fits(int num_obs, int max_k, int num_perms)
+{
+	if (max_k > num_obs-1) max_k = num_obs-1;
+	if (max_k <= 0 || num_perms <= 0) return true;
+	return (size_t) num_perms <= max_table_size / max_k;
+}
+
+void PermutationTable::FillRows(int row_start, int row_end)
+{
+	// the worker's sampler holds the index buffer, so it is set up once
+	// per thread rather than once per task
+	PermutationSampler& sampler = PermutationSampler::ForThread(num_obs);
+	for (int p=row_start; p<=row_end; p++) {
+		sampler.DrawPositions(max_k, seed + (uint64_t) p*max_k,
+							  &table[(size_t) p*max_k]);
+	}
+}
+
+void PermutationTable::PermutedSums(int obs, int k, int perm_start, int count,
+									const double* x, double* sums) const
+{
+	if (k > max_k) k = max_k;
+	if (k <= 0) {
+		for (int p=0; p<count; p++) sums[p] = 0;
+		return;
+	}
+	const int* row = &table[(size_t) perm_start*max_k];
+	for (int p=0; p<count; p++, row+=max_k) {
+		double lag = 0;
+		for (int j=0; j<k; j++) {
+			int v = row[j];
+			lag += x[v + (v >= obs)];
+		}
+		sums[p] = lag;
+	}
+}
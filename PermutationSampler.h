@@ -0,0 +1,147 @@
+/**
+ * GeoDa TM, Copyright (C) 2011-2015 by Luc Anselin - all rights reserved
+ *
+ * This file is part of GeoDa.
+ *
+ * GeoDa is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+ *
+ * GeoDa is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program.  If not, see <http://www.gnu.org/licenses/>.
+ */
+
+#ifndef __GEODA_CENTER_PERMUTATION_SAMPLER_H__
+#define __GEODA_CENTER_PERMUTATION_SAMPLER_H__
+
+#include <stdint.h>
+#include <vector>
+
+/**
+ * Batched conditional randomization for local spatial statistics.
+ *
+ * For an observation obs with k neighbors, each permutation draws k other
+ * observations without replacement (obs itself excluded) and sums the
+ * data values at the drawn positions.  Draws use a partial Fisher-Yates
+ * shuffle over an index buffer that is restored after every permutation,
+ * so the sample only depends on the random numbers and never on earlier
+ * calls.  Every permutation consumes exactly k seeds of the counter-based
+ * Gda::SplitMix64Double stream, and random numbers are generated for a
+ * block of permutations at a time in a loop the compiler can vectorize.
+ *
+ * This is version 2 of the permutation scheme.  Version 1 (GeoDa 1.8.15 and
+ * earlier) used rejection sampling with GeoDaSet and the Thomas Wang hash,
+ * so the same seed gives different, but statistically equivalent, pseudo
+ * p-values.
+ *
+ * One PermutationSampler is meant to be used by a single thread.  Setting
+ * one up costs O(num_obs), so tasks should use ForThread() instead of
+ * constructing their own.
+ */
+class PermutationSampler {
+public:
+	PermutationSampler(int num_obs);
+	virtual ~PermutationSampler();
+
+	/** Fill sums[0..num_perms-1] with the sum of x over num_perms random
+	 neighbor sets of size k for observation obs.  Random numbers are
+	 taken from seed, seed+1, ... and the next unused seed is returned. */
+	uint64_t PermutedSums(int obs, int k, int num_perms, uint64_t seed,
+						  const double* x, double* sums);
+
+	/** PermutedSums for num_vars variables at once.  x holds the data row
+	 by row, x[i*num_vars + v], and the sum of variable v over the p-th
+	 neighbor set goes to sums[p*num_vars + v].  Each neighbor set is
+	 drawn once and used for every variable, and the sets are the ones
+	 PermutedSums draws for the same seed. */
+	uint64_t PermutedSums(int obs, int k, int num_perms, uint64_t seed,
+						  const double* x, int num_vars, double* sums);
+	
+	/** Draws k distinct positions in [0, num_obs-2] into pos, taking
+	 random numbers from seed, seed+1, ...  The positions are the ones a
+	 permutation of PermutedSums picks for the same seed. */
+	void DrawPositions(int k, uint64_t seed, int* pos);
+	
+	/** Returns the calling thread's sampler, created or resized on demand.
+	 Valid until the next call to ForThread() with a different num_obs on
+	 the same thread. */
+	static PermutationSampler& ForThread(int num_obs);
+
+	/** Sequential stopping rule in the spirit of Besag and Clifford (1991).
+	 After perms_done of permutations draws, count_larger of which were at
+	 least as extreme as the observed statistic, the folded count
+	 min(count_larger, perms_done-count_larger) can only grow.  Once even
+	 that lower bound gives a pseudo p-value above cutoff, the full run
+	 cannot be significant at cutoff and the remaining draws are
+	 skipped. */
+	static bool CannotReachCutoff(uint64_t count_larger, int perms_done,
+								  int permutations, double cutoff) {
+		uint64_t c = perms_done - count_larger;
+		if (count_larger < c) c = count_larger;
+		return (c+1.0)/(permutations+1.0) > cutoff;
+	}
+
+	/** Number of permutations hashed per batch. */
+	static const int batch_size = 64;
+
+protected:
+	int num_obs;
+	std::vector<int> idx; // identity permutation between calls
+	std::vector<int> rnd; // swap targets for one batch
+};
+
+/**
+ * Permutation table shared by all observations, in the style of rlisa and
+ * PySAL's keep_simulations option.  A single num_perms x max_k table of
+ * random positions is drawn once; row p holds max_k distinct positions
+ * in [0, num_obs-2].  For observation obs with k neighbors, permutation p
+ * uses the first k positions of row p, with position v standing for
+ * observation v + (v >= obs).  Since every row is a sample without
+ * replacement from num_obs-1 positions, the mapped set never contains obs
+ * and is a uniform random neighbor set for every observation.
+ *
+ * Per-observation work is then a pure gather and sum.  The price is that
+ * the pseudo p-values of different observations are computed from the
+ * same random draws and so are no longer independent of each other.
+ *
+ * The table is read-only once built and may be shared between threads.
+ */
+class PermutationTable {
+public:
+	/** Draws the table on all cores.  Row p uses seeds
+	 seed + p*max_k, ..., seed + (p+1)*max_k - 1.  Check Fits() first. */
+	PermutationTable(int num_obs, int max_k, int num_perms, uint64_t seed);
+	virtual ~PermutationTable();
+	
+	/** False if the table for these sizes would exceed max_table_size
+	 entries.  Callers then sample every observation on its own. */
+	static bool Fits(int num_obs, int max_k, int num_perms);
+	/** Largest table, in ints, that is drawn: 256 MB. */
+	static const size_t max_table_size = (size_t) 1 << 26;
+
+	int GetMaxK() const { return max_k; }
+	int GetNumPerms() const { return num_perms; }
+
+	/** Fill sums[0..count-1] like PermutationSampler::PermutedSums, using
+	 rows perm_start through perm_start+count-1 of the table.  k must not
+	 exceed GetMaxK(). */
+	void PermutedSums(int obs, int k, int perm_start, int count,
+					  const double* x, double* sums) const;
+
+protected:
+	void FillRows(int row_start, int row_end);
+
+	int num_obs;
+	int max_k;
+	int num_perms;
+	uint64_t seed;
+	std::vector<int> table; // row-major num_perms x max_k
+};
+
+#endif
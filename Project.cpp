@@ -54,12 +54,14 @@
 #include "Explore/CatClassifManager.h"
 #include "Explore/CovSpHLStateProxy.h"
 #include "GdaShape.h"
+#include "GdaGeomBuffer.h"
 #include "GenGeomAlgs.h"
 #include "SpatialIndAlgs.h"
 #include "PointSetAlgs.h"
 #include "DbfFile.h"
 #include "ShapeOperations/GalWeight.h"
 #include "ShapeOperations/ShapeUtils.h"
+#include "ShapeOperations/ShpMappedMain.h"
 #include "ShapeOperations/VoronoiUtils.h"
 #include "VarCalc/WeightsManInterface.h"
 #include "ShapeOperations/WeightsManState.h"
@@ -78,6 +80,7 @@ table_int(0), table_state(0), time_state(0),
 w_man_int(0), w_man_state(0),
 save_manager(0),
 frames_manager(0),cat_classif_manager(0), mean_centers(0), centroids(0),
+geom_buffer(0), geom_buffer_built(false),
 voronoi_rook_nbr_gal(0), default_var_name(4), default_var_time(4),
 point_duplicates_initialized(false), point_dups_warn_prev_displayed(false),
 num_records(0), layer_proxy(NULL),
@@ -127,6 +130,7 @@ table_int(0), table_state(0), time_state(0),
 w_man_int(0), w_man_state(0),
 save_manager(0),
 frames_manager(0),cat_classif_manager(0), mean_centers(0), centroids(0),
+geom_buffer(0), geom_buffer_built(false),
 voronoi_rook_nbr_gal(0), default_var_name(4), default_var_time(4),
 point_duplicates_initialized(false), point_dups_warn_prev_displayed(false),
 num_records(0), layer_proxy(NULL),
@@ -202,6 +206,8 @@ Project::~Project()
 	for (size_t i=0, iend=centroids.size(); i<iend; i++)
         delete centroids[i];
     
+	if (geom_buffer) delete geom_buffer;
+    
 	if (voronoi_rook_nbr_gal)
         delete [] voronoi_rook_nbr_gal;
     
@@ -1137,6 +1143,21 @@ double Project::GetMaxDistArc()
 	return max_dist_arc;
 }
 
+/** Built on first use from main_data, which never changes afterwards. */
+const GdaGeomBuffer* Project::GetGeomBuffer()
+{
+	if (!geom_buffer_built) {
+		geom_buffer_built = true;
+		GdaGeomBuffer* buf = new GdaGeomBuffer;
+		if (buf->Build(main_data)) {
+			geom_buffer = buf;
+		} else {
+			delete buf;
+		}
+	}
+	return geom_buffer;
+}
+
 rtree_pt_2d_t& Project::GetEucPlaneRtree()
 {
 	return rtree_2d;
@@ -1510,7 +1531,21 @@ bool Project::InitFromOgrLayer()
     
 	isTableOnly = layer_proxy->IsTableOnly();
 	if (!isTableOnly) {
-		layer_proxy->ReadGeometries(main_data);
+		// plain point and polygon shapefiles are decoded straight from the
+		// mapped .shp, anything else goes through OGR
+		bool mapped = false;
+		if (ds_type == GdaConst::ds_shapefile) {
+			wxFileName fn(datasource_name);
+			wxString shp_fn = fn.GetPathWithSep() + fn.GetName() + ".shp";
+			wxString shx_fn = fn.GetPathWithSep() + fn.GetName() + ".shx";
+			Shapefile::MappedMain shp;
+			if (shp.Open(shp_fn, shx_fn) &&
+				shp.GetHeader().shape_type != Shapefile::POLY_LINE &&
+				shp.GetNumRecords() == layer_proxy->GetNumRecords()) {
+				mapped = shp.ToMain(main_data);
+			}
+		}
+		if (!mapped) layer_proxy->ReadGeometries(main_data);
     } else {
         // prompt user to select X/Y columns to create a geometry layer
 
@@ -63,6 +63,7 @@ class TimeChooserDlg;
 class GdaPoint;
 class GdaPolygon;
 class GdaShape;
+class GdaGeomBuffer;
 class wxGrid;
 class DataSource;
 class CovSpHLStateProxy;
@@ -156,6 +157,8 @@ public:
 	void GetCentroids(std::vector<double>& x, std::vector<double>& y);
 	void GetCentroids(std::vector<wxRealPoint>& pts);
 	const std::vector<GdaShape*>& GetVoronoiPolygons();
+	/// polygon layers only, 0 otherwise; shared by all map views
+	const GdaGeomBuffer* GetGeomBuffer();
 	
 	double GetMin1nnDistEuc();
 	double GetMax1nnDistEuc();
@@ -258,6 +261,9 @@ private:
 	std::vector<GdaPoint*> mean_centers;
 	std::vector<GdaPoint*> centroids;
 	std::vector<GdaShape*> voronoi_polygons;
+	
+	GdaGeomBuffer* geom_buffer;
+	bool geom_buffer_built;
 
 	bool point_duplicates_initialized;
 	bool point_dups_warn_prev_displayed;
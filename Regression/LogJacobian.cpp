@@ -0,0 +1,353 @@
+/**
+ * GeoDa TM, Copyright (C) 2011-2015 by Luc Anselin - all rights reserved
+ *
+ * This file is part of GeoDa.
+ * 
+ * GeoDa is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+ *
+ * GeoDa is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program.  If not, see <http://www.gnu.org/licenses/>.
+ */
+
+
+#include <algorithm>
+#include <cmath>
+#include <set>
+#include <utility>
+#include <boost/bind.hpp>
+#include "../GdaThreadPool.h"
+#include "../GenUtils.h"
+#include "../ShapeOperations/CsrWeight.h"
+#include "LogJacobian.h"
+
+LogJacobian* LogJacobian::Create(Method method, const CsrWeight& w,
+								 bool use_grid)
+{
+	LogJacobian* lj = 0;
+	if (method == sparse_lu) {
+		lj = new SparseLULogJacobian(w);
+	} else if (method == chebyshev) {
+		lj = new ChebyshevLogJacobian(w);
+	} else if (method == monte_carlo) {
+		lj = new MonteCarloLogJacobian(w);
+	}
+	if (lj && use_grid) lj = new LogJacobianGrid(lj);
+	return lj;
+}
+
+////////////////////////////////////////////////////////////////////////////////
+//
+// SparseLULogJacobian
+//
+////////////////////////////////////////////////////////////////////////////////
+SparseLULogJacobian::SparseLULogJacobian(const CsrWeight& w)
+: num_obs(w.GetNumObs())
+{
+	using namespace std;
+	int n = num_obs;
+	
+	// symmetric pattern of W + W' without the diagonal
+	vector< vector<int> > adj(n);
+	for (int i=0; i<n; i++) {
+		const int* nb = w.GetNbrs(i);
+		for (int j=0, sz=w.Size(i); j<sz; j++) {
+			if (nb[j] == i) continue;
+			adj[i].push_back(nb[j]);
+			adj[nb[j]].push_back(i);
+		}
+	}
+	for (int i=0; i<n; i++) {
+		sort(adj[i].begin(), adj[i].end());
+		adj[i].erase(unique(adj[i].begin(), adj[i].end()), adj[i].end());
+	}
+	
+	// minimum degree ordering on the elimination graph: eliminating v turns
+	// its remaining neighbors into a clique, and those neighbors are
+	// exactly the pattern of row v of U and column v of L.  Ties go to the
+	// lower observation so the ordering is reproducible.
+	set< pair<int, int> > queue;
+	for (int i=0; i<n; i++) queue.insert(make_pair((int) adj[i].size(), i));
+	vector<int> pos(n, -1), order(n);
+	vector< vector<int> > pats(n);
+	vector<int> merged;
+	for (int k=0; k<n; k++) {
+		int v = queue.begin()->second;
+		queue.erase(queue.begin());
+		pos[v] = k;
+		order[k] = v;
+		vector<int>& nv = adj[v];
+		for (size_t t=0; t<nv.size(); t++) {
+			int u = nv[t];
+			merged.clear();
+			set_union(adj[u].begin(), adj[u].end(), nv.begin(), nv.end(),
+					  back_inserter(merged));
+			merged.erase(remove(merged.begin(), merged.end(), u),
+						 merged.end());
+			merged.erase(remove(merged.begin(), merged.end(), v),
+						 merged.end());
+			queue.erase(make_pair((int) adj[u].size(), u));
+			adj[u].swap(merged);
+			queue.insert(make_pair((int) adj[u].size(), u));
+		}
+		pats[v].swap(nv);
+	}
+	
+	// pattern of the factors in eliminated order
+	f_off.resize(n+1, 0);
+	for (int k=0; k<n; k++) f_off[k+1] = f_off[k] + pats[order[k]].size();
+	f_cols.resize(f_off[n]);
+	for (int k=0; k<n; k++) {
+		vector<int>& p = pats[order[k]];
+		int* c = f_cols.empty() ? 0 : &f_cols[f_off[k]];
+		for (size_t t=0; t<p.size(); t++) c[t] = pos[p[t]];
+		sort(c, c + p.size());
+		vector<int>().swap(p);
+	}
+	
+	// where each entry of the row-standardized W goes
+	for (int i=0; i<n; i++) {
+		double s = w.GetRowSum(i);
+		if (s == 0) continue;
+		const int* nb = w.GetNbrs(i);
+		const double* nw = w.GetNbrWeights(i);
+		for (int j=0, sz=w.Size(i); j<sz; j++) {
+			int a = pos[i], b = pos[nb[j]];
+			char kind = 'd';
+			size_t slot = a;
+			if (a != b) {
+				int r = a < b ? a : b, c = a < b ? b : a;
+				slot = lower_bound(f_cols.begin() + f_off[r],
+								   f_cols.begin() + f_off[r+1], c)
+					- f_cols.begin();
+				kind = a < b ? 'u' : 'l';
+			}
+			a_vals.push_back(nw[j] / s);
+			a_slots.push_back(slot);
+			a_kind.push_back(kind);
+		}
+	}
+}
+
+SparseLULogJacobian::~SparseLULogJacobian()
+{
+}
+
+double SparseLULogJacobian::LogDet(double rho) const
+{
+	size_t nf = f_cols.size();
+	std::vector<double> u(nf, 0), l(nf, 0), d(num_obs, 1.0);
+	std::vector<size_t> where(num_obs, 0);
+	for (size_t t=0; t<a_vals.size(); t++) {
+		double v = -rho * a_vals[t];
+		if (a_kind[t] == 'u') u[a_slots[t]] += v;
+		else if (a_kind[t] == 'l') l[a_slots[t]] += v;
+		else d[a_slots[t]] += v;
+	}
+	
+	// right-looking elimination.  Row k of U and column k of L share the
+	// pattern f_cols, so entry (c, w) of the Schur complement sits in row
+	// c of U if c < w and in column w of L otherwise.
+	double logdet = 0;
+	for (int k=0; k<num_obs; k++) {
+		double dk = d[k];
+		if (dk == 0) return -HUGE_VAL;
+		logdet += log(fabs(dk));
+		size_t s = f_off[k], e = f_off[k+1];
+		for (size_t t=s; t<e; t++) l[t] /= dk;
+		for (size_t t1=s; t1<e; t1++) {
+			int c = f_cols[t1];
+			double lc = l[t1], uc = u[t1];
+			if (lc == 0 && uc == 0) continue;
+			d[c] -= lc * uc;
+			if (t1+1 == e) continue;
+			for (size_t q=f_off[c]; q<f_off[c+1]; q++) where[f_cols[q]] = q;
+			for (size_t t2=t1+1; t2<e; t2++) {
+				size_t q = where[f_cols[t2]];
+				u[q] -= lc * u[t2];
+				l[q] -= l[t2] * uc;
+			}
+		}
+	}
+	return logdet;
+}
+
+////////////////////////////////////////////////////////////////////////////////
+//
+// TraceLogJacobian
+//
+////////////////////////////////////////////////////////////////////////////////
+void TraceLogJacobian::EstimateTraces(const CsrWeight& w, int order,
+									  double a, double b, int num_probes,
+									  uint64_t seed)
+{
+	num_obs = w.GetNumObs();
+	int n = num_obs;
+	traces.assign(order+1, 0);
+	
+	// tr(I), tr(W) and tr(W^2) are exact
+	double tr_W = 0, tr_WW = 0, tr_WtW = 0;
+	for (int i=0; i<n; i++) {
+		double s = w.GetRowSum(i);
+		if (s == 0) continue;
+		const int* nb = w.GetNbrs(i);
+		const double* nw = w.GetNbrWeights(i);
+		for (int j=0, sz=w.Size(i); j<sz; j++) {
+			if (nb[j] == i) tr_W += nw[j] / s;
+		}
+	}
+	w.GetTraces(tr_WW, tr_WtW);
+	traces[0] = n;
+	if (order >= 1) traces[1] = tr_W;
+	if (order >= 2) traces[2] = a * tr_WW - b * n;
+	if (order < 3 || num_probes < 1) return;
+	
+	// one row of sums per probe, added up in probe order afterwards so the
+	// result does not depend on the number of threads
+	std::vector<double> sums((size_t) num_probes * (order+1), 0);
+	GdaThreadPool::GetInstance()->
+		ParallelFor(0, num_probes-1, 1,
+					boost::bind(&TraceLogJacobian::RunProbes, this,
+								boost::cref(w), order, a, b, seed,
+								_1, _2, &sums));
+	for (int j=3; j<=order; j++) {
+		double s = 0;
+		for (int p=0; p<num_probes; p++) s += sums[(size_t) p*(order+1) + j];
+		traces[j] = s / num_probes;
+	}
+}
+
+void TraceLogJacobian::RunProbes(const CsrWeight& w, int order,
+								 double a, double b, uint64_t seed,
+								 int probe_start, int probe_end,
+								 std::vector<double>* sums)
+{
+	int n = num_obs;
+	std::vector<double> u(n), prev(n), cur(n), next(n);
+	for (int p=probe_start; p<=probe_end; p++) {
+		double* out = &(*sums)[(size_t) p*(order+1)];
+		uint64_t s = seed + (uint64_t) p * n;
+		for (int i=0; i<n; i++) {
+			u[i] = Gda::SplitMix64Double(s+i) < 0.5 ? -1.0 : 1.0;
+		}
+		// P_0 u = u, P_1 u = W u, P_{j+1} u = a W P_j u - b P_{j-1} u
+		prev = u;
+		w.SpatialLags(&u[0], &cur[0]);
+		for (int j=2; j<=order; j++) {
+			w.SpatialLags(&cur[0], &next[0]);
+			double d = 0;
+			for (int i=0; i<n; i++) {
+				next[i] = a * next[i] - b * prev[i];
+				d += u[i] * next[i];
+			}
+			out[j] = d;
+			prev.swap(cur);
+			cur.swap(next);
+		}
+	}
+}
+
+////////////////////////////////////////////////////////////////////////////////
+//
+// ChebyshevLogJacobian
+//
+////////////////////////////////////////////////////////////////////////////////
+ChebyshevLogJacobian::ChebyshevLogJacobian(const CsrWeight& w, int order_s,
+										   int num_probes, uint64_t seed)
+: order(order_s < 2 ? 2 : order_s)
+{
+	EstimateTraces(w, order, 2, 1, num_probes, seed);
+}
+
+double ChebyshevLogJacobian::LogDet(double rho) const
+{
+	// c_j = 2/(q+1) sum_k f(x_k) T_j(x_k) at the Chebyshev nodes
+	// x_k = cos(pi (k+1/2) / (q+1)), and f(x) ~ sum_j c_j T_j(x) - c_0/2
+	int q1 = order+1;
+	std::vector<double> f(q1);
+	for (int k=0; k<q1; k++) {
+		double x = cos(M_PI * (k+0.5) / q1);
+		f[k] = log(1.0 - rho * x);
+	}
+	double logdet = 0;
+	for (int j=0; j<=order; j++) {
+		double c = 0;
+		for (int k=0; k<q1; k++) c += f[k] * cos(M_PI * j * (k+0.5) / q1);
+		c *= 2.0 / q1;
+		if (j == 0) c *= 0.5;
+		logdet += c * traces[j];
+	}
+	return logdet;
+}
+
+////////////////////////////////////////////////////////////////////////////////
+//
+// MonteCarloLogJacobian
+//
+////////////////////////////////////////////////////////////////////////////////
+MonteCarloLogJacobian::MonteCarloLogJacobian(const CsrWeight& w, int order_s,
+											 int num_probes, uint64_t seed)
+: order(order_s < 2 ? 2 : order_s)
+{
+	EstimateTraces(w, order, 1, 0, num_probes, seed);
+}
+
+double MonteCarloLogJacobian::LogDet(double rho) const
+{
+	double logdet = 0, r = 1;
+	for (int k=1; k<=order; k++) {
+		r *= rho;
+		logdet -= r * traces[k] / k;
+	}
+	return logdet;
+}
+
+////////////////////////////////////////////////////////////////////////////////
+//
+// LogJacobianGrid
+//
+////////////////////////////////////////////////////////////////////////////////
+LogJacobianGrid::LogJacobianGrid(LogJacobian* src_s, double lower_s,
+								 double upper, double step_s)
+: src(src_s), lower(lower_s), step(step_s)
+{
+	int n = (int) floor((upper - lower) / step + 0.5) + 1;
+	if (n < 2) n = 2;
+	vals.resize(n);
+	GdaThreadPool::GetInstance()->
+		ParallelFor(0, n-1, 1,
+					boost::bind(&LogJacobianGrid::FillRange, this, _1, _2));
+}
+
+LogJacobianGrid::~LogJacobianGrid()
+{
+	if (src) delete src;
+}
+
+void LogJacobianGrid::FillRange(int a, int b)
+{
+	for (int i=a; i<=b; i++) vals[i] = src->LogDet(lower + i * step);
+}
+
+double LogJacobianGrid::LogDet(double rho) const
+{
+	int n = vals.size();
+	double t = (rho - lower) / step;
+	if (t < 0 || t > n-1) return src->LogDet(rho);
+	int i = (int) t;
+	if (i >= n-1) i = n-2;
+	t -= i;
+	// cubic Hermite with central difference slopes (one-sided at the ends)
+	double m0 = i > 0 ? 0.5 * (vals[i+1] - vals[i-1]) : vals[i+1] - vals[i];
+	double m1 = i+2 < n ? 0.5 * (vals[i+2] - vals[i]) : vals[i+1] - vals[i];
+	double t2 = t*t, t3 = t2*t;
+	return (2*t3 - 3*t2 + 1) * vals[i] + (t3 - 2*t2 + t) * m0 +
+		(-2*t3 + 3*t2) * vals[i+1] + (t3 - t2) * m1;
+}
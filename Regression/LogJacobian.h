@@ -0,0 +1,181 @@
+/**
+ * GeoDa TM, Copyright (C) 2011-2015 by Luc Anselin - all rights reserved
+ *
+ * This file is part of GeoDa.
+ * 
+ * GeoDa is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+ *
+ * GeoDa is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program.  If not, see <http://www.gnu.org/licenses/>.
+ */
+
+
+#ifndef __GEODA_CENTER_LOG_JACOBIAN_H__
+#define __GEODA_CENTER_LOG_JACOBIAN_H__
+
+#include <stdint.h>
+#include <vector>
+
+class CsrWeight;
+
+/**
+ * log|I - rho*W| for the row-standardized version of a spatial weights
+ * matrix W, the log-Jacobian term of the concentrated likelihood of the ML
+ * spatial lag and error models.
+ *
+ * ML_im.cpp has always computed it from all eigenvalues of a dense copy of
+ * W for small problems and from the characteristic polynomial otherwise
+ * (Method char_poly).  The backends below only need the sparse matrix:
+ *
+ * - SparseLULogJacobian: exact, from the pivots of a sparse LU
+ *   factorization of I - rho*W, O(nnz(L)) memory.
+ * - ChebyshevLogJacobian: Chebyshev approximation of Pace and LeSage (2004).
+ * - MonteCarloLogJacobian: power series with stochastic traces of Barry
+ *   and Pace (1999).
+ *
+ * and LogJacobianGrid tabulates any of them over a grid of rho values.
+ * LogDet() is const and may be called from several threads at once.
+ */
+class LogJacobian {
+public:
+	enum Method {
+		char_poly = 0, // dense eigenvalues / characteristic polynomial
+		sparse_lu,
+		chebyshev,
+		monte_carlo
+	};
+	
+	virtual ~LogJacobian() {}
+	virtual double LogDet(double rho) const = 0;
+	
+	/** New backend for method on w, wrapped in a LogJacobianGrid if
+	 use_grid is set.  Returns 0 for char_poly, which is handled by
+	 ML_im.cpp itself. */
+	static LogJacobian* Create(Method method, const CsrWeight& w,
+							   bool use_grid);
+};
+
+/**
+ * Exact log-determinant from a sparse LU factorization without pivoting.
+ * I - rho*W is strictly diagonally dominant by rows for |rho| < 1 because W
+ * is row-standardized, so elimination in any order is stable and all
+ * pivots are positive.
+ *
+ * The constructor does the symbolic work once: a minimum degree ordering of
+ * the pattern of W + W' and the pattern of the factors.  Every LogDet()
+ * call is then a numeric factorization on that fixed pattern.
+ */
+class SparseLULogJacobian : public LogJacobian {
+public:
+	SparseLULogJacobian(const CsrWeight& w);
+	virtual ~SparseLULogJacobian();
+	virtual double LogDet(double rho) const;
+	
+	/** Number of off-diagonal entries of U (equal to that of L). */
+	size_t GetFactorSize() const { return f_cols.size(); }
+	
+protected:
+	int num_obs;
+	// pattern of row k of U / column k of L, in eliminated order: columns
+	// f_cols[f_off[k]] .. f_cols[f_off[k+1]-1], all > k and sorted
+	std::vector<size_t> f_off;
+	std::vector<int> f_cols;
+	// the row-standardized entries of W and where they go in the factors:
+	// a_kind[t] names the factor ('u' for U, 'l' for L, 'd' for the
+	// diagonal) and a_slots[t] is the plain index of the entry within it
+	std::vector<double> a_vals;
+	std::vector<size_t> a_slots;
+	std::vector<char> a_kind;
+};
+
+/**
+ * Traces of powers of W estimated with Hutchinson's estimator: for random
+ * vectors u with independent +1/-1 entries, u'Au is an unbiased estimate of
+ * tr(A).  The first two traces are exact.  Shared by the Chebyshev and
+ * Monte Carlo backends, which only differ in the polynomial basis.
+ */
+class TraceLogJacobian : public LogJacobian {
+public:
+	virtual ~TraceLogJacobian() {}
+	
+	/** The estimated traces, traces[j] for j = 0..order. */
+	const std::vector<double>& GetTraces() const { return traces; }
+	
+protected:
+	/** Fill traces[0..order] with tr(P_j(W)) where P_0 = I, P_1 = W and
+	 P_{j+1} = a*W*P_j - b*P_{j-1}; (a, b) = (1, 0) gives powers of W and
+	 (2, 1) Chebyshev polynomials.  Probes run on all cores. */
+	void EstimateTraces(const CsrWeight& w, int order, double a, double b,
+						int num_probes, uint64_t seed);
+	void RunProbes(const CsrWeight& w, int order, double a, double b,
+				   uint64_t seed, int probe_start, int probe_end,
+				   std::vector<double>* sums);
+	
+	int num_obs;
+	std::vector<double> traces;
+};
+
+/**
+ * Pace and LeSage (2004): log(1 - rho*x) is interpolated by a Chebyshev
+ * polynomial of degree order on [-1, 1], which contains the (real parts
+ * of the) eigenvalues of W, so log|I - rho*W| = sum_j c_j(rho)*tr(T_j(W)).
+ * The traces are estimated once, each LogDet() call is O(order^2).
+ */
+class ChebyshevLogJacobian : public TraceLogJacobian {
+public:
+	ChebyshevLogJacobian(const CsrWeight& w, int order = 30,
+						 int num_probes = 50, uint64_t seed = 123456789);
+	virtual ~ChebyshevLogJacobian() {}
+	virtual double LogDet(double rho) const;
+	
+protected:
+	int order;
+};
+
+/**
+ * Barry and Pace (1999): log|I - rho*W| = -sum_k rho^k tr(W^k) / k,
+ * truncated after order terms, with tr(W^k) estimated once.  Accurate for
+ * moderate rho; the truncation error grows like rho^order near |rho| = 1.
+ */
+class MonteCarloLogJacobian : public TraceLogJacobian {
+public:
+	MonteCarloLogJacobian(const CsrWeight& w, int order = 60,
+						  int num_probes = 50, uint64_t seed = 123456789);
+	virtual ~MonteCarloLogJacobian() {}
+	virtual double LogDet(double rho) const;
+	
+protected:
+	int order;
+};
+
+/**
+ * Values of another backend tabulated at lower, lower+step, ..., upper and
+ * interpolated by cubic Hermite splines.  The table is filled on all cores
+ * in the constructor, after which every LogDet() is a lookup.  Outside
+ * [lower, upper] the backend is called directly.  Takes ownership of src.
+ */
+class LogJacobianGrid : public LogJacobian {
+public:
+	LogJacobianGrid(LogJacobian* src, double lower = -0.99,
+					double upper = 0.99, double step = 0.01);
+	virtual ~LogJacobianGrid();
+	virtual double LogDet(double rho) const;
+	
+protected:
+	void FillRange(int a, int b);
+	
+	LogJacobian* src;
+	double lower;
+	double step;
+	std::vector<double> vals;
+};
+
+#endif
@@ -28,12 +28,15 @@ The IDE project should also include SLStream.cpp
 #ifndef WX_PRECOMP
     #include <wx/wx.h>
 #endif
+#include "../ShapeOperations/CsrWeight.h"
 #include "../ShapeOperations/GwtWeight.h"
+#include "../GdaAsyncTask.h"
 #include "mix.h"
 #include "Lite2.h"
 #include "Weights.h"
 #include "PowerLag.h"
 #include "polym.h"
+#include "LogJacobian.h"
 #include "ML_im.h"
 
 // use __WXMAC__ to call vecLib
@@ -767,10 +770,14 @@ VALUE norm(WIterator it)  {
 resid -- vector of residuals in regression y on X;
 residW -- vector or residulas in regression of Wy on X;
 rho -- value of the coefficient of spatial association.
+lj -- log-Jacobian backend, if null the characteristic polynomial is used.
 Note: function uses static variables Poly and SL_Max_Precision.
 */
-VALUE   CL(WVector & resid, WVector & residW, const VALUE rho)  {
-    VALUE     lj = MakeEstimate(Poly(), rho, SL_Max_Precision);	// compute log-Jacobian
+VALUE   CL(WVector & resid, WVector & residW, const VALUE rho,
+		   const LogJacobian* ljb = 0)  {
+    // compute log-Jacobian
+    VALUE     lj = ljb ? ljb->LogDet(rho) :
+		MakeEstimate(Poly(), rho, SL_Max_Precision);
     WVector   tmp;
     tmp.reset();
     tmp.copy(residW());       // copy residiual of wy on X
@@ -828,9 +835,11 @@ inline void SHFT(double &a, double &b, double &c, const double d)  {
 	c = d;
 }
 
-VALUE ErrorLogLikelihood(Iterator<WVector> X, Iterator<WVector> lagX, WIterator y, WIterator lagY, Iterator<WMap> W, const VALUE lambda, WVector &egls)  {
+VALUE ErrorLogLikelihood(Iterator<WVector> X, Iterator<WVector> lagX, WIterator y, WIterator lagY, Iterator<WMap> W, const VALUE lambda, WVector &egls,
+						 const LogJacobian* lj = 0)  {
     // compute log-Jacobian: SIGMA(ln(1 - lambda * eigenval(i)) ...
-    VALUE accum = MakeEstimate(Poly(), lambda, SL_Max_Precision);
+    VALUE accum = lj ? lj->LogDet(lambda) :
+		MakeEstimate(Poly(), lambda, SL_Max_Precision);
 
     // compute sse (sum-squared error)
     WMatrix XminusLambdaLagX(X.count());
@@ -873,6 +882,13 @@ VALUE ErrorLogLikelihood(Iterator<WVector> X, Iterator<WVector> lagX, WIterator
     return (accum + addOn);
 }  
 
+/** True if token is given and was cancelled.  The golden section searches
+ check it once per step and return their current best point. */
+static bool ml_cancelled(const GdaCancelToken* token)
+{
+	return token && token->IsCancelled();
+}
+
 inline double findQuadMax(double x0, double f0, double x1, double f1, double x2, double f2)  {
     const double s1 = (x0 - x1) * (f2 - f1), s2 = (x2 - x1) * (f0 - f1);
     const double denominator = 2.0 * (s1 - s2);
@@ -895,7 +911,9 @@ VALUE GoldenSectionError(const VALUE left,
 												 const WVector &y,
                          Iterator<WMap> W, 
 												 double * &beta,
-												 double * LogLik)  
+												 double * LogLik,
+												 const LogJacobian* lj = 0,
+												 const GdaCancelToken* token = 0)  
 {
     const VALUE   GoldenRatio = (sqrt((double)5)-1)/2, GoldenToo = 1 - GoldenRatio;
     VALUE     x0, x1, x2, x3, f0, f1, f2, f3;
@@ -913,20 +931,21 @@ VALUE GoldenSectionError(const VALUE left,
     SpatialLag(W, y(), lagY);
 
     // maximizing
-    f2 = ErrorLogLikelihood(X(), lagX(), y(), lagY(), W, x2, egls);
-    f1 = ErrorLogLikelihood(X(), lagX(), y(), lagY(), W, x1, egls);
+    f2 = ErrorLogLikelihood(X(), lagX(), y(), lagY(), W, x2, egls, lj);
+    f1 = ErrorLogLikelihood(X(), lagX(), y(), lagY(), W, x1, egls, lj);
     
 
 //  this is 'classic' golden section
 //  and tol is defined as  1e-14
-  while (fabs(x3-x0) > tol*(fabs(x1)+fabs(x2)))  
+  while (fabs(x3-x0) > tol*(fabs(x1)+fabs(x2)) &&
+		   !ml_cancelled(token))  
 	{
   	if (f1 < f2)  {
   		SHFT(x0, x1, x2, GoldenRatio*x2+GoldenToo*x3);
-  		SHFT(f0, f1, f2, ErrorLogLikelihood(X(), lagX(), y(), lagY(), W, x2, egls));
+  		SHFT(f0, f1, f2, ErrorLogLikelihood(X(), lagX(), y(), lagY(), W, x2, egls, lj));
   	}  else  {
   		SHFT(x3, x2, x1, GoldenRatio*x1+GoldenToo*x0);
-  		SHFT(f3, f2, f1, ErrorLogLikelihood(X(), lagX(), y(), lagY(), W, x1, egls));
+  		SHFT(f3, f2, f1, ErrorLogLikelihood(X(), lagX(), y(), lagY(), W, x1, egls, lj));
   	}
   	++Counter;
   }
@@ -950,7 +969,9 @@ VALUE GoldenSectionLag(const VALUE left,
 											 const VALUE right, 
 											 WVector &resid, 
 											 WVector &residW,
-											 double* LogLik)  
+											 double* LogLik,
+											 const LogJacobian* lj = 0,
+											 const GdaCancelToken* token = 0)  
 {
     const VALUE   GoldenRatio = (sqrt((double)5)-1)/2, GoldenToo = 1 - GoldenRatio;
     VALUE     x0, x1, x2, x3, f0, f1, f2, f3;
@@ -962,16 +983,17 @@ VALUE GoldenSectionLag(const VALUE left,
     else
   	x1 -= GoldenToo * (middle - left);
     int   Counter = 2;
-    f2 = CL(resid, residW, x2);
-    f1 = CL(resid, residW, x1);
-  while (fabs(x3-x0) > tol*(fabs(x1)+fabs(x2)))  
+    f2 = CL(resid, residW, x2, lj);
+    f1 = CL(resid, residW, x1, lj);
+  while (fabs(x3-x0) > tol*(fabs(x1)+fabs(x2)) &&
+		   !ml_cancelled(token))  
 	{
   	if (f1 < f2)  {
   		SHFT(x0, x1, x2, GoldenRatio*x2+GoldenToo*x3);
-  		SHFT(f0, f1, f2, CL(resid, residW, x2));
+  		SHFT(f0, f1, f2, CL(resid, residW, x2, lj));
   	}  else  {
   		SHFT(x3, x2, x1, GoldenRatio*x1+GoldenToo*x0);
-  		SHFT(f3, f2, f1, CL(resid, residW, x1));
+  		SHFT(f3, f2, f1, CL(resid, residW, x1, lj));
   	};
   	++Counter;
   };
@@ -1592,7 +1614,8 @@ double LcPrime(const DenseVector &v, const double * residW, const SparseMatrix &
 
 void run1(SparseMatrix &w, const double rr, double &trace, double &trace2,
 		  double &frobenius,
-		  wxGauge* p_bar, double p_bar_min_fraction, double p_bar_max_fraction)
+		  wxGauge* p_bar, double p_bar_min_fraction, double p_bar_max_fraction,
+		  const GdaCancelToken* token)
 {
     const int LIMIT = 50;
     const double EPS = 1.0e-14;
@@ -1621,6 +1644,8 @@ void run1(SparseMatrix &w, const double rr, double &trace, double &trace2,
 		p_bar->Update();
 	}	
     for (int ix = 0; ix < dim; ++ix) {
+		// one conjugate gradient solve per row, so check every 64 rows
+		if (ix % 64 == 0 && ml_cancelled(token)) return;
 		if (p_bar) {
 			cur_g_val = (ix*g_val_range)/loop_max + g_val_init;
 			if (cur_g_val > prev_g_val) {
@@ -1742,7 +1767,8 @@ VALUE SmallGoldenSectionLag(const VALUE left,
 														WVector &resid, 
 														WVector &residW, 
 														const double *d,
-														double *LogLik)  
+														double *LogLik,
+														const GdaCancelToken* token = 0)  
 {
     const VALUE   GoldenRatio = (sqrt((double)5)-1)/2, GoldenToo = 1 - GoldenRatio;
     VALUE     x0, x1, x2, x3, f0, f1, f2, f3;
@@ -1756,7 +1782,8 @@ VALUE SmallGoldenSectionLag(const VALUE left,
     int   Counter = 2;
     f2 = ECL(resid, residW, x2, d);
     f1 = ECL(resid, residW, x1, d);
-    while (fabs(x3-x0) > tol*(fabs(x1)+fabs(x2)))  {
+    while (fabs(x3-x0) > tol*(fabs(x1)+fabs(x2)) &&
+		   !ml_cancelled(token))  {
         if (f1 < f2)  
 				{
             SHFT(x0, x1, x2, GoldenRatio*x2+GoldenToo*x3);
@@ -1786,7 +1813,8 @@ VALUE SmallGoldenSectionLag(const VALUE left,
 														WVector &residW, 
 														const double *wr,
 														const double *wi,
-														double *LogLik)  
+														double *LogLik,
+														const GdaCancelToken* token = 0)  
 {
     const VALUE   GoldenRatio = (sqrt((double)5)-1)/2, GoldenToo = 1 - GoldenRatio;
     VALUE     x0, x1, x2, x3, f0, f1, f2, f3;
@@ -1800,7 +1828,8 @@ VALUE SmallGoldenSectionLag(const VALUE left,
     int   Counter = 2;
     f2 = ECL(resid, residW, x2, wr, wi);
     f1 = ECL(resid, residW, x1, wr, wi);
-    while (fabs(x3-x0) > tol*(fabs(x1)+fabs(x2)))  {
+    while (fabs(x3-x0) > tol*(fabs(x1)+fabs(x2)) &&
+		   !ml_cancelled(token))  {
         if (f1 < f2)  
 				{
             SHFT(x0, x1, x2, GoldenRatio*x2+GoldenToo*x3);
@@ -1833,7 +1862,8 @@ double SmallSimulationLag(Weights &W,
 						  double* LogLik, bool asym,
 						  wxGauge* p_bar,
 						  double p_bar_min_fraction,
-						  double p_bar_max_fraction)  
+						  double p_bar_max_fraction,
+						  const GdaCancelToken* token, MLError* error)  
 {
     W.Transform(W_MAT);               // makes sure it is properly formated
     const int   dim = W.dim();
@@ -1896,8 +1926,8 @@ double SmallSimulationLag(Weights &W,
 			// good and nothing else to do in this step
 		} else {
 			cerr << "error in computing eigenvalues" << endl;
-		//	wxMessageBox("error in computing eigenvalues";
-			return -1;
+			if (error) *error = ml_eigen_error;
+			return 0;
 		}
 	}
 	else
@@ -1931,8 +1961,8 @@ double SmallSimulationLag(Weights &W,
 			// good and nothing else to do in this step
 		} else {
 			cerr << "error in computing eigenvalues" << endl;
-		//	wxMessageBox("error in computing eigenvalues";
-			return -1;
+			if (error) *error = ml_eigen_error;
+			return 0;
 		}
 	}
 
@@ -1955,13 +1985,36 @@ double SmallSimulationLag(Weights &W,
 	}
     VALUE rhoEstimate = 0.0;
     if (asym)
-    	rhoEstimate = SmallGoldenSectionLag(-1, 0, 1, re, reW, wr, wi, LogLik);
+    	rhoEstimate = SmallGoldenSectionLag(-1, 0, 1, re, reW, wr, wi, LogLik,
+											token);
     else
-    	rhoEstimate = SmallGoldenSectionLag(-1, 0, 1, re, reW, s, LogLik);
+    	rhoEstimate = SmallGoldenSectionLag(-1, 0, 1, re, reW, s, LogLik,
+											token);
+    if (ml_cancelled(token) && error) *error = ml_cancel_error;
 
     return rhoEstimate;
 }
 
+/*   CreateLogJacobian
+* log-Jacobian backend for the ML estimators.  Like Weights and SparseMatrix,
+the estimators use the unweighted contiguity of the GAL rows, so the
+backend is built on a binary copy of them.  Returns 0 for char_poly.
+*/
+LogJacobian* CreateLogJacobian(const GalElement *weight, int num_obs,
+							   LogJacobian::Method lj_method, bool lj_grid)
+{
+	if (lj_method == LogJacobian::char_poly) return 0;
+	GalElement* bin = new GalElement[num_obs];
+	for (int i = 0; i < num_obs; i++) {
+		bin[i].SetSizeNbrs(weight[i].Size());
+		for (int j = 0; j < weight[i].Size(); j++)
+			bin[i].SetNbr(j, weight[i][j]);
+	}
+	CsrWeight w(bin, num_obs);
+	delete [] bin;
+	return LogJacobian::Create(lj_method, w, lj_grid);
+}
+
 double SimulationLag(const GalElement *weight,
 					 int num_obs,
 					 int Precision, 
@@ -1973,15 +2026,19 @@ double SimulationLag(const GalElement *weight,
 					 double* LogLik,
 					 wxGauge* p_bar,
 					 double p_bar_min_fraction,
-					 double p_bar_max_fraction)
+					 double p_bar_max_fraction,
+					 LogJacobian::Method lj_method,
+					 bool lj_grid,
+					 const GdaCancelToken* token, MLError* error)
 {
   	Weights  W(weight, num_obs);          // read the weights matrix
+	if (error) *error = ml_no_error;
 	
-    if (W.dim() < SMALL_DIM)
+    if (W.dim() < SMALL_DIM && lj_method == LogJacobian::char_poly)
         return SmallSimulationLag(W, num_obs, rho, my_Y, my_X, deps,
 								  InclConstant, LogLik, false,
 								  p_bar, p_bar_max_fraction,
-								  p_bar_max_fraction);
+								  p_bar_max_fraction, token, error);
     
     W.Transform(W_GWT);               // makes sure it is formated
     const int   dim= W.Git().count();
@@ -1997,10 +2054,13 @@ double SimulationLag(const GalElement *weight,
     	x[cnt].absorb(my_X[cnt], dim);
     }
 
+    LogJacobian* lj = CreateLogJacobian(weight, num_obs, lj_method, lj_grid);
     GWT sym;
-    copy(sym, W.Git());
-	// make it symmetric; has eigenvalues of the rowstandardized matrix
-    MakeSym(sym()); 
+    if (!lj) {
+    	copy(sym, W.Git());
+    	// make it symmetric; has eigenvalues of the rowstandardized matrix
+    	MakeSym(sym());
+    }
 	// non-symmetric, row-standardized -- used to compute spatial lag
     RowStandardize(W.Git());
     p_lag.alloc();
@@ -2012,8 +2072,10 @@ double SimulationLag(const GalElement *weight,
     // "  computing polynomial 
     start= clock();
 
-    InitPoly(Precision, dim);
-    SparsePoly(sym());
+    if (!lj) {
+    	InitPoly(Precision, dim);
+    	SparsePoly(sym());
+    }
     // "  --- finished computing polynomial" 
 	double **cov = new double * [deps];
 	double *resid = new double [dim];
@@ -2036,8 +2098,10 @@ double SimulationLag(const GalElement *weight,
 	}
     VALUE rhoEstimate = 0.0;
 	// e0: resid, eL: residw see Oleg's paper
-    rhoEstimate = GoldenSectionLag(-1, 0, 1, re, reW, LogLik);
+    rhoEstimate = GoldenSectionLag(-1, 0, 1, re, reW, LogLik, lj, token);
     stop= clock();
+    if (lj) delete lj;
+    if (ml_cancelled(token) && error) *error = ml_cancel_error;
 
     return rhoEstimate;
 }
@@ -2161,7 +2225,8 @@ VALUE SmallGoldenSectionError(const VALUE left,
 															double * &beta, 
 															double *d,
 															bool InclConstant,
-															double *LogLik)  
+															double *LogLik,
+															const GdaCancelToken* token = 0)  
 {
     const VALUE   GoldenRatio = (sqrt((double)5)-1)/2, GoldenToo = 1 - GoldenRatio;
     VALUE     x0, x1, x2, x3, f0, f1, f2, f3;
@@ -2181,7 +2246,8 @@ VALUE SmallGoldenSectionError(const VALUE left,
     f1 = SmallErrorLogLikelihood(X(), lagX(), y(), lagY(), W, x1, egls, d,InclConstant);
 
     //  this is 'classic' golden section
-    while (fabs(x3-x0) > tol*(fabs(x1)+fabs(x2)))  {
+    while (fabs(x3-x0) > tol*(fabs(x1)+fabs(x2)) &&
+		   !ml_cancelled(token))  {
         if (f1 < f2)  {
             SHFT(x0, x1, x2, GoldenRatio*x2+GoldenToo*x3);
             SHFT(f0, f1, f2, SmallErrorLogLikelihood(X(), lagX(), y(), lagY(), W, x2, egls, d,InclConstant));
@@ -2215,7 +2281,8 @@ VALUE SmallGoldenSectionError(const VALUE left,
 															double *wr,
 															double *wi,
 															bool InclConstant,
-															double *LogLik)  
+															double *LogLik,
+															const GdaCancelToken* token = 0)  
 {
     const VALUE   GoldenRatio = (sqrt((double)5)-1)/2, GoldenToo = 1 - GoldenRatio;
     VALUE     x0, x1, x2, x3, f0, f1, f2, f3;
@@ -2236,7 +2303,8 @@ VALUE SmallGoldenSectionError(const VALUE left,
 
 
     //  this is 'classic' golden section
-    while (fabs(x3-x0) > tol*(fabs(x1)+fabs(x2)))  {
+    while (fabs(x3-x0) > tol*(fabs(x1)+fabs(x2)) &&
+		   !ml_cancelled(token))  {
         if (f1 < f2)  {
             SHFT(x0, x1, x2, GoldenRatio*x2+GoldenToo*x3);
             SHFT(f0, f1, f2, SmallErrorLogLikelihood(X(), lagX(), y(), lagY(), W, x2, egls, wr, wi, InclConstant));
@@ -2270,7 +2338,8 @@ double SmallSimulationError(Weights &W,
 							double *LogLik, bool asym,
 							wxGauge* p_bar,
 							double p_bar_min_fraction,
-							double p_bar_max_fraction)  
+							double p_bar_max_fraction,
+							const GdaCancelToken* token, MLError* error)  
 {
     W.Transform(W_MAT);               // makes sure it is formated
     const int   dim = W.dim();
@@ -2358,8 +2427,9 @@ double SmallSimulationError(Weights &W,
 			// good and nothing else to do in this step
 		} else {
 			cerr << "error in computing eigenvalues" << endl;
-			wxMessageBox("Error: There was an error computing eigenvalues.");
-			return -1;
+			// runs off the GUI thread, the caller reports the error
+			if (error) *error = ml_eigen_error;
+			return 0;
 		}
 	}
 	else
@@ -2393,17 +2463,18 @@ double SmallSimulationError(Weights &W,
 			// good and nothing else to do in this step
 		} else {
 			cerr << "error in computing eigenvalues" << endl;
-			wxMessageBox("Error: There was an error computing eigenvalues.");
-			return -1;
+			if (error) *error = ml_eigen_error;
+			return 0;
 		}
 	}
 
     if (asym) {
-    	lambdaEstimate = SmallGoldenSectionError(-1, 0, 1, X, y, W.Mit(), beta, wr, wi, InclConstant, LogLik);
+    	lambdaEstimate = SmallGoldenSectionError(-1, 0, 1, X, y, W.Mit(), beta, wr, wi, InclConstant, LogLik, token);
     } else {
-		lambdaEstimate = SmallGoldenSectionError(-1, 0, 1, X, y, W.Mit(), beta, s, InclConstant, LogLik);
+		lambdaEstimate = SmallGoldenSectionError(-1, 0, 1, X, y, W.Mit(), beta, s, InclConstant, LogLik, token);
 	}
     stop = clock();
+    if (ml_cancelled(token) && error) *error = ml_cancel_error;
 
     return lambdaEstimate;
 }
@@ -2420,15 +2491,19 @@ double SimulationError(const GalElement *my_gal,
 					   double* LogLik,
 					   wxGauge* p_bar,
 					   double p_bar_min_fraction,
-					   double p_bar_max_fraction)  
+					   double p_bar_max_fraction,
+					   LogJacobian::Method lj_method,
+					   bool lj_grid,
+					   const GdaCancelToken* token, MLError* error)  
 {
     Weights W(my_gal, num_obs);          
     const int   dim = W.dim();
-    if (dim < SMALL_DIM)
+    if (error) *error = ml_no_error;
+    if (dim < SMALL_DIM && lj_method == LogJacobian::char_poly)
         return  SmallSimulationError(W, rho, my_Y, my_X, deps, beta,
 									 InclConstant, LogLik, false,
 									 p_bar, p_bar_min_fraction,
-									 p_bar_max_fraction);
+									 p_bar_max_fraction, token, error);
     W.Transform(W_GWT);               // makes sure it is formated
     int			cnt;
     WVector      	y(dim);
@@ -2444,18 +2519,23 @@ double SimulationError(const GalElement *my_gal,
     };
     X.reset(deps);
 
-    // ready to make symmetric
-    GWT sym;
-    copy(sym, W.Git());
-    MakeSym(sym());   // make it symmetric, while preserving eigenvalues -- used for computing log-Jacobian
+    LogJacobian* lj = CreateLogJacobian(my_gal, num_obs, lj_method, lj_grid);
+    if (!lj) {
+    	// ready to make symmetric
+    	GWT sym;
+    	copy(sym, W.Git());
+    	MakeSym(sym());   // make it symmetric, while preserving eigenvalues -- used for computing log-Jacobian
+    	InitPoly(Precision, dim);
+    	SparsePoly(sym());
+    	Destroy(sym());		// don't need that spatial weights anymore
+    }
 
     RowStandardize(W.Git());	// non-symmetric, row-standardized -- used to compute spatial lag
     VALUE lambdaEstimate = 0.0;
-    InitPoly(Precision, dim);
-    SparsePoly(sym());
-    Destroy(sym());		// don't need that spatial weights anymore
-
-    lambdaEstimate = GoldenSectionError(-1, 0, 1, X, y, W.Git(), beta, LogLik);
+    lambdaEstimate = GoldenSectionError(-1, 0, 1, X, y, W.Git(), beta, LogLik,
+										lj, token);
+    if (lj) delete lj;
+    if (ml_cancelled(token) && error) *error = ml_cancel_error;
     return lambdaEstimate;
 }
 
@@ -23,10 +23,18 @@
 #include <wx/gauge.h>
 #include "DenseVector.h"
 #include "SparseMatrix.h"
+#include "LogJacobian.h"
+
+class GdaCancelToken;
 
 const int SMALL_DIM = 500;
 const int ASYM_DIM = 1000;
 
+/** Why SimulationLag or SimulationError returned without an estimate. */
+enum MLError { ml_no_error, ml_eigen_error, ml_cancel_error };
+
+/** ML estimate of rho.  The golden section search checks token, if given,
+ once per step.  On failure, error is set and 0 is returned. */
 double SimulationLag(const GalElement* weight,
 					 int num_obs,
 					 int	Precision, 
@@ -38,8 +46,14 @@ double SimulationLag(const GalElement* weight,
 					 double* Lik,
 					 wxGauge* p_bar,
 					 double p_bar_min_fraction,
-					 double p_bar_max_fraction);  
+					 double p_bar_max_fraction,
+					 LogJacobian::Method lj_method = LogJacobian::char_poly,
+					 bool lj_grid = false,
+					 const GdaCancelToken* token = 0,
+					 MLError* error = 0);  
 
+/** ML estimate of lambda, see SimulationLag.  beta is allocated unless
+ error is set to ml_eigen_error. */
 double SimulationError(const GalElement* weight,
 					   int num_obs,
 					   int Precision, 
@@ -52,7 +66,11 @@ double SimulationError(const GalElement* weight,
 					   double* Lik,
 					   wxGauge* p_bar,
 					   double p_bar_min_fraction,
-					   double p_bar_max_fraction);
+					   double p_bar_max_fraction,
+					   LogJacobian::Method lj_method = LogJacobian::char_poly,
+					   bool lj_grid = false,
+					   const GdaCancelToken* token = 0,
+					   MLError* error = 0);
 
 bool OLS(DenseVector &y, DenseVector * X, const bool IncludeConst,
 		 double ** &cov, double *resid, DenseVector &ols);
@@ -26,6 +26,7 @@
 #endif
 
 #include <wx/gauge.h>
+#include "../ShapeOperations/CsrWeight.h"
 #include "../ShapeOperations/GalWeight.h"
 
 #include "mix.h"
@@ -33,6 +34,7 @@
 #include "ML_im.h"
 #include "smile.h"
 #include "../Regression/DiagnosticReport.h"
+#include "../GdaAsyncTask.h"
 
 #define geoda_sqr(x) ( (x) * (x) )
 
@@ -128,64 +130,13 @@ void MakeFastLookupMat(GalElement *g, int dim,
 	}
 }
 
+// tr(W'W + WW) of the row-standardized weights, in O(nnz)
 double T(GalElement *g, int dim)
 {
-    // tr(W'W+WW)
-    // = tr(W'W) + tr(WW)
-    // = w'_ij*w_ji + w_ij*w_ji
-    
-	using namespace std;
-    double	sum = 0;
-   
-    /*
-    int i=0, j=0;
-    for (i = 0; i < dim; ++i) {
-        for (j = 0; j < dim; ++j) {
-            //w_ij * w_ji
-            
-                //sum += g[i][j] * g[j][i];
-                sum += g[i].GetRW(j) * g[j].GetRW(i);
-        }
-    }
-    for (i = 0; i < dim; ++i) {
-        for (j = 0; j < dim; ++j) {
-            //w'_ij * w_ji
-                //sum += g[j][i] * g[j][i];
-                sum += g[j].GetRW(i) * g[j].GetRW(i);
-        }
-    }
-     */
-    
-    for (int i = 0; i < dim; ++i) {
-        for (int j = 0; j < dim; ++j) {
-            double w_ij = g[i].GetRW(j);
-            double w_ji = g[j].GetRW(i);
-            sum += w_ij * w_ji;
-            sum += w_ji * w_ji;
-            
-        }
-    }
-    /*
-     // below is also incorrect when handling knn weights matrix
-    int cnt = 0, cp = 0;
-    for (cnt = 0; cnt < dim; ++cnt) {
-        for (cp = 0; cp < g[cnt].Size(); ++cp) {
-            sum += geoda_sqr(1.0/g[cnt].Size());
-        }
-    }
-		
-	for (cnt = 0; cnt < dim; ++cnt) {
-        for (cp = 0; cp < g[cnt].Size(); ++cp) {
-			if (g_lookup[g[cnt][cp]].find(cnt)  != g_lookup[g[cnt][cp]].end()) {
-                // check if transpose element exists (ie, non-zero)
-				sum += (1.0/g[cnt].Size()/g[ g[cnt][cp] ].Size());
-			}
-		}
-	}
-	*/
-    
-    return sum;
-    //return 21.738295484789607;
+	double tr_WW = 0, tr_WtW = 0;
+	CsrWeight w(g, dim);
+	w.GetTraces(tr_WW, tr_WtW);
+	return tr_WtW + tr_WW;
 }
 
 // This original version of T computes the trace of W'W + WW where W
@@ -648,7 +599,8 @@ extern void run1(SparseMatrix &w,
 				 double &frobenius,
 				 wxGauge* p_bar,
 				 double p_bar_min_fraction,
-				 double p_bar_max_fraction);
+				 double p_bar_max_fraction,
+				 const GdaCancelToken* token);
 
 bool SymMatInverse(double ** mt, const int dim);
 
@@ -678,7 +630,8 @@ bool classicalRegression(GalElement *g,
 						 bool InclConstant,
 						 bool m_moranz,
 						 wxGauge* gauge,
-						 bool do_white_test)
+						 bool do_white_test,
+						 double w_trace)
 {
 	int g_rng = 100;
 	if (gauge) {
@@ -744,7 +697,9 @@ bool classicalRegression(GalElement *g,
 	{
 		double *rst = new double[2];
         
-        double t = T(g, dim); // tr[(W'+W)*W]
+        // tr[(W'+W)*W], cached by the weights manager when g is the full
+        // weights matrix
+        double t = w_trace >= 0 ? w_trace : T(g, dim);
 
 		Compute_RSLmError(g, resid, dim, rst, t);
 		dr->SetLmError(0, 1.0);
@@ -902,7 +857,11 @@ bool spatialLagRegression(GalElement *g,
 						  int deps, 
 						  DiagnosticReport *dr, 
 						  bool InclConstant,
-						  wxGauge* p_bar)  
+						  wxGauge* p_bar,
+						  LogJacobian::Method lj_method,
+						  bool lj_grid,
+						  const GdaCancelToken* token,
+						  MLError* error)  
 {
 	typedef double* double_ptr_type;
 	const int n = dim;
@@ -913,9 +872,16 @@ bool spatialLagRegression(GalElement *g,
 	
 	double LogLike = 0, initRho = 0;
 	
+	MLError ml_error = ml_no_error;
 	initRho = SimulationLag(g, num_obs, 41, 0.31, Y, X, deps,
 							!InclConstant, &LogLike,
-							p_bar, 0, 0.1);
+							p_bar, 0, 0.1, lj_method, lj_grid,
+							token, &ml_error);
+	if (error) *error = ml_error;
+	if (ml_error != ml_no_error) {
+		delete [] x;
+		return false;
+	}
 	SparseMatrix	orig(g, dim);
 
 	double **cov = new double * [deps];
@@ -943,13 +909,21 @@ bool spatialLagRegression(GalElement *g,
 	
 	double trace, trace2, fr;
 	
-	run1( orig, initRho, trace, trace2, fr, p_bar, 0.1, 0.55 );
+	run1( orig, initRho, trace, trace2, fr, p_bar, 0.1, 0.55, token );
+	if (token && token->IsCancelled()) {
+		if (error) *error = ml_cancel_error;
+		return false;
+	}
 	// correction for rho:  m
 	// final rho: finRho
 	double m = mic(r, rw, initRho, trace, trace2);
 	double finRho = initRho - m;
 	
-	run1( orig, finRho, trace, trace2, fr, p_bar, 0.55, 1 );	
+	run1( orig, finRho, trace, trace2, fr, p_bar, 0.55, 1, token );	
+	if (token && token->IsCancelled()) {
+		if (error) *error = ml_cancel_error;
+		return false;
+	}
 	
 	// approximate computational error: m 
 	m = mic(r, rw, finRho, trace, trace2);
@@ -1159,7 +1133,11 @@ bool spatialErrorRegression(GalElement *g,
 							int deps, 
 							DiagnosticReport *rr, 
 							bool InclConstant,
-							wxGauge* p_bar)  
+							wxGauge* p_bar,
+							LogJacobian::Method lj_method,
+							bool lj_grid,
+							const GdaCancelToken* token,
+							MLError* error)  
 {
 	typedef double* double_ptr_type;
 	DenseVector		y(Y, dim, false), *X = new DenseVector[deps];
@@ -1167,13 +1145,20 @@ bool spatialErrorRegression(GalElement *g,
 	for (cnt = 0; cnt < deps; ++cnt)
 		X[cnt].absorb(XX[cnt], dim, false);
 	
-	double * beta;
+	double * beta = 0;
 	const int n = dim;
 	
 	double LogLike = 0, initLambda = 0;
+	MLError ml_error = ml_no_error;
 	initLambda = SimulationError(g, num_obs, 100, 0.31, Y, XX, deps, beta,
-								 !InclConstant, &LogLike, p_bar, 0.0, 0.1 );
+								 !InclConstant, &LogLike, p_bar, 0.0, 0.1,
+								 lj_method, lj_grid, token, &ml_error);
 	release(&beta);
+	if (error) *error = ml_error;
+	if (ml_error != ml_no_error) {
+		delete [] X;
+		return false;
+	}
 	
 	double **cov = new double * [deps], *e_ols = new double [n];
 	for (row = 0; row < deps; row++) {
@@ -1205,7 +1190,11 @@ bool spatialErrorRegression(GalElement *g,
 	double sigma2 = rsd.norm() / dim;
 	
 	orig.makeStdSymmetric();
-	run1( orig, initLambda, trace, trace2, fr, p_bar, 0.1, 0.55 );
+	run1( orig, initLambda, trace, trace2, fr, p_bar, 0.1, 0.55, token );
+	if (token && token->IsCancelled()) {
+		if (error) *error = ml_cancel_error;
+		return false;
+	}
 	orig.makeRowStd();
 	
 	// correction for lambda: m 
@@ -1215,7 +1204,11 @@ bool spatialErrorRegression(GalElement *g,
 	
 	orig.makeStdSymmetric();
 	
-	run1( orig, lambda, trace, trace2, fr, p_bar, 0.55, 1 );
+	run1( orig, lambda, trace, trace2, fr, p_bar, 0.55, 1, token );
+	if (token && token->IsCancelled()) {
+		if (error) *error = ml_cancel_error;
+		return false;
+	}
 	orig.makeRowStd();
 	
 	EGLS(lambda, y, X, orig, egls);
@@ -0,0 +1,192 @@
+/**
+ * GeoDa TM, Copyright (C) 2011-2015 by Luc Anselin - all rights reserved
+ *
+ * This file is part of GeoDa.
+ * 
+ * GeoDa is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+ *
+ * GeoDa is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program.  If not, see <http://www.gnu.org/licenses/>.
+ */
+
+
+#include "GalWeight.h"
+#include "GwtWeight.h"
+#include "GdaMappedFile.h"
+#include "CsrWeight.h"
+
+CsrWeight::CsrWeight(const GalElement* gal, int num_obs_s)
+: num_obs(num_obs_s), file(0), own_offsets(num_obs_s+1, 0)
+{
+	std::vector<int>& off = own_offsets;
+	for (int i=0; i<num_obs; i++) off[i+1] = off[i] + gal[i].Size();
+	own_nbrs.resize(off[num_obs]);
+	own_weights.resize(off[num_obs]);
+	for (int i=0; i<num_obs; i++) {
+		const std::vector<long>& nb = gal[i].GetNbrs();
+		const std::vector<double>& w = gal[i].GetNbrWeights();
+		int o = off[i];
+		for (size_t j=0; j<nb.size(); j++) {
+			own_nbrs[o+j] = (int) nb[j];
+			own_weights[o+j] = j < w.size() ? w[j] : 1.0;
+		}
+	}
+	Finish();
+}
+
+CsrWeight::CsrWeight(const GwtElement* gwt, int num_obs_s)
+: num_obs(num_obs_s), file(0), own_offsets(num_obs_s+1, 0)
+{
+	std::vector<int>& off = own_offsets;
+	for (int i=0; i<num_obs; i++) off[i+1] = off[i] + gwt[i].Size();
+	own_nbrs.resize(off[num_obs]);
+	own_weights.resize(off[num_obs]);
+	for (int i=0; i<num_obs; i++) {
+		int o = off[i];
+		for (long j=0, sz=gwt[i].Size(); j<sz; j++) {
+			own_nbrs[o+j] = (int) gwt[i].data[j].nbx;
+			own_weights[o+j] = gwt[i].data[j].weight;
+		}
+	}
+	Finish();
+}
+
+CsrWeight::CsrWeight(const CsrWeight& w, const std::vector<bool>& undefs)
+: num_obs(w.num_obs), file(0), own_offsets(w.num_obs+1, 0)
+{
+	own_nbrs.reserve(w.GetNumNonZeros()+1);
+	own_weights.reserve(w.GetNumNonZeros()+1);
+	for (int i=0; i<num_obs; i++) {
+		for (int j=w.offsets[i]; j<w.offsets[i+1]; j++) {
+			if (undefs[w.nbrs[j]]) continue;
+			own_nbrs.push_back(w.nbrs[j]);
+			own_weights.push_back(w.weights[j]);
+		}
+		own_offsets[i+1] = (int) own_nbrs.size();
+	}
+	Finish();
+}
+
+CsrWeight::CsrWeight(const CsrWeight& w, const std::vector<int>& new_ids)
+: num_obs(w.num_obs), file(0), own_offsets(w.num_obs+1, 0)
+{
+	std::vector<int>& off = own_offsets;
+	for (int i=0; i<num_obs; i++) off[new_ids[i]+1] = w.Size(i);
+	for (int i=0; i<num_obs; i++) off[i+1] += off[i];
+	own_nbrs.resize(off[num_obs]);
+	own_weights.resize(off[num_obs]);
+	for (int i=0; i<num_obs; i++) {
+		int o = off[new_ids[i]];
+		for (int j=w.offsets[i], e=w.offsets[i+1]; j<e; j++, o++) {
+			own_nbrs[o] = new_ids[w.nbrs[j]];
+			own_weights[o] = w.weights[j];
+		}
+	}
+	Finish();
+}
+
+CsrWeight::CsrWeight(int num_obs_s, const int* offsets_s, const int* nbrs_s,
+					 const double* weights_s, const double* row_sums_s,
+					 GdaMappedFile* file_s)
+: num_obs(num_obs_s), offsets(offsets_s), nbrs(nbrs_s), weights(weights_s),
+row_sums(row_sums_s), file(file_s)
+{
+}
+
+CsrWeight::~CsrWeight()
+{
+	if (file) delete file;
+}
+
+void CsrWeight::Finish()
+{
+	own_row_sums.resize(num_obs);
+	for (int i=0; i<num_obs; i++) {
+		double s = 0;
+		for (int j=own_offsets[i]; j<own_offsets[i+1]; j++) {
+			s += own_weights[j];
+		}
+		own_row_sums[i] = s;
+	}
+	own_nbrs.push_back(0);
+	own_weights.push_back(0);
+	offsets = &own_offsets[0];
+	nbrs = &own_nbrs[0];
+	weights = &own_weights[0];
+	row_sums = own_row_sums.empty() ? 0 : &own_row_sums[0];
+}
+
+bool CsrWeight::HasIsolates() const
+{
+	for (int i=0; i<num_obs; i++) {
+		if (offsets[i+1] == offsets[i]) return true;
+	}
+	return false;
+}
+
+void CsrWeight::SpatialLags(const double* x, double* lags) const
+{
+	for (int i=0; i<num_obs; i++) lags[i] = SpatialLag(i, x);
+}
+
+void CsrWeight::GetTraces(double& tr_WW, double& tr_WtW) const
+{
+	tr_WW = 0;
+	tr_WtW = 0;
+	int nnz = offsets[num_obs];
+	if (nnz == 0) return;
+	
+	// row-standardized entries in CSR order.  Rows with a zero sum stay
+	// zero, as in SpatialLag.
+	std::vector<double> rw(nnz);
+	for (int i=0; i<num_obs; i++) {
+		double s = row_sums[i];
+		for (int j=offsets[i]; j<offsets[i+1]; j++) {
+			rw[j] = s == 0 ? 0 : weights[j] / s;
+			tr_WtW += rw[j] * rw[j];
+		}
+	}
+	
+	// transpose by counting sort: column c of W becomes row c of W'
+	std::vector<int> t_off(num_obs+1, 0);
+	for (int j=0; j<nnz; j++) t_off[nbrs[j]+1]++;
+	for (int i=0; i<num_obs; i++) t_off[i+1] += t_off[i];
+	std::vector<int> t_row(nnz);
+	std::vector<double> t_w(nnz);
+	std::vector<int> pos(t_off.begin(), t_off.end()-1);
+	for (int i=0; i<num_obs; i++) {
+		for (int j=offsets[i]; j<offsets[i+1]; j++) {
+			int p = pos[nbrs[j]]++;
+			t_row[p] = i;
+			t_w[p] = rw[j];
+		}
+	}
+	
+	// tr(WW) = sum_i sum_j w_ij*w_ji.  Scatter column i of W (the w_ji)
+	// into a dense work vector and run over row i; duplicate neighbors
+	// add up like entries of a sparse matrix.
+	std::vector<double> col(num_obs, 0);
+	for (int i=0; i<num_obs; i++) {
+		for (int p=t_off[i]; p<t_off[i+1]; p++) col[t_row[p]] += t_w[p];
+		for (int j=offsets[i]; j<offsets[i+1]; j++) {
+			tr_WW += rw[j] * col[nbrs[j]];
+		}
+		for (int p=t_off[i]; p<t_off[i+1]; p++) col[t_row[p]] = 0;
+	}
+}
+
+size_t CsrWeight::GetMemoryUsage() const
+{
+	return own_offsets.capacity() * sizeof(int) +
+		own_nbrs.capacity() * sizeof(int) +
+		own_weights.capacity() * sizeof(double) +
+		own_row_sums.capacity() * sizeof(double);
+}
@@ -0,0 +1,136 @@
+/**
+ * GeoDa TM, Copyright (C) 2011-2015 by Luc Anselin - all rights reserved
+ *
+ * This file is part of GeoDa.
+ *
+ * GeoDa is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+ *
+ * GeoDa is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program.  If not, see <http://www.gnu.org/licenses/>.
+ */
+
+#ifndef __GEODA_CENTER_CSR_WEIGHT_H__
+#define __GEODA_CENTER_CSR_WEIGHT_H__
+
+#include <vector>
+
+class GalElement;
+class GwtElement;
+class GdaMappedFile;
+
+/**
+ * Compressed sparse row copy of a spatial weights matrix.  The neighbors of
+ * observation i are nbrs[offsets[i]] .. nbrs[offsets[i+1]-1] with weights
+ * in the same positions of weights, so a whole matrix lives in three
+ * contiguous arrays instead of one heap allocation (or more) per row.
+ *
+ * Neighbor order and weights are taken over unchanged from the GAL or GWT
+ * rows, so lags agree with GalElement::SpatialLag and
+ * GwtElement::SpatialLag.  A CsrWeight is read-only once built and may be
+ * shared between threads.  Use GeoDaWeight::GetCsr() to get the cached
+ * copy of a weights object.
+ *
+ * The arrays are either owned by the CsrWeight or point into a mapped
+ * binary weights file (see GwbWeight.h), in which case nothing is copied.
+ */
+class CsrWeight {
+public:
+	CsrWeight(const GalElement* gal, int num_obs);
+	CsrWeight(const GwtElement* gwt, int num_obs);
+	/** Copy of w without the neighbors flagged in undefs, like
+	 GalWeight::Update does on a copy of a GalWeight. */
+	CsrWeight(const CsrWeight& w, const std::vector<bool>& undefs);
+	/** Copy of w with observation i renamed to new_ids[i].  new_ids must
+	 be a permutation of 0..num_obs-1. */
+	CsrWeight(const CsrWeight& w, const std::vector<int>& new_ids);
+	/** Uses the given arrays in place, without copying.  They must stay
+	 valid until the CsrWeight is deleted, which also deletes file.
+	 nbrs and weights must be dereferenceable even if there are no
+	 neighbors. */
+	CsrWeight(int num_obs, const int* offsets, const int* nbrs,
+			  const double* weights, const double* row_sums,
+			  GdaMappedFile* file);
+	virtual ~CsrWeight();
+	
+	int GetNumObs() const { return num_obs; }
+	int GetNumNonZeros() const { return offsets[num_obs]; }
+	/** True if the arrays live in a mapped file. */
+	bool IsMapped() const { return file != 0; }
+	
+	int Size(int i) const { return offsets[i+1] - offsets[i]; }
+	const int* GetNbrs(int i) const { return nbrs + offsets[i]; }
+	const double* GetNbrWeights(int i) const { return weights + offsets[i]; }
+	/** Sum of the weights in row i. */
+	double GetRowSum(int i) const { return row_sums[i]; }
+	
+	/** The raw arrays, as described above. */
+	const int* GetOffsets() const { return offsets; }
+	const int* GetAllNbrs() const { return nbrs; }
+	const double* GetAllWeights() const { return weights; }
+	const double* GetRowSums() const { return row_sums; }
+	bool HasIsolates() const;
+	
+	/** Row-standardized spatial lag of x at observation i.  Divides each
+	 term by the row sum, in the same order as GalElement::SpatialLag(x),
+	 so both give the same value. */
+	double SpatialLag(int i, const double* x) const {
+		double sum_w = row_sums[i];
+		if (sum_w == 0) return 0;
+		double lag = 0;
+		for (int j=offsets[i], e=offsets[i+1]; j<e; j++) {
+			lag += x[nbrs[j]] * weights[j] / sum_w;
+		}
+		return lag;
+	}
+	/** Row-standardized spatial lags of x for all observations. */
+	void SpatialLags(const double* x, double* lags) const;
+	/** Unweighted sum of x over the neighbors of i. */
+	double NbrSum(int i, const double* x) const {
+		double s = 0;
+		for (int j=offsets[i], e=offsets[i+1]; j<e; j++) s += x[nbrs[j]];
+		return s;
+	}
+	
+	/** Traces used by the Lagrange Multiplier tests, for the
+	 row-standardized matrix W: tr_WW = tr(WW) = sum w_ij*w_ji and tr_WtW =
+	 tr(W'W) = sum w_ij^2.  Runs in O(nnz) time through a transposed copy
+	 of W, instead of looking up w_ji for every pair of observations. */
+	void GetTraces(double& tr_WW, double& tr_WtW) const;
+	
+	/** Heap bytes held by the arrays, zero for a mapped file. */
+	size_t GetMemoryUsage() const;
+	
+protected:
+	void Finish();
+	
+	int num_obs;
+	// offsets has num_obs+1 entries, nbrs holds 32-bit column indices.
+	// They point at the vectors below or into file.
+	const int* offsets;
+	const int* nbrs;
+	const double* weights;
+	const double* row_sums;
+	GdaMappedFile* file;
+	
+	// owned storage.  nbrs and weights carry one unused entry at the end
+	// so that &nbrs[0] is valid for matrices without neighbors.
+	std::vector<int> own_offsets;
+	std::vector<int> own_nbrs;
+	std::vector<double> own_weights;
+	std::vector<double> own_row_sums;
+	
+private:
+	// the pointers above would be shared by a memberwise copy
+	CsrWeight(const CsrWeight&);
+	CsrWeight& operator=(const CsrWeight&);
+};
+
+#endif
@@ -0,0 +1,701 @@
+/**
+ * GeoDa TM, Copyright (C) 2011-2015 by Luc Anselin - all rights reserved
+ *
+ * This file is part of GeoDa.
+ * 
+ * GeoDa is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+ *
+ * GeoDa is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program.  If not, see <http://www.gnu.org/licenses/>.
+ */
+
+
+#include <algorithm>
+#include <fstream>
+#include <limits>
+#include <stdlib.h>
+#include <string.h>
+#include <boost/bind.hpp>
+#include <cpl_conv.h>
+#include <wx/tokenzr.h>
+#include "../DataViewer/OGRColumn.h"
+#include "../DataViewer/OGRTable.h"
+#include "../GdaThreadPool.h"
+#include "../logger.h"
+#include "CsvFileUtils.h"
+#include "CsvImporter.h"
+
+namespace {
+	const double exact_pow10[] = {
+		1e0, 1e1, 1e2, 1e3, 1e4, 1e5, 1e6, 1e7, 1e8, 1e9, 1e10, 1e11,
+		1e12, 1e13, 1e14, 1e15, 1e16, 1e17, 1e18, 1e19, 1e20, 1e21, 1e22
+	};
+	
+	inline bool is_digit(char c) { return c >= '0' && c <= '9'; }
+	inline bool is_blank(char c) { return c == ' ' || c == '\t'; }
+	
+	void trim_blanks(const char*& s, const char*& e)
+	{
+		while (s < e && is_blank(*s)) ++s;
+		while (e > s && is_blank(*(e-1))) --e;
+	}
+	
+	// lines of [p, end) that start before limit, with LF or CR LF removed
+	bool next_line(const char*& p, const char* end, const char* limit,
+				   const char*& line, const char*& line_end)
+	{
+		if (p >= limit || p >= end) return false;
+		line = p;
+		const char* nl = (const char*) memchr(p, '\n', end - p);
+		line_end = nl ? nl : end;
+		p = nl ? nl + 1 : end;
+		if (line_end > line && *(line_end-1) == '\r') --line_end;
+		return true;
+	}
+}
+
+CsvImporter::CsvImporter(const wxString& csv_path_s, bool first_row_names)
+: csv_path(csv_path_s), first_row_field_names(first_row_names),
+decimal_point('.'), thousands_sep(0), file_size(0), data_start(0),
+num_rows(0), multi_line_record(false)
+{
+	const char* sep = CPLGetConfigOption("GDAL_LOCALE_SEPARATOR", "");
+	if (sep != NULL && sep[0] != '\0' && sep[0] != decimal_point) {
+		thousands_sep = sep[0];
+	}
+}
+
+CsvImporter::~CsvImporter()
+{
+}
+
+void CsvImporter::SetNumberFormat(char decimal_point_s, char thousands_sep_s)
+{
+	decimal_point = decimal_point_s;
+	thousands_sep = (thousands_sep_s == decimal_point_s) ? 0 : thousands_sep_s;
+}
+
+bool CsvImporter::ParseDouble(const char* s, const char* e,
+							  char decimal_point, char thousands_sep,
+							  double& val)
+{
+	trim_blanks(s, e);
+	const char* p = s;
+	bool neg = false;
+	if (p < e && (*p == '-' || *p == '+')) {
+		neg = (*p == '-');
+		++p;
+	}
+	// up to 19 significant digits are kept in mant, the value is
+	// mant * 10^exp10
+	unsigned long long mant = 0;
+	int num_digits = 0;
+	int exp10 = 0;
+	bool any_digit = false;
+	bool has_sep = false;
+	while (p < e) {
+		char c = *p;
+		if (is_digit(c)) {
+			any_digit = true;
+			if (mant == 0 && c == '0') {
+				// leading zero
+			} else if (num_digits < 19) {
+				mant = mant*10 + (c - '0');
+				++num_digits;
+			} else {
+				++exp10;
+			}
+			++p;
+		} else if (thousands_sep != 0 && c == thousands_sep && p > s &&
+				   is_digit(*(p-1)) && p+1 < e && is_digit(*(p+1))) {
+			has_sep = true;
+			++p;
+		} else {
+			break;
+		}
+	}
+	if (p < e && *p == decimal_point) {
+		++p;
+		while (p < e && is_digit(*p)) {
+			any_digit = true;
+			if (mant == 0 && *p == '0') {
+				--exp10;
+			} else if (num_digits < 19) {
+				mant = mant*10 + (*p - '0');
+				++num_digits;
+				--exp10;
+			}
+			++p;
+		}
+	}
+	if (!any_digit) return false;
+	if (p < e && (*p == 'e' || *p == 'E')) {
+		++p;
+		bool exp_neg = false;
+		if (p < e && (*p == '-' || *p == '+')) {
+			exp_neg = (*p == '-');
+			++p;
+		}
+		if (p >= e || !is_digit(*p)) return false;
+		int ex = 0;
+		while (p < e && is_digit(*p)) {
+			if (ex < 100000) ex = ex*10 + (*p - '0');
+			++p;
+		}
+		exp10 += exp_neg ? -ex : ex;
+	}
+	if (p != e) return false;
+	
+	if (num_digits <= 15 && exp10 >= -22 && exp10 <= 22) {
+		// both mant and the power of ten are exact doubles, so a single
+		// multiplication or division rounds correctly
+		double v = (double) mant;
+		if (exp10 < 0) v /= exact_pow10[-exp10];
+		else v *= exact_pow10[exp10];
+		val = neg ? -v : v;
+		return true;
+	}
+	// long or huge numbers: let strtod do it on the "C" form of the text
+	std::string c_str;
+	c_str.reserve(e - s);
+	for (const char* q = s; q < e; ++q) {
+		if (has_sep && *q == thousands_sep) continue;
+		c_str += (*q == decimal_point) ? '.' : *q;
+	}
+	char* c_end = NULL;
+	val = strtod(c_str.c_str(), &c_end);
+	return c_end == c_str.c_str() + c_str.size();
+}
+
+bool CsvImporter::ParseInt64(const char* s, const char* e, char thousands_sep,
+							 wxInt64& val)
+{
+	trim_blanks(s, e);
+	const char* p = s;
+	bool neg = false;
+	if (p < e && (*p == '-' || *p == '+')) {
+		neg = (*p == '-');
+		++p;
+	}
+	if (p >= e) return false;
+	const unsigned long long limit = neg ?
+		(unsigned long long) std::numeric_limits<wxInt64>::max() + 1 :
+		(unsigned long long) std::numeric_limits<wxInt64>::max();
+	unsigned long long v = 0;
+	for (; p < e; ++p) {
+		char c = *p;
+		if (is_digit(c)) {
+			unsigned d = c - '0';
+			if (v > (limit - d) / 10) return false;
+			v = v*10 + d;
+		} else if (thousands_sep != 0 && c == thousands_sep && p > s &&
+				   is_digit(*(p-1)) && p+1 < e && is_digit(*(p+1))) {
+			continue;
+		} else {
+			return false;
+		}
+	}
+	if (!is_digit(*(e-1))) return false;
+	val = neg ? (wxInt64) (0 - v) : (wxInt64) v;
+	return true;
+}
+
+/** Splits a record into fields.  Quoted fields are given without the
+ quotes, and doubled quotes inside are left for FieldToString(). */
+bool CsvImporter::SplitFields(const char* s, const char* e,
+							  std::vector<const char*>& begins,
+							  std::vector<const char*>& ends,
+							  std::vector<bool>& quoted)
+{
+	begins.clear();
+	ends.clear();
+	quoted.clear();
+	const char* p = s;
+	for (;;) {
+		const char* q = p;
+		while (q < e && is_blank(*q)) ++q;
+		if (q < e && *q == '"') {
+			const char* b = ++q;
+			for (;;) {
+				q = (const char*) memchr(q, '"', e - q);
+				if (q == NULL) return false; // no closing quote
+				if (q+1 < e && *(q+1) == '"') {
+					q += 2;
+				} else {
+					break;
+				}
+			}
+			begins.push_back(b);
+			ends.push_back(q);
+			quoted.push_back(true);
+			++q;
+			while (q < e && is_blank(*q)) ++q;
+			if (q < e && *q != ',') return false;
+		} else {
+			q = (const char*) memchr(p, ',', e - p);
+			if (q == NULL) q = e;
+			begins.push_back(p);
+			ends.push_back(q);
+			quoted.push_back(false);
+		}
+		if (q >= e) break;
+		p = q+1;
+	}
+	return true;
+}
+
+wxString CsvImporter::FieldToString(const char* s, const char* e, bool quoted)
+{
+	if (!quoted || memchr(s, '"', e - s) == NULL) {
+		return wxString(s, e - s);
+	}
+	std::string t;
+	t.reserve(e - s);
+	for (const char* p = s; p < e; ++p) {
+		t += *p;
+		if (*p == '"') ++p; // "" stands for "
+	}
+	return wxString(t.c_str(), t.size());
+}
+
+bool CsvImporter::ReadHeader()
+{
+	using namespace std;
+	ifstream file(csv_path.mb_str(), ios::in | ios::binary);
+	if (!file.is_open()) {
+		error_message = "Unable to open CSV file.";
+		return false;
+	}
+	file.seekg(0, ios::end);
+	file_size = (wxInt64) file.tellg();
+	file.seekg(0, ios::beg);
+	
+	string line;
+	getline(file, line);
+	wxInt64 after_first_line = file.good() ? (wxInt64) file.tellg() : file_size;
+	if (!line.empty() && line[line.size()-1] == '\r') {
+		line.erase(line.size()-1);
+	}
+	size_t bom = (line.compare(0, 3, "\xEF\xBB\xBF") == 0) ? 3 : 0;
+	if (line.size() == bom) {
+		error_message = "First line of CSV is empty";
+		return false;
+	}
+	if (line.find('\r') != string::npos) {
+		error_message = "Lines of the CSV file must end with LF or CR LF.";
+		return false;
+	}
+	vector<const char*> begins, ends;
+	vector<bool> quoted;
+	const char* s = line.c_str() + bom;
+	if (!SplitFields(s, line.c_str() + line.size(), begins, ends, quoted)) {
+		error_message = "Problem parsing first line of CSV.";
+		return false;
+	}
+	
+	int num_cols = begins.size();
+	field_names.resize(num_cols);
+	for (int i=0; i<num_cols; ++i) {
+		if (first_row_field_names) {
+			const char* b = begins[i];
+			const char* e = ends[i];
+			trim_blanks(b, e);
+			field_names[i] = FieldToString(b, e, quoted[i]);
+		} else {
+			field_names[i] = wxString::Format("field_%d", i+1);
+		}
+	}
+	data_start = first_row_field_names ? after_first_line : (wxInt64) bom;
+	
+	field_types.assign(num_cols, GdaConst::string_type);
+	types_from_csvt.assign(num_cols, false);
+	ReadCsvt();
+	InferTypes();
+	return true;
+}
+
+/** Field types from the .csvt file, as written by CsvFieldConfDlg. */
+bool CsvImporter::ReadCsvt()
+{
+	std::ifstream file((csv_path + "t").mb_str());
+	if (!file.is_open()) return false;
+	std::string line;
+	Gda::safeGetline(file, line);
+	wxStringTokenizer tokenizer(wxString(line.c_str()), ",");
+	int idx = 0;
+	while (tokenizer.HasMoreTokens() && idx < (int) field_types.size()) {
+		wxString token = tokenizer.GetNextToken().Upper();
+		if (token.Contains("INTEGER")) {
+			field_types[idx] = GdaConst::long64_type;
+		} else if (token.Contains("REAL") || token.Contains("COORDX") ||
+				   token.Contains("COORDY")) {
+			field_types[idx] = GdaConst::double_type;
+		} else {
+			field_types[idx] = GdaConst::string_type;
+		}
+		types_from_csvt[idx] = true;
+		idx += 1;
+	}
+	return true;
+}
+
+/** Integer if all sampled values are integers, Real if they are numbers,
+ String otherwise or if the column was empty in the sample. */
+void CsvImporter::InferTypes()
+{
+	using namespace std;
+	int num_cols = field_types.size();
+	// 0: no value seen, 1: Integer, 2: Real, 3: String
+	vector<int> state(num_cols, 0);
+	
+	ifstream file(csv_path.mb_str(), ios::in | ios::binary);
+	if (!file.is_open()) return;
+	vector<const char*> begins, ends;
+	vector<bool> quoted;
+	string line;
+	wxInt64 sample_end = data_start;
+	
+	for (int w=0; w<=sample_windows; ++w) {
+		int n_lines = sample_lines;
+		if (w > 0) {
+			wxInt64 pos = data_start + (file_size - data_start) * w /
+				(sample_windows + 1);
+			if (pos <= sample_end) continue;
+			file.clear();
+			file.seekg(pos - 1);
+			Gda::safeGetline(file, line); // rest of the line before pos
+			n_lines = sample_window_lines;
+		} else {
+			file.seekg(data_start);
+		}
+		for (int i=0; i<n_lines && file.good(); ++i) {
+			Gda::safeGetline(file, line);
+			if (line.empty()) continue;
+			const char* s = line.c_str();
+			const char* e = s + line.size();
+			if (!SplitFields(s, e, begins, ends, quoted) ||
+				(int) begins.size() != num_cols) continue;
+			for (int c=0; c<num_cols; ++c) {
+				if (state[c] == 3) continue;
+				const char* b = begins[c];
+				const char* f = ends[c];
+				trim_blanks(b, f);
+				if (b == f) continue;
+				wxInt64 l;
+				double d;
+				if (state[c] <= 1 && ParseInt64(b, f, thousands_sep, l)) {
+					state[c] = 1;
+				} else if (ParseDouble(b, f, decimal_point, thousands_sep, d)) {
+					state[c] = 2;
+				} else {
+					state[c] = 3;
+				}
+			}
+		}
+		sample_end = file.good() ? (wxInt64) file.tellg() : file_size;
+	}
+	
+	for (int c=0; c<num_cols; ++c) {
+		if (types_from_csvt[c]) continue;
+		if (state[c] == 1) field_types[c] = GdaConst::long64_type;
+		else if (state[c] == 2) field_types[c] = GdaConst::double_type;
+		else field_types[c] = GdaConst::string_type;
+	}
+}
+
+bool CsvImporter::Read(const GdaCancelToken& token_s)
+{
+	using namespace std;
+	token = token_s;
+	multi_line_record = false;
+	wxInt64 data_bytes = file_size - data_start;
+	int num_chunks = (int) ((data_bytes + chunk_bytes - 1) / chunk_bytes);
+	int num_cols = field_types.size();
+	wxInt64 total_bytes = 0;
+	
+	// Types only ever widen, so this ends.  In practice a second pass never
+	// widens again as the first one already checked every value.
+	for (;;) {
+		// a second pass adds to the total
+		total_bytes += data_bytes;
+		token.SetTotal((double) total_bytes);
+		chunks.clear();
+		chunks.resize(num_chunks);
+		if (num_chunks > 0) {
+			GdaThreadPool::GetInstance()->
+				ParallelFor(0, num_chunks-1, 1,
+							boost::bind(&CsvImporter::ParseChunk_range,
+										this, _1, _2));
+		}
+		if (token.IsCancelled()) {
+			chunks.clear();
+			error_message = "Reading the CSV file was cancelled.";
+			return false;
+		}
+		
+		int line_no = first_row_field_names ? 1 : 0;
+		for (int k=0; k<num_chunks; ++k) {
+			const Chunk& c = chunks[k];
+			if (c.io_error) {
+				chunks.clear();
+				error_message = "Unable to read CSV file.";
+				return false;
+			}
+			if (c.error_line >= 0) {
+				multi_line_record = c.open_quote;
+				error_message.Clear();
+				error_message << "Problem parsing CSV file line ";
+				error_message << line_no + c.error_line + 1 << ".";
+				if (c.open_quote) {
+					error_message << " A quoted field on this line continues";
+					error_message << " on the next line.";
+				} else if (c.error_fields != num_cols) {
+					error_message << " First line of CSV file has " << num_cols;
+					error_message << " fields, but this line has ";
+					error_message << c.error_fields << " fields.";
+				}
+				chunks.clear();
+				return false;
+			}
+			line_no += c.num_lines;
+		}
+		
+		bool widened = false;
+		for (int col=0; col<num_cols; ++col) {
+			if (types_from_csvt[col] ||
+				field_types[col] == GdaConst::string_type) continue;
+			bool to_real = false;
+			bool to_string = false;
+			for (int k=0; k<num_chunks; ++k) {
+				if (chunks[k].widen_string[col]) to_string = true;
+				if (chunks[k].widen_real[col]) to_real = true;
+			}
+			if (to_string) {
+				field_types[col] = GdaConst::string_type;
+				widened = true;
+			} else if (to_real && field_types[col] == GdaConst::long64_type) {
+				field_types[col] = GdaConst::double_type;
+				widened = true;
+			}
+		}
+		if (!widened) break;
+		LOG_MSG("CsvImporter: sample missed some field types, reading again");
+	}
+	Merge();
+	return true;
+}
+
+void CsvImporter::ParseChunk_range(int chunk_start, int chunk_end)
+{
+	for (int k=chunk_start; k<=chunk_end; ++k) ParseChunk(k);
+}
+
+/** Reads the bytes of chunk k, from one byte before its start to the end of
+ the line running over its end.  The lines it owns start at buf[first] and
+ at every line start before buf[limit]. */
+bool CsvImporter::ReadChunkBytes(int k, std::string& buf, size_t& first,
+								 size_t& limit)
+{
+	using namespace std;
+	wxInt64 start = data_start + (wxInt64) k * chunk_bytes;
+	wxInt64 end = std::min(file_size, start + chunk_bytes);
+	wxInt64 read_from = (k == 0) ? start : start - 1;
+	
+	ifstream file(csv_path.mb_str(), ios::in | ios::binary);
+	if (!file.is_open()) return false;
+	file.seekg(read_from);
+	buf.resize(end - read_from);
+	file.read(&buf[0], buf.size());
+	if (file.gcount() != (streamsize) buf.size()) return false;
+	limit = buf.size();
+	
+	// complete the last line
+	if (end < file_size && buf[buf.size()-1] != '\n') {
+		const size_t step = 1 << 16;
+		for (;;) {
+			size_t old_size = buf.size();
+			buf.resize(old_size + step);
+			file.read(&buf[old_size], step);
+			buf.resize(old_size + file.gcount());
+			if (memchr(&buf[old_size], '\n', buf.size() - old_size) ||
+				file.gcount() == 0) break;
+		}
+	}
+	
+	if (k == 0) {
+		first = 0;
+	} else {
+		// buf[0] is the byte before the chunk
+		const char* nl = (const char*) memchr(&buf[0], '\n', limit);
+		first = nl ? nl - &buf[0] + 1 : limit;
+	}
+	return true;
+}
+
+void CsvImporter::InitChunk(Chunk& c)
+{
+	int num_cols = field_types.size();
+	c.cols.resize(num_cols);
+	c.widen_real.assign(num_cols, false);
+	c.widen_string.assign(num_cols, false);
+}
+
+void CsvImporter::ParseChunk(int k)
+{
+	using namespace std;
+	Chunk& c = chunks[k];
+	InitChunk(c);
+	if (token.IsCancelled()) return;
+	
+	string buf;
+	size_t first = 0, limit = 0;
+	if (!ReadChunkBytes(k, buf, first, limit)) {
+		c.io_error = true;
+		return;
+	}
+	wxInt64 start = data_start + (wxInt64) k * chunk_bytes;
+	wxInt64 chunk_size = std::min(file_size, start + chunk_bytes) - start;
+	
+	int num_cols = field_types.size();
+	const char* end = buf.c_str() + buf.size();
+	const char* lim = buf.c_str() + limit;
+	const char* p = buf.c_str() + first;
+	const char* line;
+	const char* line_end;
+	vector<const char*> begins, ends;
+	vector<bool> quoted;
+	
+	while (next_line(p, end, lim, line, line_end)) {
+		if ((c.num_lines & 0xffff) == 0xffff && token.IsCancelled()) return;
+		++c.num_lines;
+		if (line == line_end) continue;
+		if (!SplitFields(line, line_end, begins, ends, quoted) ||
+			(int) begins.size() != num_cols) {
+			c.error_line = c.num_lines - 1;
+			c.error_fields = begins.size();
+			c.open_quote = (std::count(line, line_end, '"') % 2 == 1);
+			return;
+		}
+		for (int col=0; col<num_cols; ++col) {
+			AddField(begins[col], ends[col], quoted[col], col, c);
+		}
+		++c.num_rows;
+	}
+	
+	token.AddProgress((double) chunk_size);
+}
+
+void CsvImporter::AddField(const char* s, const char* e, bool quoted, int col,
+						   Chunk& c)
+{
+	Column& column = c.cols[col];
+	GdaConst::FieldType type = field_types[col];
+	
+	if (type == GdaConst::string_type) {
+		column.s_data.push_back(FieldToString(s, e, quoted));
+		column.undef.push_back(false);
+		if (e - s > column.max_length) column.max_length = e - s;
+		return;
+	}
+	
+	const char* b = s;
+	const char* f = e;
+	trim_blanks(b, f);
+	bool undef = (b == f);
+	if (type == GdaConst::long64_type) {
+		wxInt64 l = 0;
+		double d = 0;
+		if (!undef && !ParseInt64(b, f, thousands_sep, l)) {
+			bool is_num = ParseDouble(b, f, decimal_point, thousands_sep, d);
+			if (types_from_csvt[col] && is_num) {
+				l = (wxInt64) d;
+			} else {
+				if (is_num) c.widen_real[col] = true;
+				else c.widen_string[col] = true;
+				undef = true;
+			}
+		}
+		column.l_data.push_back(undef ? 0 : l);
+	} else {
+		double d = 0;
+		if (!undef && !ParseDouble(b, f, decimal_point, thousands_sep, d)) {
+			c.widen_string[col] = true;
+			undef = true;
+		}
+		column.d_data.push_back(undef ? 0 : d);
+	}
+	column.undef.push_back(undef);
+}
+
+/** Concatenates the chunks column by column, freeing them on the way. */
+void CsvImporter::Merge()
+{
+	int num_cols = field_types.size();
+	num_rows = 0;
+	for (size_t k=0; k<chunks.size(); ++k) num_rows += chunks[k].num_rows;
+	
+	columns.clear();
+	columns.resize(num_cols);
+	for (int col=0; col<num_cols; ++col) {
+		Column& column = columns[col];
+		GdaConst::FieldType type = field_types[col];
+		if (type == GdaConst::long64_type) column.l_data.reserve(num_rows);
+		else if (type == GdaConst::double_type) column.d_data.reserve(num_rows);
+		else column.s_data.reserve(num_rows);
+		column.undef.reserve(num_rows);
+		
+		for (size_t k=0; k<chunks.size(); ++k) {
+			Column& part = chunks[k].cols[col];
+			column.l_data.insert(column.l_data.end(), part.l_data.begin(),
+								 part.l_data.end());
+			column.d_data.insert(column.d_data.end(), part.d_data.begin(),
+								 part.d_data.end());
+			column.s_data.insert(column.s_data.end(), part.s_data.begin(),
+								 part.s_data.end());
+			column.undef.insert(column.undef.end(), part.undef.begin(),
+								part.undef.end());
+			column.max_length = std::max(column.max_length, part.max_length);
+			Column().l_data.swap(part.l_data);
+			Column().d_data.swap(part.d_data);
+			Column().s_data.swap(part.s_data);
+			Column().undef.swap(part.undef);
+		}
+	}
+	chunks.clear();
+}
+
+OGRTable* CsvImporter::CreateTable()
+{
+	OGRTable* table = new OGRTable(num_rows);
+	int num_cols = field_types.size();
+	for (int col=0; col<num_cols; ++col) {
+		Column& column = columns[col];
+		OGRColumn* ogr_col = NULL;
+		if (field_types[col] == GdaConst::long64_type) {
+			ogr_col = new OGRColumnInteger(field_names[col],
+										   GdaConst::default_dbf_long_len, 0,
+										   column.l_data, column.undef);
+		} else if (field_types[col] == GdaConst::double_type) {
+			ogr_col = new OGRColumnDouble(field_names[col],
+										  GdaConst::default_dbf_double_len,
+										  GdaConst::default_dbf_double_decimals,
+										  column.d_data, column.undef);
+		} else {
+			int len = std::min(std::max(column.max_length, 1),
+							   GdaConst::max_dbf_string_len);
+			ogr_col = new OGRColumnString(field_names[col], len, 0,
+										  column.s_data, column.undef);
+		}
+		table->AddOGRColumn(ogr_col);
+	}
+	columns.clear();
+	return table;
+}
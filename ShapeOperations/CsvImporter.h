@@ -0,0 +1,172 @@
+/**
+ * GeoDa TM, Copyright (C) 2011-2015 by Luc Anselin - all rights reserved
+ *
+ * This file is part of GeoDa.
+ * 
+ * GeoDa is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+ *
+ * GeoDa is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program.  If not, see <http://www.gnu.org/licenses/>.
+ */
+
+
+#ifndef __GEODA_CENTER_CSV_IMPORTER_H__
+#define __GEODA_CENTER_CSV_IMPORTER_H__
+
+#include <string>
+#include <vector>
+#include <wx/string.h>
+#include "../GdaAsyncTask.h"
+#include "../GdaConst.h"
+
+class OGRTable;
+
+/**
+ * Parallel CSV reader that fills the typed column storage of an in-memory
+ * OGRTable.
+ *
+ * The data lines of the file are split into chunks of chunk_bytes bytes.
+ * A chunk owns every line that starts inside it, so chunks can be read and
+ * parsed independently on the GdaThreadPool and their rows concatenated in
+ * file order.  Lines end with LF or CR LF, and blank lines are skipped.
+ * Records can't span lines: a quoted field with a line break in it makes
+ * Read() fail with HasMultiLineRecords() set, and the caller should read
+ * the file with OGR instead.
+ *
+ * Field types come from the .csvt file next to the CSV file if there is
+ * one.  Otherwise they are inferred from a sample of lines at the start and
+ * at evenly spaced offsets of the file.  If the sample missed a value that
+ * does not fit the inferred type, the column is widened (Integer to Real,
+ * numbers to String) and the file is parsed once more.  Values that do not
+ * fit a type set in the .csvt file are undefined, as are empty fields.
+ *
+ * Read() runs in the calling thread, which usually is the worker thread of
+ * a GdaAsyncTask.  It reports progress in bytes and stops early through
+ * the token it is given.
+ *
+ * \code
+ * CsvImporter csv(path);
+ * if (csv.ReadHeader() && csv.Read()) table = csv.CreateTable();
+ * \endcode
+ */
+class CsvImporter
+{
+public:
+	CsvImporter(const wxString& csv_path, bool first_row_field_names = true);
+	virtual ~CsvImporter();
+	
+	/** Separators used in numbers, e.g. ',' and '.' for 1.234,5.  The
+	 default is '.' and the GDAL_LOCALE_SEPARATOR thousands separator, if
+	 that option is set.  A thousands separator of 0 means none. */
+	void SetNumberFormat(char decimal_point, char thousands_sep);
+	
+	/** Read the field names and determine the field types.  Returns false
+	 if the file can't be read, see GetErrorMessage(). */
+	bool ReadHeader();
+	
+	/** Parse all lines on all cores.  Returns false on a malformed line,
+	 or when token was cancelled.  Parsing again after widening a column
+	 adds the data bytes to the total of token once more. */
+	bool Read(const GdaCancelToken& token = GdaCancelToken());
+	
+	wxString GetCsvPath() { return csv_path; }
+	wxInt64 GetFileSize() { return file_size; }
+	
+	wxString GetErrorMessage() { return error_message; }
+	/** True if Read() failed on a quoted field that spans lines. */
+	bool HasMultiLineRecords() { return multi_line_record; }
+	
+	int GetNumRows() { return num_rows; }
+	int GetNumCols() { return (int) field_names.size(); }
+	const std::vector<wxString>& GetFieldNames() { return field_names; }
+	const std::vector<GdaConst::FieldType>& GetFieldTypes()
+		{ return field_types; }
+	
+	/** Hands the parsed columns over to a new in-memory OGRTable without
+	 copying them.  Can be called once after a successful Read(). */
+	OGRTable* CreateTable();
+	
+	/** Number parsers used for the fields.  [s, e) may be surrounded by
+	 blanks, and thousands separators are only accepted between digits.
+	 Short decimals are converted exactly without strtod. */
+	static bool ParseDouble(const char* s, const char* e, char decimal_point,
+							char thousands_sep, double& val);
+	static bool ParseInt64(const char* s, const char* e, char thousands_sep,
+						   wxInt64& val);
+	
+	/** Chunk size for Read(). */
+	static const int chunk_bytes = 4 << 20;
+	/** Number of lines sampled for type inference at the start of the
+	 file, and at each of the sample_windows offsets after that. */
+	static const int sample_lines = 1000;
+	static const int sample_window_lines = 100;
+	static const int sample_windows = 16;
+	
+protected:
+	struct Column {
+		Column() : max_length(0) {}
+		std::vector<wxInt64> l_data;
+		std::vector<double> d_data;
+		std::vector<wxString> s_data;
+		std::vector<bool> undef;
+		int max_length; // longest string value, in bytes
+	};
+	struct Chunk {
+		Chunk() : num_rows(0), num_lines(0), error_line(-1), error_fields(0),
+		open_quote(false), io_error(false) {}
+		int num_rows;
+		int num_lines; // including blank lines
+		std::vector<Column> cols;
+		std::vector<bool> widen_real; // an Integer column had a real value
+		std::vector<bool> widen_string; // a number column had some text
+		int error_line; // first line that is not a valid record, or -1
+		int error_fields; // number of fields found on that line
+		bool open_quote; // that line has an unbalanced quote
+		bool io_error;
+	};
+	
+	bool ReadCsvt();
+	void InferTypes();
+	bool ReadChunkBytes(int chunk, std::string& buf, size_t& first,
+						size_t& limit);
+	void ParseChunk_range(int chunk_start, int chunk_end);
+	void ParseChunk(int chunk);
+	void InitChunk(Chunk& c);
+	void AddField(const char* s, const char* e, bool quoted, int col,
+				  Chunk& c);
+	void Merge();
+	static bool SplitFields(const char* s, const char* e,
+							std::vector<const char*>& begins,
+							std::vector<const char*>& ends,
+							std::vector<bool>& quoted);
+	static wxString FieldToString(const char* s, const char* e, bool quoted);
+	
+	wxString csv_path;
+	bool first_row_field_names;
+	char decimal_point;
+	char thousands_sep;
+	
+	wxInt64 file_size;
+	wxInt64 data_start; // offset of the first data line
+	std::vector<wxString> field_names;
+	std::vector<GdaConst::FieldType> field_types;
+	std::vector<bool> types_from_csvt;
+	
+	int num_rows;
+	std::vector<Chunk> chunks;
+	std::vector<Column> columns;
+	wxString error_message;
+	bool multi_line_record;
+	
+	GdaCancelToken token; // of the current Read()
+};
+
+#endif
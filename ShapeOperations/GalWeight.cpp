@@ -23,6 +23,7 @@
 #include <set>
 #include <map>
 #include <utility>
+#include <boost/thread/mutex.hpp>
 #include <boost/uuid/uuid.hpp>
 #include <wx/filename.h>
 
@@ -30,6 +31,8 @@
 #include "../Project.h"
 #include "../VarCalc/WeightsManInterface.h"
 #include "../DataViewer/TableInterface.h"
+#include "../GdaAsyncTask.h"
+#include "CsrWeight.h"
 #include "GalWeight.h"
 
 
@@ -43,8 +46,24 @@ GalElement::GalElement()
     is_nbrAvgW_empty = true;
 }
 
+// nbrLookup and nbrAvgW are filled on first use by Check and GetRW.  Both
+// may be called on a shared weights matrix from several threads, so the
+// lazy fill and the lookups run under this lock.
+static boost::mutex gal_lookup_mutex;
+
+// nbrLookup is only needed by Check and GetRW, so it is built on first use
+// instead of costing a map node per neighbor for every weights matrix.
+// Callers hold gal_lookup_mutex.
+void GalElement::BuildNbrLookup()
+{
+    if (!nbrLookup.empty() || nbr.empty()) return;
+    for (size_t i=0; i<nbr.size(); i++) nbrLookup[nbr[i]] = i;
+}
+
 bool GalElement::Check(long nbrIdx)
 {
+    boost::mutex::scoped_lock lock(gal_lookup_mutex);
+    BuildNbrLookup();
     if (nbrLookup.find(nbrIdx) != nbrLookup.end())
         return true;
     return false;
@@ -53,6 +72,7 @@ bool GalElement::Check(long nbrIdx)
 // return row standardized weights value
 double GalElement::GetRW(int idx)
 {
+    boost::mutex::scoped_lock lock(gal_lookup_mutex);
     if (is_nbrAvgW_empty) {
         size_t sz = nbr.size();
         nbrAvgW.resize(sz);
@@ -67,6 +87,7 @@ double GalElement::GetRW(int idx)
         is_nbrAvgW_empty = false;
     }
     
+    BuildNbrLookup();
     if (nbrLookup.find(idx) != nbrLookup.end())
         return nbrAvgW[nbrLookup[idx]];
     return 0;
@@ -86,7 +107,7 @@ void GalElement::SetNbr(size_t pos, long n)
 {
     if (pos < nbr.size()) {
         nbr[pos] = n;
-        nbrLookup[n] = pos;
+        nbrLookup.clear();
     }
     // this should be called by GAL created only
     if (pos < nbrWeight.size()) {
@@ -99,11 +120,10 @@ void GalElement::SetNbr(size_t pos, long n, double w)
 {
     if (pos < nbr.size()) {
         nbr[pos] = n;
-        nbrLookup[n] = pos;
     } else {
         nbr.push_back(n);
-        nbrLookup[n] = pos;
     }
+    nbrLookup.clear();
     
     // this should be called by GWT-GAL 
     if (pos < nbrWeight.size()) {
@@ -122,13 +142,15 @@ void GalElement::Update(const std::vector<bool>& undefs)
     for (int i=0; i<nbr.size(); i++) {
         int obj_id = nbr[i];
         if (undefs[obj_id]) {
-            int pos = nbrLookup[obj_id];
-            undef_obj_positions.push_back(pos);
+            undef_obj_positions.push_back(i);
         }
     }
    
     if (undef_obj_positions.empty())
         return;
+    nbrLookup.clear();
+    nbrAvgW.clear();
+    is_nbrAvgW_empty = true;
     
     // sort the positions in descending order, for removing from std::vector
 	std::sort(undef_obj_positions.begin(),
@@ -137,7 +159,6 @@ void GalElement::Update(const std::vector<bool>& undefs)
     for (int i=0; i<undef_obj_positions.size(); i++) {
         int pos = undef_obj_positions[i];
         if (pos < nbr.size()) {
-            nbrLookup.erase( nbr[pos] );
             nbr.erase( nbr.begin() + pos);
         }
         if (pos < nbrWeight.size()) {
@@ -172,6 +193,7 @@ void GalElement::SetNbrs(const GalElement& gal)
     nbrWeight = gal.GetNbrWeights();
     nbrLookup = gal.nbrLookup;
     nbrAvgW = gal.nbrAvgW;
+    is_nbrAvgW_empty = gal.is_nbrAvgW_empty;
 }
 
 const std::vector<long> & GalElement::GetNbrs() const
@@ -281,7 +303,13 @@ void GalWeight::Update(const std::vector<bool>& undefs)
     for (int i=0; i<num_obs; ++i) {
         gal[i].Update(undefs);
     }
+    ClearCsr();
+}
 
+CsrWeight* GalWeight::CreateCsr()
+{
+    if (!gal) return 0;
+    return new CsrWeight(gal, num_obs);
 }
 
 bool GalWeight::HasIsolates(GalElement *gal, int num_obs)
@@ -558,12 +586,15 @@ bool Gda::SaveSpaceTimeGal(const GalElement* g,
  only include elements on frontier. */
 void Gda::MakeHigherOrdContiguity(size_t distance, size_t obs,
                                   GalElement* W,
-                                  bool cummulative)
+                                  bool cummulative,
+                                  const GdaCancelToken* token)
 {	
 	using namespace std;
 	if (obs < 1 || distance <=1) return;
 	vector<vector<long> > X(obs);
 	for (size_t i=0; i<obs; ++i) {
+		// W is only written below, so stopping here leaves it as it was
+		if (token && i % 1024 == 0 && token->IsCancelled()) return;
 		vector<set<long> > n_at_d(distance+1);
 		n_at_d[0].insert(i);
 		for (size_t j=0, sz=W[i].Size(); j<sz; ++j) {
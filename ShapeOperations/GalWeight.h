@@ -27,6 +27,7 @@
 class Project;
 class WeightsManInterface;
 class TableInterface;
+class GdaCancelToken;
 
 class GalElement {
 public:
@@ -54,6 +55,7 @@ public:
     void Update(const std::vector<bool>& undefs);
     
 private:
+    void BuildNbrLookup();
 	std::vector<long> nbr;
 	std::vector<double> nbrWeight;
 };
@@ -84,6 +86,9 @@ public:
     virtual bool SaveSpaceTimeWeights(const wxString& ofname,
                                       WeightsManInterface* wmi,
                                       TableInterface* table_int);
+    
+protected:
+	virtual CsrWeight* CreateCsr();
 };
 
 namespace Gda {
@@ -108,7 +113,10 @@ namespace Gda {
                           const std::vector<wxString>& id_vec);
 	
     
-	void MakeHigherOrdContiguity(size_t distance, size_t obs, GalElement* W, bool cummulative);
+	/** W is left unchanged if token is given and gets cancelled. */
+	void MakeHigherOrdContiguity(size_t distance, size_t obs, GalElement* W,
+								 bool cummulative,
+								 const GdaCancelToken* token=0);
     
     
 }
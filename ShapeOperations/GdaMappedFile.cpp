@@ -0,0 +1,127 @@
+/**
+ * GeoDa TM, Copyright (C) 2011-2015 by Luc Anselin - all rights reserved
+ *
+ * This file is part of GeoDa.
+ * 
+ * GeoDa is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+ *
+ * GeoDa is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program.  If not, see <http://www.gnu.org/licenses/>.
+ */
+
+
+#ifdef __WIN32__
+#include <windows.h>
+#else
+#include <fcntl.h>
+#include <unistd.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#endif
+#include "../GenUtils.h"
+#include "GdaMappedFile.h"
+
+GdaMappedFile::GdaMappedFile()
+: is_open(false), data(0), size(0)
+#ifdef __WIN32__
+, file_handle(INVALID_HANDLE_VALUE), map_handle(0)
+#else
+, fd(-1)
+#endif
+{
+}
+
+GdaMappedFile::~GdaMappedFile()
+{
+	Close();
+}
+
+#ifdef __WIN32__
+
+bool GdaMappedFile::Open(const wxString& fname)
+{
+	Close();
+	HANDLE fh = CreateFileW(fname.wc_str(), GENERIC_READ, FILE_SHARE_READ,
+							NULL, OPEN_EXISTING, FILE_ATTRIBUTE_NORMAL, NULL);
+	if (fh == INVALID_HANDLE_VALUE) return false;
+	LARGE_INTEGER sz;
+	if (!GetFileSizeEx(fh, &sz)) {
+		CloseHandle(fh);
+		return false;
+	}
+	file_handle = fh;
+	size = (size_t) sz.QuadPart;
+	if (size > 0) {
+		HANDLE mh = CreateFileMapping(fh, NULL, PAGE_READONLY, 0, 0, NULL);
+		if (mh == NULL) {
+			Close();
+			return false;
+		}
+		map_handle = mh;
+		data = (const char*) MapViewOfFile(mh, FILE_MAP_READ, 0, 0, 0);
+		if (data == NULL) {
+			Close();
+			return false;
+		}
+	}
+	is_open = true;
+	return true;
+}
+
+void GdaMappedFile::Close()
+{
+	if (data) UnmapViewOfFile((LPCVOID) data);
+	if (map_handle) CloseHandle((HANDLE) map_handle);
+	if (file_handle != INVALID_HANDLE_VALUE) CloseHandle((HANDLE) file_handle);
+	data = 0;
+	size = 0;
+	map_handle = 0;
+	file_handle = INVALID_HANDLE_VALUE;
+	is_open = false;
+}
+
+#else
+
+bool GdaMappedFile::Open(const wxString& fname)
+{
+	Close();
+	int f = open(GET_ENCODED_FILENAME(fname), O_RDONLY);
+	if (f < 0) return false;
+	struct stat st;
+	if (fstat(f, &st) != 0) {
+		close(f);
+		return false;
+	}
+	fd = f;
+	size = (size_t) st.st_size;
+	if (size > 0) {
+		void* p = mmap(0, size, PROT_READ, MAP_SHARED, fd, 0);
+		if (p == MAP_FAILED) {
+			Close();
+			return false;
+		}
+		data = (const char*) p;
+	}
+	is_open = true;
+	return true;
+}
+
+void GdaMappedFile::Close()
+{
+	if (data) munmap((void*) data, size);
+	if (fd >= 0) close(fd);
+	data = 0;
+	size = 0;
+	fd = -1;
+	is_open = false;
+}
+
+#endif
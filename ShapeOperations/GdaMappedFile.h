@@ -0,0 +1,70 @@
+/**
+ * GeoDa TM, Copyright (C) 2011-2015 by Luc Anselin - all rights reserved
+ *
+ * This file is part of GeoDa.
+ * 
+ * GeoDa is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+ *
+ * GeoDa is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program.  If not, see <http://www.gnu.org/licenses/>.
+ */
+
+
+#ifndef __GEODA_CENTER_GDA_MAPPED_FILE_H__
+#define __GEODA_CENTER_GDA_MAPPED_FILE_H__
+
+#include <wx/string.h>
+
+/**
+ * Read-only memory mapping of a whole file.  Pages are loaded by the OS on
+ * first access and can be dropped again under memory pressure since they
+ * are backed by the file itself, so mapping a large file costs neither a
+ * parse nor a private copy.
+ *
+ * \code
+ * GdaMappedFile f;
+ * if (f.Open(fname)) {
+ *     const char* p = f.GetData(); // f.GetSize() bytes
+ * }
+ * \endcode
+ */
+class GdaMappedFile {
+public:
+	GdaMappedFile();
+	virtual ~GdaMappedFile();
+	
+	/** Map fname, closing any previous mapping.  Returns false if the file
+	 could not be opened or mapped.  Empty files are opened, but have no
+	 data. */
+	bool Open(const wxString& fname);
+	void Close();
+	
+	bool IsOpen() const { return is_open; }
+	const char* GetData() const { return data; }
+	size_t GetSize() const { return size; }
+	
+private:
+	// not copyable: the mapping is released in the destructor
+	GdaMappedFile(const GdaMappedFile&);
+	GdaMappedFile& operator=(const GdaMappedFile&);
+	
+	bool is_open;
+	const char* data;
+	size_t size;
+#ifdef __WIN32__
+	void* file_handle;
+	void* map_handle;
+#else
+	int fd;
+#endif
+};
+
+#endif
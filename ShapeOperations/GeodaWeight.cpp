@@ -18,15 +18,23 @@
  */
 
 #include <wx/filename.h>
+#include "CsrWeight.h"
 #include "GeodaWeight.h"
 
 GeoDaWeight::GeoDaWeight(const GeoDaWeight& gw)
+: csr(0)
 {
 	GeoDaWeight::operator=(gw);
 }
 
+GeoDaWeight::~GeoDaWeight()
+{
+	ClearCsr();
+}
+
 const GeoDaWeight& GeoDaWeight::operator=(const GeoDaWeight& gw)
 {
+	ClearCsr();
 	weight_type = gw.weight_type;
 	wflnm = gw.wflnm;
 	title = gw.title;
@@ -42,3 +50,21 @@ wxString GeoDaWeight::GetTitle()
 	if (!title.IsEmpty()) return title;
 	return wxFileName(wflnm).GetName();
 }
+
+const CsrWeight* GeoDaWeight::GetCsr()
+{
+	if (!csr) csr = CreateCsr();
+	return csr;
+}
+
+void GeoDaWeight::ClearCsr()
+{
+	if (csr) delete csr;
+	csr = 0;
+}
+
+void GeoDaWeight::SetCsr(CsrWeight* csr_s)
+{
+	ClearCsr();
+	csr = csr_s;
+}
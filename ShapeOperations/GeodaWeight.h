@@ -23,16 +23,17 @@
 #include <vector>
 #include <wx/string.h>
 
+class CsrWeight;
 class Project;
 class WeightsManInterface;
 class TableInterface;
 
 class GeoDaWeight {
 public:
-	GeoDaWeight() : symmetry_checked(false), num_obs(0) {}
+	GeoDaWeight() : symmetry_checked(false), num_obs(0), csr(0) {}
 	GeoDaWeight(const GeoDaWeight& gw);
     
-	virtual ~GeoDaWeight() {}
+	virtual ~GeoDaWeight();
 
 public:
 	virtual const GeoDaWeight& operator=(const GeoDaWeight& gw);
@@ -50,6 +51,24 @@ public:
    
     virtual void Update(const std::vector<bool>& undefs)=0;
     
+	/** Compressed sparse row copy of the weights, built on first use and
+	 kept until ClearCsr() is called.  Build it on the main thread before
+	 sharing it with worker threads.  It does not share storage with the
+	 neighbor lists: the copy costs 12 bytes per neighbor (a 32-bit id and
+	 a double weight) next to the 16 of GalElement, which is paid for by
+	 GalElement only building its lookup map, one tree node per
+	 neighbor, when it is needed. */
+	const CsrWeight* GetCsr();
+	/** Must be called whenever the neighbor lists are changed. */
+	void ClearCsr();
+	/** Use csr, which must match the neighbor lists, instead of building
+	 a copy.  Takes ownership.  Used for mapped binary weights files. */
+	void SetCsr(CsrWeight* csr);
+    
+protected:
+	virtual CsrWeight* CreateCsr()=0;
+	CsrWeight* csr;
+    
 public:
 	enum WeightType { gal_type, gwt_type };
 	// subclasses
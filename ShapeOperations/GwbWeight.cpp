@@ -0,0 +1,274 @@
+/**
+ * GeoDa TM, Copyright (C) 2011-2015 by Luc Anselin - all rights reserved
+ *
+ * This file is part of GeoDa.
+ * 
+ * GeoDa is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+ *
+ * GeoDa is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program.  If not, see <http://www.gnu.org/licenses/>.
+ */
+
+
+#include <climits>
+#include <cstring>
+#include <fstream>
+#include <string>
+#include <wx/filename.h>
+#include "../GenUtils.h"
+#include "CsrWeight.h"
+#include "GdaMappedFile.h"
+#include "GwbWeight.h"
+
+// the CR LF pair catches files mangled by a text mode transfer
+static const char gwb_magic[8] = { 'G', 'D', 'A', 'G', 'W', 'B', '\r', '\n' };
+
+static uint64_t gwb_round8(uint64_t n) { return (n + 7) & ~((uint64_t) 7); }
+
+/** Checksum of n bytes at p, which must be a multiple of 8. */
+static uint64_t gwb_checksum(uint64_t h, const char* p, size_t n)
+{
+	for (size_t i=0; i<n; i+=8) {
+		uint64_t w;
+		memcpy(&w, p+i, 8);
+		h = (h ^ w) * 0x9E3779B97F4A7C15ULL;
+		h ^= h >> 29;
+	}
+	return h;
+}
+
+/** Writes sections padded to 8 bytes and keeps the running checksum. */
+class GwbWriter {
+public:
+	GwbWriter(std::ofstream& out_s, uint64_t pos_s)
+	: out(out_s), pos(pos_s), checksum(0) {}
+	
+	/** Returns the file offset the section was written at. */
+	uint64_t Write(const void* p, size_t n) {
+		uint64_t start = pos;
+		const char* c = (const char*) p;
+		size_t full = n & ~((size_t) 7);
+		checksum = gwb_checksum(checksum, c, full);
+		char pad[8] = { 0, 0, 0, 0, 0, 0, 0, 0 };
+		out.write(c, n);
+		if (n > full) {
+			memcpy(pad, c+full, n-full);
+			checksum = gwb_checksum(checksum, pad, 8);
+			memset(pad, 0, 8);
+			out.write(pad, 8-(n-full));
+		}
+		pos += gwb_round8(n);
+		return start;
+	}
+	
+	std::ofstream& out;
+	uint64_t pos;
+	uint64_t checksum;
+};
+
+bool Gda::SaveGwb(const CsrWeight& w, bool is_gwt,
+				  const wxString& layer_name,
+				  const wxString& ofname,
+				  const wxString& id_var_name,
+				  const std::vector<wxInt64>& id_vec)
+{
+	std::vector<wxString> ids(id_vec.size());
+	for (size_t i=0; i<id_vec.size(); i++) ids[i] << id_vec[i];
+	return SaveGwb(w, is_gwt, layer_name, ofname, id_var_name, ids);
+}
+
+bool Gda::SaveGwb(const CsrWeight& w, bool is_gwt,
+				  const wxString& layer_name,
+				  const wxString& ofname,
+				  const wxString& id_var_name,
+				  const std::vector<wxString>& id_vec)
+{
+	using namespace std;
+	int num_obs = w.GetNumObs();
+	if (ofname.IsEmpty()) return false;
+	if (!id_var_name.IsEmpty() && (int) id_vec.size() != num_obs) return false;
+	
+	wxFileName wx_fn(ofname);
+	wx_fn.SetExt("gwb");
+	wxString final_ofn(wx_fn.GetFullPath());
+	ofstream out;
+	out.open(GET_ENCODED_FILENAME(final_ofn), ios::out | ios::binary);
+	if (!(out.is_open() && out.good())) return false;
+	
+	GwbHeader hd;
+	memset(&hd, 0, sizeof(GwbHeader));
+	memcpy(hd.magic, gwb_magic, 8);
+	hd.version = GwbHeader::current_version;
+	hd.byte_order = GwbHeader::native_byte_order;
+	hd.flags = is_gwt ? GwbHeader::flag_gwt : 0;
+	hd.num_obs = num_obs;
+	hd.num_nonzeros = w.GetNumNonZeros();
+	// placeholder, rewritten once the offsets and checksum are known
+	out.write((const char*) &hd, sizeof(GwbHeader));
+	
+	string layer(layer_name.ToUTF8().data());
+	string id_var(id_var_name.ToUTF8().data());
+	string ids;
+	if (!id_var.empty()) {
+		for (int i=0; i<num_obs; i++) {
+			ids += id_vec[i].ToUTF8().data();
+			ids += '\0';
+		}
+	}
+	string id_map(16, '\0');
+	uint32_t layer_len = (uint32_t) layer.size();
+	uint32_t id_var_len = (uint32_t) id_var.size();
+	uint64_t ids_len = ids.size();
+	memcpy(&id_map[0], &layer_len, 4);
+	memcpy(&id_map[4], &id_var_len, 4);
+	memcpy(&id_map[8], &ids_len, 8);
+	id_map += layer;
+	id_map += id_var;
+	id_map += ids;
+	
+	size_t nnz = (size_t) w.GetNumNonZeros();
+	GwbWriter wr(out, sizeof(GwbHeader));
+	hd.ids_offset = wr.Write(id_map.data(), id_map.size());
+	hd.offsets_offset = wr.Write(w.GetOffsets(), (num_obs+1)*sizeof(int));
+	hd.nbrs_offset = wr.Write(w.GetAllNbrs(), (nnz+1)*sizeof(int));
+	hd.weights_offset = wr.Write(w.GetAllWeights(), (nnz+1)*sizeof(double));
+	hd.row_sums_offset = wr.Write(w.GetRowSums(), num_obs*sizeof(double));
+	hd.file_size = wr.pos;
+	hd.checksum = wr.checksum;
+	
+	out.seekp(0, ios::beg);
+	out.write((const char*) &hd, sizeof(GwbHeader));
+	out.close();
+	return !out.fail();
+}
+
+/** Checks the header against a file of the given size. */
+static bool gwb_check_header(const GwbHeader& hd, size_t size,
+							 wxString& err_msg)
+{
+	if (memcmp(hd.magic, gwb_magic, 8) != 0) {
+		err_msg = "The file is not a GeoDa binary weights file.";
+		return false;
+	}
+	if (hd.byte_order != GwbHeader::native_byte_order) {
+		err_msg = "The weights file was written on a machine with a ";
+		err_msg << "different byte order.";
+		return false;
+	}
+	if (hd.version > GwbHeader::current_version) {
+		err_msg = "The weights file was written by a newer version of GeoDa.";
+		return false;
+	}
+	uint64_t n = hd.num_obs, nnz = hd.num_nonzeros;
+	bool ok = (hd.num_obs >= 0 && hd.num_nonzeros >= 0 &&
+			   hd.num_nonzeros < INT_MAX && hd.file_size == size);
+	const uint64_t off[5] = { hd.ids_offset, hd.offsets_offset,
+		hd.nbrs_offset, hd.weights_offset, hd.row_sums_offset };
+	const uint64_t len[5] = { 16, (n+1)*sizeof(int), (nnz+1)*sizeof(int),
+		(nnz+1)*sizeof(double), n*sizeof(double) };
+	for (int i=0; i<5 && ok; i++) {
+		ok = (off[i] % 8 == 0 && off[i] >= sizeof(GwbHeader) &&
+			  off[i] <= size && len[i] <= size - off[i]);
+	}
+	if (!ok) {
+		err_msg = "The weights file is truncated or corrupt.";
+		return false;
+	}
+	return true;
+}
+
+/** Parses the ID map section.  Returns false if it is out of bounds. */
+static bool gwb_read_id_map(const char* data, const GwbHeader& hd,
+							GwbMetaInfo& meta, bool read_ids)
+{
+	const char* p = data + hd.ids_offset;
+	uint64_t avail = hd.file_size - hd.ids_offset;
+	uint32_t layer_len, id_var_len;
+	uint64_t ids_len;
+	memcpy(&layer_len, p, 4);
+	memcpy(&id_var_len, p+4, 4);
+	memcpy(&ids_len, p+8, 8);
+	if ((uint64_t) layer_len + id_var_len + 16 > avail ||
+		ids_len > avail - 16 - layer_len - id_var_len) return false;
+	p += 16;
+	meta.is_gwt = (hd.flags & GwbHeader::flag_gwt) != 0;
+	meta.num_obs = hd.num_obs;
+	meta.num_nonzeros = hd.num_nonzeros;
+	meta.layer_name = wxString::FromUTF8(p, layer_len);
+	p += layer_len;
+	meta.id_var_name = wxString::FromUTF8(p, id_var_len);
+	p += id_var_len;
+	meta.ids.clear();
+	if (!read_ids || meta.id_var_name.IsEmpty()) return true;
+	meta.ids.resize(hd.num_obs);
+	const char* e = p + ids_len;
+	for (int i=0; i<hd.num_obs; i++) {
+		const char* q = (const char*) memchr(p, '\0', e-p);
+		if (q == 0) return false;
+		meta.ids[i] = wxString::FromUTF8(p, q-p);
+		p = q+1;
+	}
+	return true;
+}
+
+CsrWeight* Gda::OpenGwb(const wxString& fname, wxString& err_msg,
+						GwbMetaInfo* meta, bool read_ids)
+{
+	GdaMappedFile* file = new GdaMappedFile;
+	if (!file->Open(fname) || file->GetSize() < sizeof(GwbHeader)) {
+		err_msg = "Could not open the weights file.";
+		delete file;
+		return 0;
+	}
+	const char* data = file->GetData();
+	size_t size = file->GetSize();
+	GwbHeader hd;
+	memcpy(&hd, data, sizeof(GwbHeader));
+	if (!gwb_check_header(hd, size, err_msg)) {
+		delete file;
+		return 0;
+	}
+	
+	const int* offsets = (const int*) (data + hd.offsets_offset);
+	const int* nbrs = (const int*) (data + hd.nbrs_offset);
+	int num_obs = hd.num_obs;
+	bool ok = (gwb_checksum(0, data + sizeof(GwbHeader),
+							size - sizeof(GwbHeader)) == hd.checksum);
+	// the checksum only catches damage, make sure that the matrix cannot
+	// send the statistics code out of bounds either
+	ok = ok && offsets[0] == 0 && offsets[num_obs] == hd.num_nonzeros;
+	for (int i=0; i<num_obs && ok; i++) ok = offsets[i] <= offsets[i+1];
+	for (int j=0; j<hd.num_nonzeros && ok; j++) {
+		ok = nbrs[j] >= 0 && nbrs[j] < num_obs;
+	}
+	GwbMetaInfo tmp;
+	ok = ok && gwb_read_id_map(data, hd, meta ? *meta : tmp, read_ids && meta);
+	if (!ok) {
+		err_msg = "The weights file is truncated or corrupt.";
+		delete file;
+		return 0;
+	}
+	
+	return new CsrWeight(num_obs, offsets, nbrs,
+						 (const double*) (data + hd.weights_offset),
+						 (const double*) (data + hd.row_sums_offset), file);
+}
+
+bool Gda::ReadGwbMetaInfo(const wxString& fname, GwbMetaInfo& meta)
+{
+	GdaMappedFile file;
+	if (!file.Open(fname) || file.GetSize() < sizeof(GwbHeader)) return false;
+	GwbHeader hd;
+	memcpy(&hd, file.GetData(), sizeof(GwbHeader));
+	wxString err_msg;
+	if (!gwb_check_header(hd, file.GetSize(), err_msg)) return false;
+	return gwb_read_id_map(file.GetData(), hd, meta, false);
+}
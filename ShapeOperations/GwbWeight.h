@@ -0,0 +1,111 @@
+/**
+ * GeoDa TM, Copyright (C) 2011-2015 by Luc Anselin - all rights reserved
+ *
+ * This file is part of GeoDa.
+ * 
+ * GeoDa is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+ *
+ * GeoDa is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program.  If not, see <http://www.gnu.org/licenses/>.
+ */
+
+
+#ifndef __GEODA_CENTER_GWB_WEIGHT_H__
+#define __GEODA_CENTER_GWB_WEIGHT_H__
+
+#include <stdint.h>
+#include <vector>
+#include <wx/string.h>
+
+class CsrWeight;
+
+/**
+ * GeoDa binary weights file (.gwb).  The file holds a weights matrix in
+ * the layout of CsrWeight so that it can be memory mapped and used in
+ * place, without the parsing of .gal and .gwt files.  Only the statistics
+ * that work on GeoDaWeight::GetCsr() use the mapped matrix itself; the
+ * GalElements and GwtElements handed to everything else are still built as
+ * a copy when the file is loaded.  All values are stored in native byte order, which is recorded in
+ * the header; files written on a machine of different endianness are
+ * rejected.
+ *
+ * Layout, every section starting at a multiple of 8 bytes:
+ *   GwbHeader
+ *   ID map:   uint32 layer name length, uint32 ID variable length,
+ *             uint64 ID bytes, layer name, ID variable name, and the
+ *             num_obs record IDs as NUL terminated UTF-8 strings.  The ID
+ *             variable name is empty if the rows are in record order.
+ *   offsets:  int32[num_obs+1]
+ *   nbrs:     int32[num_nonzeros+1], last entry unused
+ *   weights:  double[num_nonzeros+1], last entry unused
+ *   row_sums: double[num_obs]
+ * Sections are zero padded to 8 bytes.  The checksum covers everything
+ * after the header.
+ */
+struct GwbHeader {
+	char magic[8];
+	uint32_t version;
+	uint32_t byte_order;
+	uint32_t flags;
+	int32_t num_obs;
+	int64_t num_nonzeros;
+	uint64_t ids_offset;
+	uint64_t offsets_offset;
+	uint64_t nbrs_offset;
+	uint64_t weights_offset;
+	uint64_t row_sums_offset;
+	uint64_t file_size;
+	uint64_t checksum;
+	
+	static const uint32_t current_version = 1;
+	static const uint32_t native_byte_order = 0x01020304;
+	/** Set if the weights are general (GWT) rather than binary (GAL). */
+	static const uint32_t flag_gwt = 1;
+};
+
+/** Header fields and ID map of a .gwb file. */
+struct GwbMetaInfo {
+	GwbMetaInfo() : is_gwt(false), num_obs(0), num_nonzeros(0) {}
+	bool is_gwt;
+	int num_obs;
+	int64_t num_nonzeros;
+	wxString layer_name;
+	wxString id_var_name;
+	std::vector<wxString> ids; // empty if id_var_name is empty
+};
+
+namespace Gda {
+	/** Writes w to ofname with the extension set to gwb.  id_vec holds the
+	 ID of every row, an empty id_var_name means record order.  is_gwt
+	 selects whether the file is read back as GWT or GAL weights. */
+	bool SaveGwb(const CsrWeight& w, bool is_gwt,
+				 const wxString& layer_name,
+				 const wxString& ofname,
+				 const wxString& id_var_name,
+				 const std::vector<wxInt64>& id_vec);
+	bool SaveGwb(const CsrWeight& w, bool is_gwt,
+				 const wxString& layer_name,
+				 const wxString& ofname,
+				 const wxString& id_var_name,
+				 const std::vector<wxString>& id_vec);
+	
+	/** Maps a .gwb file and returns the matrix, which refers to the mapped
+	 arrays directly.  The header, checksum and matrix structure are
+	 validated first.  Returns 0 and sets err_msg if the file cannot be
+	 used.  If meta is given, it receives the header and, if read_ids is
+	 true, the ID map. */
+	CsrWeight* OpenGwb(const wxString& fname, wxString& err_msg,
+					   GwbMetaInfo* meta = 0, bool read_ids = true);
+	/** Reads only the header and ID variable name of a .gwb file. */
+	bool ReadGwbMetaInfo(const wxString& fname, GwbMetaInfo& meta);
+}
+
+#endif
@@ -24,6 +24,7 @@
 #include "../DataViewer/TableInterface.h"
 #include "../GenUtils.h"
 #include "../Project.h"
+#include "CsrWeight.h"
 #include "GwtWeight.h"
 
 
@@ -76,6 +77,12 @@ void GwtWeight::Update(const std::vector<bool>& undefs)
     
 }
 
+CsrWeight* GwtWeight::CreateCsr()
+{
+    if (!gwt) return 0;
+    return new CsrWeight(gwt, num_obs);
+}
+
 bool GwtWeight::HasIsolates(GwtElement *gwt, int num_obs)
 {
 	if (!gwt) return false;
@@ -79,6 +79,9 @@ public:
     virtual bool SaveSpaceTimeWeights(const wxString& ofname, WeightsManInterface* wmi, TableInterface* table_int);
     
     virtual void Update(const std::vector<bool>& undefs);
+    
+protected:
+	virtual CsrWeight* CreateCsr();
 };
 
 namespace Gda {
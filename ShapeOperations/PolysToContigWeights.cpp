@@ -22,9 +22,12 @@
 #include <fstream>
 #include <iostream>
 #include <iomanip>
+#include <algorithm>
 #include <cmath>
+#include <string.h>
 #include <time.h>
 #include <vector>
+#include <boost/bind.hpp>
 
 #include <wx/wxprec.h>
 #ifndef WX_PRECOMP
@@ -35,11 +38,15 @@
 #include "BasePoint.h"
 #include "Box.h"
 #include "../ShpFile.h"
+#include "ShpMappedMain.h"
 #include "ShapeFile.h"
 #include "ShapeFileHdr.h"
 
 #include "../logger.h"
+#include "../GdaAsyncTask.h"
+#include "../GdaThreadPool.h"
 #include "../GenUtils.h"
+#include "../SpatialIndAlgs.h"
 #include "PolysToContigWeights.h"
 
 using namespace std;
@@ -972,333 +979,452 @@ oShapeFile& MultiPoint::WriteShape(oShapeFile &s) const {
   return s;
 }
 
-typedef struct Ref  {
-	int next, prev;
-	Ref(const int nxt= -1, const int prv= -1) : next(nxt), prev(prv) {};
-} RefStruct;
+////////////////////////////////////////////////////////////////////////////////
+//
+// Hashed contiguity
+//
+////////////////////////////////////////////////////////////////////////////////
 
-typedef RefStruct* RefPtr;
+// polygons per task
+static const int contig_grain = 1024;
 
-/*
- PartitionM
- */
-class PartitionM  {
-	private :
-	double      step;
-	int         elements, cells;
-	int *       cell;
-	int *       cellIndex;
-	int *       lastIndex;
-	RefPtr *    Refs;
-	public :
-	PartitionM(const int els, const int cls, const double range);
-	virtual ~PartitionM();
-	
-	void include(const int incl);
-	void remove(const int del);
-	void initIx(const int incl, const double lwr, const double upr);
-	int lowest (const int el) const  {  return cellIndex [ el ];  };
-	int upmost(const int el) const  {  return lastIndex [ el ];  };
-	int first(const int cl) const  {  return cell[ cl ];  };
-	int tail(const int elt, const int cl) const  {
-		return Refs[elt][cl-cellIndex[elt]].next;
-	};
-	int Sum() const;
-};
-
-/*
- PartitionM
- Constructor to initialize the partition
- */
-PartitionM::PartitionM(const int els, const int cls, const double range) :
-elements(els), cells(cls)  {
-	cell= new int[ cells ];
-	cellIndex= new int [ elements ];
-	lastIndex= new int [ elements ];
-	int cnt;
-	for (cnt= 0; cnt < cells; ++cnt)
-		cell [ cnt ] = GdaConst::EMPTY;
-	Refs= new RefPtr [ elements ];
-	for (cnt= 0; cnt < elements; ++cnt)
-		Refs[cnt]= NULL;
-	step= range / cells;
-	return;
+/** True if token is given and was cancelled.  Checked once per task. */
+static bool contig_cancelled(const GdaCancelToken* token)
+{
+	return token && token->IsCancelled();
 }
+// vertex and edge keys are partitioned on the top 8 bits of their hash
+static const int contig_buckets = 256;
+// keys held at once, 16 bytes each: at most 128 MB unless a single
+// bucket is larger
+static const size_t contig_max_keys = (size_t) 1 << 23;
 
-PartitionM::~PartitionM()  {
-	if (cell)  {
-		delete [] cell;
-		cell= NULL;
-	};
-	if (cellIndex)  {
-		delete [] cellIndex;
-		cellIndex= NULL;
-	};
-	if (lastIndex)  {
-		delete [] lastIndex;
-		lastIndex= NULL;
-	};
-	if (Refs)  {
-		for (int ref= 0; ref < elements; ++ref)
-			if (Refs[ref]) delete [] Refs[ref];
-		delete [] Refs;
-		Refs= NULL;
-	};
-	cells= 0;
-	elements= 0;
-	return;
+static Shapefile::PolygonContents* GetPolygon(Shapefile::Main& main, int i)
+{
+	Shapefile::RecordContents* rec = main.records[i].contents_p;
+	Shapefile::PolygonContents* ply =
+		dynamic_cast<Shapefile::PolygonContents*>(rec);
+	if (ply && ply->num_points <= 0) return 0;
+	return ply;
 }
 
-int PartitionM::Sum() const {
-	int sum= 0;
-	for (int cnt= 0; cnt < elements; ++cnt)
-		sum += (lastIndex[cnt] - cellIndex[cnt] + 1);
-	return sum;
+/** Decoded polygon with the accessors of Shapefile::RecordView. */
+class PolygonRef {
+public:
+	PolygonRef(Shapefile::PolygonContents* p_s) : p(p_s) {}
+	bool IsNull() const { return !p; }
+	int GetNumParts() const { return p->num_parts; }
+	int GetNumPoints() const { return p->num_points; }
+	int GetPart(int j) const { return p->parts[j]; }
+	const Shapefile::Point& GetPoint(int v) const { return p->points[v]; }
+	double GetBox(int k) const { return p->box[k]; }
+	Shapefile::PolygonContents* Get() const { return p; }
+private:
+	Shapefile::PolygonContents* p;
 };
 
-void PartitionM::initIx(const int incl, const double lwr, const double upr)  {
-    int lower= (int)floor(lwr/step);
-    int upper= (int)floor(upr/step);
-    
-    
-    if (lower < 0) {
-        lower= 0;
-    } else if (lower >= cells) {
-        lower= cells-1;
-    }
-    
-    if (upper >= cells) {
-        upper= cells-1;
-    }
-    else if (upper < 0) {
-        upper= 0;
-    }
-    
-    if (lower < 0 || upper > cells || incl < 0 || incl >= elements)
-    {
-        //     cout << "PartM: incl= " << incl << " l= " << lwr << "  " << upr;
-        exit(1);
-    }
-
-    
-	cellIndex [ incl ] = lower;
-	lastIndex [ incl ] = upper;
-	return;
-}
-
-/*
- PartitionM::include
- Include element incl with duration [lower, upper] into the partition.
- */
+/** The builders below read polygons from a source with Size() and
+ Get(i), where Get(i) is null for null or empty polygons.  MainPolys
+ serves the decoded records of a Shapefile::Main, MappedPolys the
+ records of a mapped shapefile in place. */
+class MainPolys {
+public:
+	typedef PolygonRef Poly;
+	MainPolys(Shapefile::Main& main_s) : main(main_s) {}
+	int Size() const { return main.records.size(); }
+	Poly Get(int i) const { return PolygonRef(GetPolygon(main, i)); }
+private:
+	Shapefile::Main& main;
+};
 
-void PartitionM::include(const int incl)  {
-	int cnt, lower= cellIndex [ incl ], upper= lastIndex [ incl ];
-	RefPtr rptr= new RefStruct[ upper - lower + 1 ];
-	Refs[incl]= rptr;
-	for (cnt= upper-lower; cnt >= 0; --cnt)
-		rptr[cnt]= Ref();
-	for (cnt= lower; cnt <= upper; ++cnt)  {
-		int old= cell [ cnt ];            // first element in the cell
-		cell [ cnt ] = incl;              // new first element in the cell
-		if (old != GdaConst::EMPTY)  {  // the cell was not empty
-			rptr[cnt-lower].next = old; // OLD is the next element after incl in the list
-			Refs[old][cnt-cellIndex[old]].prev= incl;    // incl is preceeding OLD in the list
-		};
-	};
-	return;
+class MappedPolys {
+public:
+	typedef Shapefile::RecordView Poly;
+	MappedPolys(const Shapefile::MappedMain& main_s) : main(main_s) {}
+	int Size() const { return main.GetNumRecords(); }
+	Poly Get(int i) const {
+		Shapefile::RecordView r = main.GetRecord(i);
+		if (r.IsNull() || r.GetNumPoints() <= 0) return Poly();
+		return r;
+	}
+private:
+	const Shapefile::MappedMain& main;
 };
 
-/*
- PartitionM::remove
- Remove an element del from the partition.
- */
-void PartitionM::remove(const int del)  {
-	int   lower= cellIndex[ del ], upper= lastIndex [ del ], cnt;
-	for (cnt= lower; cnt <= upper; ++cnt)  {
-		RefStruct  cRef= Refs[del][cnt-lower];
-		if (cRef.prev < 0)       // this is the first element in the list
-			cell[ cnt ]= cRef.next;
-		else
-			Refs[cRef.prev][ cnt-cellIndex[cRef.prev] ].next= cRef.next;
-		if (cRef.next != GdaConst::EMPTY)  // this is not the last element in the list
-			Refs[cRef.next][cnt-cellIndex[cRef.next]].prev= cRef.prev;
-	};
-	delete [] Refs[del];
-	Refs[del]= NULL;
-	return;
+/** Polygon as needed by SpatialIndAlgs::comp_polys, decoded into tmp
+ if it is only a view. */
+static Shapefile::PolygonContents* Decoded(const PolygonRef& p,
+										   Shapefile::PolygonContents& tmp)
+{
+	return p.Get();
 }
 
+static Shapefile::PolygonContents* Decoded(const Shapefile::RecordView& r,
+										   Shapefile::PolygonContents& tmp)
+{
+	r.GetPolygon(tmp);
+	return &tmp;
+}
 
+static uint64_t HashPoint(const Shapefile::Point& pt)
+{
+	// adding 0.0 turns -0.0 into 0.0, which compare equal
+	double x = pt.x + 0.0, y = pt.y + 0.0;
+	uint64_t bx, by;
+	memcpy(&bx, &x, sizeof(bx));
+	memcpy(&by, &y, sizeof(by));
+	return Gda::ThomasWangHashUInt64(bx ^ Gda::ThomasWangHashUInt64(by));
+}
 
-// # of records in the Shapefile == dimesion of the weights matrix
-static long         gRecords= 0;
-// locations of the polygon records in the shp file
-static long *       gOffset= NULL;
-// bounding boxes for each polygon
-static Box *        gBox= NULL;
-// bounding box for the entire map
-static Box          gBigBox;
-// partition constructed on lower(x) and upper(x) for each polygon
-static BasePartition  gMinX, gMaxX;
-// partition constructed on y for each polygon
-static PartitionM * gY;
-
-
-GalElement* MakeContiguity(Shapefile::Main& main, bool is_queen,
-                           double precision_threshold=0.0)
+static bool PointLess(const Shapefile::Point& a, const Shapefile::Point& b)
 {
-	using namespace Shapefile;
-	int curr;
-	GalElement * gl= new GalElement [ gRecords ];
+	return a.x < b.x || (a.x == b.x && a.y < b.y);
+}
+
+/** Polygon pairs sharing a vertex (queen) or an edge (rook) exactly.
+ Every vertex or edge becomes a 64-bit hash key.  Keys are counted per
+ bucket in parallel over polygons.  Consecutive buckets are then grouped
+ into passes of at most contig_max_keys keys; each pass scatters only its
+ own keys, again in parallel over polygons, and sorts and scans its
+ buckets for equal keys in parallel.  A map with more keys than that is
+ hashed once per pass, in exchange for never holding all of its 16-byte
+ keys at the same time.  Equal hashes are checked against the actual
+ coordinates, so hash collisions never create neighbors. */
+template <class Polys>
+class ContigHasher {
+public:
+	ContigHasher(const Polys& src_s, bool is_queen_s,
+				 const GdaCancelToken* token_s)
+	: src(src_s), is_queen(is_queen_s), token(token_s),
+	num_obs(src_s.Size()),
+	num_chunks((num_obs + contig_grain - 1) / contig_grain),
+	counts(num_chunks * contig_buckets, 0), bucket_pairs(contig_buckets) {}
 	
-	if (!gl) return NULL;
-	GeoDaSet   Neighbors(gRecords), Related(gRecords);
-	//  cout << "total steps= " << gMinX.Cells() << endl;
-	for (int step= 0; step < gMinX.Cells(); ++step) {
-		// include all elements from xmin[step]
-		for (curr= gMinX.first(step); curr != GdaConst::EMPTY;
-             curr= gMinX.tail(curr))
-        {
-            gY->include(curr);
-        }
-		
-		// test each element in xmax[step]
-		for (curr= gMaxX.first(step); curr != GdaConst::EMPTY;
-             curr= gMaxX.tail(curr))
-        {
-            RecordContents* rec = main.records[curr].contents_p;
-			PolygonContents* ply = dynamic_cast<PolygonContents*> (rec);
-			PolygonPartition testPoly(ply);
-			testPoly.MakePartition();
-			
-			// form a list of neighbors
-			for (int cell=gY->lowest(curr); cell <= gY->upmost(curr); ++cell) {
-				int potential = gY->first( cell );
-				while (potential != GdaConst::EMPTY) {
-					if (potential != curr) Neighbors.Push( potential );
-					potential = gY->tail(potential, cell);
-				}
+	void Run(std::vector<std::vector<std::pair<int, int> > >& pairs)
+	{
+		GdaThreadPool* pool = GdaThreadPool::GetInstance();
+		pool->ParallelFor(0, num_obs-1, contig_grain,
+			boost::bind(&ContigHasher::CountKeys, this, _1, _2));
+		std::vector<size_t> bucket_size(contig_buckets, 0);
+		for (int c=0; c<num_chunks; c++) {
+			for (int b=0; b<contig_buckets; b++) {
+				bucket_size[b] += counts[c*contig_buckets + b];
 			}
-			
-			// test each potential neighbor
-			for (int nbr = Neighbors.Pop(); nbr != GdaConst::EMPTY;
-					 nbr = Neighbors.Pop()) {
-                RecordContents* nbr_rec = main.records[nbr].contents_p;
-                PolygonContents* nbr_ply = dynamic_cast<PolygonContents*>(nbr_rec);
-                
-				if (ply->intersect(nbr_ply)) {
-					
-					PolygonPartition nbrPoly(nbr_ply);
-					//shp.seekg(gOffset[nbr]+12, ios::beg);
-					//nbrPoly.ReadShape(shp);
-					
-					if (curr == 0 && nbr == 0) {
-						
-					}
-					// run sweep with testPoly as a host and nbrPoly as a guest
-					int related = testPoly.sweep(nbrPoly, is_queen, precision_threshold);
-					if (related) Related.Push(nbr);
-				}
+		}
+		pos.resize(counts.size());
+		bucket_start.resize(contig_buckets+1, 0);
+		for (pass_first=0; pass_first<contig_buckets &&
+			 !contig_cancelled(token); pass_first=pass_last+1)
+		{
+			pass_last = pass_first;
+			size_t total = bucket_size[pass_first];
+			while (pass_last+1 < contig_buckets &&
+				   total + bucket_size[pass_last+1] <= contig_max_keys) {
+				total += bucket_size[++pass_last];
 			}
-			
-			
-			if (size_t sz = Related.Size()) {
-				gl[curr].SetSizeNbrs(sz);
-                for (size_t i=0; i<sz; ++i) {
-                    gl[curr].SetNbr(i, Related.Pop());
-                }
+			// keys of bucket b from chunk c start at pos[c*contig_buckets+b]
+			total = 0;
+			for (int b=pass_first; b<=pass_last; b++) {
+				bucket_start[b] = total;
+				for (int c=0; c<num_chunks; c++) {
+					pos[c*contig_buckets + b] = total;
+					total += counts[c*contig_buckets + b];
+				}
 			}
-			
-			gY->remove(curr);       // remove from the partition
+			bucket_start[pass_last+1] = total;
+			keys.resize(total);
+			pool->ParallelFor(0, num_obs-1, contig_grain,
+				boost::bind(&ContigHasher::ScatterKeys, this, _1, _2));
+			pool->ParallelFor(pass_first, pass_last, 1,
+				boost::bind(&ContigHasher::MatchBuckets, this, _1, _2));
 		}
+		std::vector<Key>().swap(keys);
+		pairs.swap(bucket_pairs);
 	}
 	
-	return gl;
-}
-
-
-void MakeFull(GalElement* W, size_t obs)
-{
-	using namespace std;
-	vector<set<long> > G(obs);
-	for (size_t i=0; i<obs; ++i) {
-		for (size_t j=0, sz=W[i].Size(); j<sz; ++j) {
-			G[i].insert(W[i][j]);
-			G[W[i][j]].insert(i);
+protected:
+	struct Key {
+		uint64_t h;
+		int poly;
+		int vert; // the vertex, or the first vertex of the edge
+		bool operator<(const Key& k) const {
+			return h < k.h || (h == k.h && poly < k.poly);
 		}
-	}
-	for (size_t i=0; i<obs; ++i) {
-		if (W[i].Size() == G[i].size()) continue;
-		W[i].SetSizeNbrs(G[i].size());
-		size_t cnt = 0;
-		for (set<long>::iterator it=G[i].begin(); it!=G[i].end(); ++it) {
-			W[i].SetNbr(cnt++, *it);
+	};
+	
+	/** Calls f(h, vert) for every key of polygon i. */
+	template <class F> void ForEachKey(int i, F& f)
+	{
+		typename Polys::Poly ply = src.Get(i);
+		if (ply.IsNull()) return;
+		int num_points = ply.GetNumPoints();
+		if (is_queen) {
+			for (int v=0; v<num_points; v++) {
+				f(HashPoint(ply.GetPoint(v)), v);
+			}
+			return;
+		}
+		int num_parts = ply.GetNumParts();
+		for (int part=0; part<num_parts; part++) {
+			int first = ply.GetPart(part);
+			int last = (part+1 < num_parts) ? ply.GetPart(part+1) : num_points;
+			for (int v=first; v+1<last; v++) {
+				f(EdgeHash(ply.GetPoint(v), ply.GetPoint(v+1)), v);
+			}
 		}
-		W[i].SortNbrs();
 	}
-}
-
-
-
-GalElement* PolysToContigWeights(Shapefile::Main& main, bool is_queen,
-                                 double precision_threshold)
-{
-	using namespace Shapefile;
 	
-	gRecords = main.records.size();
-	double shp_min_x = (double)main.header.bbox_x_min;
-	double shp_max_x = (double)main.header.bbox_x_max;
-	double shp_min_y = (double)main.header.bbox_y_min;
-	double shp_max_y = (double)main.header.bbox_y_max;
-	double shp_x_len = shp_max_x - shp_min_x;
-	double shp_y_len = shp_max_y - shp_min_y;
+	static uint64_t EdgeHash(const Shapefile::Point& a,
+							 const Shapefile::Point& b)
+	{
+		uint64_t ha = HashPoint(a), hb = HashPoint(b);
+		if (PointLess(b, a)) std::swap(ha, hb);
+		return Gda::ThomasWangHashUInt64(ha ^ (hb * 0x9E3779B97F4A7C15ULL));
+	}
 	
-	long gx, gy, cnt, total=0;
-	gx= gRecords / 8 + 2;
+	struct Counter {
+		int* c;
+		void operator()(uint64_t h, int v) { c[h >> 56]++; }
+	};
+	struct Scatter {
+		std::vector<Key>* keys;
+		size_t* p;
+		int poly;
+		int first, last; // buckets of the current pass
+		void operator()(uint64_t h, int v) {
+			int b = (int) (h >> 56);
+			if (b < first || b > last) return;
+			Key& k = (*keys)[p[b]++];
+			k.h = h; k.poly = poly; k.vert = v;
+		}
+	};
 	
-	gMinX.alloc(gRecords, gx, shp_x_len );
-	gMaxX.alloc(gRecords, gx, shp_x_len );
+	void CountKeys(int a, int b)
+	{
+		if (contig_cancelled(token)) return;
+		Counter f;
+		f.c = &counts[(a / contig_grain) * contig_buckets];
+		for (int i=a; i<=b; i++) ForEachKey(i, f);
+	}
 	
-	for (cnt= 0; cnt < gRecords; ++cnt) {
-        RecordContents* rec = main.records[cnt].contents_p;
-		PolygonContents* ply = dynamic_cast<PolygonContents*>(rec);
+	void ScatterKeys(int a, int b)
+	{
+		if (contig_cancelled(token)) return;
+		Scatter f;
+		f.keys = &keys;
+		f.p = &pos[(a / contig_grain) * contig_buckets];
+		f.first = pass_first;
+		f.last = pass_last;
+		for (int i=a; i<=b; i++) {
+			f.poly = i;
+			ForEachKey(i, f);
+		}
+	}
 	
-		gMinX.include( cnt, ply->box[0] - shp_min_x );
-		gMaxX.include( cnt, ply->box[2] - shp_min_x );
+	bool SameKey(const Key& k1, const Key& k2)
+	{
+		typename Polys::Poly p1 = src.Get(k1.poly);
+		typename Polys::Poly p2 = src.Get(k2.poly);
+		Shapefile::Point a1 = p1.GetPoint(k1.vert);
+		Shapefile::Point a2 = p2.GetPoint(k2.vert);
+		if (is_queen) return a1.x == a2.x && a1.y == a2.y;
+		Shapefile::Point b1 = p1.GetPoint(k1.vert+1);
+		Shapefile::Point b2 = p2.GetPoint(k2.vert+1);
+		return ((a1.x == a2.x && a1.y == a2.y && b1.x == b2.x && b1.y == b2.y)
+				|| (a1.x == b2.x && a1.y == b2.y &&
+					b1.x == a2.x && b1.y == a2.y));
 	}
 	
-	gy= (int)(sqrt((long double)gRecords) + 2);
-	do {
-		gY= new PartitionM(gRecords, gy, shp_y_len );
-		for (cnt= 0; cnt < gRecords; ++cnt) {
-            RecordContents* rec = main.records[cnt].contents_p;
-			PolygonContents* ply = dynamic_cast<PolygonContents*>(rec);
-            double lwr = ply->box[1] - shp_min_y;
-            double upr = ply->box[3] - shp_min_y;
-			gY->initIx(cnt, lwr, upr);
+	void MatchBuckets(int b_start, int b_end)
+	{
+		if (contig_cancelled(token)) return;
+		for (int b=b_start; b<=b_end; b++) {
+			typename std::vector<Key>::iterator first =
+				keys.begin()+bucket_start[b];
+			typename std::vector<Key>::iterator last =
+				keys.begin()+bucket_start[b+1];
+			std::sort(first, last);
+			std::vector<std::pair<int, int> >& out = bucket_pairs[b];
+			for (typename std::vector<Key>::iterator i=first; i!=last; ) {
+				typename std::vector<Key>::iterator j = i+1;
+				while (j != last && j->h == i->h) ++j;
+				// sorted by poly within the run, so only later polygons
+				for (typename std::vector<Key>::iterator x=i; x!=j; ++x) {
+					for (typename std::vector<Key>::iterator y=x+1; y!=j; ++y) {
+						if (y->poly != x->poly && SameKey(*x, *y)) {
+							out.push_back(std::make_pair(x->poly, y->poly));
+						}
+					}
+				}
+				i = j;
+			}
 		}
-		total= gY->Sum();
-		if (total > gRecords * 8) {
-			delete gY;
-			gy = gy/2 + 1;
-			total= 0;
+	}
+	
+	Polys src;
+	bool is_queen;
+	const GdaCancelToken* token;
+	int num_obs;
+	int num_chunks;
+	std::vector<int> counts;
+	std::vector<size_t> pos;
+	std::vector<size_t> bucket_start; // of the current pass
+	int pass_first, pass_last;
+	std::vector<Key> keys; // keys of the current pass
+	std::vector<std::vector<std::pair<int, int> > > bucket_pairs;
+};
+
+/** Polygon pairs whose vertices match within precision_threshold.  The
+ bounding boxes, grown by the threshold, are bulk loaded into an R-tree;
+ every polygon queries it for overlapping boxes in parallel and the
+ candidates are tested with SpatialIndAlgs::comp_polys. */
+template <class Polys>
+class ContigNearMatcher {
+public:
+	ContigNearMatcher(const Polys& src_s, bool is_queen_s,
+					  double precision_threshold,
+					  const GdaCancelToken* token_s)
+	: src(src_s), is_queen(is_queen_s), prec(precision_threshold),
+	token(token_s),
+	num_obs(src_s.Size()),
+	chunk_pairs((num_obs + contig_grain - 1) / contig_grain) {}
+	
+	void Run(std::vector<std::vector<std::pair<int, int> > >& pairs)
+	{
+		std::vector<box_2d_val> boxes;
+		boxes.reserve(num_obs);
+		for (int i=0; i<num_obs; i++) {
+			box_2d b;
+			if (GetBox(i, b)) boxes.push_back(std::make_pair(b, i));
 		}
-	} while ( total == 0);
+		// packing constructor: bulk load, much faster than inserting
+		rtree_box_2d_t rtree_s(boxes.begin(), boxes.end());
+		rtree = &rtree_s;
+		GdaThreadPool::GetInstance()->
+			ParallelFor(0, num_obs-1, contig_grain,
+				boost::bind(&ContigNearMatcher::Match, this, _1, _2));
+		rtree = 0;
+		pairs.swap(chunk_pairs);
+	}
 	
-	GalElement * gl= MakeContiguity(main, is_queen, precision_threshold);
+protected:
+	bool GetBox(int i, box_2d& b)
+	{
+		typename Polys::Poly ply = src.Get(i);
+		if (ply.IsNull()) return false;
+		b = box_2d(pt_2d(ply.GetBox(0)-prec, ply.GetBox(1)-prec),
+				   pt_2d(ply.GetBox(2)+prec, ply.GetBox(3)+prec));
+		return true;
+	}
 	
-	if (gY) delete gY; gY = 0;
-	if (gOffset) delete [] gOffset; gOffset = 0;
-	if (gBox) delete [] gBox; gBox = 0;
+	void Match(int a, int b)
+	{
+		if (contig_cancelled(token)) return;
+		std::vector<std::pair<int, int> >& out = chunk_pairs[a/contig_grain];
+		std::vector<box_2d_val> hits;
+		Shapefile::PolygonContents tmp_i, tmp_j;
+		for (int i=a; i<=b; i++) {
+			box_2d bx;
+			if (!GetBox(i, bx)) continue;
+			hits.clear();
+			rtree->query(bgi::intersects(bx), std::back_inserter(hits));
+			Shapefile::PolygonContents* ply_i = 0;
+			for (size_t h=0; h<hits.size(); h++) {
+				int j = hits[h].second;
+				if (j <= i) continue;
+				if (!ply_i) ply_i = Decoded(src.Get(i), tmp_i);
+				if (SpatialIndAlgs::comp_polys(ply_i,
+											   Decoded(src.Get(j), tmp_j),
+											   !is_queen, prec)) {
+					out.push_back(std::make_pair(i, j));
+				}
+			}
+		}
+	}
 	
-	MakeFull(gl, gRecords);
+	Polys src;
+	bool is_queen;
+	double prec;
+	const GdaCancelToken* token;
+	int num_obs;
+	const rtree_box_2d_t* rtree;
+	std::vector<std::vector<std::pair<int, int> > > chunk_pairs;
+};
+
+/** Symmetric GAL from lists of neighbor pairs, which may contain
+ duplicates.  Neighbors are sorted in descending order as MakeFull
+ leaves them. */
+static GalElement* MakeGalFromPairs(
+				const std::vector<std::vector<std::pair<int, int> > >& pairs,
+				int num_obs)
+{
+	std::vector<int> offsets(num_obs+1, 0);
+	for (size_t l=0; l<pairs.size(); l++) {
+		for (size_t k=0; k<pairs[l].size(); k++) {
+			offsets[pairs[l][k].first+1]++;
+			offsets[pairs[l][k].second+1]++;
+		}
+	}
+	for (int i=0; i<num_obs; i++) offsets[i+1] += offsets[i];
+	std::vector<int> nbrs(offsets[num_obs]);
+	std::vector<int> fill(offsets.begin(), offsets.end()-1);
+	for (size_t l=0; l<pairs.size(); l++) {
+		for (size_t k=0; k<pairs[l].size(); k++) {
+			int i = pairs[l][k].first, j = pairs[l][k].second;
+			nbrs[fill[i]++] = j;
+			nbrs[fill[j]++] = i;
+		}
+	}
+	GalElement* gl = new GalElement[num_obs];
+	for (int i=0; i<num_obs; i++) {
+		std::vector<int>::iterator first = nbrs.begin()+offsets[i];
+		std::vector<int>::iterator last = nbrs.begin()+offsets[i+1];
+		std::sort(first, last, std::greater<int>());
+		last = std::unique(first, last);
+		size_t sz = last - first;
+		if (sz == 0) continue;
+		gl[i].SetSizeNbrs(sz);
+		for (size_t k=0; k<sz; k++) gl[i].SetNbr(k, first[k]);
+	}
 	return gl;
 }
 
+/** Queen or rook neighbors of every polygon.  With a zero precision_threshold, shared vertices or
+ edges are found by hashing; otherwise near matches are resolved with an
+ R-tree of the polygon bounding boxes.  Both run on all cores. */
+template <class Polys>
+static GalElement* ContigFromPolys(const Polys& src, bool is_queen,
+								   double precision_threshold,
+								   const GdaCancelToken* token)
+{
+	int num_obs = src.Size();
+	std::vector<std::vector<std::pair<int, int> > > pairs;
+	if (num_obs > 0) {
+		if (precision_threshold > 0) {
+			ContigNearMatcher<Polys> m(src, is_queen, precision_threshold,
+									   token);
+			m.Run(pairs);
+		} else {
+			ContigHasher<Polys> h(src, is_queen, token);
+			h.Run(pairs);
+		}
+	}
+	if (contig_cancelled(token)) return 0;
+	return MakeGalFromPairs(pairs, num_obs);
+}
 
+GalElement* PolysToContigWeights(Shapefile::Main& main, bool is_queen,
+                                 double precision_threshold,
+								 const GdaCancelToken* token)
+{
+	return ContigFromPolys(MainPolys(main), is_queen, precision_threshold,
+						   token);
+}
 
-
-
-
-
-
+GalElement* PolysToContigWeights(const Shapefile::MappedMain& main,
+								 bool is_queen, double precision_threshold,
+								 const GdaCancelToken* token)
+{
+	return ContigFromPolys(MappedPolys(main), is_queen, precision_threshold,
+						   token);
+}
@@ -27,9 +27,25 @@
 #include "GalWeight.h"
 #include "../ShpFile.h"
 
+namespace Shapefile { class MappedMain; }
+class GdaCancelToken;
+
+/** Queen (shared vertex) or rook (shared edge) contiguity.  Vertices
+ whose coordinates differ by at most precision_threshold are treated as
+ the same point.  Returns 0 if token is given and gets cancelled. */
 GalElement* PolysToContigWeights(Shapefile::Main& main,
 																 bool is_queen,
-																 double precision_threshold=0.0);
+																 double precision_threshold=0.0,
+								 const GdaCancelToken* token=0);
+
+/** PolysToContigWeights reading the polygons in place from a mapped
+ shapefile.  Only polygons that are compared within precision_threshold
+ are decoded, one pair at a time. */
+GalElement* PolysToContigWeights(const Shapefile::MappedMain& main,
+								 bool is_queen,
+								 double precision_threshold=0.0,
+								 const GdaCancelToken* token=0);
+
 
 
 #endif
@@ -18,6 +18,7 @@
  */
 
 #include <math.h>
+#include "CsrWeight.h"
 #include "GalWeight.h"
 #include "RateSmoothing.h"
 
@@ -209,15 +210,12 @@ bool GdaAlgs::RateSmoother_SEBS(int obs, WeightsManInterface* w_man_int,
             break;
         }
     }
-    GalElement* gal = NULL;
-    GalWeight* gw  = NULL;
-    
+    // drop undefined neighbors from a CSR copy instead of copying the GAL
+    const CsrWeight* W = w_man_int->GetGal(weights_id)->GetCsr();
+    CsrWeight* W_undef = NULL;
     if (has_undefined) {
-        gw = new GalWeight(*w_man_int->GetGal(weights_id));
-        gw->Update(undefined);
-        gal = gw->gal;
-    } else {
-        gal = w_man_int->GetGal(weights_id)->gal;
+        W_undef = new CsrWeight(*W, undefined);
+        W = W_undef;
     }
 
 	
@@ -239,8 +237,8 @@ bool GdaAlgs::RateSmoother_SEBS(int obs, WeightsManInterface* w_man_int,
 		if (undefined[i])
             continue;
         
-		int  nbrs = gal[i].Size();
-		GalElement& elt_i = gal[i];
+		int  nbrs = W->Size(i);
+		const int* elt_i = W->GetNbrs(i);
 		
 		double SP=P[i], SE=E[i];
 		
@@ -280,11 +278,7 @@ bool GdaAlgs::RateSmoother_SEBS(int obs, WeightsManInterface* w_man_int,
 	}
 	delete [] pi_raw;
    
-    if (has_undefined) {
-        if (gw) {
-            delete gw;
-        }
-    }
+    if (W_undef) delete W_undef;
     
     for (int i=0; i<obs; ++i) {
         if (undefined[i]) {
@@ -310,15 +304,12 @@ bool GdaAlgs::RateSmoother_SRS(int obs, WeightsManInterface* w_man_int,
             break;
         } 
     }
-    GalElement* gal = NULL;
-    GalWeight* gw  = NULL;
-    
+    // drop undefined neighbors from a CSR copy instead of copying the GAL
+    const CsrWeight* W = w_man_int->GetGal(weights_id)->GetCsr();
+    CsrWeight* W_undef = NULL;
     if (has_undefined) {
-        gw = new GalWeight(*w_man_int->GetGal(weights_id));
-        gw->Update(undefined);
-        gal = gw->gal;
-    } else {
-        gal = w_man_int->GetGal(weights_id)->gal;
+        W_undef = new CsrWeight(*W, undefined);
+        W = W_undef;
     }
 	
 	double SE = 0, SP=0;
@@ -329,8 +320,8 @@ bool GdaAlgs::RateSmoother_SRS(int obs, WeightsManInterface* w_man_int,
         if (undefined[i])
             continue;
         
-		const GalElement& elm_i = gal[i];
-		for (int j=0, sz=elm_i.Size(); j<sz; j++) {
+		const int* elm_i = W->GetNbrs(i);
+		for (int j=0, sz=W->Size(i); j<sz; j++) {
 			SE += E[elm_i[j]];
 			SP += P[elm_i[j]];
 		}
@@ -339,17 +330,13 @@ bool GdaAlgs::RateSmoother_SRS(int obs, WeightsManInterface* w_man_int,
 		} else {
 			undefined[i] = true;
 		}
-		if (gal[i].Size() <= 0) {
+		if (W->Size(i) <= 0) {
 			undefined[i] = true;
 			results[i] = 0;
 		}
 	}
   
-    if (has_undefined) {
-        if (gw) {
-            delete gw;
-        }
-    }
+    if (W_undef) delete W_undef;
     for (int i=0; i<obs; ++i) {
         if (undefined[i]) {
             has_undefined = true;
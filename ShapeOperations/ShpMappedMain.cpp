@@ -0,0 +1,213 @@
+/**
+ * GeoDa TM, Copyright (C) 2011-2015 by Luc Anselin - all rights reserved
+ *
+ * This file is part of GeoDa.
+ * 
+ * GeoDa is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+ *
+ * GeoDa is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program.  If not, see <http://www.gnu.org/licenses/>.
+ */
+
+
+#include "ShpMappedMain.h"
+
+using namespace Shapefile;
+
+namespace {
+	
+	wxInt32 read_int_be(const char* b)
+	{
+		wxInt32 x;
+		memcpy(&x, b, 4);
+		return wxINT32_SWAP_ON_LE(x);
+	}
+	
+	/** POINT_TYP, POLY_LINE or POLYGON for the Z and M variants too. */
+	wxInt32 base_shape_type(wxInt32 st)
+	{
+		if (st == POINT_Z || st == POINT_M) return POINT_TYP;
+		if (st == POLY_LINE_Z || st == POLY_LINE_M) return POLY_LINE;
+		if (st == POLYGON_Z || st == POLYGON_M) return POLYGON;
+		return st;
+	}
+	
+	/** PolyLineContents and PolygonContents have the same fields. */
+	template <class Contents>
+	void decode_parts_points(const RecordView& r, Contents& pc)
+	{
+		bool null_shape = r.IsNull();
+		pc.shape_type = null_shape ? NULL_SHAPE : r.GetShapeType();
+		pc.box.assign(4, 0);
+		pc.num_parts = null_shape ? 0 : r.GetNumParts();
+		pc.num_points = null_shape ? 0 : r.GetNumPoints();
+		pc.parts.resize(pc.num_parts);
+		pc.points.resize(pc.num_points);
+		if (null_shape) return;
+		for (int k=0; k<4; k++) pc.box[k] = r.GetBox(k);
+		for (int j=0; j<pc.num_parts; j++) pc.parts[j] = r.GetPart(j);
+		for (int v=0; v<pc.num_points; v++) pc.points[v] = r.GetPoint(v);
+	}
+}
+
+void RecordView::GetPoint(PointContents& pc) const
+{
+	pc.shape_type = IsNull() ? NULL_SHAPE : GetShapeType();
+	pc.x = IsNull() ? 0 : GetX();
+	pc.y = IsNull() ? 0 : GetY();
+}
+
+void RecordView::GetPolyLine(PolyLineContents& pc) const
+{
+	decode_parts_points(*this, pc);
+}
+
+void RecordView::GetPolygon(PolygonContents& pc) const
+{
+	decode_parts_points(*this, pc);
+}
+
+MappedMain::MappedMain()
+{
+}
+
+MappedMain::~MappedMain()
+{
+}
+
+void MappedMain::Close()
+{
+	shp.Close();
+	header = Header();
+	offsets.clear();
+}
+
+bool MappedMain::Open(const wxString& shp_fname, const wxString& shx_fname)
+{
+	Close();
+	if (!shp.Open(shp_fname) || shp.GetSize() < 100) {
+		Close();
+		return false;
+	}
+	const char* d = shp.GetData();
+	header.file_code = read_int_be(d);
+	header.file_length = read_int_be(d+24);
+	header.version = RecordView::ReadInt(d+28);
+	header.shape_type = base_shape_type(RecordView::ReadInt(d+32));
+	header.bbox_x_min = RecordView::ReadDouble(d+36);
+	header.bbox_y_min = RecordView::ReadDouble(d+44);
+	header.bbox_x_max = RecordView::ReadDouble(d+52);
+	header.bbox_y_max = RecordView::ReadDouble(d+60);
+	header.bbox_z_min = RecordView::ReadDouble(d+68);
+	header.bbox_z_max = RecordView::ReadDouble(d+76);
+	header.bbox_m_min = RecordView::ReadDouble(d+84);
+	header.bbox_m_max = RecordView::ReadDouble(d+92);
+	
+	bool ok = (header.file_code == 9994 &&
+			   (header.shape_type == POINT_TYP ||
+				header.shape_type == POLY_LINE ||
+				header.shape_type == POLYGON));
+	if (ok) {
+		ok = shx_fname.IsEmpty() ? IndexFromShp() : IndexFromShx(shx_fname);
+	}
+	if (!ok) Close();
+	return ok;
+}
+
+bool MappedMain::IndexFromShx(const wxString& shx_fname)
+{
+	GdaMappedFile shx;
+	if (!shx.Open(shx_fname) || shx.GetSize() < 100) return false;
+	const char* d = shx.GetData();
+	wxInt64 shx_end = 2 * (wxInt64) read_int_be(d+24);
+	if (shx_end > (wxInt64) shx.GetSize()) shx_end = shx.GetSize();
+	wxInt64 num_recs = (shx_end - 100) / 8;
+	offsets.reserve(num_recs);
+	for (wxInt64 i=0; i<num_recs; i++) {
+		if (!AddRecord(2 * (wxInt64) read_int_be(d + 100 + 8*i))) return false;
+	}
+	return true;
+}
+
+bool MappedMain::IndexFromShp()
+{
+	wxInt64 shp_end = 2 * (wxInt64) header.file_length;
+	if (shp_end > (wxInt64) shp.GetSize()) shp_end = shp.GetSize();
+	const char* d = shp.GetData();
+	for (wxInt64 pos = 100; pos + 8 <= shp_end; ) {
+		wxInt64 len = 2 * (wxInt64) read_int_be(d+pos+4);
+		if (read_int_be(d+pos) != (wxInt32) offsets.size()+1 || len < 4 ||
+			!AddRecord(pos)) return false;
+		pos += 8 + len;
+	}
+	return true;
+}
+
+/** Appends the record with header at rec_start if all of it, including
+ the parts and points arrays, lies within the file.  The content length
+ in the record header is not used for this: some writers get it wrong for
+ point files, and populateMain ignores it too. */
+bool MappedMain::AddRecord(wxInt64 rec_start)
+{
+	wxInt64 size = shp.GetSize();
+	if (rec_start < 100 || rec_start + 12 > size) return false;
+	wxInt64 start = rec_start + 8;
+	wxInt64 avail = size - start;
+	const char* p = shp.GetData() + start;
+	wxInt32 st = RecordView::ReadInt(p);
+	if (st != NULL_SHAPE) {
+		if (base_shape_type(st) != header.shape_type) return false;
+		if (header.shape_type == POINT_TYP) {
+			if (avail < 20) return false;
+		} else {
+			if (avail < 44) return false;
+			wxInt64 num_parts = RecordView::ReadInt(p+36);
+			wxInt64 num_points = RecordView::ReadInt(p+40);
+			if (num_parts < 0 || num_points < 0 ||
+				44 + 4*num_parts + 16*num_points > avail) return false;
+			for (wxInt64 j=0; j<num_parts; j++) {
+				wxInt32 first = RecordView::ReadInt(p+44+4*j);
+				if (first < 0 || first > num_points) return false;
+			}
+		}
+	}
+	offsets.push_back(start);
+	return true;
+}
+
+bool MappedMain::ToMain(Main& main_s) const
+{
+	if (!IsOpen()) return false;
+	main_s.header = header;
+	int n = GetNumRecords();
+	main_s.records.clear();
+	main_s.records.resize(n);
+	for (int i=0; i<n; i++) {
+		MainRecord& mr = main_s.records[i];
+		mr.header.record_number = i+1;
+		mr.header.content_length = read_int_be(shp.GetData()+offsets[i]-4);
+		RecordView r = GetRecord(i);
+		if (header.shape_type == POINT_TYP) {
+			PointContents* pc = new PointContents();
+			r.GetPoint(*pc);
+			mr.contents_p = pc;
+		} else if (header.shape_type == POLY_LINE) {
+			PolyLineContents* pc = new PolyLineContents();
+			r.GetPolyLine(*pc);
+			mr.contents_p = pc;
+		} else {
+			PolygonContents* pc = new PolygonContents();
+			r.GetPolygon(*pc);
+			mr.contents_p = pc;
+		}
+	}
+	return true;
+}
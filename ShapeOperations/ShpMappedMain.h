@@ -0,0 +1,167 @@
+/**
+ * GeoDa TM, Copyright (C) 2011-2015 by Luc Anselin - all rights reserved
+ *
+ * This file is part of GeoDa.
+ * 
+ * GeoDa is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+ *
+ * GeoDa is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program.  If not, see <http://www.gnu.org/licenses/>.
+ */
+
+
+#ifndef __GEODA_CENTER_SHP_MAPPED_MAIN_H__
+#define __GEODA_CENTER_SHP_MAPPED_MAIN_H__
+
+#include <string.h>
+#include <vector>
+#include <wx/defs.h>
+#include <wx/string.h>
+#include "../ShpFile.h"
+#include "GdaMappedFile.h"
+
+namespace Shapefile {
+	
+	/**
+	 Read-only view of the contents of one record of a memory mapped .shp
+	 file.  Nothing is copied: every accessor decodes the requested value
+	 from the mapped bytes, which are little endian and not necessarily
+	 aligned.  Point accessors are for point records, the others for
+	 polyline and polygon records.  The Z and M variants share the x/y
+	 layout, so their extra values are simply never looked at.
+	 
+	 A view is only valid as long as the MappedMain it came from is open.
+	 */
+	class RecordView {
+	public:
+		RecordView() : p(0), pts(0) {}
+		RecordView(const char* contents, wxInt32 shape_type)
+		: p(contents), pts(0) {
+			if ((shape_type == POLY_LINE || shape_type == POLYGON) &&
+				!IsNull()) {
+				pts = p + 44 + 4*GetNumParts();
+			}
+		}
+		
+		/** True for a NULL_SHAPE record or one missing from the file. */
+		bool IsNull() const { return !p || GetShapeType() == NULL_SHAPE; }
+		wxInt32 GetShapeType() const { return ReadInt(p); }
+		
+		wxFloat64 GetX() const { return ReadDouble(p+4); }
+		wxFloat64 GetY() const { return ReadDouble(p+12); }
+		
+		/** Bounding box in the order x_min, y_min, x_max, y_max. */
+		wxFloat64 GetBox(int k) const { return ReadDouble(p+4+8*k); }
+		wxInt32 GetNumParts() const { return ReadInt(p+36); }
+		wxInt32 GetNumPoints() const { return ReadInt(p+40); }
+		/** Index of the first point of part j. */
+		wxInt32 GetPart(int j) const { return ReadInt(p+44+4*j); }
+		/** One past the last point of part j. */
+		wxInt32 GetPartEnd(int j) const {
+			return j+1 < GetNumParts() ? GetPart(j+1) : GetNumPoints();
+		}
+		wxFloat64 GetPointX(int v) const { return ReadDouble(pts+16*v); }
+		wxFloat64 GetPointY(int v) const { return ReadDouble(pts+16*v+8); }
+		Point GetPoint(int v) const {
+			return Point(GetPointX(v), GetPointY(v));
+		}
+		
+		/** Decode the whole record, for code that needs the classic
+		 structures. */
+		void GetPoint(PointContents& pc) const;
+		void GetPolyLine(PolyLineContents& pc) const;
+		void GetPolygon(PolygonContents& pc) const;
+		
+		static wxInt32 ReadInt(const char* b) {
+			wxInt32 x;
+			memcpy(&x, b, 4);
+			return wxINT32_SWAP_ON_BE(x);
+		}
+		static wxFloat64 ReadDouble(const char* b) {
+#ifdef WORDS_BIGENDIAN
+			wxUint64 u;
+			memcpy(&u, b, 8);
+			u = wxUINT64_SWAP_ALWAYS(u);
+			wxFloat64 x;
+			memcpy(&x, &u, 8);
+			return x;
+#else
+			wxFloat64 x;
+			memcpy(&x, b, 8);
+			return x;
+#endif
+		}
+		
+	private:
+		const char* p; // record contents, after the record header
+		const char* pts; // first point of a polyline or polygon
+	};
+	
+	/**
+	 Memory mapped .shp file, the zero-copy counterpart of populateMain.
+	 Open() reads the header, finds every record through the .shx index
+	 (or by walking the .shp if there is none) and checks that each record,
+	 including its parts and points arrays, lies within the file.  After
+	 that GetRecord() only does pointer arithmetic, and the geometry is
+	 decoded when a consumer reads it.  Memory use is 8 bytes per record
+	 on top of the mapping, which the OS pages in and out as needed.
+	 
+	 As in populateMain, the shape type in the header is reduced to
+	 POINT_TYP, POLY_LINE or POLYGON for the Z and M variants.  Other shape
+	 types, MULTI_POINT included, are rejected.
+	 
+	 \code
+	 Shapefile::MappedMain shp;
+	 if (shp.Open(shp_fname, shx_fname)) {
+	     for (int i=0; i<shp.GetNumRecords(); i++) {
+	         Shapefile::RecordView r = shp.GetRecord(i);
+	         if (!r.IsNull()) use(r.GetNumPoints(), r.GetPointX(0));
+	     }
+	 }
+	 \endcode
+	 */
+	class MappedMain {
+	public:
+		MappedMain();
+		virtual ~MappedMain();
+		
+		/** Map shp_fname and index its records.  shx_fname may be empty.
+		 Returns false if either file cannot be read or is malformed. */
+		bool Open(const wxString& shp_fname,
+				  const wxString& shx_fname=wxEmptyString);
+		void Close();
+		
+		bool IsOpen() const { return shp.IsOpen(); }
+		const Header& GetHeader() const { return header; }
+		int GetNumRecords() const { return offsets.size(); }
+		RecordView GetRecord(int i) const {
+			return RecordView(shp.GetData() + offsets[i], header.shape_type);
+		}
+		
+		/** Decode all records into main_s, like populateMain. */
+		bool ToMain(Main& main_s) const;
+		
+	private:
+		MappedMain(const MappedMain&);
+		MappedMain& operator=(const MappedMain&);
+		
+		bool IndexFromShx(const wxString& shx_fname);
+		bool IndexFromShp();
+		bool AddRecord(wxInt64 rec_start);
+		
+		GdaMappedFile shp;
+		Header header;
+		// byte offset of the contents of every record
+		std::vector<wxInt64> offsets;
+	};
+}
+
+#endif
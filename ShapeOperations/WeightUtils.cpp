@@ -25,7 +25,9 @@
 #include <vector>
 #include <map>
 #include <wx/msgdlg.h>
+#include "CsrWeight.h"
 #include "GalWeight.h"
+#include "GwbWeight.h"
 #include "GwtWeight.h"
 #include "../DataViewer/TableInterface.h"
 #include "../GdaConst.h"
@@ -36,6 +38,11 @@ wxString WeightUtils::ReadIdField(const wxString& fname)
 {
 	using namespace std;
 	wxString ext = GenUtils::GetFileExt(fname).Lower();
+	if (ext == "gwb") {
+		GwbMetaInfo meta;
+		if (!Gda::ReadGwbMetaInfo(fname, meta)) return "";
+		return meta.id_var_name;
+	}
 	if (ext != "gal" && ext != "gwt") return "";
 	
 	ifstream file;
@@ -835,5 +842,244 @@ GalElement* WeightUtils::Gwt2Gal(GwtElement* Gwt, long obs)
 	return Gal;
 }
 
+/** Values of the ID variable key_field as strings, in the same form that
+ ReadGal matches against.  Reports problems to the user and returns false
+ if key_field cannot be used as an ID variable. */
+static bool GetIdStrings(TableInterface* table_int, const wxString& key_field,
+						 std::vector<wxString>& ids)
+{
+	int col=0, tm=0;
+	table_int->DbColNmToColAndTm(key_field, col, tm);
+	if (col == wxNOT_FOUND) {
+		wxString msg = "Specified key value field \"";
+		msg << key_field << "\" of weights file not found ";
+		msg << "in currently loaded Table.";
+		wxMessageDialog dlg(NULL, msg, "Error", wxOK | wxICON_ERROR);
+		dlg.ShowModal();
+		return false;
+	}
+	int num_obs = table_int->GetNumberRows();
+	ids.resize(num_obs);
+	if (table_int->GetColType(col) == GdaConst::long64_type) {
+		std::vector<wxInt64> vec;
+		table_int->GetColData(col, 0, vec);
+		for (int i=0; i<num_obs; i++) {
+			ids[i].Clear();
+			ids[i] << vec[i];
+		}
+	} else if (table_int->GetColType(col) == GdaConst::string_type) {
+		table_int->GetColData(col, 0, ids);
+	} else {
+		wxString msg = "Specified key value field \"";
+		msg << key_field << "\" of weights file is";
+		msg << " not a number type in the currently loaded Table.";
+		wxMessageDialog dlg(NULL, msg, "Error", wxOK | wxICON_ERROR);
+		dlg.ShowModal();
+		return false;
+	}
+	return true;
+}
 
+/** Maps a .gwb weights file.  If the file rows are in the order of the
+ Table, the returned matrix points into the mapped file.  Otherwise the rows
+ are matched by ID and a reordered copy is returned. */
+CsrWeight* WeightUtils::ReadGwb(const wxString& fname,
+								TableInterface* table_int, bool* is_gwt)
+{
+	using namespace std;
+	GwbMetaInfo meta;
+	wxString err_msg;
+	CsrWeight* w = Gda::OpenGwb(fname, err_msg, &meta);
+	if (!w) {
+		wxMessageDialog dlg(NULL, err_msg, "Error", wxOK | wxICON_ERROR);
+		dlg.ShowModal();
+		return 0;
+	}
+	int num_obs = meta.num_obs;
+	if (num_obs != table_int->GetNumberRows()) {
+		wxString msg = "The number of observations specified in chosen ";
+		msg << "weights file is " << num_obs << ", but the number in the ";
+		msg << "current Table is " << table_int->GetNumberRows();
+		msg << ", which is incompatible.";
+		wxMessageDialog dlg(NULL, msg, "Error", wxOK | wxICON_ERROR);
+		dlg.ShowModal();
+		delete w;
+		return 0;
+	}
+	if (is_gwt) *is_gwt = meta.is_gwt;
+	if (meta.id_var_name.IsEmpty()) return w;
+	
+	vector<wxString> tbl_ids;
+	if (!GetIdStrings(table_int, meta.id_var_name, tbl_ids)) {
+		delete w;
+		return 0;
+	}
+	if (tbl_ids == meta.ids) return w;
+	
+	// rows were saved in a different order, match them up by ID
+	map<wxString, int> id_map;
+	for (int i=0; i<num_obs; i++) id_map[tbl_ids[i]] = i;
+	if ((int) id_map.size() != num_obs) {
+		wxString msg = "Specified key value field \"";
+		msg << meta.id_var_name << "\" in weights file contains duplicate ";
+		msg << "values in the currently loaded Table.";
+		wxMessageDialog dlg(NULL, msg, "Error", wxOK | wxICON_ERROR);
+		dlg.ShowModal();
+		delete w;
+		return 0;
+	}
+	vector<int> new_ids(num_obs);
+	vector<bool> used(num_obs, false);
+	for (int i=0; i<num_obs; i++) {
+		map<wxString, int>::iterator it = id_map.find(meta.ids[i]);
+		if (it == id_map.end() || used[it->second]) {
+			wxString msg = "Observation id " + meta.ids[i];
+			if (it == id_map.end()) {
+				msg << " in weights file does not exist in field \"";
+				msg << meta.id_var_name << "\" of the Table.";
+			} else {
+				msg << " appears more than once in weights file.";
+			}
+			wxMessageDialog dlg(NULL, msg, "Error", wxOK | wxICON_ERROR);
+			dlg.ShowModal();
+			delete w;
+			return 0;
+		}
+		new_ids[i] = it->second;
+		used[it->second] = true;
+	}
+	CsrWeight* r = new CsrWeight(*w, new_ids);
+	delete w;
+	return r;
+}
+
+/** Reads a .gwb weights file into GalElements.  The GalElements are a copy
+ of the mapped matrix, so the format saves the parsing of a text file but
+ not the memory of the copy.  A GWT-type file gives binary weights, as
+ Gwt2Gal does.  If csr is given, it receives the matrix of a GAL-type file,
+ ready for GeoDaWeight::SetCsr, and is set to 0 for a GWT-type file, whose
+ matrix holds the distances. */
+GalElement* WeightUtils::ReadGwbAsGal(const wxString& fname,
+									  TableInterface* table_int,
+									  CsrWeight** csr)
+{
+	bool is_gwt = false;
+	CsrWeight* w = ReadGwb(fname, table_int, &is_gwt);
+	if (csr) *csr = 0;
+	if (!w) return 0;
+	GalElement* gal = Csr2Gal(w, is_gwt);
+	if (csr && !is_gwt) {
+		*csr = w;
+	} else {
+		delete w;
+	}
+	return gal;
+}
+
+/** Copies w into GalElements, with all weights 1 if binary is true. */
+GalElement* WeightUtils::Csr2Gal(const CsrWeight* w, bool binary)
+{
+	if (w == NULL) return NULL;
+	int obs = w->GetNumObs();
+	GalElement* Gal = new GalElement[obs];
+	for (int i=0; i<obs; i++) {
+		const int* nbrs = w->GetNbrs(i);
+		const double* wts = w->GetNbrWeights(i);
+		Gal[i].SetSizeNbrs(w->Size(i));
+		for (int j=0, sz=w->Size(i); j<sz; j++) {
+			if (binary) {
+				Gal[i].SetNbr(j, nbrs[j]);
+			} else {
+				Gal[i].SetNbr(j, nbrs[j], wts[j]);
+			}
+		}
+	}
+	return Gal;
+}
+
+GwtElement* WeightUtils::Csr2Gwt(const CsrWeight* w)
+{
+	if (w == NULL) return NULL;
+	int obs = w->GetNumObs();
+	GwtElement* Gwt = new GwtElement[obs];
+	for (int i=0; i<obs; i++) {
+		const int* nbrs = w->GetNbrs(i);
+		const double* wts = w->GetNbrWeights(i);
+		Gwt[i].alloc(w->Size(i));
+		for (int j=0, sz=w->Size(i); j<sz; j++) {
+			Gwt[i].Push(GwtNeighbor(nbrs[j], wts[j]));
+		}
+	}
+	return Gwt;
+}
 
+/** Converts a .gal or .gwt file to a .gwb file.  The rows are written in
+ Table order. */
+bool WeightUtils::ConvertToGwb(const wxString& in_fname,
+							   const wxString& out_fname,
+							   TableInterface* table_int)
+{
+	wxString ext = GenUtils::GetFileExt(in_fname).Lower();
+	int num_obs = table_int->GetNumberRows();
+	CsrWeight* w = 0;
+	if (ext == "gal") {
+		GalElement* gal = ReadGal(in_fname, table_int);
+		if (gal) w = new CsrWeight(gal, num_obs);
+		delete [] gal;
+	} else if (ext == "gwt") {
+		GwtElement* gwt = ReadGwt(in_fname, table_int);
+		if (gwt) w = new CsrWeight(gwt, num_obs);
+		delete [] gwt;
+	}
+	if (!w) return false;
+	
+	wxString id_field = ReadIdField(in_fname);
+	std::vector<wxString> ids;
+	bool success = id_field.IsEmpty() || GetIdStrings(table_int, id_field, ids);
+	if (success) {
+		success = Gda::SaveGwb(*w, ext == "gwt", table_int->GetTableName(),
+							   out_fname, id_field, ids);
+	}
+	delete w;
+	return success;
+}
+
+/** Converts a .gwb file to a .gal or .gwt file, depending on the type of
+ weights stored in it.  The file must have an ID variable. */
+bool WeightUtils::ConvertFromGwb(const wxString& in_fname,
+								 const wxString& out_fname,
+								 TableInterface* table_int)
+{
+	GwbMetaInfo meta;
+	if (!Gda::ReadGwbMetaInfo(in_fname, meta) ||
+		meta.id_var_name.IsEmpty()) return false;
+	int col=0, tm=0;
+	table_int->DbColNmToColAndTm(meta.id_var_name, col, tm);
+	if (col == wxNOT_FOUND) return false;
+	CsrWeight* w = ReadGwb(in_fname, table_int);
+	if (!w) return false;
+	
+	int num_obs = w->GetNumObs();
+	GalElement* gal = meta.is_gwt ? 0 : Csr2Gal(w);
+	GwtElement* gwt = meta.is_gwt ? Csr2Gwt(w) : 0;
+	delete w;
+	bool success = false;
+	if (table_int->GetColType(col) == GdaConst::long64_type) {
+		std::vector<wxInt64> id_vec(num_obs);
+		table_int->GetColData(col, 0, id_vec);
+		success = gal ? Gda::SaveGal(gal, meta.layer_name, out_fname,
+									 meta.id_var_name, id_vec)
+			: Gda::SaveGwt(gwt, meta.layer_name, out_fname,
+						   meta.id_var_name, id_vec);
+	} else if (table_int->GetColType(col) == GdaConst::string_type) {
+		std::vector<wxString> id_vec(num_obs);
+		table_int->GetColData(col, 0, id_vec);
+		success = gal ? Gda::SaveGal(gal, meta.layer_name, out_fname,
+									 meta.id_var_name, id_vec)
+			: Gda::SaveGwt(gwt, meta.layer_name, out_fname,
+						   meta.id_var_name, id_vec);
+	}
+	if (gal) delete [] gal;
+	if (gwt) delete [] gwt;
+	return success;
+}
@@ -25,6 +25,7 @@ class GalWeight;
 class GwtWeight;
 class GalElement;
 class GwtElement;
+class CsrWeight;
 
 namespace WeightUtils {
 	wxString ReadIdField(const wxString& w_fname);
@@ -34,6 +35,18 @@ namespace WeightUtils {
 							 TableInterface* table_int);
 	GwtElement* ReadGwt(const wxString& w_fname, TableInterface* table_int);
 	GalElement* Gwt2Gal(GwtElement* Gwt, long obs);
+	
+	// GeoDa binary weights (.gwb), see GwbWeight.h
+	CsrWeight* ReadGwb(const wxString& w_fname, TableInterface* table_int,
+					   bool* is_gwt = 0);
+	GalElement* ReadGwbAsGal(const wxString& w_fname,
+							 TableInterface* table_int, CsrWeight** csr = 0);
+	GalElement* Csr2Gal(const CsrWeight* w, bool binary = false);
+	GwtElement* Csr2Gwt(const CsrWeight* w);
+	bool ConvertToGwb(const wxString& in_fname, const wxString& out_fname,
+					  TableInterface* table_int);
+	bool ConvertFromGwb(const wxString& in_fname, const wxString& out_fname,
+						TableInterface* table_int);
 }
 
 #endif
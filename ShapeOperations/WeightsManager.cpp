@@ -28,6 +28,7 @@
 #include "../GenUtils.h"
 #include "../DataViewer/TableInterface.h"
 #include "WeightsManState.h"
+#include "CsrWeight.h"
 #include "GeodaWeight.h"
 #include "GalWeight.h"
 #include "GwtWeight.h"
@@ -115,6 +116,7 @@ bool WeightsNewManager::AssociateGal(boost::uuids::uuid w_uuid, GalWeight* gw)
 		delete it->second.gal_weight; it->second.gal_weight = 0;
 	}
 	it->second.gal_weight = gw;
+	it->second.has_traces = false;
 	if (w_man_state) w_man_state->notifyObservers();
 	return true;
 }
@@ -353,14 +355,17 @@ GalWeight* WeightsNewManager::GetGal(boost::uuids::uuid w_uuid)
 	// Load file for first use
 	wxFileName t_fn(e.wpte.wmi.filename);
 	wxString ext = t_fn.GetExt().Lower();
-	if (ext != "gal" && ext != "gwt") {
+	if (ext != "gal" && ext != "gwt" && ext != "gwb") {
 		return 0;
 	}
 	GalElement* gal=0;
+	CsrWeight* csr=0;
 	if (ext == "gal") {
 		gal = WeightUtils::ReadGal(e.wpte.wmi.filename, table_int);
-	} else { // ext == "gwt"
+	} else if (ext == "gwt") {
 		gal = WeightUtils::ReadGwtAsGal(e.wpte.wmi.filename, table_int);
+	} else { // ext == "gwb"
+		gal = WeightUtils::ReadGwbAsGal(e.wpte.wmi.filename, table_int, &csr);
 	}
 	if (gal != 0) {
 		GalWeight* w = new GalWeight();
@@ -369,11 +374,30 @@ GalWeight* WeightsNewManager::GetGal(boost::uuids::uuid w_uuid)
         w->id_field = e.wpte.wmi.id_var;
 		w->title = e.wpte.title;
 		w->gal = gal;
+		// statistics that work on the CSR matrix use the mapped file
+		if (csr) w->SetCsr(csr);
 		e.gal_weight = w;
 	}
 	return e.gal_weight;
 }
 
+bool WeightsNewManager::GetTraces(boost::uuids::uuid w_uuid,
+								  double& tr_WW, double& tr_WtW)
+{
+	EmType::iterator it = entry_map.find(w_uuid);
+	if (it == entry_map.end()) return false;
+	Entry& e = it->second;
+	if (!e.has_traces) {
+		GalWeight* gw = GetGal(w_uuid);
+		if (gw == 0 || gw->gal == 0) return false;
+		gw->GetCsr()->GetTraces(e.tr_WW, e.tr_WtW);
+		e.has_traces = true;
+	}
+	tr_WW = e.tr_WW;
+	tr_WtW = e.tr_WtW;
+	return true;
+}
+
 GeoDaWeight* WeightsNewManager::GetWeights(boost::uuids::uuid w_uuid)
 {
 	EmType::iterator it = entry_map.find(w_uuid);
@@ -383,15 +407,38 @@ GeoDaWeight* WeightsNewManager::GetWeights(boost::uuids::uuid w_uuid)
     
     wxFileName t_fn(tmpName);
     wxString ext = t_fn.GetExt().Lower();
-    if (ext != "gal" && ext != "gwt") {
+    if (ext != "gal" && ext != "gwt" && ext != "gwb") {
         return 0;
     }
     
 	if (ext == "gal" && e.gal_weight) return e.gal_weight;
+	if (ext == "gwb" && e.geoda_weight) return e.geoda_weight;
 	
 	// Load file for first use
 	
-	if (ext == "gal") {
+	if (ext == "gwb") {
+		bool is_gwt = false;
+		CsrWeight* csr = WeightUtils::ReadGwb(e.wpte.wmi.filename, table_int,
+											  &is_gwt);
+		if (csr != 0) {
+			GeoDaWeight* w = 0;
+			if (is_gwt) {
+				GwtWeight* gwt_w = new GwtWeight();
+				gwt_w->gwt = WeightUtils::Csr2Gwt(csr);
+				w = gwt_w;
+			} else {
+				GalWeight* gal_w = new GalWeight();
+				gal_w->gal = WeightUtils::Csr2Gal(csr);
+				w = gal_w;
+			}
+			w->num_obs = table_int->GetNumberRows();
+			w->wflnm = e.wpte.wmi.filename;
+			w->id_field = e.wpte.wmi.id_var;
+			w->title = e.wpte.title;
+			w->SetCsr(csr);
+			e.geoda_weight = w;
+		}
+	} else if (ext == "gal") {
         GalElement* gal = WeightUtils::ReadGal(e.wpte.wmi.filename, table_int);
     	if (gal != 0) {
     		GalWeight* w = new GalWeight();
@@ -70,6 +70,10 @@ public:
 	virtual void Remove(boost::uuids::uuid w_uuid);
 	virtual wxString RecNumToId(boost::uuids::uuid w_uuid, long rec_num);
 	virtual GalWeight* GetGal(boost::uuids::uuid w_uuid);
+	/** tr(WW) and tr(W'W) of the row-standardized weights, see
+	 CsrWeight::GetTraces.  Computed once per weights and cached. */
+	virtual bool GetTraces(boost::uuids::uuid w_uuid,
+						   double& tr_WW, double& tr_WtW);
 	virtual GeoDaWeight* GetWeights(boost::uuids::uuid w_uuid);
 	virtual boost::uuids::uuid GetDefault() const;
 	virtual void MakeDefault(boost::uuids::uuid w_uuid);
@@ -81,11 +85,15 @@ public:
 	
 private:
 	struct Entry {
-		Entry() : gal_weight(0), geoda_weight(0) {}
-		Entry(const WeightsPtreeEntry& e) : gal_weight(0), geoda_weight(0), wpte(e) {}
+		Entry() : gal_weight(0), geoda_weight(0), has_traces(false) {}
+		Entry(const WeightsPtreeEntry& e) : gal_weight(0), geoda_weight(0), has_traces(false), wpte(e) {}
 		WeightsPtreeEntry wpte;
 		GalWeight* gal_weight;
         GeoDaWeight* geoda_weight;
+		// cached by GetTraces, reset when gal_weight is replaced
+		bool has_traces;
+		double tr_WW;
+		double tr_WtW;
 		std::vector<wxString> rec_num_to_id;
 	};
 	typedef std::map<boost::uuids::uuid, Entry> EmType;
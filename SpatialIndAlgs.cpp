@@ -17,6 +17,9 @@
  * along with this program.  If not, see <http://www.gnu.org/licenses/>.
  */
 
+#include <algorithm>
+#include <math.h>
+#include <boost/bind.hpp>
 #include <boost/foreach.hpp>
 #include <boost/random.hpp>
 #include <boost/random/uniform_01.hpp>
@@ -30,7 +33,9 @@
 #include "GenGeomAlgs.h"
 #include "SpatialIndAlgs.h"
 #include "VarCalc/NumericTests.h"
+#include "GdaAsyncTask.h"
 #include "GdaException.h"
+#include "GdaThreadPool.h"
 #include "logger.h"
 
 using namespace std;
@@ -153,17 +158,82 @@ void SpatialIndAlgs::get_shp_bb(Shapefile::PolygonContents* p,
 	}
 }
 
-bool comp_polys(Shapefile::PolygonContents* p1,
-                Shapefile::PolygonContents* p2,
-				bool rook, double prec)
+/** Previous and next vertex of vertex v along its ring, skipping the
+ closing point that repeats the first one.  Same convention as
+ PolygonPartition::MakeNeighbors. */
+static void ring_prev_succ(const Shapefile::PolygonContents* p, int v,
+						   int& prev, int& succ)
 {
-	if (!p1 || !p2)
-        return false;
-    
+	int part = std::upper_bound(p->parts.begin(), p->parts.end(), v)
+		- p->parts.begin() - 1;
+	int first = part < 0 ? 0 : p->parts[part];
+	int last = (part+1 < p->num_parts) ? p->parts[part+1] : p->num_points;
+	prev = (v == first) ? last-2 : v-1;
+	succ = (v == last-1) ? first+1 : v+1;
+	if (prev < first) prev = first;
+	if (succ >= last) succ = last-1;
+}
+
+static bool pts_equal(const Shapefile::Point& a, const Shapefile::Point& b,
+					  double prec)
+{
+	return fabs(a.x - b.x) <= prec && fabs(a.y - b.y) <= prec;
+}
+
+/** True if p1 and p2 share a vertex (rook false) or an edge (rook true),
+ where two vertices are the same if both coordinates are within prec.
+ This is the test PolygonPartition::sweep does, but the vertices of p1
+ are sorted into grid cells of size prec so that each vertex of p2 is
+ only compared with the p1 vertices of its own and the 8 surrounding
+ cells. */
+bool SpatialIndAlgs::comp_polys(Shapefile::PolygonContents* p1,
+								Shapefile::PolygonContents* p2,
+								bool rook, double prec)
+{
+	if (!p1 || !p2 || p1->num_points <= 0 || p2->num_points <= 0) {
+		return false;
+	}
+	if (prec < 0) prec = 0;
+	// with prec == 0 a cell is a single coordinate pair
+	double cell = prec > 0 ? prec : 1;
+	typedef std::pair<std::pair<double, double>, int> cell_vert;
+	std::vector<cell_vert> cells(p1->num_points);
 	for (int i=0; i<p1->num_points; ++i) {
-		for (int j=0; j<p1->num_points; ++j) {
-			if (p1->points[i] == p2->points[j])
-                return true;
+		const Shapefile::Point& pt = p1->points[i];
+		double cx = prec > 0 ? floor(pt.x / cell) : pt.x;
+		double cy = prec > 0 ? floor(pt.y / cell) : pt.y;
+		cells[i] = std::make_pair(std::make_pair(cx, cy), i);
+	}
+	std::sort(cells.begin(), cells.end());
+	
+	int reach = prec > 0 ? 1 : 0;
+	for (int j=0; j<p2->num_points; ++j) {
+		const Shapefile::Point& pt = p2->points[j];
+		double cx = prec > 0 ? floor(pt.x / cell) : pt.x;
+		double cy = prec > 0 ? floor(pt.y / cell) : pt.y;
+		for (int dx=-reach; dx<=reach; ++dx) {
+			for (int dy=-reach; dy<=reach; ++dy) {
+				cell_vert lo(std::make_pair(cx+dx, cy+dy), -1);
+				std::vector<cell_vert>::iterator it =
+					std::lower_bound(cells.begin(), cells.end(), lo);
+				for (; it != cells.end() && it->first == lo.first; ++it) {
+					int h = it->second;
+					if (!pts_equal(p1->points[h], pt, prec)) continue;
+					if (!rook) return true;
+					// shared edge: a ring neighbor of h matches one of j
+					int h_prev, h_succ, g_prev, g_succ;
+					ring_prev_succ(p1, h, h_prev, h_succ);
+					ring_prev_succ(p2, j, g_prev, g_succ);
+					const Shapefile::Point& hs = p1->points[h_succ];
+					const Shapefile::Point& hp = p1->points[h_prev];
+					const Shapefile::Point& gs = p2->points[g_succ];
+					const Shapefile::Point& gp = p2->points[g_prev];
+					if (pts_equal(hs, gp, prec) || pts_equal(hs, gs, prec) ||
+						pts_equal(hp, gs, prec) || pts_equal(hp, gp, prec)) {
+						return true;
+					}
+				}
+			}
 		}
 	}
 	return false;
@@ -287,9 +357,222 @@ void SpatialIndAlgs::knn_query(const rtree_pt_2d_t& rtree, int nn)
 	}
 }
 
+// points per task when building weights from a point rtree
+static const int build_grain = 256;
+
+/** All values of rtree, in the order the rtree returns them. */
+template <class RTree, class Val>
+static void get_all_values(const RTree& rtree, std::vector<Val>& vals)
+{
+	vals.reserve(rtree.size());
+	rtree.query(bgi::intersects(rtree.bounds()), std::back_inserter(vals));
+}
+
+/** True if token is given and was cancelled.  Checked once per task. */
+static bool build_cancelled(const GdaCancelToken* token)
+{
+	return token && token->IsCancelled();
+}
+
+static long count_gwt_nbrs(const GwtWeight* W)
+{
+	long cnt = 0;
+	for (int i=0; i<W->num_obs; ++i) cnt += W->gwt[i].Size();
+	return cnt;
+}
+
+/** knn_build for values a through b of vals.  Every value fills only its
+ own row of gwt, so ranges can run concurrently. */
+static void knn_2d_range(const rtree_pt_2d_t* rtree,
+						 const std::vector<pt_2d_val>* vals, int k,
+						 GwtElement* gwt, const GdaCancelToken* token,
+						 int a, int b)
+{
+	if (build_cancelled(token)) return;
+	vector<pt_2d_val> q;
+	for (int i=a; i<=b; ++i) {
+		const pt_2d_val& v = (*vals)[i];
+		q.clear();
+		rtree->query(bgi::nearest(v.first, k), std::back_inserter(q));
+		GwtElement& e = gwt[v.second];
+		e.alloc(q.size());
+		BOOST_FOREACH(pt_2d_val const& w, q) {
+			if (w.second == v.second) continue;
+			GwtNeighbor neigh;
+			neigh.nbx = w.second;
+			neigh.weight = bg::distance(v.first, w.first);
+			e.Push(neigh);
+		}
+	}
+}
+
+static void knn_3d_range(const rtree_pt_3d_t* rtree,
+						 const std::vector<pt_3d_val>* vals, int k,
+						 bool is_arc, bool is_mi,
+						 GwtElement* gwt, const GdaCancelToken* token,
+						 int a, int b)
+{
+	if (build_cancelled(token)) return;
+	using namespace GenGeomAlgs;
+	vector<pt_3d_val> q;
+	for (int i=a; i<=b; ++i) {
+		const pt_3d_val& v = (*vals)[i];
+		q.clear();
+		rtree->query(bgi::nearest(v.first, k), std::back_inserter(q));
+		GwtElement& e = gwt[v.second];
+		e.alloc(q.size());
+		double lon_v, lat_v;
+		double x_v, y_v;
+		if (is_arc) {
+			UnitToLongLatDeg(bg::get<0>(v.first), bg::get<1>(v.first),
+							 bg::get<2>(v.first), lon_v, lat_v);
+		} else {
+			x_v = bg::get<0>(v.first);
+			y_v = bg::get<1>(v.first);
+		}
+		BOOST_FOREACH(pt_3d_val const& w, q) {
+			if (w.second == v.second) continue;
+			GwtNeighbor neigh;
+			neigh.nbx = w.second;
+			if (is_arc) {
+				double lon_w, lat_w;
+				UnitToLongLatDeg(bg::get<0>(w.first), bg::get<1>(w.first),
+								 bg::get<2>(w.first), lon_w, lat_w);
+				if (is_mi) {
+					neigh.weight = ComputeArcDistMi(lon_v, lat_v, lon_w, lat_w);
+				} else {
+					neigh.weight = ComputeArcDistKm(lon_v, lat_v, lon_w, lat_w);
+				}
+			} else {
+				neigh.weight = ComputeEucDist(x_v, y_v,
+											  bg::get<0>(w.first),
+											  bg::get<1>(w.first));
+			}
+			e.Push(neigh);
+		}
+	}
+}
+
+static void knn_lonlat_range(const rtree_pt_lonlat_t* rtree,
+							 const std::vector<pt_lonlat_val>* vals, int k,
+							 GwtElement* gwt, int a, int b)
+{
+	vector<pt_lonlat_val> q;
+	for (int i=a; i<=b; ++i) {
+		const pt_lonlat_val& v = (*vals)[i];
+		q.clear();
+		rtree->query(bgi::nearest(v.first, k), std::back_inserter(q));
+		GwtElement& e = gwt[v.second];
+		e.alloc(q.size());
+		BOOST_FOREACH(const pt_lonlat_val& w, q) {
+			if (w.second == v.second) continue;
+			GwtNeighbor neigh;
+			neigh.nbx = w.second;
+			neigh.weight = bg::distance(v.first, w.first);
+			e.Push(neigh);
+		}
+	}
+}
+
+/** thresh_build for values a through b of vals.  Sets
+ (*too_many)[a/build_grain] and stops if a point has more than 200
+ neighbors. */
+static void thresh_2d_range(const rtree_pt_2d_t* rtree,
+							const std::vector<pt_2d_val>* vals, double th,
+							GwtElement* gwt, std::vector<char>* too_many,
+							const GdaCancelToken* token, int a, int b)
+{
+	if (build_cancelled(token)) return;
+	vector<pt_2d_val> q;
+	vector<pt_2d_val> l;
+	for (int i=a; i<=b; ++i) {
+		const pt_2d_val& v = (*vals)[i];
+		double x = v.first.get<0>();
+		double y = v.first.get<1>();
+		box_2d bx(pt_2d(x-th, y-th), pt_2d(x+th, y+th));
+		q.clear();
+		l.clear();
+		rtree->query(bgi::intersects(bx), std::back_inserter(q));
+		BOOST_FOREACH(pt_2d_val const& w, q) {
+			if (w.second != v.second &&
+				bg::distance(v.first, w.first) <= th)
+			{
+				l.push_back(w);
+			}
+		}
+		if (l.size() > 200) {
+			(*too_many)[a/build_grain] = 1;
+			return;
+		}
+		GwtElement& e = gwt[v.second];
+		e.alloc(l.size());
+		// reversed, as the serial version pushed to the front of a list
+		BOOST_REVERSE_FOREACH(pt_2d_val const& w, l) {
+			GwtNeighbor neigh;
+			neigh.nbx = w.second;
+			neigh.weight = bg::distance(v.first, w.first);
+			e.Push(neigh);
+		}
+	}
+}
+
+/** Arc distance version of thresh_2d_range, with the same limit of 200
+ neighbors. */
+static void thresh_3d_range(const rtree_pt_3d_t* rtree,
+							const std::vector<pt_3d_val>* vals, double th,
+							bool is_mi, GwtElement* gwt,
+							std::vector<char>* too_many,
+							const GdaCancelToken* token, int a, int b)
+{
+	if (build_cancelled(token)) return;
+	using namespace GenGeomAlgs;
+	vector<pt_3d_val> q;
+	vector<pt_3d_val> l;
+	for (int i=a; i<=b; ++i) {
+		const pt_3d_val& v = (*vals)[i];
+		double vx = v.first.get<0>();
+		double vy = v.first.get<1>();
+		double vz = v.first.get<2>();
+		double lon_v, lat_v;
+		UnitToLongLatDeg(vx, vy, vz, lon_v, lat_v);
+		box_3d bx(pt_3d(vx-th, vy-th, vz-th), pt_3d(vx+th, vy+th, vz+th));
+		q.clear();
+		l.clear();
+		rtree->query(bgi::intersects(bx), std::back_inserter(q));
+		BOOST_FOREACH(pt_3d_val const& w, q) {
+			if (w.second != v.second &&
+				bg::distance(v.first, w.first) <= th)
+			{
+				l.push_back(w);
+			}
+		}
+		if (l.size() > 200) {
+			(*too_many)[a/build_grain] = 1;
+			return;
+		}
+		GwtElement& e = gwt[v.second];
+		e.alloc(l.size());
+		// reversed, as the serial version pushed to the front of a list
+		BOOST_REVERSE_FOREACH(pt_3d_val const& w, l) {
+			GwtNeighbor neigh;
+			neigh.nbx = w.second;
+			double lon_w, lat_w;
+			UnitToLongLatDeg(w.first.get<0>(), w.first.get<1>(),
+							 w.first.get<2>(), lon_w, lat_w);
+			if (is_mi) {
+				neigh.weight = ComputeArcDistMi(lon_v, lat_v, lon_w, lat_w);
+			} else {
+				neigh.weight = ComputeArcDistKm(lon_v, lat_v, lon_w, lat_w);
+			}
+			e.Push(neigh);
+		}
+	}
+}
+
 GwtWeight* SpatialIndAlgs::knn_build(const vector<double>& x,
                                      const vector<double>& y,
-                                     int nn, bool is_arc, bool is_mi)
+                                     int nn, bool is_arc, bool is_mi,
+									 const GdaCancelToken* token)
 {
 	size_t nobs = x.size();
 	GwtWeight* gwt = 0;
@@ -304,7 +587,7 @@ GwtWeight* SpatialIndAlgs::knn_build(const vector<double>& x,
 			}
 			fill_pt_rtree(rtree, pts);
 		}
-		gwt = knn_build(rtree, nn, true, is_mi);
+		gwt = knn_build(rtree, nn, true, is_mi, token);
         
 	} else {
 		rtree_pt_2d_t rtree;
@@ -313,13 +596,14 @@ GwtWeight* SpatialIndAlgs::knn_build(const vector<double>& x,
 			for (int i=0; i<nobs; ++i) pts[i] = pt_2d(x[i], y[i]);
 			fill_pt_rtree(rtree, pts);
 		}
-		gwt = knn_build(rtree, nn);
+		gwt = knn_build(rtree, nn, token);
         
 	}
 	return gwt;
 }
 
-GwtWeight* SpatialIndAlgs::knn_build(const rtree_pt_2d_t& rtree, int nn)
+GwtWeight* SpatialIndAlgs::knn_build(const rtree_pt_2d_t& rtree, int nn,
+									 const GdaCancelToken* token)
 {
 	GwtWeight* Wp = new GwtWeight;
 	Wp->num_obs = rtree.size();
@@ -327,36 +611,24 @@ GwtWeight* SpatialIndAlgs::knn_build(const rtree_pt_2d_t& rtree, int nn)
 	Wp->symmetry_checked = true;
 	Wp->gwt = new GwtElement[Wp->num_obs];
 	
-	int cnt=0;
-	const int k=nn+1;
-	for (rtree_pt_2d_t::const_query_iterator it =
-			 rtree.qbegin(bgi::intersects(rtree.bounds()));
-		 it != rtree.qend() ; ++it)
-	{
-		const pt_2d_val& v = *it;
-		size_t obs = v.second;		
-		vector<pt_2d_val> q;
-		rtree.query(bgi::nearest(v.first, k), std::back_inserter(q));
-		GwtElement& e = Wp->gwt[obs];
-		e.alloc(q.size());
-		BOOST_FOREACH(pt_2d_val const& w, q) {
-			if (w.second == v.second) continue;
-			GwtNeighbor neigh;
-			neigh.nbx = w.second;
-			neigh.weight = bg::distance(v.first, w.first);
-			e.Push(neigh);
-			++cnt;
-		}
+	// the rtree is only read, so all points are queried in parallel
+	vector<pt_2d_val> vals;
+	get_all_values(rtree, vals);
+	GdaThreadPool::GetInstance()->
+		ParallelFor(0, (int) vals.size()-1, build_grain,
+					boost::bind(&knn_2d_range, &rtree, &vals, nn+1,
+								Wp->gwt, token, _1, _2));
+	if (build_cancelled(token)) {
+		delete Wp;
+		return 0;
 	}
-
 	return Wp;
 }
 
 GwtWeight* SpatialIndAlgs::knn_build(const rtree_pt_3d_t& rtree, int nn,
-					 bool is_arc, bool is_mi)
+					 bool is_arc, bool is_mi, const GdaCancelToken* token)
 {
 	wxStopWatch sw;
-	using namespace GenGeomAlgs;
 
 	GwtWeight* Wp = new GwtWeight;
 	Wp->num_obs = rtree.size();
@@ -364,55 +636,22 @@ GwtWeight* SpatialIndAlgs::knn_build(const rtree_pt_3d_t& rtree, int nn,
 	Wp->symmetry_checked = true;
 	Wp->gwt = new GwtElement[Wp->num_obs];
 	
-	int cnt=0;
-	const int k=nn+1;
-	for (rtree_pt_3d_t::const_query_iterator it =
-			 rtree.qbegin(bgi::intersects(rtree.bounds()));
-		 it != rtree.qend() ; ++it)
-	{
-		const pt_3d_val& v = *it;
-		size_t obs = v.second;		
-		vector<pt_3d_val> q;
-		rtree.query(bgi::nearest(v.first, k), std::back_inserter(q));
-		GwtElement& e = Wp->gwt[obs];
-		e.alloc(q.size());
-		double lon_v, lat_v;
-		double x_v, y_v;
-		if (is_arc) {
-			UnitToLongLatDeg(bg::get<0>(v.first), bg::get<1>(v.first),
-							 bg::get<2>(v.first), lon_v, lat_v);
-		} else {
-			x_v = bg::get<0>(v.first);
-			y_v = bg::get<1>(v.first);
-		}
-		BOOST_FOREACH(pt_3d_val const& w, q) {
-			if (w.second == v.second) continue;
-			GwtNeighbor neigh;
-			neigh.nbx = w.second;
-			if (is_arc) {
-				double lon_w, lat_w;
-				UnitToLongLatDeg(bg::get<0>(w.first), bg::get<1>(w.first),
-								 bg::get<2>(w.first), lon_w, lat_w);
-				if (is_mi) {
-					neigh.weight = ComputeArcDistMi(lon_v, lat_v, lon_w, lat_w);
-				} else {
-					neigh.weight = ComputeArcDistKm(lon_v, lat_v, lon_w, lat_w);
-				}
-			} else {
-				//neigh.weight = bg::distance(v.first, w.first);
-				neigh.weight = ComputeEucDist(x_v, y_v,
-											  bg::get<0>(w.first),
-                                              bg::get<1>(w.first));
-			}
-			e.Push(neigh);
-			++cnt;
-		}
+	vector<pt_3d_val> vals;
+	get_all_values(rtree, vals);
+	GdaThreadPool::GetInstance()->
+		ParallelFor(0, (int) vals.size()-1, build_grain,
+					boost::bind(&knn_3d_range, &rtree, &vals, nn+1,
+								is_arc, is_mi, Wp->gwt, token, _1, _2));
+	if (build_cancelled(token)) {
+		delete Wp;
+		return 0;
 	}
 
 	stringstream ss;
 	ss << "Time to create 3D " << (is_arc ? " arc " : "")
 	   << nn << "-NN GwtWeight "
-	   << "with " << cnt << " total neighbors in ms : " << sw.Time();
+	   << "with " << count_gwt_nbrs(Wp) << " total neighbors in ms : "
+	   << sw.Time();
 	return Wp;
 }
 
@@ -622,7 +861,8 @@ double SpatialIndAlgs::est_median_distance(const std::vector<double>& x,
 
 GwtWeight* SpatialIndAlgs::thresh_build(const std::vector<double>& x,
                                         const std::vector<double>& y,
-                                        double th, bool is_arc, bool is_mi)
+                                        double th, bool is_arc, bool is_mi,
+										const GdaCancelToken* token)
 {
 	using namespace GenGeomAlgs;
 	size_t nobs = x.size();
@@ -640,7 +880,7 @@ GwtWeight* SpatialIndAlgs::thresh_build(const std::vector<double>& x,
 			}
 			fill_pt_rtree(rtree, pts);
 		}
-		gwt = thresh_build(rtree, u_th, is_mi);
+		gwt = thresh_build(rtree, u_th, is_mi, token);
 	} else {
 		rtree_pt_2d_t rtree;
 		{
@@ -650,12 +890,13 @@ GwtWeight* SpatialIndAlgs::thresh_build(const std::vector<double>& x,
             }
 			fill_pt_rtree(rtree, pts);
 		}
-		gwt = thresh_build(rtree, th);
+		gwt = thresh_build(rtree, th, token);
 	}
 	return gwt;
 }
 
-GwtWeight* SpatialIndAlgs::thresh_build(const rtree_pt_2d_t& rtree, double th)
+GwtWeight* SpatialIndAlgs::thresh_build(const rtree_pt_2d_t& rtree, double th,
+										const GdaCancelToken* token)
 {
 	wxStopWatch sw;
     
@@ -667,50 +908,29 @@ GwtWeight* SpatialIndAlgs::thresh_build(const rtree_pt_2d_t& rtree, double th)
     int num_obs = Wp->num_obs;
 	Wp->gwt = new GwtElement[num_obs];
 	
-	int cnt=0;
-  
-    rtree_pt_2d_t::const_query_iterator it;
-	for (it = rtree.qbegin(bgi::intersects(rtree.bounds()));
-		 it != rtree.qend() ; ++it)
-	{
-		const pt_2d_val& v = *it;
-		double x = v.first.get<0>();
-		double y = v.first.get<1>();
-		box_2d b(pt_2d(x-th, y-th), pt_2d(x+th, y+th));
-		size_t obs = v.second;		
-		vector<pt_2d_val> q;
-		rtree.query(bgi::intersects(b), std::back_inserter(q));
-		size_t lcnt = 0;
-		list<pt_2d_val> l;
-		BOOST_FOREACH(pt_2d_val const& w, q) {
-			if (w.second != v.second &&
-				bg::distance(v.first, w.first) <= th)
-			{
-				l.push_front(w);
-				++lcnt;
-			}
-		}
-        if (lcnt > 200) {
-            // clean up memory
-            delete Wp;
-            
-            wxString msg = _("Current threshold distance value in weights creation may cause memory problems. Please input a smaller distance band (which might leave some observations neighborless) or use another weights (e.g. KNN).");
-            throw GdaException(msg.mb_str());
-        }
-		GwtElement& e = Wp->gwt[obs];
-		e.alloc(lcnt);
-		BOOST_FOREACH(pt_2d_val const& w, l) {
-			GwtNeighbor neigh;
-			neigh.nbx = w.second;
-			neigh.weight = bg::distance(v.first, w.first);
-			e.Push(neigh);
-			++cnt;
-		}
+	vector<pt_2d_val> vals;
+	get_all_values(rtree, vals);
+	// one flag per task, exceptions can't cross the thread pool
+	vector<char> too_many((vals.size() + build_grain - 1) / build_grain, 0);
+	GdaThreadPool::GetInstance()->
+		ParallelFor(0, (int) vals.size()-1, build_grain,
+					boost::bind(&thresh_2d_range, &rtree, &vals, th,
+								Wp->gwt, &too_many, token, _1, _2));
+	if (build_cancelled(token)) {
+		delete Wp;
+		return 0;
+	}
+	if (std::find(too_many.begin(), too_many.end(), 1) != too_many.end()) {
+		// clean up memory
+		delete Wp;
+		
+		wxString msg = _("Current threshold distance value in weights creation may cause memory problems. Please input a smaller distance band (which might leave some observations neighborless) or use another weights (e.g. KNN).");
+		throw GdaException(msg.mb_str());
 	}
 
 	stringstream ss;
 	ss << "Time to create " << th << " threshold GwtWeight,"
-	   << endl << "  with " << cnt << " total neighbors in ms : "
+	   << endl << "  with " << count_gwt_nbrs(Wp) << " total neighbors in ms : "
 	   << sw.Time();
 	return Wp;
 }
@@ -754,7 +974,8 @@ double SpatialIndAlgs::est_avg_num_neigh_thresh(const rtree_pt_3d_t& rtree,
 
 /** threshold th is the radius of intersection sphere with
   respect to the unit shpere of the 3d point rtree */
-GwtWeight* SpatialIndAlgs::thresh_build(const rtree_pt_3d_t& rtree, double th, bool is_mi)
+GwtWeight* SpatialIndAlgs::thresh_build(const rtree_pt_3d_t& rtree, double th, bool is_mi,
+										const GdaCancelToken* token)
 {
 	wxStopWatch sw;
 	using namespace GenGeomAlgs;
@@ -775,56 +996,29 @@ GwtWeight* SpatialIndAlgs::thresh_build(const rtree_pt_3d_t& rtree, double th, b
 		ss << "Input th (earth km): " << EarthRadToKm(r) << endl;
 		ss << "Input th (earth mi): " << EarthRadToMi(r);	
 	}
-	int cnt=0;
-	for (rtree_pt_3d_t::const_query_iterator it =
-			 rtree.qbegin(bgi::intersects(rtree.bounds()));
-		 it != rtree.qend() ; ++it)
-	{
-		const pt_3d_val& v = *it;
-		double vx = v.first.get<0>();
-		double vy = v.first.get<1>();
-		double vz = v.first.get<2>();
-		double lon_v, lat_v;
-		UnitToLongLatDeg(vx, vy, vz, lon_v, lat_v);
-		box_3d b(pt_3d(vx-th, vy-th, vz-th), pt_3d(vx+th, vy+th, vz+th));
-		size_t obs = v.second;
-		vector<pt_3d_val> q;
-		rtree.query(bgi::intersects(b), std::back_inserter(q));
-		size_t lcnt = 0;
-		list<pt_3d_val> l;
-		BOOST_FOREACH(pt_3d_val const& w, q) {
-			if (w.second != v.second &&
-				bg::distance(v.first, w.first) <= th)
-			{
-				l.push_front(w);
-				++lcnt;
-			}
-		}
-		GwtElement& e = Wp->gwt[obs];
-		e.alloc(lcnt);
-		BOOST_FOREACH(pt_3d_val const& w, l) {
-			GwtNeighbor neigh;
-			neigh.nbx = w.second;
-			double wx = w.first.get<0>();
-			double wy = w.first.get<1>();
-			double wz = w.first.get<2>();
-			double lon_w, lat_w;
-			double d;
-			UnitToLongLatDeg(wx, wy, wz, lon_w, lat_w);
-			if (is_mi) {
-				d = ComputeArcDistMi(lon_v, lat_v, lon_w, lat_w);
-			} else {
-				d = ComputeArcDistKm(lon_v, lat_v, lon_w, lat_w);
-			}
-			neigh.weight = d;
-			e.Push(neigh);
-			++cnt;
-		}
+	vector<pt_3d_val> vals;
+	get_all_values(rtree, vals);
+	// one flag per task, exceptions can't cross the thread pool
+	vector<char> too_many((vals.size() + build_grain - 1) / build_grain, 0);
+	GdaThreadPool::GetInstance()->
+		ParallelFor(0, (int) vals.size()-1, build_grain,
+					boost::bind(&thresh_3d_range, &rtree, &vals, th, is_mi,
+								Wp->gwt, &too_many, token, _1, _2));
+	if (build_cancelled(token)) {
+		delete Wp;
+		return 0;
+	}
+	if (std::find(too_many.begin(), too_many.end(), 1) != too_many.end()) {
+		// clean up memory
+		delete Wp;
+		
+		wxString msg = _("Current threshold distance value in weights creation may cause memory problems. Please input a smaller distance band (which might leave some observations neighborless) or use another weights (e.g. KNN).");
+		throw GdaException(msg.mb_str());
 	}
 
 	stringstream ss;
 	ss << "Time to create arc " << th << " threshold GwtWeight,"
-	   << endl << "  with " << cnt << " total neighbors in ms : "
+	   << endl << "  with " << count_gwt_nbrs(Wp) << " total neighbors in ms : "
 	   << sw.Time();
 	return Wp;
 }
@@ -962,28 +1156,12 @@ GwtWeight* SpatialIndAlgs::knn_build(const rtree_pt_lonlat_t& rtree, int nn)
 	Wp->symmetry_checked = true;
 	Wp->gwt = new GwtElement[Wp->num_obs];
 	
-	int cnt=0;
-	const int k=nn+1;
-	for (rtree_pt_lonlat_t::const_query_iterator it =
-			 rtree.qbegin(bgi::intersects(rtree.bounds()));
-		 it != rtree.qend() ; ++it)
-	{
-		const pt_lonlat_val& v = *it;
-		size_t obs = v.second;		
-		vector<pt_lonlat_val> q;
-		rtree.query(bgi::nearest(v.first, k), std::back_inserter(q));
-		GwtElement& e = Wp->gwt[obs];
-		e.alloc(q.size());
-		BOOST_FOREACH(const pt_lonlat_val& w, q) {
-			if (w.second == v.second) continue;
-			GwtNeighbor neigh;
-			neigh.nbx = w.second;
-			neigh.weight = bg::distance(v.first, w.first);
-			e.Push(neigh);
-			++cnt;
-		}
-	}
-
+	vector<pt_lonlat_val> vals;
+	get_all_values(rtree, vals);
+	GdaThreadPool::GetInstance()->
+		ParallelFor(0, (int) vals.size()-1, build_grain,
+					boost::bind(&knn_lonlat_range, &rtree, &vals, nn+1,
+								Wp->gwt, _1, _2));
 	return Wp;
 }
 
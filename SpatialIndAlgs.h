@@ -29,6 +29,7 @@
 #include "GdaShape.h"
 #include "ShapeOperations/GwtWeight.h"
 
+class GdaCancelToken;
 
 namespace SpatialIndAlgs {
 
@@ -52,13 +53,18 @@ void knn_query(const rtree_pt_2d_t& rtree, int nn=6);
  build the correct type of rtree automatically.  If is_arc false,
  then Euclidean distance is used and x, y are normal coordinates and
  is_mi ignored.  If is_arc is true, then arc distances are used and distances
- reported in either kms or miles according to is_mi. */
+ reported in either kms or miles according to is_mi.  If token is given
+ and gets cancelled, the partial weights are freed and 0 is returned;
+ the same holds for the rtree versions and for thresh_build. */
 GwtWeight* knn_build(const std::vector<double>& x,
 										 const std::vector<double>& y,
-										 int nn, bool is_arc, bool is_mi);
-GwtWeight* knn_build(const rtree_pt_2d_t& rtree, int nn=6);
+										 int nn, bool is_arc, bool is_mi,
+					 const GdaCancelToken* token=0);
+GwtWeight* knn_build(const rtree_pt_2d_t& rtree, int nn=6,
+					 const GdaCancelToken* token=0);
 GwtWeight* knn_build(const rtree_pt_3d_t& rtree, int nn=6,
-					 bool is_arc=false, bool is_mi=true);
+					 bool is_arc=false, bool is_mi=true,
+					 const GdaCancelToken* token=0);
 double est_thresh_for_num_pairs(const rtree_pt_2d_t& rtree, double num_pairs);
 double est_thresh_for_avg_num_neigh(const rtree_pt_2d_t& rtree, double avg_n);
 double est_avg_num_neigh_thresh(const rtree_pt_2d_t& rtree, double th,
@@ -82,13 +88,16 @@ double est_median_distance(const std::vector<double>& x,
  according to is_mi. */
 GwtWeight* thresh_build(const std::vector<double>& x,
 												const std::vector<double>& y,
-												double th, bool is_arc, bool is_mi);
-GwtWeight* thresh_build(const rtree_pt_2d_t& rtree, double th);
+												double th, bool is_arc, bool is_mi,
+						const GdaCancelToken* token=0);
+GwtWeight* thresh_build(const rtree_pt_2d_t& rtree, double th,
+						const GdaCancelToken* token=0);
 double est_avg_num_neigh_thresh(const rtree_pt_3d_t& rtree, double th,
 								size_t trials=100);
 /** threshold th is the radius of intersection sphere with
   respect to the unit shpere of the 3d point rtree */
-GwtWeight* thresh_build(const rtree_pt_3d_t& rtree, double th, bool is_mi);
+GwtWeight* thresh_build(const rtree_pt_3d_t& rtree, double th, bool is_mi,
+						const GdaCancelToken* token=0);
 /** Find the nearest neighbor for all points and return the maximum
  distance of all of these nearest neighbor pairs.  This is the minimum
  threshold distance such that all points have at least one neighbor.
@@ -18,6 +18,8 @@
  */
 
 
+#include <algorithm>
+#include <iterator>
 #include <limits>
 #include <math.h>
 #include <map>
@@ -36,6 +38,7 @@
 #include <wx/graphics.h>
 #include <wx/dcgraph.h>
 
+#include <boost/bind.hpp>
 #include <boost/foreach.hpp>
 #include <boost/array.hpp>
 #include <boost/geometry/geometry.hpp>
@@ -48,6 +51,9 @@
 
 
 #include "GdaShape.h"
+#include "GdaGeomBuffer.h"
+#include "GdaRaster.h"
+#include "GdaThreadPool.h"
 #include "ShpFile.h"
 #include "GeoDa.h"
 #include "Project.h"
@@ -108,6 +114,7 @@ isResize(false),
 layer0_bm(0), layer1_bm(0), layer2_bm(0), faded_layer_bm(0),
 layer0_valid(false), layer1_valid(false), layer2_valid(false),
 total_hover_obs(0), max_hover_obs(11), hover_obs(11),
+sel_index_off(0,0), sel_index_dirty(true),
 is_pan_zoom(false), prev_scroll_pos_x(0), prev_scroll_pos_y(0),
 useScientificNotation(false), is_showing_brush(false),
 axis_display_precision(2),
@@ -341,13 +348,22 @@ void TemplateCanvas::ResizeSelectableShps(int virtual_scrn_w,
     
     // view: extent, margins, width, height
     last_scale_trans.SetView(vs_w, vs_h);
+	sel_index_dirty = true;
 
     if (last_scale_trans.IsValid()) {
 		BOOST_FOREACH( GdaShape* ms, background_shps ) {
 			ms->applyScaleTrans(last_scale_trans);
 		}
-		BOOST_FOREACH( GdaShape* ms, selectable_shps ) {
-			ms->applyScaleTrans(last_scale_trans);
+		if (selectable_shps_type == polygons) {
+			// each polygon only writes its own coordinates
+			GdaThreadPool::GetInstance()->
+				ParallelFor(0, (int) selectable_shps.size()-1, 256,
+							boost::bind(&TemplateCanvas::ApplyScaleTransRange,
+										this, _1, _2));
+		} else {
+			BOOST_FOREACH( GdaShape* ms, selectable_shps ) {
+				ms->applyScaleTrans(last_scale_trans);
+			}
 		}
     	BOOST_FOREACH( GdaShape* ms, foreground_shps ) {
     		ms->applyScaleTrans(last_scale_trans);
@@ -358,6 +374,15 @@ void TemplateCanvas::ResizeSelectableShps(int virtual_scrn_w,
     layer2_valid = false;
 }
 
+void TemplateCanvas::ApplyScaleTransRange(int first, int last)
+{
+	for (int i=first; i<=last; i++) {
+		if (selectable_shps[i]) {
+			selectable_shps[i]->applyScaleTrans(last_scale_trans);
+		}
+	}
+}
+
 void TemplateCanvas::ResetBrushing()
 {
     is_showing_brush = false;
@@ -450,7 +475,8 @@ void TemplateCanvas::SetMouseMode(MouseMode mode)
 }
 
 void TemplateCanvas::CreateSelShpsFromProj(vector<GdaShape*>& selectable_shps,
-                                           Project* project)
+                                           Project* project,
+                                           vector<wxPoint>* screen_pts)
 {
 	using namespace Shapefile;
 	
@@ -477,6 +503,17 @@ void TemplateCanvas::CreateSelShpsFromProj(vector<GdaShape*>& selectable_shps,
 	} else if (hdr.shape_type == Shapefile::POLYGON) {
 
 		PolygonContents* pc = 0;
+		const GdaGeomBuffer* geom = screen_pts ? project->GetGeomBuffer() : 0;
+		if (geom && geom->GetNumRecords() == num_recs) {
+			screen_pts->resize(geom->GetNumVertices());
+			wxPoint* pts = screen_pts->empty() ? 0 : &(*screen_pts)[0];
+			for (int i=0; i<num_recs; i++) {
+				pc = (PolygonContents*) records[i].contents_p;
+				selectable_shps[i] = new GdaPolygon(pc, geom, i,
+											pts + geom->vtx_start[i]);
+			}
+			return;
+		}
 		for (int i=0; i<num_recs; i++) {
 			pc = (PolygonContents*) records[i].contents_p;
 			selectable_shps[i] = new GdaPolygon(pc);
@@ -583,14 +620,71 @@ void TemplateCanvas::update(HLStateInt* o)
             faded_layer_bm = NULL;
         }
     }
-    // re-paint highlight layer (layer1_bm)
-	layer1_valid = false;
-    DrawLayers();
-    Refresh();
+    // re-paint highlight layer (layer1_bm), only around the shapes that
+    // changed when they are known.  Drawing is left to OnIdle, so that a
+    // burst of events while brushing is drawn once.
+	if (type == HLStateInt::delta && o->IsDeltaExact() && layer1_valid &&
+		AddLayer1Dirty(o)) {
+		layer2_valid = false;
+	} else {
+		layer1_valid = false;
+	}
     
     UpdateStatusBar();
 }
 
+/** Grows layer1_dirty by the screen boxes of the shapes changed by the
+ delta event of o, whose changes must be listed exactly.  Returns false if
+ all of layer1_bm has to be redrawn: the changes cover much of the canvas,
+ or the unhighlighted shapes start or stop being faded. */
+bool TemplateCanvas::AddLayer1Dirty(HLStateInt* o)
+{
+	if (!layer1_bm) return false;
+	if (selectable_shps_type != points && selectable_shps_type != polygons) {
+		return false;
+	}
+	if ((int) selectable_shps.size() != o->GetHighlightSize()) return false;
+	int nh = o->GetTotalNewlyHighlighted();
+	int nu = o->GetTotalNewlyUnhighlighted();
+	int total = o->GetTotalHighlighted();
+	if (total == 0 || total - nh + nu == 0) return false;
+	
+	int w = layer1_bm->GetWidth();
+	int h = layer1_bm->GetHeight();
+	int pad = 3; // covers the outline pen
+	if (selectable_shps_type == points) {
+		pad += (int) ceil(GdaConst::my_point_click_radius);
+	}
+	wxRect r(layer1_dirty);
+	for (int l=0; l<2; l++) {
+		vector<int>& ids = (l == 0 ? o->GetNewlyHighlighted() :
+							o->GetNewlyUnhighlighted());
+		for (int k=0, kend=(l == 0 ? nh : nu); k<kend; k++) {
+			GdaShape* shp = selectable_shps[ids[k]];
+			wxPoint a, b;
+			if (!shp || !shp->getScreenBBox(a, b)) continue;
+			r.Union(wxRect(a - wxPoint(pad, pad), b + wxPoint(pad, pad)));
+			// beyond this a full redraw is cheaper
+			if ((double) r.GetWidth() * r.GetHeight() > w*h/2.0) return false;
+		}
+	}
+	r.Intersect(wxRect(0, 0, w, h));
+	layer1_dirty = r;
+	return true;
+}
+
+/** True during a partial repaint of layer1_bm if the screen box of shp,
+ grown by pad, is outside of layer1_dirty, so that shp need not be drawn.
+ */
+bool TemplateCanvas::IsOutsideLayer1Dirty(GdaShape* shp, int pad)
+{
+	if (layer1_dirty.IsEmpty()) return false;
+	wxPoint a, b;
+	if (!shp->getScreenBBox(a, b)) return true;
+	return !layer1_dirty.Intersects(wxRect(a - wxPoint(pad, pad),
+										   b + wxPoint(pad, pad)));
+}
+
 void TemplateCanvas::RenderToDC(wxDC &dc, bool disable_crosshatch_brush)
 {
 	wxSize sz = GetClientSize();
@@ -618,7 +712,7 @@ void TemplateCanvas::DrawLayers()
         DrawLayer0();
     }
 
-    if (!layer1_valid)
+    if (!layer1_valid || !layer1_dirty.IsEmpty())
         DrawLayer1();
     
     if (!layer2_valid) {
@@ -648,6 +742,7 @@ void TemplateCanvas::DrawLayer0()
     }
     
     DrawSelectableShapes(dc);
+	sel_index_dirty = true; // redrawn because shapes may have changed
 
 
     dc.SelectObject(wxNullBitmap);
@@ -662,7 +757,13 @@ void TemplateCanvas::DrawLayer1()
     if (layer1_bm == NULL)
         return;
     wxMemoryDC dc(*layer1_bm);
-    dc.Clear();
+    if (!layer1_valid) layer1_dirty = wxRect();
+    if (!layer1_dirty.IsEmpty()) {
+        // partial repaint, everything below is drawn clipped
+        dc.SetClippingRegion(layer1_dirty);
+    } else {
+        dc.Clear();
+    }
     wxSize sz = GetClientSize();
     dc.SetPen(canvas_background_color);
     dc.SetBrush(canvas_background_color);
@@ -689,6 +790,7 @@ void TemplateCanvas::DrawLayer1()
     DrawHighlightedShapes(dc);
     
     dc.SelectObject(wxNullBitmap);
+    layer1_dirty = wxRect();
     layer1_valid = true;
     layer2_valid = false;
 }
@@ -885,6 +987,9 @@ void TemplateCanvas::helper_DrawSelectableShapes_dc(wxDC &dc, bool hl_only,
                 if (p->isNull()) {
                     continue;
                 }
+				if (hl_only && IsOutsideLayer1Dirty(p, (int) ceil(r)+1)) {
+					continue;
+				}
 				int bnd_idx = p->center.x + p->center.y*w;
 				if (bnd_idx >= 0 && bnd_idx < bnd && !dirty[bnd_idx]) {
 					dc.DrawCircle(p->center.x, p->center.y, r);
@@ -917,17 +1022,10 @@ void TemplateCanvas::helper_DrawSelectableShapes_dc(wxDC &dc, bool hl_only,
                 }
 				p = (GdaPolygon*) selectable_shps[ids[i]];
                 if (p->isNull()) continue;
-				if (p->all_points_same) {
-					dc.DrawPoint(p->center.x, p->center.y);
-
-				} else {
-
-					if (p->n_count > 1) {
-						dc.DrawPolyPolygon(p->n_count, p->count, p->points);
-					} else {
-						dc.DrawPolygon(p->n, p->points);
-					}
-				}
+				// not drawn if off the bitmap, the margin covers the pen
+				if (p->isOffScreen(w, h, 2)) continue;
+				if (hl_only && IsOutsideLayer1Dirty(p, 2)) continue;
+				p->paintShape(dc);
 			}
 		}
         
@@ -1000,6 +1098,107 @@ void TemplateCanvas::helper_DrawSelectableShapes_dc(wxDC &dc, bool hl_only,
 	}
 }
 
+bool TemplateCanvas::RasterizeSelectableShapes(GdaRaster& raster, bool hl_only,
+											   bool revert)
+{
+	if (selectable_shps_type != points && selectable_shps_type != polygons) {
+		return false;
+	}
+	vector<bool>& hs = GetSelBitVec();
+	
+	int cc_ts = cat_data.curr_canvas_tm_step;
+	int num_cats = cat_data.GetNumCategories(cc_ts);
+	int w = raster.GetWidth();
+	int h = raster.GetHeight();
+	
+	if (selectable_shps_type == points) {
+		int bnd = w*h;
+		vector<bool> dirty(bnd, false);
+		
+		double r = GdaConst::my_point_click_radius;
+		if (w < 150 || h < 150) {
+			r *= 0.66;
+		}
+		if (selectable_shps.size() > 100 && (w < 80 || h < 80)) {
+			r = 0.2;
+		}
+		for (int cat=0; cat<num_cats; cat++) {
+			wxColour clr = cat_data.GetCategoryColor(cc_ts, cat);
+			wxColour new_clr(clr.Red(), clr.Green(), clr.Blue(),
+							 GdaConst::plot_transparency_highlighted);
+			vector<int>& ids = cat_data.GetIdsRef(cc_ts, cat);
+			for (int i=0, iend=ids.size(); i<iend; i++) {
+				if (!_IsShpValid(ids[i]) || (hl_only && hs[ids[i]] == revert)) {
+					continue;
+				}
+				GdaPoint* p = (GdaPoint*) selectable_shps[ids[i]];
+				if (p->isNull()) continue;
+				if (hl_only && IsOutsideLayer1Dirty(p, (int) ceil(r)+1)) {
+					continue;
+				}
+				int bnd_idx = p->center.x + p->center.y*w;
+				if (bnd_idx >= 0 && bnd_idx < bnd && !dirty[bnd_idx]) {
+					raster.BeginShape(new_clr, true);
+					raster.AddCircleStroke(p->center, r, 1);
+					dirty[bnd_idx] = true;
+				}
+			}
+		}
+		return true;
+	}
+	
+	// polygons: solid fills and outlines only
+	for (int cat=0; cat<num_cats; cat++) {
+		wxBrush brush = cat_data.GetCategoryBrush(cc_ts, cat);
+		if (!brush.IsTransparent() &&
+			brush.GetStyle() != wxBRUSHSTYLE_SOLID) return false;
+		if (!selectable_outline_visible) continue;
+		wxPen pen = cat_data.GetCategoryPen(cc_ts, cat);
+		if (!pen.IsTransparent() &&
+			pen.GetStyle() != wxPENSTYLE_SOLID) return false;
+	}
+	for (int cat=0; cat<num_cats; cat++) {
+		wxBrush brush = cat_data.GetCategoryBrush(cc_ts, cat);
+		wxPen pen = cat_data.GetCategoryPen(cc_ts, cat);
+		bool fill = !brush.IsTransparent();
+		bool outline = selectable_outline_visible && !pen.IsTransparent();
+		double pen_w = std::max(1, pen.GetWidth());
+		vector<int>& ids = cat_data.GetIdsRef(cc_ts, cat);
+		for (int i=0, iend=ids.size(); i<iend; i++) {
+			if (!_IsShpValid(ids[i]) || (hl_only && hs[ids[i]] == revert)) {
+				continue;
+			}
+			GdaPolygon* p = (GdaPolygon*) selectable_shps[ids[i]];
+			if (p->isNull() || p->isOffScreen(w, h, 2)) continue;
+			if (hl_only && IsOutsideLayer1Dirty(p, 2)) continue;
+			const wxPoint* pts = 0;
+			const int* cnt = 0;
+			int rings = p->getDrawRings(pts, cnt);
+			if (rings == 0) {
+				// drawn by wxDC as a single pixel with the pen
+				if (outline) {
+					raster.BeginShape(pen.GetColour());
+					raster.AddSquare(p->center, 1);
+				}
+				continue;
+			}
+			if (fill) {
+				raster.BeginShape(brush.GetColour());
+				for (int c=0, start=0; c<rings; start+=cnt[c++]) {
+					raster.AddRing(cnt[c], pts+start);
+				}
+			}
+			if (outline) {
+				raster.BeginShape(pen.GetColour(), true);
+				for (int c=0, start=0; c<rings; start+=cnt[c++]) {
+					raster.AddStroke(cnt[c], pts+start, pen_w, true);
+				}
+			}
+		}
+	}
+	return true;
+}
+
 // draw unhighlighted selectable shapes with wxGraphicsContext
 void TemplateCanvas::helper_DrawSelectableShapes_gc(wxGraphicsContext &gc,
                                                     bool hl_only,
@@ -1570,9 +1769,8 @@ void TemplateCanvas::UpdateSelection(bool shiftdown, bool pointsel)
 		UpdateSelectionPoints(shiftdown, pointsel);
 	}
     
-    // re-paint highlight layer (layer1_bm)
-    layer1_valid = false;
-    DrawLayers();
+    // the highlight layer (layer1_bm) is repainted by OnIdle, see
+    // NotifySelection
     Refresh();
     
     UpdateStatusBar();
@@ -1587,84 +1785,47 @@ void TemplateCanvas::UpdateSelectionPoints(bool shiftdown, bool pointsel)
 	int hl_size = GetSelBitVec().size();
 	if (hl_size != selectable_shps.size()) return;
     
-	vector<bool>& hs = GetSelBitVec();
-    bool selection_changed = false;
-    
+	// only the shapes whose bounding box meets the brush can be selected,
+	// every box includes the shape's center
+	vector<int> cands;
+	vector<int> hits;
+	bool toggle = false;
 	if (pointsel) { // a point selection
-		for (int i=0; i<hl_size; i++) {
+		toggle = true;
+		// GdaPoint::pointWithin allows 3 pixels
+		QuerySelectableIndex(sel1, sel1, 3, cands);
+		for (size_t c=0; c<cands.size(); c++) {
+			int i = cands[c];
             if ( !_IsShpValid(i))
                 continue;
-			if (selectable_shps[i]->pointWithin(sel1)) {
-				if (hs[i]) {
-                    hs[i] = false;
-                    selection_changed = true;
-				} else {
-                    hs[i] = true;
-                    selection_changed = true;
-				}
-			} else {
-				if (!shiftdown && hs[i]) {
-                    hs[i] = false;
-                    selection_changed = true;
-				}
-			}			
+			if (selectable_shps[i]->pointWithin(sel1)) hits.push_back(i);
 		}
 	} else { // determine which obs intersect the selection region.
 		if (brushtype == rectangle) {
 			wxRegion rect(wxRect(sel1, sel2));
-			for (int i=0; i<hl_size; i++) {
+			QuerySelectableIndex(sel1, sel2, 0, cands);
+			for (size_t c=0; c<cands.size(); c++) {
+				int i = cands[c];
                 if ( !_IsShpValid(i))
                     continue;
-				bool contains = (rect.Contains(selectable_shps[i]->center) !=
-								 wxOutRegion);
-				if (!shiftdown) {
-					if (contains) {
-                        if (!hs[i]) {
-                            hs[i] = true;
-                            selection_changed = true;
-                        }
-					} else {
-                        if (hs[i]) {
-                            hs[i] = false;
-                            selection_changed = true;
-                        }
-					}
-				} else { // do not unhighlight if not in intersection region
-					if (contains && !hs[i]) {
-                        hs[i] = true;
-                        selection_changed = true;
-					}
+				if (rect.Contains(selectable_shps[i]->center) != wxOutRegion) {
+					hits.push_back(i);
 				}
 			}
 			
 		} else if (brushtype == circle) {
-			// using quad-tree to do pre-selection
-			
-			
 			double radius = GenUtils::distance(sel1, sel2);
+			int r = (int) ceil(radius);
+			QuerySelectableIndex(sel1 - wxPoint(r,r), sel1 + wxPoint(r,r), 0,
+								 cands);
 			// determine if each center is within radius of sel1
-			for (int i=0; i<hl_size; i++) {
+			for (size_t c=0; c<cands.size(); c++) {
+				int i = cands[c];
                 if ( !_IsShpValid(i) )
                     continue;
-				bool contains = (GenUtils::distance(sel1, selectable_shps[i]->center)
-								 <= radius);
-				if (!shiftdown) {
-					if (contains) {
-                        if (!hs[i]) {
-                            hs[i] = true;
-                            selection_changed = true;
-                        }
-					} else {
-                        if (hs[i]) {
-                            hs[i] = false;
-                            selection_changed = true;
-                        }
-					}
-				} else { // do not unhighlight if not in intersection region
-					if (contains && !hs[i]) {
-                        hs[i] = true;
-                        selection_changed = true;
-					}
+				if (GenUtils::distance(sel1, selectable_shps[i]->center)
+					<= radius) {
+					hits.push_back(i);
 				}
 			}
 		} else if (brushtype == line) {
@@ -1683,7 +1844,9 @@ void TemplateCanvas::UpdateSelectionPoints(bool shiftdown, bool pointsel)
 			double p2yMp1y = p2y - p1y;
 			double dp1p2 = GenUtils::distance(sel1, sel2);
 			double delta = 3.0 * dp1p2;
-			for (int i=0; i<hl_size; i++) {
+			QuerySelectableIndex(sel1, sel2, 0, cands);
+			for (size_t c=0; c<cands.size(); c++) {
+				int i = cands[c];
                 if ( !_IsShpValid(i) )
                     continue;
 				bool contains = (rect.Contains(selectable_shps[i]->center) !=
@@ -1696,31 +1859,11 @@ void TemplateCanvas::UpdateSelectionPoints(bool shiftdown, bool pointsel)
 					if (abs(p2xMp1x * (p1y-p0y) - (p1x-p0x) * p2yMp1y) >
 						delta ) contains = false;
 				}
-				if (!shiftdown) {
-					if (contains) {
-                        if (!hs[i]) {
-                            hs[i] = true;
-                            selection_changed = true;
-                        }
-					} else {
-                        if (hs[i]) {
-                            hs[i] = false;
-                            selection_changed = true;
-                        }
-					}
-				} else { // do not unhighlight if not in intersection region
-					if (contains && !hs[i]) {
-                        hs[i] = true;
-                        selection_changed = true;
-					}
-				}
+				if (contains) hits.push_back(i);
 			}
 		}
 	}
-	if ( selection_changed ) {
-		highlight_state->SetEventType(HLStateInt::delta);
-		highlight_state->notifyObservers(this);
-	}
+	if ( ApplySelection(hits, shiftdown, toggle) ) NotifySelection();
 }
 
 // The following function assumes that the set of selectable objects
@@ -1730,29 +1873,21 @@ void TemplateCanvas::UpdateSelectionCircles(bool shiftdown, bool pointsel)
 	int hl_size = GetSelBitVec().size();
 	if (hl_size != selectable_shps.size()) return;
     
-	vector<bool>& hs = GetSelBitVec();
-    bool selection_changed = false;
-	
+	vector<int> cands;
+	vector<int> hits;
+	bool toggle = false;
 	if (pointsel) { // a point selection
-		for (int i=0; i<hl_size; i++) {
+		toggle = true;
+		QuerySelectableIndex(sel1, sel1, 0, cands);
+		for (size_t c=0; c<cands.size(); c++) {
+			int i = cands[c];
             if ( !_IsShpValid(i))
                 continue;
 			GdaCircle* s = (GdaCircle*) selectable_shps[i];
 			if (s->isNull()) continue;
 			if (GenUtils::distance(s->center, sel1) <= s->radius) {
-				if (hs[i]) {
-                    hs[i] = false;
-                    selection_changed = true;
-				} else {
-                    hs[i] = true;
-                    selection_changed = true;
-				}
-			} else {
-				if (!shiftdown && hs[i]) {
-                    hs[i] = false;
-                    selection_changed = true;
-				}
-			}			
+				hits.push_back(i);
+			}
 		}
 	} else {
 		if (brushtype == rectangle) {
@@ -1761,7 +1896,9 @@ void TemplateCanvas::UpdateSelectionCircles(bool shiftdown, bool pointsel)
 			double rect_y = rect.GetPosition().y;
 			double half_rect_w = fabs((double) (sel1.x - sel2.x))/2.0;
 			double half_rect_h = fabs((double) (sel1.y - sel2.y))/2.0;
-			for (int i=0; i<hl_size; i++) {
+			QuerySelectableIndex(sel1, sel2, 0, cands);
+			for (size_t c=0; c<cands.size(); c++) {
+				int i = cands[c];
                 if ( !_IsShpValid(i))
                     continue;
                 
@@ -1782,58 +1919,34 @@ void TemplateCanvas::UpdateSelectionCircles(bool shiftdown, bool pointsel)
 					double corner_dist_sq = t1*t1 + t2*t2;
 					contains = corner_dist_sq <= (s->radius)*(s->radius); 
 				}
-				if (!shiftdown) {
-					if (contains) {
-                        if (!hs[i])  {
-                            hs[i] = true;
-                            selection_changed = true;
-                        }
-					} else {
-                        if (hs[i]) {
-                            hs[i] = false;
-                            selection_changed = true;
-                        }
-					}
-				} else { // do not unhighlight if not in intersection region
-					if (contains && !hs[i]) {
-                        hs[i] = true;
-                        selection_changed = true;
-					}
-				}
+				if (contains) hits.push_back(i);
 			}
 		} else if (brushtype == circle) {
 			double radius = GenUtils::distance(sel1, sel2);
+			int r = (int) ceil(radius);
+			QuerySelectableIndex(sel1 - wxPoint(r,r), sel1 + wxPoint(r,r), 0,
+								 cands);
 			// determine if circles overlap
-			for (int i=0; i<hl_size; i++) {
+			for (size_t c=0; c<cands.size(); c++) {
+				int i = cands[c];
                 if ( !_IsShpValid(i))
                     continue;
 				GdaCircle* s = (GdaCircle*) selectable_shps[i];
 				if (s->isNull()) continue;
-				bool contains = (radius + s->radius >=
-								 GenUtils::distance(sel1, s->center));
-				if (!shiftdown) {
-					if (contains) {
-                        if (!hs[i]) {
-                            hs[i] = true;
-                            selection_changed = true;
-                        }
-					} else {
-                        if (hs[i])  {
-                            hs[i] = false;
-                            selection_changed = true;
-                        }
-					}
-				} else { // do not unhighlight if not in intersection region
-					if (contains && !hs[i]) {
-                        hs[i] = true;
-                        selection_changed = true;
-					}
+				if (radius + s->radius >= GenUtils::distance(sel1, s->center)) {
+					hits.push_back(i);
 				}
 			}
 		} else if (brushtype == line) {
 			wxRealPoint hp((sel1.x+sel2.x)/2.0, (sel1.y+sel2.y)/2.0);
 			double hp_rad = GenUtils::distance(sel1, sel2)/2.0;
-			for (int i=0; i<hl_size; i++) {
+			// circles that reach within hp_rad of hp
+			int r = (int) ceil(hp_rad);
+			wxPoint hp_i((int) hp.x, (int) hp.y);
+			QuerySelectableIndex(hp_i - wxPoint(r,r), hp_i + wxPoint(r,r), 1,
+								 cands);
+			for (size_t c=0; c<cands.size(); c++) {
+				int i = cands[c];
                 if ( !_IsShpValid(i))
                     continue;
 				GdaCircle* s = (GdaCircle*) selectable_shps[i];
@@ -1843,32 +1956,12 @@ void TemplateCanvas::UpdateSelectionCircles(bool shiftdown, bool pointsel)
 								 s->radius) &&
 								 (GenUtils::distance(hp, s->center) <=
 								  hp_rad + s->radius));
-				if (!shiftdown) {
-					if (contains) {
-                        if (!hs[i]) {
-                            hs[i] = true;
-                            selection_changed = true;
-                        }
-					} else {
-                        if (hs[i])  {
-                            hs[i] = false;
-                            selection_changed = true;
-                        }
-					}
-				} else { // do not unhighlight if not in intersection region
-					if (contains && !hs[i]) {
-                        hs[i] = true;
-                        selection_changed = true;
-					}
-				}
+				if (contains) hits.push_back(i);
 			}
 		}
 	}
 
-	if ( selection_changed ) {
-		highlight_state->SetEventType(HLStateInt::delta);
-		highlight_state->notifyObservers(this);
-	}
+	if ( ApplySelection(hits, shiftdown, toggle) ) NotifySelection();
 }
 
 // The following function assumes that the set of selectable objects
@@ -1878,15 +1971,20 @@ void TemplateCanvas::UpdateSelectionPolylines(bool shiftdown, bool pointsel)
 	int hl_size = GetSelBitVec().size();
 	if (hl_size != selectable_shps.size()) return;
     
-	vector<bool>& hs = GetSelBitVec();
-    bool selection_changed = false;
-	
+	// A point within distance r of a segment, in the sense of the tests
+	// below, is at most r*sqrt(2) outside the segment's bounding box.
+	vector<int> cands;
+	vector<int> hits;
+	bool toggle = false;
 	GdaPolyLine* p;
 	if (pointsel) { // a point selection
+		toggle = true;
 		double radius = 3.0;
 		wxRealPoint hp;
 		double hp_rad;
-		for (int i=0; i<hl_size; i++) {
+		QuerySelectableIndex(sel1, sel1, (int) ceil(radius*1.5), cands);
+		for (size_t c=0; c<cands.size(); c++) {
+			int i = cands[c];
             if ( !_IsShpValid(i))
                 continue;
 			p = (GdaPolyLine*) selectable_shps[i];
@@ -1908,20 +2006,7 @@ void TemplateCanvas::UpdateSelectionPolylines(bool shiftdown, bool pointsel)
 					break;
 				}
 			}
-			if (contains) {
-				if (hs[i]) {
-                    hs[i] = false;
-                    selection_changed = true;
-				} else {
-                    hs[i] = true;
-                    selection_changed = true;
-				}
-			} else {
-				if (!shiftdown && hs[i]) {
-                    hs[i] = false;
-                    selection_changed = true;
-				}
-			}
+			if (contains) hits.push_back(i);
 		}
 	} else { // determine which obs intersect the selection region.
 		if (brushtype == rectangle) {
@@ -1934,7 +2019,9 @@ void TemplateCanvas::UpdateSelectionPolylines(bool shiftdown, bool pointsel)
 			uleft.y = uright.y;
 			lright.x = uright.x;
 			lright.y = lleft.y;
-			for (int i=0; i<hl_size; i++) {
+			QuerySelectableIndex(sel1, sel2, 0, cands);
+			for (size_t c=0; c<cands.size(); c++) {
+				int i = cands[c];
                 if ( !_IsShpValid(i))
                     continue;
 				p = (GdaPolyLine*) selectable_shps[i];
@@ -1952,27 +2039,12 @@ void TemplateCanvas::UpdateSelectionPolylines(bool shiftdown, bool pointsel)
 						break;
 					}
 				}
-				if (!shiftdown) {
-					if (contains) {
-                        if (!hs[i])  {
-                            hs[i] = true;
-                            selection_changed = true;
-                        }
-					} else {
-                        if (hs[i]) {
-                            hs[i] = false;
-                            selection_changed = true;
-                        }
-					}
-				} else { // do not unhighlight if not in intersection region
-					if (contains && !hs[i]) {
-                        hs[i] = true;
-                        selection_changed = true;
-					}
-				}
+				if (contains) hits.push_back(i);
 			}
 		} else if (brushtype == line) {
-			for (int i=0; i<hl_size; i++) {
+			QuerySelectableIndex(sel1, sel2, 0, cands);
+			for (size_t c=0; c<cands.size(); c++) {
+				int i = cands[c];
                 if ( !_IsShpValid(i))
                     continue;
                 
@@ -1988,30 +2060,15 @@ void TemplateCanvas::UpdateSelectionPolylines(bool shiftdown, bool pointsel)
 						break;
 					}
 				}
-				if (!shiftdown) {
-					if (contains) {
-                        if (!hs[i]) {
-                            hs[i] = true;
-                            selection_changed = true;
-                        }
-					} else {
-                        if (hs[i])  {
-                            hs[i] = false;
-                            selection_changed = true;
-                        }
-					}
-				} else { // do not unhighlight if not in intersection region
-					if (contains && !hs[i]) {
-                        hs[i] = true;
-                        selection_changed = true;
-					}
-				}
+				if (contains) hits.push_back(i);
 			}	
 		} else if (brushtype == circle) {
 			double radius = GenUtils::distance(sel1, sel2);
 			wxRealPoint hp;
 			double hp_rad;
-			for (int i=0; i<hl_size; i++) {
+			QuerySelectableIndex(sel1, sel1, (int) ceil(radius*1.5), cands);
+			for (size_t c=0; c<cands.size(); c++) {
+				int i = cands[c];
                 if ( !_IsShpValid(i))
                     continue;
                 
@@ -2032,31 +2089,181 @@ void TemplateCanvas::UpdateSelectionPolylines(bool shiftdown, bool pointsel)
 						break;
 					}
 				}
-				if (!shiftdown) {
-					if (contains) {
-                        if (!hs[i])  {
-                            hs[i] = true;
-                            selection_changed = true;
-                        }
-					} else {
-                        if (hs[i])  {
-                            hs[i] = false;
-                            selection_changed = true;
-                        }
-					}
-				} else { // do not unhighlight if not in intersection region
-					if (contains && !hs[i]) {
-                        hs[i] = true;
-                        selection_changed = true;
-					}
+				if (contains) hits.push_back(i);
+			}
+		}
+	}
+	if ( ApplySelection(hits, shiftdown, toggle) ) NotifySelection();
+}
+
+/** Sends the delta event recorded by ApplySelection to the other views
+ and, like update() does for them, marks only the changed shapes of this
+ canvas for repainting.  Drawing is left to OnIdle, so that brushing
+ does not repaint all of layer1_bm on every mouse move. */
+void TemplateCanvas::NotifySelection()
+{
+	highlight_state->SetEventType(HLStateInt::delta);
+	highlight_state->notifyObservers(this);
+	// notifyObservers clears the exact flag, but ApplySelection listed
+	// every change
+	if (layer1_valid && AddLayer1Dirty(highlight_state)) {
+		layer2_valid = false;
+	} else {
+		layer1_valid = false;
+	}
+}
+
+/** Applies the result of a brush or click.  hits lists, in ascending
+ order, the valid observations the selection tool covers.  They are
+ highlighted, or toggled for a point selection.  Without shiftdown every
+ other valid observation is unhighlighted.  Returns true if anything
+ changed. */
+bool TemplateCanvas::ApplySelection(const vector<int>& hits, bool shiftdown,
+									bool toggle)
+{
+	vector<bool>& hs = GetSelBitVec();
+	// every change is recorded, so that observers can redraw only those
+	vector<int>& nh = GetNewlySelList();
+	vector<int>& nu = GetNewlyUnselList();
+	int nh_cnt = 0;
+	int nu_cnt = 0;
+	for (size_t k=0; k<hits.size(); k++) {
+		int i = hits[k];
+		if (toggle || !hs[i]) {
+			hs[i] = !hs[i];
+			if (hs[i]) nh[nh_cnt++] = i;
+			else nu[nu_cnt++] = i;
+		}
+	}
+	if (!shiftdown) {
+		size_t k = 0;
+		for (int i=0, iend=hs.size(); i<iend; i++) {
+			if (k < hits.size() && hits[k] == i) {
+				k++;
+				continue;
+			}
+			if (hs[i] && _IsShpValid(i)) {
+				hs[i] = false;
+				nu[nu_cnt++] = i;
+			}
+		}
+	}
+	if (nh_cnt == 0 && nu_cnt == 0) return false;
+	SetNumNewlySel(nh_cnt);
+	SetNumNewlyUnsel(nu_cnt);
+	highlight_state->SetDeltaExact(true);
+	return true;
+}
+
+/** Brings the screen-space index of selectable_shps up to date.  Shapes
+ are only re-indexed if they moved relative to each other: a pan moves
+ everything by the same offset, which is kept in sel_index_off instead.
+ Since screen coordinates are truncated, a shape counts as unmoved if it
+ is within sel_index_slack pixels of where the index expects it, and
+ queries are widened by the same amount. */
+void TemplateCanvas::SyncSelectableIndex()
+{
+	int n = selectable_shps.size();
+	if (!sel_index_dirty && (size_t) n == sel_index_min.size()) return;
+	sel_index_dirty = false;
+	
+	// null shapes get an empty box, min.x > max.x
+	vector<wxPoint> mins(n, wxPoint(1,0));
+	vector<wxPoint> maxs(n, wxPoint(0,0));
+	for (int i=0; i<n; i++) {
+		if (!selectable_shps[i] ||
+			!selectable_shps[i]->getScreenBBox(mins[i], maxs[i])) {
+			mins[i] = wxPoint(1,0);
+			maxs[i] = wxPoint(0,0);
+		}
+	}
+	
+	bool rebuild = ((size_t) n != sel_index_min.size());
+	if (!rebuild) {
+		// common offset, taken from the first shape that has a box
+		wxPoint off(0,0);
+		for (int i=0; i<n; i++) {
+			if (mins[i].x <= maxs[i].x &&
+				sel_index_min[i].x <= sel_index_max[i].x) {
+				off = mins[i] - sel_index_min[i];
+				break;
+			}
+		}
+		const int sl = sel_index_slack;
+		vector<int> moved;
+		for (int i=0; i<n && moved.size() <= (size_t) n/8; i++) {
+			bool has_box = mins[i].x <= maxs[i].x;
+			bool had_box = sel_index_min[i].x <= sel_index_max[i].x;
+			if (!has_box && !had_box) continue;
+			if (has_box != had_box ||
+				abs(mins[i].x - off.x - sel_index_min[i].x) > sl ||
+				abs(mins[i].y - off.y - sel_index_min[i].y) > sl ||
+				abs(maxs[i].x - off.x - sel_index_max[i].x) > sl ||
+				abs(maxs[i].y - off.y - sel_index_max[i].y) > sl) {
+				moved.push_back(i);
+			}
+		}
+		if (moved.size() > (size_t) n/8) {
+			rebuild = true;
+		} else {
+			for (size_t k=0; k<moved.size(); k++) {
+				int i = moved[k];
+				if (sel_index_min[i].x <= sel_index_max[i].x) {
+					sel_index.remove(std::make_pair(
+						box_2d(pt_2d(sel_index_min[i].x, sel_index_min[i].y),
+							   pt_2d(sel_index_max[i].x, sel_index_max[i].y)),
+						(unsigned) i));
+				}
+				sel_index_min[i] = mins[i] - off;
+				sel_index_max[i] = maxs[i] - off;
+				if (mins[i].x <= maxs[i].x) {
+					sel_index.insert(std::make_pair(
+						box_2d(pt_2d(sel_index_min[i].x, sel_index_min[i].y),
+							   pt_2d(sel_index_max[i].x, sel_index_max[i].y)),
+						(unsigned) i));
 				}
 			}
+			sel_index_off = off;
 		}
 	}
-	if ( selection_changed ) {
-		highlight_state->SetEventType(HLStateInt::delta);
-		highlight_state->notifyObservers(this);
+	if (!rebuild) return;
+	
+	sel_index_min.swap(mins);
+	sel_index_max.swap(maxs);
+	sel_index_off = wxPoint(0,0);
+	vector<box_2d_val> vals;
+	vals.reserve(n);
+	for (int i=0; i<n; i++) {
+		if (sel_index_min[i].x > sel_index_max[i].x) continue;
+		vals.push_back(std::make_pair(
+			box_2d(pt_2d(sel_index_min[i].x, sel_index_min[i].y),
+				   pt_2d(sel_index_max[i].x, sel_index_max[i].y)),
+			(unsigned) i));
 	}
+	// bulk loading packs the tree, much faster than one insert at a time
+	rtree_box_2d_t tree(vals.begin(), vals.end());
+	sel_index.swap(tree);
+}
+
+/** ids, in ascending order, of the selectable shapes whose bounding box
+ meets the rectangle spanned by a and b grown by pad pixels.  A superset
+ of the shapes a selection test can accept, if pad covers the tolerance of
+ that test. */
+void TemplateCanvas::QuerySelectableIndex(const wxPoint& a, const wxPoint& b,
+										  int pad, vector<int>& ids)
+{
+	SyncSelectableIndex();
+	ids.clear();
+	int g = pad + sel_index_slack;
+	box_2d q(pt_2d(min(a.x, b.x) - g - sel_index_off.x,
+				   min(a.y, b.y) - g - sel_index_off.y),
+			 pt_2d(max(a.x, b.x) + g - sel_index_off.x,
+				   max(a.y, b.y) + g - sel_index_off.y));
+	vector<box_2d_val> found;
+	sel_index.query(bgi::intersects(q), back_inserter(found));
+	ids.resize(found.size());
+	for (size_t k=0; k<found.size(); k++) ids[k] = found[k].second;
+	sort(ids.begin(), ids.end());
 }
 
 void TemplateCanvas::SelectAllInCategory(int category,
@@ -2131,10 +2338,13 @@ void TemplateCanvas::NotifyObservables()
 void TemplateCanvas::DetermineMouseHoverObjects(wxPoint pt)
 {
 	total_hover_obs = 0;
-	int total_obs = selectable_shps.size();
+	// candidates come in ascending order, as the full scan found them
+	vector<int> cands;
 	if (selectable_shps_type == circles) {
+		QuerySelectableIndex(pt, pt, 0, cands);
 		// slightly faster than GdaCircle::pointWithin
-		for (int i=0; i<total_obs && total_hover_obs<max_hover_obs; i++) {
+		for (size_t c=0; c<cands.size() && total_hover_obs<max_hover_obs; c++) {
+			int i = cands[c];
             if ( !_IsShpValid(i))
                 continue;
 			GdaCircle* s = (GdaCircle*) selectable_shps[i];
@@ -2148,7 +2358,10 @@ void TemplateCanvas::DetermineMouseHoverObjects(wxPoint pt)
 			   selectable_shps_type == polylines ||
                selectable_shps_type == rectangles)
 	{
-		for (int i=0; i<total_obs && total_hover_obs<max_hover_obs; i++) {
+		// GdaPolyLine::pointWithin accepts points 3 pixels off a segment
+		QuerySelectableIndex(pt, pt, 5, cands);
+		for (size_t c=0; c<cands.size() && total_hover_obs<max_hover_obs; c++) {
+			int i = cands[c];
             if ( !_IsShpValid(i))
                 continue;
 			if (selectable_shps[i]->pointWithin(pt)) {
@@ -2157,7 +2370,9 @@ void TemplateCanvas::DetermineMouseHoverObjects(wxPoint pt)
 		}
 	} else { // selectable_shps_type == points or anything without pointWithin
 		const double r2 = GdaConst::my_point_click_radius;
-		for (int i=0; i<total_obs && total_hover_obs<max_hover_obs; i++) {
+		QuerySelectableIndex(pt, pt, 5, cands);
+		for (size_t c=0; c<cands.size() && total_hover_obs<max_hover_obs; c++) {
+			int i = cands[c];
             if ( !_IsShpValid(i))
                 continue;
 			if (GenUtils::distance_sqrd(selectable_shps[i]->center, pt)
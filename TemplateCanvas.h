@@ -37,11 +37,13 @@
 #include "HighlightStateObserver.h"
 #include "GdaShape.h"
 #include "GdaConst.h"
+#include "SpatialIndTypes.h"
 
 typedef boost::multi_array<GdaShape*, 2> shp_array_type;
 typedef boost::multi_array<int, 2> i_array_type;
 
 class CatClassifManager;
+class GdaRaster;
 class Project;
 class TemplateFrame;
 
@@ -219,8 +221,12 @@ public:
 	/** generic function to create and initialized the selectable_shps vector
 		based on a passed-in Project pointer and given an initial canvas
 	    screen size. */
+	/** Polygons share the project's GdaGeomBuffer when screen_pts is
+	 given: their screen coordinates are then slices of *screen_pts, which
+	 must outlive them and is not touched until they are deleted. */
 	static void CreateSelShpsFromProj(std::vector<GdaShape*>& selectable_shps,
-                               Project* project);
+                               Project* project,
+                               std::vector<wxPoint>* screen_pts = 0);
 	
 	/** convert mouse coordiante point to original observation-coordinate
 	 points.  This is an inverse of the affine transformation that converts
@@ -269,6 +275,12 @@ public:
     void helper_DrawSelectableShapes_gc(wxGraphicsContext &gc, bool hl_only=false,
                                         bool revert=false,
                                         bool crosshatch= false);
+	/** Records the selectable shapes in raster, in the order and colours
+	 of helper_DrawSelectableShapes_dc.  Returns false, with nothing
+	 recorded, for layers that need a wxDC: hatched brushes, dashed pens,
+	 circles and polylines. */
+	bool RasterizeSelectableShapes(GdaRaster& raster, bool hl_only=false,
+								   bool revert=false);
     
 
     void SetTransparency(double _transparency) {
@@ -347,6 +359,27 @@ protected:
 	std::vector<int> hover_obs; // list of obs mouse is hovering over
 	int total_hover_obs; // total obs in list
 	int max_hover_obs;
+	
+	// Screen-space R-tree over the bounding boxes of selectable_shps, so
+	// that selection and hover only test shapes near the mouse.  Entries
+	// are shifted by -sel_index_off, see SyncSelectableIndex().
+	rtree_box_2d_t sel_index;
+	std::vector<wxPoint> sel_index_min; // min.x > max.x for null shapes
+	std::vector<wxPoint> sel_index_max;
+	wxPoint sel_index_off;
+	bool sel_index_dirty; // set whenever shapes may have moved
+	static const int sel_index_slack = 2;
+	void SyncSelectableIndex();
+	void QuerySelectableIndex(const wxPoint& a, const wxPoint& b, int pad,
+							  std::vector<int>& ids);
+	bool ApplySelection(const std::vector<int>& hits, bool shiftdown,
+						bool toggle);
+	void NotifySelection();
+	
+	// screen coordinates of all selectable polygons, see
+	// CreateSelShpsFromProj
+	std::vector<wxPoint> sel_screen_pts;
+	void ApplyScaleTransRange(int first, int last);
 	// preserve current map bounding box for zoom/pan
 	bool is_pan_zoom;
 	int  prev_scroll_pos_x;
@@ -361,6 +394,12 @@ protected:
 	bool layer0_valid; // if false, then needs to be redrawn
 	bool layer1_valid; // if false, then needs to be redrawn
 	bool layer2_valid; // if flase, then needs to be redrawn
+	// Part of layer1_bm that is out of date while layer1_valid is still
+	// true: a delta event that changes a few shapes only repaints around
+	// them.  Empty when there is nothing to repaint, see update().
+	wxRect layer1_dirty;
+	bool AddLayer1Dirty(HLStateInt* o);
+	bool IsOutsideLayer1Dirty(GdaShape* shp, int pad);
 	
 	Project* project;
 	TemplateFrame* template_frame;
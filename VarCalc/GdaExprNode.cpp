@@ -0,0 +1,407 @@
+/**
+ * GeoDa TM, Copyright (C) 2011-2015 by Luc Anselin - all rights reserved
+ *
+ * This file is part of GeoDa.
+ * 
+ * GeoDa is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+ *
+ * GeoDa is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program.  If not, see <http://www.gnu.org/licenses/>.
+ */
+
+#include <algorithm>
+#include <math.h>
+#include <boost/bind.hpp>
+#include "../GdaThreadPool.h"
+#include "GdaParser.h"
+#include "WeightsManInterface.h"
+#include "GdaExprNode.h"
+
+/**
+ * An element-wise subtree of GdaExprNode flattened into instructions over
+ * chunk sized registers.  Operands are leaves (encoded as -1-leaf_index)
+ * or registers (0, 1, ...).  Registers are assigned by depth so that a
+ * program needs no more registers than the subtree is deep.
+ */
+class GdaExprProgram {
+public:
+	GdaExprProgram(const GdaExprNode* root, WeightsManInterface* w_man_int);
+	void Run(GdaFlexValue& out);
+	
+private:
+	struct Instr {
+		GdaExprNode::OpType op;
+		int dst, a, b;
+		double (*uni_f)(double);
+		double (*bin_f)(double, double);
+	};
+	enum LeafKind { SCALAR, FULL, BROADCAST };
+	
+	int Emit(const GdaExprNode* n, int depth, WeightsManInterface* w_man_int);
+	void RunChunks(double* out, int c_start, int c_end);
+	void Gather(int l, size_t k0, int len, double* buf) const;
+	static void Exec(const Instr& ins, const double* a, const double* b,
+					 double* d, int len);
+	
+	std::vector<GdaFVSmtPtr> leaves;
+	std::vector<LeafKind> leaf_kind;
+	std::vector<Instr> code;
+	int num_regs;
+	int result;
+	size_t obs, tms, size;
+};
+
+GdaExprProgram::GdaExprProgram(const GdaExprNode* root,
+							   WeightsManInterface* w_man_int)
+: num_regs(0), obs(1), tms(1), size(1)
+{
+	result = Emit(root, 0, w_man_int);
+	
+	// shape of the result, as repeated grow_if_smaller calls would give
+	for (size_t l=0; l<leaves.size(); ++l) {
+		const GdaFlexValue& v = *leaves[l];
+		if (v.GetObs() != 1) {
+			if (obs != 1 && obs != v.GetObs()) {
+				throw GdaFVException("number of obs mismatch");
+			}
+			obs = v.GetObs();
+		}
+		if (v.GetTms() != 1) {
+			if (tms != 1 && tms != v.GetTms()) {
+				throw GdaFVException("number of tms mismatch");
+			}
+			tms = v.GetTms();
+		}
+	}
+	size = obs*tms;
+	leaf_kind.resize(leaves.size());
+	for (size_t l=0; l<leaves.size(); ++l) {
+		const GdaFlexValue& v = *leaves[l];
+		if (v.GetObs() == obs && v.GetTms() == tms) {
+			leaf_kind[l] = FULL;
+		} else if (v.GetConstValArrayRef().size() == 1) {
+			leaf_kind[l] = SCALAR;
+		} else {
+			leaf_kind[l] = BROADCAST;
+		}
+	}
+}
+
+int GdaExprProgram::Emit(const GdaExprNode* n, int depth,
+						 WeightsManInterface* w_man_int)
+{
+	if (!n->IsElementWise()) {
+		// leaves and whole column functions are evaluated up front, in the
+		// same left to right order as the operators that use them
+		GdaFVSmtPtr v = (n->op == GdaExprNode::LEAF) ? n->val
+			: n->Eval(w_man_int);
+		if (!v->IsData()) {
+			throw GdaFVException("value expected data expression");
+		}
+		leaves.push_back(v);
+		return -((int) leaves.size());
+	}
+	int a = Emit(n->args[0].get(), depth, w_man_int);
+	int b = -1;
+	if (n->args.size() > 1) {
+		// a register holding the first operand must survive the second
+		b = Emit(n->args[1].get(), a >= 0 ? depth+1 : depth, w_man_int);
+	}
+	Instr ins;
+	ins.op = n->op;
+	ins.dst = depth;
+	ins.a = a;
+	ins.b = b;
+	ins.uni_f = n->uni_f;
+	ins.bin_f = n->bin_f;
+	code.push_back(ins);
+	num_regs = std::max(num_regs, depth+1);
+	return depth;
+}
+
+void GdaExprProgram::Run(GdaFlexValue& out)
+{
+	out.SetSize(obs, tms);
+	if (size == 0) return;
+	double* o = &out.GetValArrayRef()[0];
+	const int cs = GdaExprNode::chunk_size;
+	int num_chunks = (int) ((size-1)/cs + 1);
+	if (num_chunks < 16) {
+		RunChunks(o, 0, num_chunks-1);
+	} else {
+		GdaThreadPool::GetInstance()->
+			ParallelFor(0, num_chunks-1, 8,
+						boost::bind(&GdaExprProgram::RunChunks, this, o,
+									_1, _2));
+	}
+}
+
+void GdaExprProgram::RunChunks(double* out, int c_start, int c_end)
+{
+	const int cs = GdaExprNode::chunk_size;
+	size_t num_leaves = leaves.size();
+	// per task scratch: registers, then one chunk per scalar or
+	// broadcast leaf.  Full size leaves are read in place.
+	std::vector<double> scratch((num_regs + num_leaves) * cs);
+	double* regs = &scratch[0];
+	std::vector<const double*> lp(num_leaves);
+	for (size_t l=0; l<num_leaves; ++l) {
+		if (leaf_kind[l] != SCALAR) continue;
+		double* buf = &scratch[(num_regs + l) * cs];
+		std::fill(buf, buf+cs, leaves[l]->GetDouble());
+		lp[l] = buf;
+	}
+	for (int c=c_start; c<=c_end; ++c) {
+		size_t k0 = ((size_t) c) * cs;
+		int len = (int) std::min((size_t) cs, size-k0);
+		for (size_t l=0; l<num_leaves; ++l) {
+			if (leaf_kind[l] == FULL) {
+				lp[l] = &leaves[l]->GetValArrayRef()[k0];
+			} else if (leaf_kind[l] == BROADCAST) {
+				double* buf = &scratch[(num_regs + l) * cs];
+				Gather(l, k0, len, buf);
+				lp[l] = buf;
+			}
+		}
+		for (size_t i=0; i<code.size(); ++i) {
+			const Instr& ins = code[i];
+			const double* a = ins.a < 0 ? lp[-1-ins.a] : regs + ins.a*cs;
+			const double* b = 0;
+			if (ins.b != -1) b = ins.b < 0 ? lp[-1-ins.b] : regs + ins.b*cs;
+			Exec(ins, a, b, regs + ins.dst*cs, len);
+		}
+		std::copy(regs + result*cs, regs + result*cs + len, out + k0);
+	}
+}
+
+/** Copies elements k0 through k0+len-1 of leaf l, repeated to the shape of
+ the result, into buf.  Element k is observation k/tms, time k%tms. */
+void GdaExprProgram::Gather(int l, size_t k0, int len, double* buf) const
+{
+	const GdaFlexValue& v = *leaves[l];
+	const std::valarray<double>& V = v.GetConstValArrayRef();
+	size_t v_tms = v.GetTms();
+	bool rep_obs = v.GetObs() == 1;
+	bool rep_tms = v.GetTms() == 1;
+	size_t i = k0 / tms;
+	size_t t = k0 % tms;
+	for (int k=0; k<len; ++k) {
+		buf[k] = V[(rep_obs ? 0 : i*v_tms) + (rep_tms ? 0 : t)];
+		if (++t == tms) {
+			t = 0;
+			++i;
+		}
+	}
+}
+
+void GdaExprProgram::Exec(const Instr& ins, const double* a,
+						  const double* b, double* d, int len)
+{
+	// one simple loop per operator so that the compiler can vectorize
+	// the arithmetic and comparisons
+	switch (ins.op) {
+		case GdaExprNode::ADD:
+			for (int k=0; k<len; ++k) d[k] = a[k] + b[k];
+			break;
+		case GdaExprNode::SUB:
+			for (int k=0; k<len; ++k) d[k] = a[k] - b[k];
+			break;
+		case GdaExprNode::MUL:
+			for (int k=0; k<len; ++k) d[k] = a[k] * b[k];
+			break;
+		case GdaExprNode::DIV:
+			for (int k=0; k<len; ++k) d[k] = a[k] / b[k];
+			break;
+		case GdaExprNode::POW:
+			for (int k=0; k<len; ++k) d[k] = pow(a[k], b[k]);
+			break;
+		case GdaExprNode::NEG:
+			for (int k=0; k<len; ++k) d[k] = -a[k];
+			break;
+		case GdaExprNode::LT:
+			for (int k=0; k<len; ++k) d[k] = a[k] < b[k];
+			break;
+		case GdaExprNode::LE:
+			for (int k=0; k<len; ++k) d[k] = a[k] <= b[k];
+			break;
+		case GdaExprNode::GT:
+			for (int k=0; k<len; ++k) d[k] = a[k] > b[k];
+			break;
+		case GdaExprNode::GE:
+			for (int k=0; k<len; ++k) d[k] = a[k] >= b[k];
+			break;
+		case GdaExprNode::EQ:
+			for (int k=0; k<len; ++k) d[k] = a[k] == b[k];
+			break;
+		case GdaExprNode::NE:
+			for (int k=0; k<len; ++k) d[k] = a[k] != b[k];
+			break;
+		// as in NumericTests, any non-zero value (and NaN) is true
+		case GdaExprNode::AND:
+			for (int k=0; k<len; ++k) d[k] = (a[k] != 0) && (b[k] != 0);
+			break;
+		case GdaExprNode::OR:
+			for (int k=0; k<len; ++k) d[k] = (a[k] != 0) || (b[k] != 0);
+			break;
+		case GdaExprNode::XOR:
+			for (int k=0; k<len; ++k) d[k] = (a[k] != 0) != (b[k] != 0);
+			break;
+		case GdaExprNode::NOT:
+			for (int k=0; k<len; ++k) d[k] = a[k] == 0;
+			break;
+		case GdaExprNode::UNI_FUNC:
+			for (int k=0; k<len; ++k) d[k] = ins.uni_f(a[k]);
+			break;
+		case GdaExprNode::BIN_FUNC:
+			for (int k=0; k<len; ++k) d[k] = ins.bin_f(a[k], b[k]);
+			break;
+		default:
+			break;
+	}
+}
+
+GdaExprNode::GdaExprNode(OpType op_)
+: op(op_), uni_f(0), bin_f(0), col_f(SUM)
+{
+}
+
+GdaExprPtr GdaExprNode::Leaf(GdaFVSmtPtr val)
+{
+	GdaExprPtr p(new GdaExprNode(LEAF));
+	p->val = val;
+	return p;
+}
+
+GdaExprPtr GdaExprNode::Op(OpType op, GdaExprPtr arg0, GdaExprPtr arg1)
+{
+	GdaExprPtr p(new GdaExprNode(op));
+	p->args.push_back(arg0);
+	if (arg1) p->args.push_back(arg1);
+	return p;
+}
+
+GdaExprPtr GdaExprNode::UniFunc(double (*f)(double), GdaExprPtr arg0)
+{
+	GdaExprPtr p(Op(UNI_FUNC, arg0));
+	p->uni_f = f;
+	return p;
+}
+
+GdaExprPtr GdaExprNode::BinFunc(double (*f)(double, double),
+								GdaExprPtr arg0, GdaExprPtr arg1)
+{
+	GdaExprPtr p(Op(BIN_FUNC, arg0, arg1));
+	p->bin_f = f;
+	return p;
+}
+
+GdaExprPtr GdaExprNode::ColFunc(ColFuncType f,
+								const std::vector<GdaExprPtr>& args)
+{
+	GdaExprPtr p(new GdaExprNode(COL_FUNC));
+	p->col_f = f;
+	p->args = args;
+	return p;
+}
+
+GdaFVSmtPtr GdaExprNode::Eval(WeightsManInterface* w_man_int) const
+{
+	if (op == LEAF) return GdaFVSmtPtr(new GdaFlexValue(*val));
+	if (op == COL_FUNC) return EvalColFunc(w_man_int);
+	return EvalElementWise(w_man_int);
+}
+
+GdaFVSmtPtr GdaExprNode::EvalElementWise(WeightsManInterface* w_man_int) const
+{
+	GdaExprProgram prog(this, w_man_int);
+	GdaFVSmtPtr p(new GdaFlexValue());
+	prog.Run(*p);
+	return p;
+}
+
+GdaFVSmtPtr GdaExprNode::EvalColFunc(WeightsManInterface* w_man_int) const
+{
+	if (col_f == COUNTS || col_f == LAG) {
+		if (!w_man_int) {
+			throw GdaParserException("no weights available.");
+		}
+		GdaFVSmtPtr w(args[0]->Eval(w_man_int));
+		if (!w->IsWeights()) {
+			throw GdaParserException(col_f == COUNTS ?
+						"first argument of counts must be weights" :
+						"first argument of lag must be weights.");
+		}
+		if (col_f == COUNTS) {
+			std::vector<long> counts;
+			if (!w_man_int->GetCounts(w->GetWUuid(), counts)) {
+				throw GdaParserException("could not find neighbor counts");
+			}
+			return GdaFVSmtPtr(new GdaFlexValue(counts));
+		}
+		GdaFVSmtPtr x(args[1]->Eval(w_man_int));
+		if (!x->IsData()) {
+			throw GdaParserException("second argument of lag must be data.");
+		}
+		if (!w_man_int->WeightsExists(w->GetWUuid())) {
+			throw GdaParserException("invalid weights.");
+		}
+		GdaFVSmtPtr p(new GdaFlexValue());
+		if (!w_man_int->Lag(w->GetWUuid(), *x, *p)) {
+			throw GdaParserException("error computing spatial lag");
+		}
+		return p;
+	}
+	
+	GdaFVSmtPtr x(args[0]->Eval(w_man_int));
+	if ((col_f == ENUMERATE || col_f == NORM_DIST) && args.size() == 3) {
+		wxString f_name(col_f == ENUMERATE ? "enumerate" : "norm_dist");
+		GdaFVSmtPtr a1(args[1]->Eval(w_man_int));
+		GdaFVSmtPtr a2(args[2]->Eval(w_man_int));
+		if (a1->GetObs() != 1 || a1->GetTms() != 1) {
+			throw GdaParserException("second argument of " + f_name
+									 + " must be a constant.");
+		}
+		if (a2->GetObs() != 1 || a2->GetTms() != 1) {
+			throw GdaParserException("third argument of " + f_name
+									 + " must be a constant.");
+		}
+		if (col_f == ENUMERATE) {
+			x->Enumerate(a1->GetDouble(), a2->GetDouble());
+		} else {
+			double sd = a2->GetDouble();
+			if (sd-sd != 0 || sd < 0) {
+				// x-x == 0 is a reliable test for double being finite
+				throw GdaParserException("third argument of " + f_name
+								+ " must be a non-negative finite real.");
+			}
+			x->GaussianDist(a1->GetDouble(), sd);
+		}
+		return x;
+	}
+	
+	switch (col_f) {
+		case SUM: x->Sum(); break;
+		case MEAN: x->Mean(); break;
+		case STDDEV: x->StdDev(); break;
+		case DEV_FR_MEAN: x->DevFromMean(); break;
+		case STANDARDIZE: x->Standardize(); break;
+		case SHUFFLE: x->Shuffle(); break;
+		case ROT_DOWN: x->Rotate(-1); break;
+		case ROT_UP: x->Rotate(1); break;
+		case UNIF_DIST: x->UniformDist(); break;
+		case NORM_DIST: x->GaussianDist(0,1); break;
+		case ENUMERATE: x->Enumerate(1, 1); break;
+		case MAX: x->Max(); break;
+		case MIN: x->Min(); break;
+		default: break;
+	}
+	return x;
+}
@@ -0,0 +1,106 @@
+/**
+ * GeoDa TM, Copyright (C) 2011-2015 by Luc Anselin - all rights reserved
+ *
+ * This file is part of GeoDa.
+ * 
+ * GeoDa is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+ *
+ * GeoDa is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program.  If not, see <http://www.gnu.org/licenses/>.
+ */
+
+#ifndef __GEODA_CENTER_GDA_EXPR_NODE_H__
+#define __GEODA_CENTER_GDA_EXPR_NODE_H__
+
+#include <vector>
+#include <boost/shared_ptr.hpp>
+#include "GdaFlexValue.h"
+
+class GdaExprNode;
+class WeightsManInterface;
+typedef boost::shared_ptr<GdaExprNode> GdaExprPtr;
+
+/**
+ * A calculator expression compiled by GdaParser.
+ *
+ * Element-wise operators (arithmetic, comparisons, logical operators and
+ * functions such as sqrt or pow) are not evaluated one node at a time.
+ * Every maximal element-wise subtree is flattened into a short register
+ * program that is run over chunks of the obs x tms result, so that
+ * a + b*c - sqrt(d) makes one pass over the data with a few chunk sized
+ * scratch buffers per thread instead of allocating a full column for every
+ * operator.  Large results are evaluated on the GdaThreadPool.
+ *
+ * Functions that need a whole column at once (sum, mean, lag, shuffle, ...)
+ * are applied with GdaFlexValue as before, and their results are leaves
+ * of the surrounding element-wise program.
+ *
+ * Shapes follow GdaFlexValue::grow_if_smaller: a value with a single
+ * observation or time period is repeated along that dimension, and any
+ * other mismatch throws a GdaFVException.
+ */
+class GdaExprNode {
+public:
+	enum OpType {
+		LEAF, // number, column, weights or string literal
+		// element-wise operators
+		ADD, SUB, MUL, DIV, POW, NEG,
+		LT, LE, GT, GE, EQ, NE,
+		AND, OR, XOR, NOT,
+		UNI_FUNC, // uni_f(arg0)
+		BIN_FUNC, // bin_f(arg0, arg1)
+		// functions of whole columns, see ColFuncType
+		COL_FUNC
+	};
+	enum ColFuncType {
+		SUM, MEAN, STDDEV, DEV_FR_MEAN, STANDARDIZE, SHUFFLE,
+		ROT_DOWN, ROT_UP, UNIF_DIST, NORM_DIST, ENUMERATE, MAX, MIN,
+		COUNTS, LAG
+	};
+	
+	/** A leaf for val.  val is never modified, so columns of the
+	 calculator's data table can be used without copying them. */
+	static GdaExprPtr Leaf(GdaFVSmtPtr val);
+	static GdaExprPtr Op(OpType op, GdaExprPtr arg0,
+						 GdaExprPtr arg1 = GdaExprPtr());
+	static GdaExprPtr UniFunc(double (*f)(double), GdaExprPtr arg0);
+	static GdaExprPtr BinFunc(double (*f)(double, double),
+							  GdaExprPtr arg0, GdaExprPtr arg1);
+	static GdaExprPtr ColFunc(ColFuncType f,
+							  const std::vector<GdaExprPtr>& args);
+	
+	/** Evaluate the expression.  The returned value is always a new
+	 object that the caller may modify.  Throws GdaFVException or
+	 GdaParserException on errors. */
+	GdaFVSmtPtr Eval(WeightsManInterface* w_man_int) const;
+	
+	OpType GetOp() const { return op; }
+	bool IsElementWise() const { return op != LEAF && op != COL_FUNC; }
+	
+	/** Number of elements per chunk of the fused loops. */
+	static const int chunk_size = 512;
+	
+private:
+	GdaExprNode(OpType op);
+	GdaFVSmtPtr EvalColFunc(WeightsManInterface* w_man_int) const;
+	GdaFVSmtPtr EvalElementWise(WeightsManInterface* w_man_int) const;
+	
+	friend class GdaExprProgram;
+	
+	OpType op;
+	GdaFVSmtPtr val; // LEAF only
+	std::vector<GdaExprPtr> args;
+	double (*uni_f)(double);
+	double (*bin_f)(double, double);
+	ColFuncType col_f;
+};
+
+#endif
@@ -19,6 +19,7 @@
 
 #include <limits>
 #include <math.h>
+#include <boost/math/special_functions/round.hpp>
 #include "../logger.h"
 #include "GdaParser.h"
 
@@ -27,6 +28,12 @@ GdaParser::GdaParser()
 {
 }
 
+/** round() as a function of one double for GdaExprNode::UniFunc */
+static double round_dbl(double x)
+{
+	return boost::math::round(x);
+}
+
 bool GdaParser::eval(const std::vector<GdaTokenDetails>& tokens_,
 					 std::map<wxString, GdaFVSmtPtr>* data_table_,
 					 WeightsManInterface* w_man_int_)
@@ -39,7 +46,9 @@ bool GdaParser::eval(const std::vector<GdaTokenDetails>& tokens_,
 	eval_toks.clear();
 	try {
 		error_msg = "";
-		eval_val = expression();
+		// parse the whole expression first, then evaluate it
+		GdaExprPtr e = expression();
+		eval_val = e->Eval(w_man_int);
 		success = true;
 	}
 	catch (GdaParserException e) {
@@ -54,158 +63,147 @@ bool GdaParser::eval(const std::vector<GdaTokenDetails>& tokens_,
 	return success;
 }
 
-GdaFVSmtPtr GdaParser::expression()
+GdaExprPtr GdaParser::expression()
 {
 	return logical_xor_expr();
 }
 
-GdaFVSmtPtr GdaParser::logical_xor_expr()
+GdaExprPtr GdaParser::logical_xor_expr()
 {
 	using namespace std;
-	GdaFVSmtPtr left = logical_or_expr();
+	GdaExprPtr left = logical_or_expr();
 	
 	for (;;) {
 		if (curr_token() == Gda::XOR) {
 			inc_token(); // consume XOR
-			GdaFVSmtPtr right = logical_or_expr();
-			left->ApplyBinarySelf(&Gda::logical_xor, *right);
+			GdaExprPtr right = logical_or_expr();
+			left = GdaExprNode::Op(GdaExprNode::XOR, left, right);
 		} else {
 			return left;
 		}
 	}
 }
 
-GdaFVSmtPtr GdaParser::logical_or_expr()
+GdaExprPtr GdaParser::logical_or_expr()
 {
 	using namespace std;
-	GdaFVSmtPtr left = logical_and_expr();
+	GdaExprPtr left = logical_and_expr();
 	
 	for (;;) {
 		if (curr_token() == Gda::OR) {
 			inc_token(); // consume OR
-			GdaFVSmtPtr right = logical_and_expr();
-			left->ApplyBinarySelf(&Gda::logical_or, *right);
+			GdaExprPtr right = logical_and_expr();
+			left = GdaExprNode::Op(GdaExprNode::OR, left, right);
 		} else {
 			return left;
 		}
 	}
 }
 
-GdaFVSmtPtr GdaParser::logical_and_expr()
+GdaExprPtr GdaParser::logical_and_expr()
 {
 	using namespace std;
-	GdaFVSmtPtr left = logical_not_expr();
+	GdaExprPtr left = logical_not_expr();
 	
 	for (;;) {
 		if (curr_token() == Gda::AND) {
 			inc_token(); // consume AND
-			GdaFVSmtPtr right = logical_not_expr();
-			left->ApplyBinarySelf(&Gda::logical_and, *right);
+			GdaExprPtr right = logical_not_expr();
+			left = GdaExprNode::Op(GdaExprNode::AND, left, right);
 		} else {
 			return left;
 		}
 	}
 }
 
-GdaFVSmtPtr GdaParser::logical_not_expr()
+GdaExprPtr GdaParser::logical_not_expr()
 {
 	if (curr_token() == Gda::NOT) {
 		inc_token(); // consume NOT
-		GdaFVSmtPtr p(expression());
-		p->ApplyUniSelf(&Gda::logical_not);
-		return p;
+		return GdaExprNode::Op(GdaExprNode::NOT, expression());
 	}
 	return comp_expr();
 }
 
-GdaFVSmtPtr GdaParser::comp_expr()
+GdaExprPtr GdaParser::comp_expr()
 {
-	GdaFVSmtPtr left = add_expr();
+	GdaExprPtr left = add_expr();
 	
 	for (;;) {
+		GdaExprNode::OpType op;
 		if (curr_token() == Gda::LT) {
-			inc_token(); // consume <
-			GdaFVSmtPtr right = add_expr();
-			left->ApplyBinarySelf(&Gda::lt, *right);
+			op = GdaExprNode::LT;
 		} else if (curr_token() == Gda::LE) {
-			inc_token(); // consume <=
-			GdaFVSmtPtr right = add_expr();
-			left->ApplyBinarySelf(&Gda::le, *right);
+			op = GdaExprNode::LE;
 		} else if (curr_token() == Gda::GT) {
-			inc_token(); // consume >
-			GdaFVSmtPtr right = add_expr();
-			left->ApplyBinarySelf(&Gda::gt, *right);
+			op = GdaExprNode::GT;
 		} else if (curr_token() == Gda::GE) {
-			inc_token(); // consume >=
-			GdaFVSmtPtr right = add_expr();
-			left->ApplyBinarySelf(&Gda::ge, *right);
+			op = GdaExprNode::GE;
 		} else if (curr_token() == Gda::EQ) {
-			inc_token(); // consume =
-			GdaFVSmtPtr right = add_expr();
-			left->ApplyBinarySelf(&Gda::eq, *right);
+			op = GdaExprNode::EQ;
 		} else if (curr_token() == Gda::NE) {
-			inc_token(); // consume <>
-			GdaFVSmtPtr right = add_expr();
-			left->ApplyBinarySelf(&Gda::ne, *right);
+			op = GdaExprNode::NE;
 		} else {
 			return left;
 		}
+		inc_token(); // consume comparison operator
+		GdaExprPtr right = add_expr();
+		left = GdaExprNode::Op(op, left, right);
 	}
 }
 
-GdaFVSmtPtr GdaParser::add_expr()
+GdaExprPtr GdaParser::add_expr()
 {
 	using namespace std;
-	GdaFVSmtPtr left = mult_expr();
+	GdaExprPtr left = mult_expr();
 	
 	for (;;) {
 		if (curr_token() == Gda::PLUS) {
 			inc_token(); // consume '+'
-			GdaFVSmtPtr right = mult_expr();
-			wxString ss;
-			ss << "GdaParser + op: operand " << (*left).ToStr();
-			ss << ", operand " << (*right).ToStr();
-			(*left) += (*right);
+			GdaExprPtr right = mult_expr();
+			left = GdaExprNode::Op(GdaExprNode::ADD, left, right);
 		} else if (curr_token() == Gda::MINUS) {
 			inc_token(); // consume '-'
-			(*left) -= (*mult_expr());
+			GdaExprPtr right = mult_expr();
+			left = GdaExprNode::Op(GdaExprNode::SUB, left, right);
 		} else {
 			return left;
 		}
 	}
 }
 
-GdaFVSmtPtr GdaParser::mult_expr()
+GdaExprPtr GdaParser::mult_expr()
 {
-	GdaFVSmtPtr left = pow_expr();
+	GdaExprPtr left = pow_expr();
 	
 	for (;;) {
 		if (curr_token() == Gda::MUL) {
 			inc_token(); // consume '*'
-			(*left) *= (*pow_expr());
+			GdaExprPtr right = pow_expr();
+			left = GdaExprNode::Op(GdaExprNode::MUL, left, right);
 		} else if (curr_token() == Gda::DIV) {
 			inc_token(); // consume '/'
-			(*left) /= (*pow_expr());
+			GdaExprPtr right = pow_expr();
+			left = GdaExprNode::Op(GdaExprNode::DIV, left, right);
 		} else {
 			return left;
 		}
 	}
 }
 
-GdaFVSmtPtr GdaParser::pow_expr()
+GdaExprPtr GdaParser::pow_expr()
 {
-	GdaFVSmtPtr left = func_expr();
+	GdaExprPtr left = func_expr();
 	if (curr_token() == Gda::POW) {
 		inc_token(); // consume '^'
-		GdaFVSmtPtr right = expression();
-		(*left) ^= (*right);
-		return left;
+		GdaExprPtr right = expression();
+		return GdaExprNode::Op(GdaExprNode::POW, left, right);
 	} else {
 		return left;
 	}
 }
 
-GdaFVSmtPtr GdaParser::func_expr()
+GdaExprPtr GdaParser::func_expr()
 {
 	if (curr_token() != Gda::NAME ||
 		(curr_token() == Gda::NAME && next_token() != Gda::LP)) {
@@ -217,210 +215,142 @@ GdaFVSmtPtr GdaParser::func_expr()
 	inc_token(); // consume '('
 	if (curr_token() == Gda::RP) {
 		inc_token(); // consume ')'
-		// return 0-ary function NAME () value
+		// 0-ary function NAME ()
 		LOG(func_name);
 		if (func_name.CmpNoCase("rook") == 0 ||
 			func_name.CmpNoCase("queen") == 0) {
 			throw GdaParserException("automatic weights creation "
 									 "not yet supported");
-			if (!w_man_int) {
-				throw GdaParserException("no weights available.");
-			}
-			WeightsMetaInfo wmi;
-			if (func_name.CmpNoCase("rook") == 0) {
-				wmi.SetToRook("");
-			} else {
-				wmi.SetToQueen("");
-			}
-			boost::uuids::uuid u = w_man_int->RequestWeights(wmi);
-			GdaFVSmtPtr p(new GdaFlexValue(u));
-			return p;
 		}
 		throw GdaParserException("unknown function \"" + func_name + "\"");
 	}
-	GdaFVSmtPtr arg1(expression()); // evaluate first argument
+	std::vector<GdaExprPtr> args;
+	args.push_back(expression()); // first argument
 	if (curr_token() == Gda::RP) {
 		inc_token(); // consume ')'
-		// evaluate unary function NAME ( arg1 )
+		// unary function NAME ( arg1 )
 		LOG(func_name);
+		GdaExprPtr arg1 = args[0];
 		if (func_name.CmpNoCase("sqrt") == 0) {
-			arg1->ApplyUniSelf(&sqrt);
+			return GdaExprNode::UniFunc(&sqrt, arg1);
 		} else if (func_name.CmpNoCase("cos") == 0) {
-			arg1->ApplyUniSelf(&cos);
+			return GdaExprNode::UniFunc(&cos, arg1);
 		} else if (func_name.CmpNoCase("sin") == 0) {
-			arg1->ApplyUniSelf(&sin);
+			return GdaExprNode::UniFunc(&sin, arg1);
 		} else if (func_name.CmpNoCase("tan") == 0) {
-			arg1->ApplyUniSelf(&tan);
+			return GdaExprNode::UniFunc(&tan, arg1);
 		} else if (func_name.CmpNoCase("acos") == 0) {
-			arg1->ApplyUniSelf(&acos);
+			return GdaExprNode::UniFunc(&acos, arg1);
 		} else if (func_name.CmpNoCase("asin") == 0) {
-			arg1->ApplyUniSelf(&asin);
+			return GdaExprNode::UniFunc(&asin, arg1);
 		} else if (func_name.CmpNoCase("atan") == 0) {
-			arg1->ApplyUniSelf(&atan);
+			return GdaExprNode::UniFunc(&atan, arg1);
 		} else if (func_name.CmpNoCase("abs") == 0 ||
 			func_name.CmpNoCase("fabs") == 0) {
-			arg1->ApplyUniSelf(&fabs);
+			return GdaExprNode::UniFunc(&fabs, arg1);
 		} else if (func_name.CmpNoCase("ceil") == 0) {
-			arg1->ApplyUniSelf(&ceil);
+			return GdaExprNode::UniFunc(&ceil, arg1);
 		} else if (func_name.CmpNoCase("floor") == 0) {
-			arg1->ApplyUniSelf(&floor);
+			return GdaExprNode::UniFunc(&floor, arg1);
 		} else if (func_name.CmpNoCase("round") == 0) {
-			arg1->Round();
+			return GdaExprNode::UniFunc(&round_dbl, arg1);
 		} else if (func_name.CmpNoCase("log") == 0 ||
 			func_name.CmpNoCase("ln") == 0) {
-			arg1->ApplyUniSelf(&log);
+			return GdaExprNode::UniFunc(&log, arg1);
 		} else if (func_name.CmpNoCase("log10") == 0) {
-			arg1->ApplyUniSelf(&log10);
+			return GdaExprNode::UniFunc(&log10, arg1);
 		} else if (func_name.CmpNoCase("sum") == 0) {
-			arg1->Sum();
+			return GdaExprNode::ColFunc(GdaExprNode::SUM, args);
 		} else if (func_name.CmpNoCase("mean") == 0 ||
 			func_name.CmpNoCase("avg") == 0) {
-			arg1->Mean();
-		} else if (func_name.CmpNoCase("sum") == 0) {
-			arg1->Sum();
+			return GdaExprNode::ColFunc(GdaExprNode::MEAN, args);
 		} else if (func_name.CmpNoCase("stddev") == 0) {
-			arg1->StdDev();
+			return GdaExprNode::ColFunc(GdaExprNode::STDDEV, args);
 		} else if (func_name.CmpNoCase("dev_fr_mean") == 0) {
-			arg1->DevFromMean();
+			return GdaExprNode::ColFunc(GdaExprNode::DEV_FR_MEAN, args);
 		} else if (func_name.CmpNoCase("standardize") == 0) {
-			arg1->Standardize();
+			return GdaExprNode::ColFunc(GdaExprNode::STANDARDIZE, args);
 		} else if (func_name.CmpNoCase("shuffle") == 0) {
-			arg1->Shuffle();
+			return GdaExprNode::ColFunc(GdaExprNode::SHUFFLE, args);
 		} else if (func_name.CmpNoCase("rot_down") == 0) {
-			arg1->Rotate(-1);
+			return GdaExprNode::ColFunc(GdaExprNode::ROT_DOWN, args);
 		} else if (func_name.CmpNoCase("rot_up") == 0) {
-			arg1->Rotate(1);
+			return GdaExprNode::ColFunc(GdaExprNode::ROT_UP, args);
 		} else if (func_name.CmpNoCase("unif_dist") == 0) {
-			arg1->UniformDist();
+			return GdaExprNode::ColFunc(GdaExprNode::UNIF_DIST, args);
 		} else if (func_name.CmpNoCase("norm_dist") == 0) {
-			arg1->GaussianDist(0,1);
+			return GdaExprNode::ColFunc(GdaExprNode::NORM_DIST, args);
 		} else if (func_name.CmpNoCase("enumerate") == 0) {
-			arg1->Enumerate(1, 1);
+			return GdaExprNode::ColFunc(GdaExprNode::ENUMERATE, args);
 		} else if (func_name.CmpNoCase("max") == 0) {
-			arg1->Max();
+			return GdaExprNode::ColFunc(GdaExprNode::MAX, args);
 		} else if (func_name.CmpNoCase("min") == 0) {
-			arg1->Min();
+			return GdaExprNode::ColFunc(GdaExprNode::MIN, args);
 		} else if (func_name.CmpNoCase("is_defined") == 0) {
-			arg1->ApplyUniSelf(&Gda::is_defined);
+			return GdaExprNode::UniFunc(&Gda::is_defined, arg1);
 		} else if (func_name.CmpNoCase("is_finite") == 0) {
-			arg1->ApplyUniSelf(&Gda::is_finite);
+			return GdaExprNode::UniFunc(&Gda::is_finite, arg1);
 		} else if (func_name.CmpNoCase("is_nan") == 0) {
-			arg1->ApplyUniSelf(&Gda::is_nan);
+			return GdaExprNode::UniFunc(&Gda::is_nan, arg1);
 		} else if (func_name.CmpNoCase("is_pos_inf") == 0) {
-			arg1->ApplyUniSelf(&Gda::is_pos_inf);
+			return GdaExprNode::UniFunc(&Gda::is_pos_inf, arg1);
 		} else if (func_name.CmpNoCase("is_neg_inf") == 0) {
-			arg1->ApplyUniSelf(&Gda::is_neg_inf);
+			return GdaExprNode::UniFunc(&Gda::is_neg_inf, arg1);
 		} else if (func_name.CmpNoCase("is_inf") == 0) {
-			arg1->ApplyUniSelf(&Gda::is_inf);
+			return GdaExprNode::UniFunc(&Gda::is_inf, arg1);
 		} else if (func_name.CmpNoCase("counts") == 0) {
-			if (!w_man_int) {
-				throw GdaParserException("no weights available.");
-			}
-			if (!arg1->IsWeights()) {
-				throw GdaParserException("first argument of counts must be weights");
-			}
-			std::vector<long> counts;
-			if (!w_man_int->GetCounts(arg1->GetWUuid(), counts)) {
-				throw GdaParserException("could not find neighbor counts");
-			}
-			GdaFVSmtPtr p(new GdaFlexValue(counts));
-			return p;
-		} else {
-			throw GdaParserException("unknown function \"" + func_name + "\"");
+			return GdaExprNode::ColFunc(GdaExprNode::COUNTS, args);
 		}
-		return arg1;
+		throw GdaParserException("unknown function \"" + func_name + "\"");
 	}
 	if (curr_token() != Gda::COMMA) {
 		throw GdaParserException("',' or ')' expected");
 	}
 	inc_token(); // consume ','
-	GdaFVSmtPtr arg2(expression()); // evaluate second argument
+	args.push_back(expression()); // second argument
 	if (curr_token() == Gda::RP) {
 		inc_token(); // consume ')'
-		// evaluate binary function NAME ( arg1 , arg2 )
+		// binary function NAME ( arg1 , arg2 )
 		LOG(func_name);
 		if (func_name.CmpNoCase("pow") == 0) {
-			arg1->ApplyBinarySelf(&pow, *arg2);
+			return GdaExprNode::BinFunc(&pow, args[0], args[1]);
 		} else if (func_name.CmpNoCase("lag") == 0) {
-			if (!w_man_int) {
-				throw GdaParserException("no weights available.");
-			}
-			if (!arg1->IsWeights()) {
-				throw GdaParserException("first argument of lag must be weights.");
-			}
-			if (!arg2->IsData()) {
-				throw GdaParserException("second argument of lag must be data.");
-			}
-			if (!w_man_int->WeightsExists(arg1->GetWUuid())) {
-				throw GdaParserException("invalid weights.");
-			}
-			LOG(arg1->ToStr());
-			GdaFVSmtPtr p(new GdaFlexValue());
-			if (!w_man_int->Lag(arg1->GetWUuid(), *arg2, *p)) {
-				throw GdaParserException("error computing spatial lag");
-			}
-			return p;
-		} else {
-			throw GdaParserException("unknown function \"" + func_name + "\"");
+			return GdaExprNode::ColFunc(GdaExprNode::LAG, args);
 		}
-		return arg1;
+		throw GdaParserException("unknown function \"" + func_name + "\"");
 	}
 	if (curr_token() != Gda::COMMA) {
 		throw GdaParserException("',' or ')' expected");
 	}
 	inc_token(); // consume ','
-	GdaFVSmtPtr arg3(expression()); // evaluate third argument
+	args.push_back(expression()); // third argument
 	if (curr_token() == Gda::RP) {
-		// mark as function token.
 		inc_token(); // consume ')'
-		// evaluate binary function NAME ( arg1 , arg2, arg3 )
+		// ternary function NAME ( arg1 , arg2, arg3 )
 		LOG(func_name);
-		if (func_name.CmpNoCase("enumerate") == 0 ||
-			func_name.CmpNoCase("norm_dist") == 0) {
-			if (arg2->GetObs() != 1 || arg2->GetTms() != 1) {
-				throw GdaParserException("second argument of " + func_name
-										 + " must be a constant.");
-			}
-			if (arg3->GetObs() != 1 || arg3->GetTms() != 1) {
-				throw GdaParserException("third argument of " + func_name
-										 + " must be a constant.");
-			}
-		}
 		if (func_name.CmpNoCase("enumerate") == 0) {
-			arg1->Enumerate(arg2->GetDouble(), arg3->GetDouble());
+			return GdaExprNode::ColFunc(GdaExprNode::ENUMERATE, args);
 		} else if (func_name.CmpNoCase("norm_dist") == 0) {
-			double sd = arg3->GetDouble();
-			if (sd-sd != 0 || sd < 0) {
-				// x-x == 0 is a reliable test for double being finite
-				throw GdaParserException("third argument of " + func_name
-										 + " must be a non-negative finite real.");
-			}
-			arg1->GaussianDist(arg2->GetDouble(), sd);
-		} else {
-			throw GdaParserException("unknown function \"" + func_name + "\"");
+			return GdaExprNode::ColFunc(GdaExprNode::NORM_DIST, args);
 		}
-		return arg1;
+		throw GdaParserException("unknown function \"" + func_name + "\"");
 	}
 	throw GdaParserException("')' expected");
 }
 
-GdaFVSmtPtr GdaParser::primary()
+GdaExprPtr GdaParser::primary()
 {	
 	if (curr_token() == Gda::STRING) {
 		GdaFVSmtPtr p(new GdaFlexValue(curr_tok_str_val()));
 		inc_token(); // consume STRING token
-		return p;
+		return GdaExprNode::Leaf(p);
 	}
 	if (curr_token() == Gda::NUMBER) {
 		GdaFVSmtPtr p(new GdaFlexValue(curr_tok_num_val()));
-		//double v = curr_tok_num_val();
 		inc_token(); // consume NUMBER token
-		return p;
+		return GdaExprNode::Leaf(p);
 	} else if (curr_token() == Gda::NAME) {
 		wxString key(curr_tok_str_val());
-		//if (next_token() == Gda::ASSIGN) {
-		//	(*data_table)[key] = expression(true);
-		//}
 		// check for existence in data_table and in weights if w_man_int exists
 		if (data_table->find(key) == data_table->end() &&
 			(!w_man_int ||
@@ -433,20 +363,18 @@ GdaFVSmtPtr GdaParser::primary()
 		mark_curr_token_ident();
 		inc_token(); // consume NAME token
 		if (data_table->find(key) != data_table->end()) {
-			GdaFVSmtPtr p(new GdaFlexValue((*(*data_table)[key])));
-			return p;
+			// the column is only read, no need to copy it
+			return GdaExprNode::Leaf((*data_table)[key]);
 		} else {
 			GdaFVSmtPtr p(new GdaFlexValue(w_man_int->FindIdByTitle(key)));
-			return p;
+			return GdaExprNode::Leaf(p);
 		}
 	} else if (curr_token() == Gda::MINUS) { // unary minus
 		inc_token(); // consume '-'
-		GdaFVSmtPtr p(primary());
-		p->NegateSelf();
-		return p;
+		return GdaExprNode::Op(GdaExprNode::NEG, primary());
 	} else if (curr_token() == Gda::LP) {
 		inc_token(); // consume '('
-		GdaFVSmtPtr e(expression());
+		GdaExprPtr e(expression());
 		if (curr_token() != Gda::RP) {
 			throw GdaParserException("')' expected");
 		}
@@ -512,18 +440,3 @@ void GdaParser::mark_curr_token_problem()
 {
 	if (tok_i < tokens.size()) tokens[tok_i].problem_token = true;
 }
-
-void GdaParser::exception_if_not_data(const GdaFVSmtPtr x)
-{
-	if (!x->IsData()) {
-		throw GdaParserException("parser expected data expression");
-	}
-}
-
-void GdaParser::exception_if_not_weights(const GdaFVSmtPtr x)
-{
-	if (!x->IsWeights()) {
-		throw GdaParserException("parser expected weights expression");
-	}
-}
-
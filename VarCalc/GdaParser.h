@@ -25,6 +25,7 @@
 #include <boost/shared_ptr.hpp>
 #include <wx/string.h>
 #include "WeightsManInterface.h"
+#include "GdaExprNode.h"
 #include "GdaFlexValue.h"
 #include "GdaLexer.h"
 #include "NumericTests.h"
@@ -45,8 +46,9 @@ private:
 class GdaParser {
 public:
 	GdaParser();
-	/** If no errors during evaluation, then true is returned and GetEvalVal
-	 retuns the final output value.  If errors occurred, then GetErrorMsg
+	/** The tokens are compiled into a GdaExprNode tree which is then
+	 evaluated.  If no errors during evaluation, then true is returned and
+	 GetEvalVal retuns the final output value.  If errors occurred, then GetErrorMsg
 	 returns a helpful error message.  Regardless of success, GetEvalTokens
 	 returns the list of tokens that were evaluated. */ 
 	bool eval(const std::vector<GdaTokenDetails>& tokens,
@@ -60,17 +62,17 @@ public:
 	std::vector<GdaTokenDetails> GetEvalTokens() { return eval_toks; }
 	
 private:
-	GdaFVSmtPtr expression();
-	GdaFVSmtPtr logical_xor_expr();
-	GdaFVSmtPtr logical_or_expr();
-	GdaFVSmtPtr logical_and_expr();
-	GdaFVSmtPtr logical_not_expr();
-	GdaFVSmtPtr comp_expr();
-	GdaFVSmtPtr add_expr();
-	GdaFVSmtPtr mult_expr();
-	GdaFVSmtPtr pow_expr();
-	GdaFVSmtPtr func_expr();
-	GdaFVSmtPtr primary();
+	GdaExprPtr expression();
+	GdaExprPtr logical_xor_expr();
+	GdaExprPtr logical_or_expr();
+	GdaExprPtr logical_and_expr();
+	GdaExprPtr logical_not_expr();
+	GdaExprPtr comp_expr();
+	GdaExprPtr add_expr();
+	GdaExprPtr mult_expr();
+	GdaExprPtr pow_expr();
+	GdaExprPtr func_expr();
+	GdaExprPtr primary();
 
 	Gda::TokenEnum curr_token();
 	double curr_tok_num_val();
@@ -81,9 +83,6 @@ private:
 	void mark_curr_token_ident();
 	void mark_curr_token_problem();
 
-	static void exception_if_not_data(const GdaFVSmtPtr x);
-	static void exception_if_not_weights(const GdaFVSmtPtr x);
-	
 	size_t tok_i;
 	std::vector<GdaTokenDetails> tokens;
 	std::map<wxString, GdaFVSmtPtr>* data_table;
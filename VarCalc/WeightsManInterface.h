@@ -62,6 +62,8 @@ public:
 	virtual void Remove(boost::uuids::uuid w_uuid) = 0;
 	virtual wxString RecNumToId(boost::uuids::uuid w_uuid, long rec_num) = 0;
 	virtual GalWeight* GetGal(boost::uuids::uuid w_uuid) = 0;
+	virtual bool GetTraces(boost::uuids::uuid w_uuid,
+						   double& tr_WW, double& tr_WtW) = 0;
     virtual GeoDaWeight* GetWeights(boost::uuids::uuid w_uuid) = 0;
 	virtual boost::uuids::uuid GetDefault() const = 0;
 	virtual void MakeDefault(boost::uuids::uuid w_uuid) = 0;